@@ -0,0 +1,201 @@
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "../tools/batch_validate.hpp"
+
+/* *
+ * batch_bench
+ *  checks the batch move validator (tools/batch_validate.hpp) against rules::valid_move, and measures its throughput.
+ *
+ *  Positions are taken from random games.  Two workloads are built from them - 'legal', every legal move of every
+ *  position, the way a replay of real games looks, and 'candidates', every live piece of the side to move against
+ *  every square, the way a legal move list is worked out, where nearly every move is rejected.  Every kernel the cpu
+ *  supports runs both; each lane is compared with valid_move (the valid flag always, the other results for valid
+ *  moves) and any difference fails the run.  Throughput is for one thread, so it is per core.
+ * */
+
+struct workload {
+  const char* name;
+  batch::move_batch moves;
+};
+
+static std::vector<rules::game_state> random_positions (
+  size_t game_count,
+  size_t max_plies,
+  uint64_t seed
+) {
+  std::mt19937_64 rng(seed);
+  std::vector<rules::game_state> positions;
+  for (size_t g = 0; g < game_count; ++g) {
+    rules::game_state state;
+    for (size_t ply = 0; ply < max_plies; ++ply) {
+      positions.push_back(state);
+      std::vector<uint16_t> legal = rules::legal_moves(state);
+      if (legal.empty()) {
+        break;
+      }
+      uint16_t move = legal[rng() % legal.size()];
+      uint8_t captured_piece_index = 32;
+      bool checkmate = false;
+      rules::play_move(state, rules::packed_piece_id(move), rules::packed_new_position(move), rules::packed_promotion_type(move), captured_piece_index, checkmate);
+      if (checkmate) {
+        break;
+      }
+    }
+  }
+  return positions;
+}
+
+static void fill (
+  batch::move_batch& moves,
+  const std::vector<std::pair<const rules::game_state*, uint16_t>>& lanes
+) {
+  moves.resize(lanes.size());
+  for (size_t lane = 0; lane < lanes.size(); ++lane) {
+    moves.set(lane, *lanes[lane].first, lanes[lane].second);
+  }
+}
+
+//the number of lanes that differ from valid_move, printing the first few
+static size_t compare (
+  const char* kernel,
+  const workload& w,
+  const batch::move_results& expected,
+  const batch::move_results& got
+) {
+  size_t differences = 0;
+  for (size_t lane = 0; lane < w.moves.size(); ++lane) {
+    bool same = expected.valid[lane] == got.valid[lane];
+    if (same && expected.valid[lane]) {
+      same = expected.captured_piece_index[lane] == got.captured_piece_index[lane] &&
+        expected.castle[lane] == got.castle[lane] &&
+        expected.en_passant_idx[lane] == got.en_passant_idx[lane] &&
+        expected.promoted_pawns[lane] == got.promoted_pawns[lane] &&
+        expected.promoted_pawn_types[lane] == got.promoted_pawn_types[lane] &&
+        expected.white_attacks[lane] == got.white_attacks[lane] &&
+        expected.black_attacks[lane] == got.black_attacks[lane] &&
+        expected.checkers[lane] == got.checkers[lane] &&
+        expected.checkmate[lane] == got.checkmate[lane];
+    }
+    if (!same && differences++ < 5) {
+      rules::game_state state = w.moves.state(lane);
+      std::fprintf(stderr, "%s/%s lane %zu: piece %u to %u:", kernel, w.name, lane, w.moves.piece_id[lane], w.moves.new_position[lane]);
+      for (uint8_t p : state.piece_positions) {
+        std::fprintf(stderr, " %u", p);
+      }
+      std::fprintf(stderr, " | promoted %u/%u | expected valid %u captured %u castle %u ep %u mate %u | got valid %u captured %u castle %u ep %u mate %u\n",
+        state.promoted_pawns, state.promoted_pawn_types,
+        expected.valid[lane], expected.captured_piece_index[lane], expected.castle[lane], expected.en_passant_idx[lane], expected.checkmate[lane],
+        got.valid[lane], got.captured_piece_index[lane], got.castle[lane], got.en_passant_idx[lane], got.checkmate[lane]);
+    }
+  }
+  return differences;
+}
+
+static void usage () {
+  std::cerr <<
+    "usage: batch_bench [options]\n"
+    "  --games N          random games to take positions from (default 200)\n"
+    "  --plies N          longest random game (default 120)\n"
+    "  --min-time SECONDS time each kernel for at least this long (default 0.5)\n"
+    "  --seed N           random seed (default 1)\n";
+  std::exit(1);
+}
+
+int main (int argc, char** argv) {
+  size_t game_count = 200;
+  size_t max_plies = 120;
+  double min_time = 0.5;
+  uint64_t seed = 1;
+
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    auto next = [&]() -> std::string {
+      if (i + 1 >= argc) { usage(); }
+      return argv[++i];
+    };
+    if (arg == "--games") { game_count = std::stoul(next()); }
+    else if (arg == "--plies") { max_plies = std::stoul(next()); }
+    else if (arg == "--min-time") { min_time = std::stod(next()); }
+    else if (arg == "--seed") { seed = std::stoull(next()); }
+    else { usage(); }
+  }
+
+  try {
+    std::vector<rules::game_state> positions = random_positions(game_count, max_plies, seed);
+    std::vector<std::pair<const rules::game_state*, uint16_t>> legal, candidates;
+    std::mt19937_64 rng(seed);
+    for (auto& state : positions) {
+      for (uint16_t move : rules::legal_moves(state)) {
+        legal.push_back({ &state, move });
+      }
+      uint8_t first_piece = state.move_count % 2 == 0 ? 0 : 16;
+      for (uint8_t piece_id = first_piece; piece_id < first_piece + 16; ++piece_id) {
+        if (state.piece_positions[piece_id] == 0) {
+          continue;
+        }
+        for (uint8_t new_position = 1; new_position < 65; ++new_position) {
+          candidates.push_back({ &state, rules::pack_move(piece_id, new_position, rng() % 4) });
+        }
+      }
+    }
+
+    std::vector<workload> workloads(2);
+    workloads[0].name = "legal";
+    fill(workloads[0].moves, legal);
+    workloads[1].name = "candidates";
+    fill(workloads[1].moves, candidates);
+
+    std::vector<batch::kernel_kind> kernels = { batch::KERNEL_SCALAR, batch::KERNEL_PORTABLE };
+    if (__builtin_cpu_supports("sse4.2")) { kernels.push_back(batch::KERNEL_SSE4); }
+    if (__builtin_cpu_supports("avx2")) { kernels.push_back(batch::KERNEL_AVX2); }
+
+    std::printf("%zu positions, best kernel %s\n\n", positions.size(), batch::kernel_name(batch::best_kernel()));
+    std::printf("%-12s %-12s %12s %16s %10s %10s\n", "workload", "kernel", "moves", "moves/s/core", "ns/move", "speedup");
+    size_t differences = 0;
+    for (auto& w : workloads) {
+      batch::move_results expected;
+      batch::validate(w.moves, expected, batch::KERNEL_SCALAR);
+      size_t valid = 0;
+      for (size_t lane = 0; lane < w.moves.size(); ++lane) {
+        valid += expected.valid[lane];
+      }
+
+      double scalar_rate = 0;
+      for (batch::kernel_kind kind : kernels) {
+        batch::move_results results;
+        batch::validate(w.moves, results, kind);
+        differences += compare(batch::kernel_name(kind), w, expected, results);
+
+        uint64_t passes = 0;
+        auto start = std::chrono::steady_clock::now();
+        double seconds = 0;
+        while (seconds < min_time) {
+          batch::validate(w.moves, results, kind);
+          ++passes;
+          seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        }
+        double rate = passes * w.moves.size() / seconds;
+        if (kind == batch::KERNEL_SCALAR) {
+          scalar_rate = rate;
+        }
+        std::printf("%-12s %-12s %12zu %16.0f %10.1f %9.2fx\n", w.name, batch::kernel_name(kind), w.moves.size(), rate, 1e9 / rate, rate / scalar_rate);
+      }
+      std::printf("%-12s %zu of %zu moves valid\n\n", w.name, valid, w.moves.size());
+    }
+
+    if (differences != 0) {
+      std::cerr << "batch_bench: " << differences << " results differ from valid_move\n";
+      return 1;
+    }
+    std::printf("every kernel matches valid_move\n");
+  } catch (const std::exception& e) {
+    std::cerr << "batch_bench: " << e.what() << "\n";
+    return 1;
+  }
+  return 0;
+}
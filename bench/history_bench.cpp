@@ -0,0 +1,169 @@
+#include <cstdio>
+#include <iostream>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "../tools/pgn.hpp"
+
+/* *
+ * history_bench
+ *  measures the chain RAM that storing move histories would cost, as a list of packed moves in every game row against
+ *  a trie shared by all games, in a table of nodes each holding one packed move and its parent node, so that games
+ *  which open the same way share the nodes of the common opening.  The contract keeps neither; this is what settled
+ *  that a shared trie costs far more RAM than it saves unless games mostly repeat each other.
+ *
+ *  RAM is worked out the way nodeos bills it: every table row costs its packed size plus a fixed 108 bytes
+ *  (billable_size<key_value_object> in eosio's chain library - 44 bytes of fields and 32 for each of its two internal
+ *  indexes).  A move list adds its packed size to a game row that exists anyway; the trie adds an 8 byte node id to the
+ *  game row and one 18 byte row per distinct (parent, move).
+ *
+ *  Games come from PGN files or packed move lists, or are generated: each generated game opens with one of a few
+ *  popular lines, weighted towards the most common, for --book-plies plies, then plays random legal moves.
+ * */
+
+#define ROW_OVERHEAD   108 //per table row
+#define NODE_ROW_BYTES 18  //node_id, parent, move
+#define NODE_ID_BYTES  8   //history_node in the game row
+
+static const std::pair<const char*, int> openings[] = {
+  { "e4 e5 Nf3 Nc6 Bb5 a6 Ba4 Nf6 O-O Be7 Re1 b5", 30 },
+  { "e4 c5 Nf3 d6 d4 cxd4 Nxd4 Nf6 Nc3 a6 Be3 e5", 25 },
+  { "d4 d5 c4 e6 Nc3 Nf6 Bg5 Be7 e3 O-O Nf3 h6",   15 },
+  { "d4 Nf6 c4 g6 Nc3 Bg7 e4 d6 Nf3 O-O Be2 e5",   10 },
+  { "e4 e6 d4 d5 Nc3 Nf6 Bg5 Be7 e5 Nfd7 Bxe7 Qxe7", 8 },
+  { "c4 e5 Nc3 Nf6 Nf3 Nc6 g3 d5 cxd5 Nxd5 Bg2 Nb6",  5 },
+  { "e4 c6 d4 d5 Nc3 dxe4 Nxe4 Bf5 Ng3 Bg6 h4 h6",    4 },
+  { "Nf3 d5 g3 Nf6 Bg2 e6 O-O Be7 d3 O-O Nbd2 c5",    3 },
+};
+
+static size_t varint_size (
+  uint64_t n
+) {
+  size_t size = 1;
+  while (n >= 0x80) {
+    n >>= 7;
+    ++size;
+  }
+  return size;
+}
+
+static std::vector<std::vector<uint16_t>> generate_games (
+  size_t game_count,
+  size_t plies,
+  size_t book_plies,
+  uint64_t seed
+) {
+  std::vector<std::vector<uint16_t>> book;
+  std::vector<int> weights;
+  for (auto& opening : openings) {
+    book.push_back(pgn::game_moves(pgn::split_games(opening.first)[0]));
+    weights.push_back(opening.second);
+  }
+
+  std::mt19937_64 rng(seed);
+  std::discrete_distribution<size_t> pick_opening(weights.begin(), weights.end());
+  std::vector<std::vector<uint16_t>> games;
+  for (size_t g = 0; g < game_count; ++g) {
+    const std::vector<uint16_t>& line = book[pick_opening(rng)];
+    rules::game_state state;
+    std::vector<uint16_t> moves;
+    while (moves.size() < plies) {
+      uint16_t move;
+      if (moves.size() < book_plies && moves.size() < line.size()) {
+        move = line[moves.size()];
+      } else {
+        std::vector<uint16_t> legal = rules::legal_moves(state);
+        if (legal.empty()) {
+          break;
+        }
+        move = legal[rng() % legal.size()];
+      }
+      uint8_t captured_piece_index = 32;
+      bool checkmate = false;
+      rules::play_move(state, rules::packed_piece_id(move), rules::packed_new_position(move), rules::packed_promotion_type(move), captured_piece_index, checkmate);
+      moves.push_back(move);
+      if (checkmate) {
+        break;
+      }
+    }
+    games.push_back(moves);
+  }
+  return games;
+}
+
+static void usage () {
+  std::cerr <<
+    "usage: history_bench [options] [game.pgn | game.moves]...\n"
+    "  --games N          games to generate when no files are given (default 2000)\n"
+    "  --plies N          length of generated games (default 80)\n"
+    "  --book-plies N     plies of each generated game taken from an opening line (default 12)\n"
+    "  --seed N           random seed (default 1)\n";
+  std::exit(1);
+}
+
+int main (int argc, char** argv) {
+  size_t game_count = 2000;
+  size_t plies = 80;
+  size_t book_plies = 12;
+  uint64_t seed = 1;
+  std::vector<std::string> files;
+
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    auto next = [&]() -> std::string {
+      if (i + 1 >= argc) { usage(); }
+      return argv[++i];
+    };
+    if (arg == "--games") { game_count = std::stoul(next()); }
+    else if (arg == "--plies") { plies = std::stoul(next()); }
+    else if (arg == "--book-plies") { book_plies = std::stoul(next()); }
+    else if (arg == "--seed") { seed = std::stoull(next()); }
+    else if (arg[0] == '-') { usage(); }
+    else { files.push_back(arg); }
+  }
+
+  try {
+    std::vector<std::vector<uint16_t>> games;
+    if (files.empty()) {
+      games = generate_games(game_count, plies, book_plies, seed);
+    }
+    for (auto& file : files) {
+      for (auto& game : pgn::load_games(file)) {
+        games.push_back(game);
+      }
+    }
+    if (games.empty()) {
+      std::cerr << "history_bench: no games\n";
+      return 1;
+    }
+
+    //the trie, one node per distinct (parent, move)
+    std::map<std::pair<uint64_t, uint16_t>, uint64_t> nodes;
+    uint64_t moves = 0;
+    uint64_t list_bytes = 0;
+    for (auto& game : games) {
+      uint64_t node = 0;
+      for (uint16_t move : game) {
+        auto inserted = nodes.insert({ { node, move }, nodes.size() + 1 });
+        node = inserted.first->second;
+      }
+      moves += game.size();
+      list_bytes += varint_size(game.size()) + 2 * game.size();
+    }
+    uint64_t trie_bytes = NODE_ID_BYTES * games.size() + nodes.size() * (ROW_OVERHEAD + NODE_ROW_BYTES);
+
+    std::printf("games            %zu\n", games.size());
+    std::printf("moves            %llu (%.1f per game)\n", (unsigned long long)moves, (double)moves / games.size());
+    std::printf("trie nodes       %zu (%.2f moves per node)\n", nodes.size(), nodes.empty() ? 0.0 : (double)moves / nodes.size());
+    std::printf("\n%-16s %14s %14s\n", "storage", "RAM bytes", "per game");
+    std::printf("%-16s %14llu %14.1f\n", "move list", (unsigned long long)list_bytes, (double)list_bytes / games.size());
+    std::printf("%-16s %14llu %14.1f\n", "move trie", (unsigned long long)trie_bytes, (double)trie_bytes / games.size());
+    std::printf("\nthe trie needs %.0f moves per node to break even\n", (double)(ROW_OVERHEAD + NODE_ROW_BYTES) / 2);
+  } catch (const std::exception& e) {
+    std::cerr << "history_bench: " << e.what() << "\n";
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,287 @@
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include "../tools/pgn.hpp"
+
+/* *
+ * rules_bench
+ *  times the hot rule helpers in chess_rules.hpp on their own, natively.
+ *
+ *  Each helper runs over every argument combination that makes sense for it (every piece of the right type against
+ *  every square, and so on) in three curated positions - a crowded opening, an open middlegame, and an endgame with
+ *  promoted pawns - and reports nanoseconds per call and calls per second.  Results can be stored with
+ *  --write-baseline and compared against with --baseline, to measure a change to one of the helpers.
+ *
+ *  Native timings are only a guide to what the contract pays in wasm, but they do move in the same direction.
+ * */
+
+struct position {
+  const char* name;
+  rules::game_state state;
+};
+
+struct bench_case {
+  std::string name;
+  uint64_t calls; //calls made by one pass
+  std::function<uint64_t ()> pass;
+};
+
+//keeps the compiler from discarding results
+static volatile uint64_t sink = 0;
+
+static rules::game_state after (
+  const char* san
+) {
+  rules::game_state state;
+  for (uint16_t move : pgn::game_moves(pgn::split_games(san)[0])) {
+    uint8_t captured_piece_index = 32;
+    bool checkmate = false;
+    rules::play_move(state, rules::packed_piece_id(move), rules::packed_new_position(move), rules::packed_promotion_type(move), captured_piece_index, checkmate);
+  }
+  return state;
+}
+
+/* *
+ * promoted_endgame
+ *  rooks, a knight and a bishop left, with a white pawn promoted to a queen and a black pawn promoted to a rook
+ * */
+static rules::game_state promoted_endgame () {
+  rules::game_state state;
+  state.piece_positions = rules::piece_array();
+  auto place = [&](uint8_t index, const char* square) {
+    state.piece_positions[index] = pgn::square_to_position(square[0], square[1]);
+  };
+  place(0, "g1"); place(4, "e5"); place(6, "d1"); place(8, "c6"); place(13, "f2"); place(14, "g2"); place(15, "h2");
+  place(16, "g8"); place(18, "e6"); place(22, "e8"); place(24, "b2"); place(29, "f7"); place(30, "g7"); place(31, "h7");
+  rules::promote_pawn(8, state.promoted_pawns, state.promoted_pawn_types, PROMOTED_QUEEN);
+  rules::promote_pawn(24, state.promoted_pawns, state.promoted_pawn_types, PROMOTED_ROOK);
+  state.castle = W_CAS_Q | W_CAS_K | B_CAS_Q | B_CAS_K;
+  state.move_count = 60;
+  rules::update_attacks(state);
+  return state;
+}
+
+static void usage () {
+  std::cerr <<
+    "usage: rules_bench [options]\n"
+    "  --filter TEXT          only run benchmarks whose name contains TEXT\n"
+    "  --min-time SECONDS     time each benchmark for at least this long (default 0.2)\n"
+    "  --baseline FILE        compare against stored results\n"
+    "  --write-baseline FILE  store this run's results\n";
+  std::exit(1);
+}
+
+int main (int argc, char** argv) {
+  std::string filter;
+  double min_time = 0.2;
+  std::string baseline_file;
+  std::string write_baseline_file;
+
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    auto next = [&]() -> std::string {
+      if (i + 1 >= argc) { usage(); }
+      return argv[++i];
+    };
+    if (arg == "--filter") { filter = next(); }
+    else if (arg == "--min-time") { min_time = std::stod(next()); }
+    else if (arg == "--baseline") { baseline_file = next(); }
+    else if (arg == "--write-baseline") { write_baseline_file = next(); }
+    else { usage(); }
+  }
+
+  std::vector<position> positions = {
+    { "opening",    after("e4 e5 Nf3 Nc6 Bc4 Nf6") },
+    { "middlegame", after("e4 e5 Nf3 Nc6 d4 exd4 Nxd4 Nf6 Nxc6 bxc6 e5 Qe7 Qe2 Nd5 c4 Ba6 b3 g6 Bb2 Bg7") },
+    { "endgame",    promoted_endgame() },
+  };
+
+  std::vector<bench_case> cases;
+
+  //the geometry helpers only depend on the two squares, so they get every pair once
+  typedef bool (*geometry)(uint8_t, uint8_t);
+  std::vector<std::pair<const char*, geometry>> geometry_helpers = {
+    { "same_row", rules::same_row }, { "same_col", rules::same_col },
+    { "same_nw_diag", rules::same_nw_diag }, { "same_ne_diag", rules::same_ne_diag },
+    { "same_sw_diag", rules::same_sw_diag }, { "same_se_diag", rules::same_se_diag },
+  };
+  for (auto& helper : geometry_helpers) {
+    geometry fn = helper.second;
+    cases.push_back({ helper.first, 64 * 64, [fn]() {
+      uint64_t hits = 0;
+      for (uint8_t p1 = 1; p1 < 65; ++p1) {
+        for (uint8_t p2 = 1; p2 < 65; ++p2) {
+          hits += fn(p1, p2);
+        }
+      }
+      return hits;
+    } });
+  }
+
+  for (auto& pos : positions) {
+    const rules::game_state& state = pos.state;
+    std::string suffix = std::string("/") + pos.name;
+
+    std::vector<uint8_t> occupied;
+    for (uint8_t p : state.piece_positions) {
+      if (p != 0) {
+        occupied.push_back(p);
+      }
+    }
+
+    //blocked: every occupied square as the start, every square as the target, every occupied square as the test
+    cases.push_back({ "blocked" + suffix, occupied.size() * 64 * occupied.size(), [occupied]() {
+      uint64_t hits = 0;
+      for (uint8_t from : occupied) {
+        for (uint8_t to = 1; to < 65; ++to) {
+          for (uint8_t test : occupied) {
+            hits += rules::blocked(from, to, test);
+          }
+        }
+      }
+      return hits;
+    } });
+
+    //the validators: every live piece of the type, for both sides, against every square
+    std::map<uint8_t, std::vector<uint8_t>> pieces_of_type;
+    for (uint8_t index = 0; index < 32; ++index) {
+      if (state.piece_positions[index] != 0) {
+        uint8_t type = index % 16 >= 8 ? PIECE_PAWN : rules::piece_type(index, 0, 0);
+        pieces_of_type[type].push_back(index);
+      }
+    }
+
+    typedef bool (*validator)(uint8_t, uint8_t, const rules::piece_array&, bool, uint8_t&);
+    std::vector<std::tuple<const char*, uint8_t, validator>> validators = {
+      { "valid_queen_move", PIECE_QUEEN, rules::valid_queen_move },
+      { "valid_bishop_move", PIECE_BISHOP, rules::valid_bishop_move },
+      { "valid_knight_move", PIECE_KNIGHT, rules::valid_knight_move },
+      { "valid_rook_move", PIECE_ROOK, rules::valid_rook_move },
+    };
+    for (auto& v : validators) {
+      std::vector<uint8_t> pieces = pieces_of_type[std::get<1>(v)];
+      if (pieces.empty()) {
+        continue;
+      }
+      validator fn = std::get<2>(v);
+      cases.push_back({ std::get<0>(v) + suffix, pieces.size() * 64, [fn, pieces, &state]() {
+        uint64_t hits = 0;
+        for (uint8_t index : pieces) {
+          for (uint8_t to = 1; to < 65; ++to) {
+            uint8_t captured_piece_index = 32;
+            hits += fn(state.piece_positions[index], to, state.piece_positions, index < 16, captured_piece_index);
+          }
+        }
+        return hits;
+      } });
+    }
+
+    std::vector<uint8_t> kings = pieces_of_type[PIECE_KING];
+    cases.push_back({ "valid_king_move" + suffix, kings.size() * 64, [kings, &state]() {
+      uint64_t hits = 0;
+      for (uint8_t index : kings) {
+        for (uint8_t to = 1; to < 65; ++to) {
+          uint8_t captured_piece_index = 32;
+          hits += rules::valid_king_move(state.piece_positions[index], to, state.castle, state.piece_positions, index < 16, captured_piece_index);
+        }
+      }
+      return hits;
+    } });
+
+    std::vector<uint8_t> pawns = pieces_of_type[PIECE_PAWN];
+    cases.push_back({ "valid_pawn_move" + suffix, pawns.size() * 64, [pawns, &state]() {
+      uint64_t hits = 0;
+      for (uint8_t index : pawns) {
+        for (uint8_t to = 1; to < 65; ++to) {
+          uint8_t captured_piece_index = 32;
+          uint8_t en_passant_idx = state.en_passant_idx;
+          hits += rules::valid_pawn_move(index, to, state.piece_positions, index < 16, captured_piece_index, state.promoted_pawns, state.promoted_pawn_types, en_passant_idx);
+        }
+      }
+      return hits;
+    } });
+
+    cases.push_back({ "is_pawn_promoted" + suffix, 16, [&state]() {
+      uint64_t hits = 0;
+      for (uint8_t index = 8; index < 32; index += index == 15 ? 9 : 1) {
+        uint8_t promoted_pawn_type = 0;
+        hits += rules::is_pawn_promoted(index, state.promoted_pawns, state.promoted_pawn_types, promoted_pawn_type) + promoted_pawn_type;
+      }
+      return hits;
+    } });
+
+    cases.push_back({ "in_check" + suffix, 2, [&state]() {
+      return (uint64_t)rules::in_check(true, state.piece_positions, state.promoted_pawns, state.promoted_pawn_types) +
+        rules::in_check(false, state.piece_positions, state.promoted_pawns, state.promoted_pawn_types);
+    } });
+
+    cases.push_back({ "in_checkmate" + suffix, 2, [&state]() {
+      return (uint64_t)rules::in_checkmate(true, state.piece_positions, state.promoted_pawns, state.promoted_pawn_types) +
+        rules::in_checkmate(false, state.piece_positions, state.promoted_pawns, state.promoted_pawn_types);
+    } });
+
+    cases.push_back({ "attacks_of" + suffix, 2, [&state]() {
+      uint64_t checkers = 0;
+      return rules::attacks_of(true, state.piece_positions, state.promoted_pawns, state.promoted_pawn_types, checkers) ^
+        rules::attacks_of(false, state.piece_positions, state.promoted_pawns, state.promoted_pawn_types, checkers) ^ checkers;
+    } });
+  }
+
+  std::map<std::string, double> baseline;
+  if (!baseline_file.empty()) {
+    std::ifstream in(baseline_file);
+    if (!in) {
+      std::cerr << "rules_bench: unable to open " << baseline_file << "\n";
+      return 1;
+    }
+    std::string name;
+    double ns;
+    while (in >> name >> ns) {
+      baseline[name] = ns;
+    }
+  }
+
+  std::vector<std::pair<std::string, double>> results;
+  std::printf("%-32s %10s %14s %10s %9s\n", "benchmark", "ns/call", "calls/s", "baseline", "change");
+  for (auto& c : cases) {
+    if (!filter.empty() && c.name.find(filter) == std::string::npos) {
+      continue;
+    }
+
+    sink = sink + c.pass();
+    uint64_t passes = 0;
+    auto start = std::chrono::steady_clock::now();
+    double elapsed = 0;
+    do {
+      for (int i = 0; i < 16; ++i) {
+        sink = sink + c.pass();
+      }
+      passes += 16;
+      elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    } while (elapsed < min_time);
+
+    double ns = elapsed * 1e9 / (double)(passes * c.calls);
+    results.push_back({ c.name, ns });
+    std::printf("%-32s %10.2f %14.0f", c.name.c_str(), ns, 1e9 / ns);
+    auto itr = baseline.find(c.name);
+    if (itr != baseline.end()) {
+      std::printf(" %10.2f %+8.1f%%", itr->second, 100.0 * (ns - itr->second) / itr->second);
+    }
+    std::printf("\n");
+  }
+
+  if (!write_baseline_file.empty()) {
+    std::ofstream out(write_baseline_file);
+    for (auto& r : results) {
+      out << r.first << " " << r.second << "\n";
+    }
+  }
+  return 0;
+}
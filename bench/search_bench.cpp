@@ -0,0 +1,92 @@
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../tools/engine.hpp"
+
+/* *
+ * search_bench
+ *  measures how the analysis engine (tools/engine.hpp) scales with threads.
+ *
+ *  Each position is searched to a fixed depth with 1, 2, 4 ... --threads threads, each time with a cleared
+ *  transposition table, and the time to depth, nodes and nodes per second are reported with the speedup in time to
+ *  depth over one thread.  Lazy SMP threads search overlapping trees, so nodes per second grows faster than the time
+ *  to depth shrinks - the time to depth is the number that counts.
+ * */
+
+struct bench_position {
+  const char* name;
+  const char* fen;
+  int depth;
+};
+
+static const bench_position positions[] = {
+  { "opening",    "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1", 6 },
+  { "middlegame", "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1", 5 },
+  { "endgame",    "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1", 9 },
+};
+
+static void usage () {
+  std::cerr <<
+    "usage: search_bench [options]\n"
+    "  --threads N        most threads to try (default one per core)\n"
+    "  --hash MB          transposition table size (default 64)\n"
+    "  --depth-offset N   plies to add to every position's depth (default 0)\n";
+  std::exit(1);
+}
+
+int main (int argc, char** argv) {
+  size_t max_threads = std::max(std::thread::hardware_concurrency(), 1u);
+  size_t hash_mb = 64;
+  int depth_offset = 0;
+
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    auto next = [&]() -> std::string {
+      if (i + 1 >= argc) { usage(); }
+      return argv[++i];
+    };
+    if (arg == "--threads") { max_threads = std::stoul(next()); }
+    else if (arg == "--hash") { hash_mb = std::stoul(next()); }
+    else if (arg == "--depth-offset") { depth_offset = std::stoi(next()); }
+    else { usage(); }
+  }
+  if (max_threads == 0) {
+    usage();
+  }
+
+  std::vector<size_t> thread_counts;
+  for (size_t threads = 1; threads < max_threads; threads *= 2) {
+    thread_counts.push_back(threads);
+  }
+  thread_counts.push_back(max_threads);
+
+  try {
+    engine::transposition_table tt(hash_mb);
+    std::printf("%-12s %7s %6s %10s %14s %12s %8s  %s\n", "position", "threads", "depth", "seconds", "nodes", "nps", "speedup", "best");
+    for (auto& p : positions) {
+      rules::game_state state = pgn::from_fen(p.fen);
+      int depth = std::max(p.depth + depth_offset, 1);
+      double single = 0;
+      for (size_t threads : thread_counts) {
+        tt.clear();
+        engine::searcher search(tt, threads);
+        engine::depth_report result = search.run(state, depth, 0);
+        if (threads == 1) {
+          single = result.seconds;
+        }
+        std::printf("%-12s %7zu %6d %10.3f %14llu %12.0f %7.2fx  %s %s\n", p.name, threads, result.depth, result.seconds,
+          (unsigned long long)result.nodes, result.seconds > 0 ? result.nodes / result.seconds : 0.0,
+          result.seconds > 0 ? single / result.seconds : 0.0,
+          result.pv.empty() ? "-" : engine::move_text(state, result.pv[0]).c_str(), engine::score_text(result.score).c_str());
+        std::fflush(stdout);
+      }
+    }
+  } catch (const std::exception& e) {
+    std::cerr << "search_bench: " << e.what() << "\n";
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,186 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "../tools/pgn.hpp"
+
+/* *
+ * slider_bench
+ *  checks the slider attack tables of native builds (tools/sliders.hpp) and measures what they are worth.
+ *
+ *  Every kind the cpu supports - the contract's ray walk, magic and pext - first answers a few thousand random
+ *  occupancies of every square, which must match rules::ray_attacks, and has its table size and the time of a queen's
+ *  attacks on random boards reported.  Each then counts the move sequences (perft, with rules::play_move) from a few
+ *  positions to a fixed depth, keeping the fastest of --runs runs; the counts must match the ray walk's, and the nodes
+ *  per second are reported with the speedup over it.  --find-magics searches for the magic numbers again and prints them.
+ * */
+
+struct bench_position {
+  const char* name;
+  const char* fen;
+  uint32_t depth;
+};
+
+static const bench_position positions[] = {
+  { "opening",    "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1", 4 },
+  { "middlegame", "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1", 3 },
+  { "endgame",    "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1", 5 },
+};
+
+//the number of random occupancies whose table attacks differ from the ray walk's
+static size_t check_tables (
+  uint64_t seed
+) {
+  size_t differences = 0;
+  for (uint8_t position = 1; position < 65; ++position) {
+    for (int sample = 0; sample < 4000; ++sample) {
+      //a mix of sparse and crowded boards
+      uint64_t occupied = rules::splitmix64(seed) & rules::splitmix64(seed);
+      if (sample % 2) {
+        occupied |= rules::splitmix64(seed);
+      }
+      uint64_t rook = rules::ray_attacks(position, 0, occupied) | rules::ray_attacks(position, 1, occupied) |
+        rules::ray_attacks(position, 4, occupied) | rules::ray_attacks(position, 5, occupied);
+      uint64_t bishop = rules::ray_attacks(position, 2, occupied) | rules::ray_attacks(position, 3, occupied) |
+        rules::ray_attacks(position, 6, occupied) | rules::ray_attacks(position, 7, occupied);
+      if (sliders::rook_attacks(position, occupied) != rook || sliders::bishop_attacks(position, occupied) != bishop) {
+        if (differences++ < 5) {
+          std::fprintf(stderr, "%s: position %u occupied %016llx differs\n", sliders::kind_name(sliders::tables.kind),
+            position, (unsigned long long)occupied);
+        }
+      }
+    }
+  }
+  return differences;
+}
+
+//nanoseconds for the attacks of a queen (a rook and a bishop lookup) on random boards
+static double time_lookups (
+  uint64_t seed
+) {
+  std::vector<uint64_t> boards(1 << 16);
+  for (uint64_t& occupied : boards) {
+    occupied = rules::splitmix64(seed) & rules::splitmix64(seed);
+  }
+  uint64_t total = 0;
+  double best = 0;
+  for (int pass = 0; pass < 5; ++pass) {
+    auto start = std::chrono::steady_clock::now();
+    for (size_t index = 0; index < boards.size(); ++index) {
+      uint8_t position = 1 + (index * 7 + pass) % 64;
+      total ^= rules::rook_attacks(position, boards[index]) | rules::bishop_attacks(position, boards[index]);
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    best = pass == 0 ? seconds : std::min(best, seconds);
+  }
+  //keep the lookups from being optimised away
+  if (total == 1) {
+    std::printf(" ");
+  }
+  return best * 1e9 / boards.size();
+}
+
+static void find_magics () {
+  uint64_t seed = 1;
+  for (int diagonal = 0; diagonal < 2; ++diagonal) {
+    std::printf("%s magics\n", diagonal ? "bishop" : "rook");
+    for (int square = 0; square < 64; ++square) {
+      uint64_t magic = sliders::find_magic(square, diagonal, seed);
+      uint64_t built_in = diagonal ? sliders::bishop_magics[square] : sliders::rook_magics[square];
+      std::printf("  0x%016llXULL%s%s", (unsigned long long)magic, magic == built_in ? "" : " (differs)", square % 4 == 3 ? "\n" : "");
+    }
+  }
+}
+
+static void usage () {
+  std::cerr <<
+    "usage: slider_bench [options]\n"
+    "  --depth-offset N   plies to add to every position's depth (default 0)\n"
+    "  --runs N           time each count N times and keep the fastest (default 3)\n"
+    "  --seed N           random seed for the table check (default 1)\n"
+    "  --find-magics      search for the magic numbers and print them\n";
+  std::exit(1);
+}
+
+int main (int argc, char** argv) {
+  int depth_offset = 0;
+  int runs = 3;
+  uint64_t seed = 1;
+
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    auto next = [&]() -> std::string {
+      if (i + 1 >= argc) { usage(); }
+      return argv[++i];
+    };
+    if (arg == "--depth-offset") { depth_offset = std::stoi(next()); }
+    else if (arg == "--runs") { runs = std::max(1, std::stoi(next())); }
+    else if (arg == "--seed") { seed = std::stoull(next()); }
+    else if (arg == "--find-magics") { find_magics(); return 0; }
+    else { usage(); }
+  }
+
+  try {
+    std::vector<sliders::slider_kind> kinds = { sliders::SLIDERS_RAYS, sliders::SLIDERS_MAGIC };
+    if (sliders::cpu_has_pext()) {
+      kinds.push_back(sliders::SLIDERS_PEXT);
+    }
+
+    std::printf("%-8s %14s %18s\n", "kind", "table bytes", "ns/queen attacks");
+    size_t differences = 0;
+    for (sliders::slider_kind kind : kinds) {
+      sliders::select(kind);
+      size_t bytes = sliders::table_bytes(kind);
+      if (kind == sliders::SLIDERS_RAYS) {
+        bytes = sizeof(rules::empty_board_attacks.rays);
+      } else {
+        differences += check_tables(seed);
+      }
+      std::printf("%-8s %14zu %18.2f\n", sliders::kind_name(kind), bytes, time_lookups(seed));
+    }
+    std::printf("\n%-12s %-6s %6s %12s %10s %14s %9s\n", "position", "kind", "depth", "nodes", "seconds", "nodes/s", "speedup");
+
+    for (const bench_position& p : positions) {
+      rules::game_state state = pgn::from_fen(p.fen);
+      uint32_t depth = std::max(1, (int)p.depth + depth_offset);
+      uint64_t ray_nodes = 0;
+      double ray_rate = 0;
+      for (sliders::slider_kind kind : kinds) {
+        sliders::select(kind);
+        uint64_t nodes = 0;
+        double seconds = 0;
+        for (int run = 0; run < runs; ++run) {
+          auto start = std::chrono::steady_clock::now();
+          nodes = rules::perft(state, depth);
+          double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+          seconds = run == 0 ? elapsed : std::min(seconds, elapsed);
+        }
+        double rate = nodes / seconds;
+        if (kind == sliders::SLIDERS_RAYS) {
+          ray_nodes = nodes;
+          ray_rate = rate;
+        } else if (nodes != ray_nodes) {
+          std::fprintf(stderr, "%s/%s: %llu nodes, the ray walk counts %llu\n", p.name, sliders::kind_name(kind),
+            (unsigned long long)nodes, (unsigned long long)ray_nodes);
+          ++differences;
+        }
+        std::printf("%-12s %-6s %6u %12llu %10.3f %14.0f %8.2fx\n", p.name, sliders::kind_name(kind), depth,
+          (unsigned long long)nodes, seconds, rate, rate / ray_rate);
+      }
+    }
+
+    sliders::select(sliders::best_kind());
+    if (differences != 0) {
+      std::cerr << "slider_bench: " << differences << " differences from the ray walk\n";
+      return 1;
+    }
+    std::printf("\nevery kind matches the ray walk\n");
+  } catch (const std::exception& e) {
+    std::cerr << "slider_bench: " << e.what() << "\n";
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,400 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "../tools/transaction.hpp"
+
+/* *
+ * table_bench
+ *  measures how the contract's games table behaves as it grows, against a local chain (see nodeos_start).
+ *
+ *  The table is filled with 'newgame' actions, --batch to a transaction, up to each of --scales in turn; games are
+ *  never removed, so scales are table sizes counted from the rows already there.  At every scale the same workload
+ *  runs, one action to a transaction so each receipt bills one action -
+ *   newgame   available_primary_key and emplace at the end of the table
+ *   move      find and modify of games spread over the table: e2-e4 then e7-e5 in games the fill created, picked at
+ *             random so lookups don't all land near one end
+ *  and reports the billed cpu of each transaction and the elapsed time nodeos traced for the action itself, which
+ *  leaves out the transaction overhead.  RAM per row is the growth of the contract account's ram_usage over the fill
+ *  divided by the rows added ('move' moves a row's RAM to the player, so only the fill is counted).
+ *
+ *  Then get_table_rows is timed the ways the tools read the table: one game by id (games_table::read_game), the first
+ *  --page rows, --page rows from a random id, and with --scan a walk of the whole table page by page (bin/export).
+ *
+ *  Only this bench should be creating games in --scope while it runs, since it counts on the games it creates having
+ *  consecutive ids; a scope of its own keeps it clear of other games, and dropscope clears it out afterwards.
+ * */
+
+static void usage () {
+  std::cerr <<
+    "usage: table_bench [options]\n"
+    "  --url URL          nodeos endpoint (default http://127.0.0.1:8888)\n"
+    "  --wallet-url URL   keosd endpoint (default unix://~/eosio-wallet/keosd.sock)\n"
+    "  --contract NAME    chess contract account (default chess)\n"
+    "  --scope NAME       games table scope (default the contract account)\n"
+    "  --white NAME       white player (default alice)\n"
+    "  --black NAME       black player (default bob)\n"
+    "  --scales LIST      comma separated table sizes to measure at (default 1000,10000,100000,300000)\n"
+    "  --batch N          newgame actions per fill transaction (default 100)\n"
+    "  --samples N        actions of each kind in the workload (default 200)\n"
+    "  --queries N        get_table_rows requests of each kind (default 200)\n"
+    "  --page N           rows per page for the page queries and the scan (default 500)\n"
+    "  --scan             also time a walk of the whole table\n"
+    "  --seed N           random seed for the games and ids picked (default 1)\n";
+  std::exit(1);
+}
+
+//a sorted sample, for percentiles
+struct sample {
+  std::vector<double> values;
+
+  void add (double value) { values.push_back(value); }
+
+  double percentile (double p) {
+    if (values.empty()) {
+      return 0;
+    }
+    std::sort(values.begin(), values.end());
+    return values[std::min(values.size() - 1, (size_t)(p * values.size()))];
+  }
+
+  double average () const {
+    double total = 0;
+    for (double value : values) {
+      total += value;
+    }
+    return values.empty() ? 0 : total / values.size();
+  }
+};
+
+struct action_result {
+  std::string action;
+  sample billed_us;
+  sample elapsed_us;
+  uint64_t rejected = 0;
+};
+
+class table_bench {
+  public:
+    table_bench (
+      const std::string& node_url,
+      const std::string& wallet_url,
+      const std::string& contract,
+      const std::string& scope,
+      const std::string& player_w,
+      const std::string& player_b,
+      uint64_t seed
+    ) : session(node_url, wallet_url), node(node_url), contract(contract), scope(scope), player_w(player_w),
+      player_b(player_b), rng(seed) {}
+
+    //the number of rows, from the id of the last one (games are only erased by dropscope)
+    uint64_t rows () {
+      json::value request = table_request();
+      request.set("reverse", true);
+      request.set("limit", 1);
+      json::value result = session.call_node("/v1/chain/get_table_rows", request.dump());
+      const json::value& found = result["rows"];
+      return found.size() == 0 ? 0 : found.at(0)["game_id"].as_uint64() + 1;
+    }
+
+    int64_t ram_usage () {
+      json::value request = json::value::object();
+      request.set("account_name", contract);
+      return session.call_node("/v1/chain/get_account", request.dump())["ram_usage"].as_int64();
+    }
+
+    /* *
+     * fill
+     *  adds newgame actions until the table has target rows, and returns the rows added.  The new games are kept as
+     *  candidates for the move workload.
+     * */
+    uint64_t fill (
+      uint64_t target,
+      size_t batch
+    ) {
+      uint64_t first = rows();
+      auto start = std::chrono::steady_clock::now();
+      for (uint64_t count = first; count < target; ) {
+        eos::transaction trx;
+        trx.context_free_actions.push_back(eos::nonce_action(rng()));
+        size_t actions = (size_t)std::min<uint64_t>(batch, target - count);
+        for (size_t i = 0; i < actions; ++i) {
+          trx.actions.push_back(eos::newgame_action(contract, scope, player_w, player_b));
+        }
+        push(trx);
+        count += actions;
+        if (count % 10000 < actions) {
+          std::fprintf(stderr, "\r  filling %llu / %llu", (unsigned long long)count, (unsigned long long)target);
+        }
+      }
+      uint64_t added = target > first ? target - first : 0;
+      for (uint64_t id = first; id < first + added; ++id) {
+        fresh.push_back(id);
+      }
+      double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+      if (added > 0) {
+        std::fprintf(stderr, "\r  filled %llu rows in %.1fs\n", (unsigned long long)added, seconds);
+      }
+      return added;
+    }
+
+    /* *
+     * workload
+     *  samples newgame and move transactions of one action each.  New games join the fresh pool too.
+     * */
+    std::vector<action_result> workload (
+      size_t samples
+    ) {
+      std::vector<action_result> results(3);
+      results[0].action = "newgame";
+      results[1].action = "move w";
+      results[2].action = "move b";
+
+      uint64_t first = rows();
+      for (size_t i = 0; i < samples; ++i) {
+        measure(results[0], eos::newgame_action(contract, scope, player_w, player_b));
+      }
+      for (uint64_t id = first; id < first + samples; ++id) {
+        fresh.push_back(id);
+      }
+
+      //e2-e4 (pawn 11 to 28) and e7-e5 (pawn 27 to 36) in games still at the start
+      std::vector<uint64_t> games;
+      for (size_t i = 0; i < samples && !fresh.empty(); ++i) {
+        size_t pick = rng() % fresh.size();
+        games.push_back(fresh[pick]);
+        fresh[pick] = fresh.back();
+        fresh.pop_back();
+      }
+      for (uint64_t id : games) {
+        measure(results[1], eos::move_action(contract, player_w, scope, id, 11, 28, 0));
+      }
+      for (uint64_t id : games) {
+        measure(results[2], eos::move_action(contract, player_b, scope, id, 27, 36, 0));
+      }
+      return results;
+    }
+
+    /* *
+     * time_query
+     *  milliseconds for one get_table_rows request, from sending it to parsing the reply
+     * */
+    double time_query (
+      const json::value& request,
+      std::string* next_key = nullptr
+    ) {
+      auto start = std::chrono::steady_clock::now();
+      http_response response = node.post("/v1/chain/get_table_rows", request.dump());
+      if (response.status != 200) {
+        throw std::runtime_error("get_table_rows failed: " + eos::error_message(response.body));
+      }
+      json::value result = json::parse(response.body);
+      double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+      //the key of the next page, or empty after the last; older nodeos versions don't send next_key
+      if (next_key != nullptr) {
+        const json::value& rows = result["rows"];
+        next_key->clear();
+        if (result["more"].as_bool() && rows.size() != 0) {
+          *next_key = result["next_key"].as_string();
+          if (next_key->empty()) {
+            *next_key = std::to_string(rows.at(rows.size() - 1)["game_id"].as_uint64() + 1);
+          }
+        }
+      }
+      return ms;
+    }
+
+    json::value table_request () {
+      json::value request = json::value::object();
+      request.set("code", contract);
+      request.set("scope", scope);
+      request.set("table", "games");
+      request.set("json", true);
+      return request;
+    }
+
+    uint64_t random_id (uint64_t count) { return count == 0 ? 0 : rng() % count; }
+
+  private:
+    eos::chain_session session;
+    http_client node;
+    std::string contract;
+    std::string scope;
+    std::string player_w;
+    std::string player_b;
+    std::mt19937_64 rng;
+    std::vector<uint64_t> fresh;   //games the bench created that haven't been moved in
+
+    json::value push (
+      eos::transaction& trx
+    ) {
+      session.prepare(trx);
+      return session.push(trx, session.sign(trx));
+    }
+
+    void measure (
+      action_result& result,
+      const eos::action& act
+    ) {
+      eos::transaction trx;
+      trx.context_free_actions.push_back(eos::nonce_action(rng()));
+      trx.actions.push_back(act);
+      json::value pushed = push(trx);
+      result.billed_us.add(pushed["processed"]["receipt"]["cpu_usage_us"].as_double());
+
+      //the contract reports rule violations by printing, not by failing the transaction
+      const json::value& traces = pushed["processed"]["action_traces"];
+      for (size_t i = 0; i < traces.size(); ++i) {
+        if (traces.at(i)["act"]["account"].as_string() == contract) {
+          result.elapsed_us.add(traces.at(i)["elapsed"].as_double());
+          if (traces.at(i)["console"].as_string() != "") {
+            ++result.rejected;
+          }
+        }
+      }
+    }
+};
+
+int main (int argc, char** argv) {
+  std::string node_url = "http://127.0.0.1:8888";
+  std::string wallet_url = "unix://~/eosio-wallet/keosd.sock";
+  std::string contract = "chess";
+  std::string scope;
+  std::string player_w = "alice";
+  std::string player_b = "bob";
+  std::vector<uint64_t> scales = { 1000, 10000, 100000, 300000 };
+  size_t batch = 100;
+  size_t samples = 200;
+  size_t queries = 200;
+  size_t page = 500;
+  bool scan = false;
+  uint64_t seed = 1;
+
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    auto next = [&]() -> std::string {
+      if (i + 1 >= argc) { usage(); }
+      return argv[++i];
+    };
+    if (arg == "--url") { node_url = next(); }
+    else if (arg == "--wallet-url") { wallet_url = next(); }
+    else if (arg == "--contract") { contract = next(); }
+    else if (arg == "--scope") { scope = next(); }
+    else if (arg == "--white") { player_w = next(); }
+    else if (arg == "--black") { player_b = next(); }
+    else if (arg == "--scales") {
+      scales.clear();
+      std::stringstream list(next());
+      std::string scale;
+      while (std::getline(list, scale, ',')) {
+        scales.push_back(std::stoull(scale));
+      }
+    }
+    else if (arg == "--batch") { batch = std::stoul(next()); }
+    else if (arg == "--samples") { samples = std::stoul(next()); }
+    else if (arg == "--queries") { queries = std::stoul(next()); }
+    else if (arg == "--page") { page = std::stoul(next()); }
+    else if (arg == "--scan") { scan = true; }
+    else if (arg == "--seed") { seed = std::stoull(next()); }
+    else { usage(); }
+  }
+  if (scope.empty()) {
+    scope = contract;
+  }
+  if (scales.empty() || !std::is_sorted(scales.begin(), scales.end()) || batch == 0 || samples == 0 || page == 0) {
+    usage();
+  }
+
+  try {
+    table_bench bench(node_url, wallet_url, contract, scope, player_w, player_b, seed);
+    std::printf("%-9s %-8s %7s %8s %9s %9s %9s %9s %9s %9s %9s\n", "rows", "action", "count", "rejected",
+      "ram/row", "cpu p50", "cpu p99", "cpu avg", "elap p50", "elap p99", "elap avg");
+    std::vector<std::string> query_lines;
+    std::vector<std::string> scan_lines;
+
+    for (uint64_t scale : scales) {
+      int64_t ram_before = bench.ram_usage();
+      uint64_t added = bench.fill(scale, batch);
+      int64_t ram_after = bench.ram_usage();
+      uint64_t rows = bench.rows();
+
+      std::vector<action_result> results = bench.workload(samples);
+      for (action_result& r : results) {
+        char ram[16] = "-";
+        if (added > 0 && r.action == "newgame") {
+          std::snprintf(ram, sizeof(ram), "%.1f", (double)(ram_after - ram_before) / added);
+        }
+        std::printf("%-9llu %-8s %7zu %8llu %9s %9.0f %9.0f %9.1f %9.0f %9.0f %9.1f\n", (unsigned long long)rows,
+          r.action.c_str(), r.billed_us.values.size(), (unsigned long long)r.rejected, ram,
+          r.billed_us.percentile(0.5), r.billed_us.percentile(0.99), r.billed_us.average(),
+          r.elapsed_us.percentile(0.5), r.elapsed_us.percentile(0.99), r.elapsed_us.average());
+      }
+
+      //queries, against the table as the workload left it
+      rows = bench.rows();
+      sample by_id, first_page, random_page;
+      for (size_t i = 0; i < queries; ++i) {
+        json::value request = bench.table_request();
+        std::string id = std::to_string(bench.random_id(rows));
+        request.set("lower_bound", id);
+        request.set("upper_bound", id);
+        request.set("limit", 1);
+        by_id.add(bench.time_query(request));
+
+        request = bench.table_request();
+        request.set("limit", (int64_t)page);
+        first_page.add(bench.time_query(request));
+
+        request.set("lower_bound", std::to_string(bench.random_id(rows)));
+        random_page.add(bench.time_query(request));
+      }
+      auto line = [&](const char* query, sample& s) {
+        char text[128];
+        std::snprintf(text, sizeof(text), "%-9llu %-12s %7zu %9.2f %9.2f %9.2f", (unsigned long long)rows, query,
+          s.values.size(), s.percentile(0.5), s.percentile(0.99), s.average());
+        query_lines.push_back(text);
+      };
+      line("by id", by_id);
+      line("first page", first_page);
+      line("random page", random_page);
+
+      if (scan) {
+        sample pages;
+        std::string next_key;
+        do {
+          json::value request = bench.table_request();
+          request.set("limit", (int64_t)page);
+          if (!next_key.empty()) {
+            request.set("lower_bound", next_key);
+          }
+          pages.add(bench.time_query(request, &next_key));
+        } while (!next_key.empty());
+        line("scan page", pages);
+        char text[128];
+        double seconds = pages.average() * pages.values.size() / 1000;
+        std::snprintf(text, sizeof(text), "%-9llu %.2fs, %.0f rows/s", (unsigned long long)rows, seconds, rows / seconds);
+        scan_lines.push_back(text);
+      }
+    }
+
+    std::printf("\n%-9s %-12s %7s %9s %9s %9s\n", "rows", "query", "count", "p50 ms", "p99 ms", "avg ms");
+    for (const std::string& line : query_lines) {
+      std::printf("%s\n", line.c_str());
+    }
+    if (scan) {
+      std::printf("\n%-9s whole table scan\n", "rows");
+      for (const std::string& line : scan_lines) {
+        std::printf("%s\n", line.c_str());
+      }
+    }
+  } catch (const std::exception& e) {
+    std::cerr << "\ntable_bench: " << e.what() << "\n";
+    return 1;
+  }
+  return 0;
+}
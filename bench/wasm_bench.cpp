@@ -0,0 +1,190 @@
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "../tools/pgn.hpp"
+#include "wasm_chain.hpp"
+
+/* *
+ * wasm_bench
+ *  counts the wasm instructions the compiled contract executes for each action in a fixed corpus of positions.
+ *
+ *  nodeos bills cpu by wall-clock time, which is too noisy to compare one build of the contract against the next.
+ *  Instruction counts from the interpreter in wasm_vm.hpp are exact and repeatable, so they can be stored as a
+ *  baseline, and a run fails if any action got more than --threshold percent more expensive.
+ *
+ *  Every corpus entry starts a fresh game, plays its setup moves, then measures one move.  The setup moves are played
+ *  through the contract too, and the run fails if the contract rejects any of them.
+ * */
+
+struct scenario {
+  const char* name;
+  const char* setup; //SAN moves leading to the position
+  const char* move;  //the measured move
+};
+
+static const scenario corpus[] = {
+  { "first-move",         "",                                                   "e4" },
+  { "knight",             "e4 e5",                                              "Nf3" },
+  { "pawn-capture",       "e4 d5",                                              "exd5" },
+  { "castle-kingside",    "e4 e5 Nf3 Nc6 Bc4 Bc5",                              "O-O" },
+  { "castle-queenside",   "d4 d5 Nc3 Nc6 Bf4 Bf5 Qd2 Qd7",                      "O-O-O" },
+  { "en-passant",         "e4 a6 e5 d5",                                        "exd6" },
+  { "promotion",          "a4 b5 axb5 a6 bxa6 Bb7 axb7 Nc6",                    "bxa8=Q" },
+  { "promoted-queen",     "a4 b5 axb5 a6 bxa6 Bb7 axb7 Nc6 bxa8=Q Nf6",         "Qxd8+" },
+  { "check",              "e4 e5 Nf3 d6",                                       "Bb5+" },
+  { "out-of-check",       "e4 e5 Nf3 d6 Bb5+",                                  "c6" },
+  { "checkmate",          "f3 e5 g4",                                           "Qh4#" },
+  { "middlegame",         "e4 e5 Nf3 Nc6 Bb5 a6 Ba4 Nf6 O-O Be7 Re1 b5 Bb3 d6 c3 O-O h3 Nb8 d4 Nbd7", "c4" },
+  { "middlegame-capture", "e4 e5 Nf3 Nc6 Bb5 a6 Ba4 Nf6 O-O Be7 Re1 b5 Bb3 d6 c3 O-O h3 Nb8 d4 Nbd7 c4 c6", "cxb5" },
+};
+
+static void usage () {
+  std::cerr <<
+    "usage: wasm_bench [options]\n"
+    "  --wasm FILE            compiled contract (default chess.wasm)\n"
+    "  --contract NAME        account the contract runs as (default chess)\n"
+    "  --baseline FILE        compare against stored instruction counts\n"
+    "  --write-baseline FILE  store this run's instruction counts\n"
+    "  --threshold PCT        allowed increase over the baseline (default 1)\n";
+  std::exit(1);
+}
+
+static std::map<std::string, uint64_t> read_baseline (
+  const std::string& filename
+) {
+  std::ifstream in(filename);
+  if (!in) {
+    throw std::runtime_error("unable to open " + filename);
+  }
+  std::map<std::string, uint64_t> baseline;
+  std::string key;
+  uint64_t instructions;
+  while (in >> key >> instructions) {
+    baseline[key] = instructions;
+  }
+  return baseline;
+}
+
+int main (int argc, char** argv) {
+  std::string wasm_file = "chess.wasm";
+  std::string contract = "chess";
+  std::string baseline_file;
+  std::string write_baseline_file;
+  double threshold = 1.0;
+
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    auto next = [&]() -> std::string {
+      if (i + 1 >= argc) { usage(); }
+      return argv[++i];
+    };
+    if (arg == "--wasm") { wasm_file = next(); }
+    else if (arg == "--contract") { contract = next(); }
+    else if (arg == "--baseline") { baseline_file = next(); }
+    else if (arg == "--write-baseline") { write_baseline_file = next(); }
+    else if (arg == "--threshold") { threshold = std::stod(next()); }
+    else { usage(); }
+  }
+
+  try {
+    std::string bytes = pgn::read_file(wasm_file);
+    wasm_chain chain(std::vector<uint8_t>(bytes.begin(), bytes.end()));
+    const std::string player_w = "alice";
+    const std::string player_b = "bob";
+    const std::string& scope = contract;
+
+    //results in the order they were measured, keyed like 'move/castle-kingside'
+    std::vector<std::pair<std::string, uint64_t>> results;
+
+    auto run = [&](const eos::action& act, const std::string& what) -> action_result {
+      action_result result = chain.apply(act);
+      if (!result.error.empty()) {
+        throw std::runtime_error(what + " failed: " + result.error);
+      }
+      return result;
+    };
+
+    auto play = [&](const rules::game_state& state, uint16_t move, const std::string& what) -> action_result {
+      action_result result = run(eos::move_action(contract, state.move_count % 2 == 0 ? player_w : player_b, scope, 0,
+        rules::packed_piece_id(move), rules::packed_new_position(move), rules::packed_promotion_type(move)), what);
+      if (!result.console.empty()) {
+        throw std::runtime_error(what + " was rejected by the contract: " + result.console);
+      }
+      return result;
+    };
+
+    for (auto& s : corpus) {
+      chain.reset();
+      action_result created = run(eos::newgame_action(contract, scope, player_w, player_b), "newgame");
+      if (results.empty()) {
+        results.push_back({ "newgame", created.instructions });
+      }
+
+      auto games = pgn::split_games(std::string(s.setup) + " " + s.move);
+      std::vector<std::string> san_moves = games.empty() ? std::vector<std::string>() : games[0];
+      rules::game_state state;
+      for (size_t ply = 0; ply < san_moves.size(); ++ply) {
+        std::string what = std::string(s.name) + " ply " + std::to_string(ply + 1) + " (" + san_moves[ply] + ")";
+        uint16_t move = pgn::san_to_move(state, san_moves[ply]);
+        action_result result = play(state, move, what);
+        uint8_t captured_piece_index = 32;
+        bool checkmate = false;
+        rules::play_move(state, rules::packed_piece_id(move), rules::packed_new_position(move), rules::packed_promotion_type(move), captured_piece_index, checkmate);
+        if (ply + 1 == san_moves.size()) {
+          results.push_back({ std::string("move/") + s.name, result.instructions });
+        }
+      }
+    }
+
+    //the remaining actions, each on a fresh game
+    chain.reset();
+    run(eos::newgame_action(contract, scope, player_w, player_b), "newgame");
+    results.push_back({ "draw/offer", run(eos::draw_action(contract, player_w, scope, 0), "draw offer").instructions });
+    results.push_back({ "draw/accept", run(eos::draw_action(contract, player_b, scope, 0), "draw accept").instructions });
+    chain.reset();
+    run(eos::newgame_action(contract, scope, player_w, player_b), "newgame");
+    results.push_back({ "concede", run(eos::concede_action(contract, player_b, scope, 0), "concede").instructions });
+    results.push_back({ "move/game-over", run(eos::move_action(contract, player_w, scope, 0, 12, 28, 0), "move after the game ended").instructions });
+
+    std::map<std::string, uint64_t> baseline;
+    if (!baseline_file.empty()) {
+      baseline = read_baseline(baseline_file);
+    }
+
+    int regressions = 0;
+    std::printf("%-28s %14s %14s %9s\n", "action", "instructions", "baseline", "change");
+    for (auto& r : results) {
+      std::printf("%-28s %14llu", r.first.c_str(), (unsigned long long)r.second);
+      auto itr = baseline.find(r.first);
+      if (itr == baseline.end()) {
+        std::printf("\n");
+        continue;
+      }
+      double change = itr->second == 0 ? 0 : 100.0 * ((double)r.second - (double)itr->second) / (double)itr->second;
+      bool regressed = change > threshold;
+      regressions += regressed ? 1 : 0;
+      std::printf(" %14llu %+8.2f%%%s\n", (unsigned long long)itr->second, change, regressed ? "  REGRESSED" : "");
+    }
+
+    if (!write_baseline_file.empty()) {
+      std::ofstream out(write_baseline_file);
+      for (auto& r : results) {
+        out << r.first << " " << r.second << "\n";
+      }
+    }
+
+    if (regressions > 0) {
+      std::cerr << regressions << " action(s) regressed by more than " << threshold << "%\n";
+      return 1;
+    }
+  } catch (const std::exception& e) {
+    std::cerr << "wasm_bench: " << e.what() << "\n";
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,419 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <map>
+#include <string>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+
+#include "../tools/transaction.hpp"
+#include "wasm_vm.hpp"
+
+/* *
+ * wasm_chain.hpp
+ *  runs actions of a compiled contract in the instruction counting interpreter (wasm_vm.hpp), with just enough of the
+ *  eosio host api mocked to get through them: action data, authorization, console printing, the i64 database and the
+ *  memory intrinsics.  Like nodeos, every action starts from a fresh instance of the module; only the database carries
+ *  over between actions.  Inline actions the contract sends run after it, and their instructions and console output
+ *  are added to its result.
+ *
+ *  Host functions the chess contract doesn't use are left unresolved, and trap if they are ever called.
+ * */
+
+struct action_result {
+  uint64_t instructions = 0;
+  std::string console;
+  std::string error; //set if the action trapped or failed an assertion
+};
+
+class wasm_chain {
+  public:
+    wasm_chain (
+      const std::vector<uint8_t>& wasm
+    ) : mod(wasm) {
+      bind_host_functions();
+    }
+
+    /* *
+     * apply
+     *  runs one action and any inline actions it sends; like a failed transaction, an action that traps (or whose inline
+     *  action traps) leaves the database as it was
+     * */
+    action_result apply (
+      const eos::action& act
+    ) {
+      receiver = eos::string_to_name(act.account);
+      action_data = act.data;
+      authorizers.clear();
+      for (auto& auth : act.authorization) {
+        authorizers.push_back(eos::string_to_name(auth.actor));
+      }
+      iterators.clear();
+      iterator_of.clear();
+      end_tables.clear();
+      console.clear();
+      inline_actions.clear();
+
+      auto saved_tables = tables;
+      action_result result;
+      wasm::instance vm(mod, host_functions);
+      current = &vm;
+      try {
+        vm.call("apply", { receiver, receiver, eos::string_to_name(act.name) });
+      } catch (const exit_action&) {
+      } catch (const wasm::trap& e) {
+        result.error = e.what();
+        tables = saved_tables;
+      }
+      current = nullptr;
+
+      result.instructions = vm.instructions;
+      result.console = console;
+
+      std::vector<eos::action> sent;
+      sent.swap(inline_actions);
+      for (auto& inline_act : sent) {
+        if (!result.error.empty()) {
+          break;
+        }
+        action_result inline_result = apply(inline_act);
+        result.instructions += inline_result.instructions;
+        result.console += inline_result.console;
+        if (!inline_result.error.empty()) {
+          result.error = inline_act.name + ": " + inline_result.error;
+          tables = saved_tables;
+        }
+      }
+      return result;
+    }
+
+    void reset () {
+      tables.clear();
+    }
+
+  private:
+    struct exit_action {};
+
+    typedef std::tuple<uint64_t, uint64_t, uint64_t> table_id; //code, scope, table
+    typedef std::map<uint64_t, std::vector<uint8_t>> table_rows;
+
+    wasm::module mod;
+    std::unordered_map<std::string, wasm::host_function> host_functions;
+    wasm::instance* current = nullptr;
+
+    std::map<table_id, table_rows> tables;
+    uint64_t receiver = 0;
+    std::vector<char> action_data;
+    std::vector<uint64_t> authorizers;
+    std::string console;
+    std::vector<eos::action> inline_actions;
+
+    //database iterators only live for one action; end iterators are -2 - (table number), -1 means no table
+    std::vector<std::pair<table_id, uint64_t>> iterators;
+    std::map<std::pair<table_id, uint64_t>, int32_t> iterator_of;
+    std::vector<table_id> end_tables;
+
+    uint8_t* mem (uint64_t address, uint64_t size) { return current->memory_at((uint32_t)address, (uint32_t)size); }
+
+    std::string c_string (
+      uint64_t address
+    ) {
+      std::string s;
+      for (uint32_t p = address; ; ++p) {
+        char c = *mem(p, 1);
+        if (c == 0) {
+          return s;
+        }
+        s += c;
+      }
+    }
+
+    int32_t iterator (
+      const table_id& t,
+      uint64_t primary
+    ) {
+      auto key = std::make_pair(t, primary);
+      auto itr = iterator_of.find(key);
+      if (itr != iterator_of.end()) {
+        return itr->second;
+      }
+      iterators.push_back(key);
+      iterator_of[key] = iterators.size() - 1;
+      return iterators.size() - 1;
+    }
+
+    int32_t end_iterator (
+      const table_id& t
+    ) {
+      for (size_t i = 0; i < end_tables.size(); ++i) {
+        if (end_tables[i] == t) {
+          return -2 - (int32_t)i;
+        }
+      }
+      end_tables.push_back(t);
+      return -2 - (int32_t)(end_tables.size() - 1);
+    }
+
+    std::pair<table_id, uint64_t>& row_at (
+      int32_t itr
+    ) {
+      if (itr < 0 || (size_t)itr >= iterators.size()) {
+        throw wasm::trap("dereference of invalid database iterator");
+      }
+      auto table_itr = tables.find(iterators[itr].first);
+      if (table_itr == tables.end() || table_itr->second.count(iterators[itr].second) == 0) {
+        throw wasm::trap("dereference of invalid database iterator");
+      }
+      return iterators[itr];
+    }
+
+    /* *
+     * unpack_action
+     *  reads a serialized action, as passed to send_inline
+     * */
+    static eos::action unpack_action (
+      const uint8_t* p,
+      uint32_t size
+    ) {
+      const uint8_t* end = p + size;
+      auto need = [&](uint32_t n) {
+        if ((uint32_t)(end - p) < n) {
+          throw wasm::trap("truncated inline action");
+        }
+      };
+      auto u64 = [&]() {
+        need(8);
+        uint64_t v;
+        std::memcpy(&v, p, 8);
+        p += 8;
+        return v;
+      };
+      auto varuint32 = [&]() {
+        uint32_t v = 0;
+        for (int shift = 0; ; shift += 7) {
+          need(1);
+          uint8_t b = *p++;
+          v |= (uint32_t)(b & 0x7F) << shift;
+          if ((b & 0x80) == 0 || shift > 28) {
+            return v;
+          }
+        }
+      };
+
+      eos::action act;
+      act.account = eos::name_to_string(u64());
+      act.name = eos::name_to_string(u64());
+      for (uint32_t n = varuint32(); n > 0; --n) {
+        std::string actor = eos::name_to_string(u64());
+        act.authorization.push_back({ actor, eos::name_to_string(u64()) });
+      }
+      uint32_t data_size = varuint32();
+      need(data_size);
+      act.data.assign(p, p + data_size);
+      return act;
+    }
+
+    void check_auth (
+      uint64_t account
+    ) {
+      for (auto a : authorizers) {
+        if (a == account) {
+          return;
+        }
+      }
+      throw wasm::trap("missing authority of " + eos::name_to_string(account));
+    }
+
+    void bind_host_functions () {
+      auto& h = host_functions;
+
+      h["env.action_data_size"] = [this](const uint64_t*) -> uint64_t { return action_data.size(); };
+      h["env.read_action_data"] = [this](const uint64_t* a) -> uint64_t {
+        uint32_t size = std::min<uint64_t>((uint32_t)a[1], action_data.size());
+        if (size > 0) {
+          std::memcpy(mem(a[0], size), action_data.data(), size);
+        }
+        return (uint32_t)a[1] == 0 ? action_data.size() : size;
+      };
+      h["env.current_receiver"] = [this](const uint64_t*) -> uint64_t { return receiver; };
+
+      h["env.require_auth"] = [this](const uint64_t* a) -> uint64_t { check_auth(a[0]); return 0; };
+      h["env.require_auth2"] = [this](const uint64_t* a) -> uint64_t { check_auth(a[0]); return 0; };
+      h["env.has_auth"] = [this](const uint64_t* a) -> uint64_t {
+        for (auto account : authorizers) {
+          if (account == a[0]) {
+            return 1;
+          }
+        }
+        return 0;
+      };
+      h["env.is_account"] = [](const uint64_t*) -> uint64_t { return 1; };
+      h["env.require_recipient"] = [](const uint64_t*) -> uint64_t { return 0; };
+      h["env.send_inline"] = [this](const uint64_t* a) -> uint64_t {
+        inline_actions.push_back(unpack_action(mem(a[0], (uint32_t)a[1]), (uint32_t)a[1]));
+        return 0;
+      };
+      h["env.current_time"] = [](const uint64_t*) -> uint64_t { return 1546300800000000ull; };
+
+      h["env.eosio_assert"] = [this](const uint64_t* a) -> uint64_t {
+        if ((uint32_t)a[0] == 0) {
+          throw wasm::trap("assertion failure with message: " + c_string(a[1]));
+        }
+        return 0;
+      };
+      h["env.eosio_assert_message"] = [this](const uint64_t* a) -> uint64_t {
+        if ((uint32_t)a[0] == 0) {
+          throw wasm::trap("assertion failure with message: " + std::string((char*)mem(a[1], (uint32_t)a[2]), (uint32_t)a[2]));
+        }
+        return 0;
+      };
+      h["env.eosio_assert_code"] = [](const uint64_t* a) -> uint64_t {
+        if ((uint32_t)a[0] == 0) {
+          throw wasm::trap("assertion failure with error code: " + std::to_string(a[1]));
+        }
+        return 0;
+      };
+      h["env.eosio_exit"] = [](const uint64_t*) -> uint64_t { throw exit_action(); };
+      h["env.abort"] = [](const uint64_t*) -> uint64_t { throw wasm::trap("abort() called"); };
+
+      h["env.prints"] = [this](const uint64_t* a) -> uint64_t { console += c_string(a[0]); return 0; };
+      h["env.prints_l"] = [this](const uint64_t* a) -> uint64_t {
+        console.append((char*)mem(a[0], (uint32_t)a[1]), (uint32_t)a[1]);
+        return 0;
+      };
+      h["env.printi"] = [this](const uint64_t* a) -> uint64_t { console += std::to_string((int64_t)a[0]); return 0; };
+      h["env.printui"] = [this](const uint64_t* a) -> uint64_t { console += std::to_string(a[0]); return 0; };
+      h["env.printn"] = [this](const uint64_t* a) -> uint64_t { console += eos::name_to_string(a[0]); return 0; };
+      h["env.printhex"] = [this](const uint64_t* a) -> uint64_t {
+        uint8_t* p = mem(a[0], (uint32_t)a[1]);
+        console += eos::to_hex(std::vector<char>(p, p + (uint32_t)a[1]));
+        return 0;
+      };
+
+      h["env.memcpy"] = [this](const uint64_t* a) -> uint64_t {
+        uint32_t size = a[2];
+        if (size > 0) {
+          std::memmove(mem(a[0], size), mem(a[1], size), size);
+        }
+        return (uint32_t)a[0];
+      };
+      h["env.memmove"] = h["env.memcpy"];
+      h["env.memset"] = [this](const uint64_t* a) -> uint64_t {
+        uint32_t size = a[2];
+        if (size > 0) {
+          std::memset(mem(a[0], size), (int)a[1], size);
+        }
+        return (uint32_t)a[0];
+      };
+      h["env.memcmp"] = [this](const uint64_t* a) -> uint64_t {
+        uint32_t size = a[2];
+        int cmp = size > 0 ? std::memcmp(mem(a[0], size), mem(a[1], size), size) : 0;
+        return (uint32_t)(cmp < 0 ? -1 : cmp > 0 ? 1 : 0);
+      };
+
+      h["env.db_store_i64"] = [this](const uint64_t* a) -> uint64_t {
+        table_id t { receiver, a[0], a[1] };
+        uint32_t size = a[5];
+        uint8_t* p = mem(a[4], size);
+        table_rows& rows = tables[t];
+        if (rows.count(a[3])) {
+          throw wasm::trap("db_store_i64: primary key " + std::to_string(a[3]) + " already exists");
+        }
+        rows[a[3]] = std::vector<uint8_t>(p, p + size);
+        return (uint32_t)iterator(t, a[3]);
+      };
+      h["env.db_update_i64"] = [this](const uint64_t* a) -> uint64_t {
+        auto& row = row_at(a[0]);
+        if (std::get<0>(row.first) != receiver) {
+          throw wasm::trap("db_update_i64: table is not owned by the receiver");
+        }
+        uint32_t size = a[3];
+        uint8_t* p = mem(a[2], size);
+        tables[row.first][row.second] = std::vector<uint8_t>(p, p + size);
+        return 0;
+      };
+      h["env.db_remove_i64"] = [this](const uint64_t* a) -> uint64_t {
+        auto& row = row_at(a[0]);
+        tables[row.first].erase(row.second);
+        return 0;
+      };
+      h["env.db_get_i64"] = [this](const uint64_t* a) -> uint64_t {
+        auto& row = row_at(a[0]);
+        const std::vector<uint8_t>& value = tables[row.first][row.second];
+        uint32_t size = a[2];
+        if (size == 0) {
+          return value.size();
+        }
+        size = std::min<uint32_t>(size, value.size());
+        std::memcpy(mem(a[1], size), value.data(), size);
+        return size;
+      };
+      h["env.db_next_i64"] = [this](const uint64_t* a) -> uint64_t {
+        int32_t itr = a[0];
+        if (itr < 0) {
+          return (uint32_t)-1;
+        }
+        auto row = row_at(itr);
+        table_rows& rows = tables[row.first];
+        auto next = rows.upper_bound(row.second);
+        if (next == rows.end()) {
+          return (uint32_t)end_iterator(row.first);
+        }
+        std::memcpy(mem(a[1], 8), &next->first, 8);
+        return (uint32_t)iterator(row.first, next->first);
+      };
+      h["env.db_previous_i64"] = [this](const uint64_t* a) -> uint64_t {
+        int32_t itr = a[0];
+        table_id t;
+        table_rows::iterator prev;
+        if (itr < -1) {
+          t = end_tables.at(-2 - itr);
+          table_rows& rows = tables[t];
+          if (rows.empty()) {
+            return (uint32_t)-1;
+          }
+          prev = std::prev(rows.end());
+        } else {
+          auto row = row_at(itr);
+          t = row.first;
+          table_rows& rows = tables[t];
+          prev = rows.find(row.second);
+          if (prev == rows.begin()) {
+            return (uint32_t)-1;
+          }
+          --prev;
+        }
+        std::memcpy(mem(a[1], 8), &prev->first, 8);
+        return (uint32_t)iterator(t, prev->first);
+      };
+
+      //find, lowerbound and upperbound only differ in how they pick the row
+      auto lookup = [this](const uint64_t* a, int mode) -> uint64_t {
+        table_id t { a[0], a[1], a[2] };
+        auto table_itr = tables.find(t);
+        if (table_itr == tables.end()) {
+          return (uint32_t)-1;
+        }
+        table_rows& rows = table_itr->second;
+        table_rows::iterator row = mode == 0 ? rows.find(a[3]) : mode == 1 ? rows.lower_bound(a[3]) : rows.upper_bound(a[3]);
+        if (row == rows.end()) {
+          return (uint32_t)end_iterator(t);
+        }
+        return (uint32_t)iterator(t, row->first);
+      };
+      h["env.db_find_i64"] = [lookup](const uint64_t* a) -> uint64_t { return lookup(a, 0); };
+      h["env.db_lowerbound_i64"] = [lookup](const uint64_t* a) -> uint64_t { return lookup(a, 1); };
+      h["env.db_upperbound_i64"] = [lookup](const uint64_t* a) -> uint64_t { return lookup(a, 2); };
+      h["env.db_end_i64"] = [this](const uint64_t* a) -> uint64_t {
+        table_id t { a[0], a[1], a[2] };
+        if (tables.find(t) == tables.end()) {
+          return (uint32_t)-1;
+        }
+        return (uint32_t)end_iterator(t);
+      };
+    }
+};
@@ -0,0 +1,999 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/* *
+ * wasm_vm.hpp
+ *  a small interpreter for WebAssembly 1.0 (MVP) modules, the kind eosio-cpp produces, that counts every instruction
+ *  it executes.  It makes no attempt to be fast - the instruction count is the point, since unlike wall-clock time it
+ *  is the same on every run and every machine.
+ *
+ *  Imports are resolved by "module.name" against a map of host functions; an import with no host function only traps
+ *  when it is actually called.  Values live on the stack as raw 64 bit patterns (f32 in the low 32 bits).
+ * */
+
+namespace wasm {
+
+struct trap : std::runtime_error {
+  using std::runtime_error::runtime_error;
+};
+
+const uint32_t PAGE_SIZE = 65536;
+const int MAX_CALL_DEPTH = 1024;
+
+const uint8_t TYPE_I32 = 0x7F;
+const uint8_t TYPE_I64 = 0x7E;
+const uint8_t TYPE_F32 = 0x7D;
+const uint8_t TYPE_F64 = 0x7C;
+const uint8_t BLOCK_EMPTY = 0x40;
+
+//host functions get a pointer to their arguments; the return value is ignored for functions without a result
+using host_function = std::function<uint64_t (const uint64_t* args)>;
+
+struct func_type {
+  std::vector<uint8_t> params;
+  std::vector<uint8_t> results;
+
+  bool operator== (const func_type& other) const { return params == other.params && results == other.results; }
+};
+
+struct function {
+  uint32_t type_index = 0;
+  bool imported = false;
+  std::string import_name; //"module.name"
+  std::vector<uint8_t> locals; //declared locals, after the parameters
+  uint32_t code_begin = 0;
+  uint32_t code_end = 0;
+
+  //offsets of the matching 'else' and 'end' opcodes for each block, loop and if opcode; 'end' is also recorded for
+  //each 'else', so the true branch of an if can jump past the false one
+  std::unordered_map<uint32_t, uint32_t> else_of;
+  std::unordered_map<uint32_t, uint32_t> end_of;
+};
+
+struct global_def {
+  uint8_t type;
+  bool is_mutable;
+  uint64_t init;
+};
+
+struct segment {
+  uint32_t offset;
+  uint32_t begin; //offset of the contents in the module bytes
+  uint32_t size;
+};
+
+struct element_segment {
+  uint32_t offset;
+  std::vector<uint32_t> functions;
+};
+
+/* *
+ * reader
+ *  LEB128 and fixed width decoding over the module bytes
+ * */
+struct reader {
+  const std::vector<uint8_t>& bytes;
+  uint32_t pos;
+
+  uint8_t u8 () {
+    if (pos >= bytes.size()) {
+      throw trap("unexpected end of module");
+    }
+    return bytes[pos++];
+  }
+
+  uint64_t uleb () {
+    uint64_t result = 0;
+    int shift = 0;
+    uint8_t b;
+    do {
+      b = u8();
+      result |= (uint64_t)(b & 0x7F) << shift;
+      shift += 7;
+    } while (b & 0x80);
+    return result;
+  }
+
+  int64_t sleb () {
+    int64_t result = 0;
+    int shift = 0;
+    uint8_t b;
+    do {
+      b = u8();
+      result |= (int64_t)(b & 0x7F) << shift;
+      shift += 7;
+    } while (b & 0x80);
+    if (shift < 64 && (b & 0x40)) {
+      result |= -((int64_t)1 << shift);
+    }
+    return result;
+  }
+
+  uint64_t fixed (int size) {
+    uint64_t result = 0;
+    for (int i = 0; i < size; ++i) {
+      result |= (uint64_t)u8() << (8 * i);
+    }
+    return result;
+  }
+
+  std::string str () {
+    uint32_t size = uleb();
+    if (pos + size > bytes.size()) {
+      throw trap("unexpected end of module");
+    }
+    std::string s(bytes.begin() + pos, bytes.begin() + pos + size);
+    pos += size;
+    return s;
+  }
+};
+
+/* *
+ * skip_immediates
+ *  moves past the immediates of an opcode, throwing for anything outside the MVP instruction set
+ * */
+inline void skip_immediates (
+  reader& r,
+  uint8_t op
+) {
+  switch (op) {
+    case 0x02 : case 0x03 : case 0x04 : {
+      uint8_t type = r.u8();
+      if (type != BLOCK_EMPTY && type != TYPE_I32 && type != TYPE_I64 && type != TYPE_F32 && type != TYPE_F64) {
+        throw trap("unsupported block type");
+      }
+      break;
+    }
+    case 0x0C : case 0x0D : case 0x10 : case 0x20 : case 0x21 : case 0x22 : case 0x23 : case 0x24 :
+      r.uleb();
+      break;
+    case 0x0E : {
+      uint32_t count = r.uleb();
+      for (uint32_t i = 0; i <= count; ++i) {
+        r.uleb();
+      }
+      break;
+    }
+    case 0x11 :
+      r.uleb();
+      r.u8();
+      break;
+    case 0x3F : case 0x40 :
+      r.u8();
+      break;
+    case 0x41 : case 0x42 :
+      r.sleb();
+      break;
+    case 0x43 :
+      r.fixed(4);
+      break;
+    case 0x44 :
+      r.fixed(8);
+      break;
+    default :
+      if (op >= 0x28 && op <= 0x3E) {
+        r.uleb();
+        r.uleb();
+      } else if (!(op <= 0x01 || op == 0x05 || op == 0x0B || op == 0x0F || op == 0x1A || op == 0x1B || (op >= 0x45 && op <= 0xC4))) {
+        throw trap("unsupported opcode " + std::to_string(op) + " at offset " + std::to_string(r.pos - 1));
+      }
+  }
+}
+
+/* *
+ * module
+ *  a decoded module.  Function bodies stay in the original bytes; the interpreter only needs the block structure
+ *  worked out ahead of time.
+ * */
+struct module {
+  std::vector<uint8_t> bytes;
+  std::vector<func_type> types;
+  std::vector<function> functions;
+  std::vector<global_def> globals;
+  std::vector<segment> data;
+  std::vector<element_segment> elements;
+  std::unordered_map<std::string, uint32_t> exports;
+  uint32_t table_size = 0;
+  bool has_memory = false;
+  uint32_t memory_pages = 0;
+  uint32_t memory_max_pages = PAGE_SIZE;
+  int64_t start = -1;
+
+  explicit module (
+    std::vector<uint8_t> module_bytes
+  ) : bytes(std::move(module_bytes)) {
+    reader r { bytes, 0 };
+    if (r.fixed(4) != 0x6D736100 || r.fixed(4) != 1) {
+      throw trap("not a version 1 wasm module");
+    }
+
+    std::vector<uint32_t> function_types;
+    while (r.pos < bytes.size()) {
+      uint8_t id = r.u8();
+      uint32_t size = r.uleb();
+      uint32_t end = r.pos + size;
+
+      switch (id) {
+        case 1 : {
+          uint32_t count = r.uleb();
+          for (uint32_t i = 0; i < count; ++i) {
+            if (r.u8() != 0x60) {
+              throw trap("malformed function type");
+            }
+            func_type t;
+            for (uint32_t n = r.uleb(); n > 0; --n) { t.params.push_back(r.u8()); }
+            for (uint32_t n = r.uleb(); n > 0; --n) { t.results.push_back(r.u8()); }
+            types.push_back(t);
+          }
+          break;
+        }
+        case 2 : {
+          uint32_t count = r.uleb();
+          for (uint32_t i = 0; i < count; ++i) {
+            std::string module_name = r.str();
+            std::string name = r.str();
+            if (r.u8() != 0) {
+              throw trap("only function imports are supported (" + module_name + "." + name + ")");
+            }
+            function f;
+            f.imported = true;
+            f.import_name = module_name + "." + name;
+            f.type_index = r.uleb();
+            functions.push_back(f);
+          }
+          break;
+        }
+        case 3 : {
+          for (uint32_t n = r.uleb(); n > 0; --n) {
+            function_types.push_back(r.uleb());
+          }
+          break;
+        }
+        case 4 : {
+          if (r.uleb() != 1 || r.u8() != 0x70) {
+            throw trap("unsupported table");
+          }
+          uint8_t flags = r.u8();
+          table_size = r.uleb();
+          if (flags & 1) {
+            r.uleb();
+          }
+          break;
+        }
+        case 5 : {
+          if (r.uleb() != 1) {
+            throw trap("unsupported memory");
+          }
+          uint8_t flags = r.u8();
+          has_memory = true;
+          memory_pages = r.uleb();
+          if (flags & 1) {
+            memory_max_pages = r.uleb();
+          }
+          break;
+        }
+        case 6 : {
+          uint32_t count = r.uleb();
+          for (uint32_t i = 0; i < count; ++i) {
+            global_def g;
+            g.type = r.u8();
+            g.is_mutable = r.u8() != 0;
+            g.init = init_expression(r);
+            globals.push_back(g);
+          }
+          break;
+        }
+        case 7 : {
+          uint32_t count = r.uleb();
+          for (uint32_t i = 0; i < count; ++i) {
+            std::string name = r.str();
+            uint8_t kind = r.u8();
+            uint32_t index = r.uleb();
+            if (kind == 0) {
+              exports[name] = index;
+            }
+          }
+          break;
+        }
+        case 8 :
+          start = r.uleb();
+          break;
+        case 9 : {
+          uint32_t count = r.uleb();
+          for (uint32_t i = 0; i < count; ++i) {
+            if (r.uleb() != 0) {
+              throw trap("unsupported element segment");
+            }
+            element_segment e;
+            e.offset = init_expression(r);
+            for (uint32_t n = r.uleb(); n > 0; --n) {
+              e.functions.push_back(r.uleb());
+            }
+            elements.push_back(e);
+          }
+          break;
+        }
+        case 10 : {
+          uint32_t count = r.uleb();
+          if (count != function_types.size()) {
+            throw trap("function and code section sizes differ");
+          }
+          for (uint32_t i = 0; i < count; ++i) {
+            uint32_t body_size = r.uleb();
+            uint32_t body_end = r.pos + body_size;
+            function f;
+            f.type_index = function_types[i];
+            for (uint32_t n = r.uleb(); n > 0; --n) {
+              uint32_t repeat = r.uleb();
+              uint8_t type = r.u8();
+              f.locals.insert(f.locals.end(), repeat, type);
+            }
+            f.code_begin = r.pos;
+            f.code_end = body_end;
+            map_blocks(f);
+            functions.push_back(std::move(f));
+            r.pos = body_end;
+          }
+          break;
+        }
+        case 11 : {
+          uint32_t count = r.uleb();
+          for (uint32_t i = 0; i < count; ++i) {
+            if (r.uleb() != 0) {
+              throw trap("unsupported data segment");
+            }
+            segment s;
+            s.offset = init_expression(r);
+            s.size = r.uleb();
+            s.begin = r.pos;
+            r.pos += s.size;
+            data.push_back(s);
+          }
+          break;
+        }
+      }
+      r.pos = end;
+    }
+
+    for (auto& f : functions) {
+      if (f.type_index >= types.size()) {
+        throw trap("bad function type index");
+      }
+    }
+  }
+
+  private:
+    //constant expressions; global.get can only refer to an earlier global, since imported globals are unsupported
+    uint64_t init_expression (
+      reader& r
+    ) {
+      uint64_t value = 0;
+      uint8_t op = r.u8();
+      switch (op) {
+        case 0x41 : value = (uint32_t)r.sleb(); break;
+        case 0x42 : value = r.sleb(); break;
+        case 0x43 : value = r.fixed(4); break;
+        case 0x44 : value = r.fixed(8); break;
+        case 0x23 : {
+          uint32_t index = r.uleb();
+          if (index >= globals.size()) {
+            throw trap("bad global in constant expression");
+          }
+          value = globals[index].init;
+          break;
+        }
+        default :
+          throw trap("unsupported constant expression");
+      }
+      if (r.u8() != 0x0B) {
+        throw trap("unterminated constant expression");
+      }
+      return value;
+    }
+
+    void map_blocks (
+      function& f
+    ) {
+      reader r { bytes, f.code_begin };
+      std::vector<uint32_t> open;
+      while (r.pos < f.code_end) {
+        uint32_t at = r.pos;
+        uint8_t op = r.u8();
+        if (op == 0x02 || op == 0x03 || op == 0x04) {
+          open.push_back(at);
+        } else if (op == 0x05) {
+          if (open.empty()) {
+            throw trap("else outside of an if");
+          }
+          f.else_of[open.back()] = at;
+        } else if (op == 0x0B && !open.empty()) {
+          f.end_of[open.back()] = at;
+          auto else_itr = f.else_of.find(open.back());
+          if (else_itr != f.else_of.end()) {
+            f.end_of[else_itr->second] = at;
+          }
+          open.pop_back();
+        }
+        skip_immediates(r, op);
+      }
+      if (!open.empty() || bytes[f.code_end - 1] != 0x0B) {
+        throw trap("unbalanced blocks in function body");
+      }
+    }
+};
+
+/* *
+ * instance
+ *  memory, globals and table for one run of a module.  Instances are cheap to create, so making a fresh one per call
+ *  gives every call the same starting state.
+ * */
+class instance {
+  public:
+    std::vector<uint8_t> memory;
+    uint64_t instructions = 0;
+
+    instance (
+      const module& m,
+      const std::unordered_map<std::string, host_function>& host_functions
+    ) : mod(m) {
+      for (auto& f : mod.functions) {
+        if (!f.imported) {
+          imports.emplace_back();
+          continue;
+        }
+        auto itr = host_functions.find(f.import_name);
+        if (itr != host_functions.end()) {
+          imports.push_back(itr->second);
+        } else {
+          std::string name = f.import_name;
+          imports.push_back([name](const uint64_t*) -> uint64_t { throw trap("unresolved import " + name + " called"); });
+        }
+      }
+
+      for (auto& g : mod.globals) {
+        globals.push_back(g.init);
+      }
+
+      memory.assign((size_t)mod.memory_pages * PAGE_SIZE, 0);
+      for (auto& s : mod.data) {
+        std::memcpy(memory_at(s.offset, s.size), mod.bytes.data() + s.begin, s.size);
+      }
+
+      table.assign(mod.table_size, -1);
+      for (auto& e : mod.elements) {
+        if ((uint64_t)e.offset + e.functions.size() > table.size()) {
+          throw trap("element segment out of bounds");
+        }
+        for (size_t i = 0; i < e.functions.size(); ++i) {
+          table[e.offset + i] = e.functions[i];
+        }
+      }
+
+      if (mod.start >= 0) {
+        invoke(mod.start);
+      }
+    }
+
+    /* *
+     * call
+     *  runs an exported function, returning its result (0 if it has none)
+     * */
+    uint64_t call (
+      const std::string& export_name,
+      const std::vector<uint64_t>& args
+    ) {
+      auto itr = mod.exports.find(export_name);
+      if (itr == mod.exports.end()) {
+        throw trap("no exported function " + export_name);
+      }
+      const func_type& t = mod.types[mod.functions[itr->second].type_index];
+      if (t.params.size() != args.size()) {
+        throw trap("wrong number of arguments for " + export_name);
+      }
+      stack.clear();
+      depth = 0;
+      stack.insert(stack.end(), args.begin(), args.end());
+      invoke(itr->second);
+      return t.results.empty() ? 0 : stack.back();
+    }
+
+    uint8_t* memory_at (
+      uint64_t address,
+      uint64_t size
+    ) {
+      if (address + size > memory.size()) {
+        throw trap("out of bounds memory access");
+      }
+      return memory.data() + address;
+    }
+
+  private:
+    struct label {
+      uint32_t continuation; //where a branch to this label goes
+      uint32_t height;       //stack height when the block was entered
+      uint8_t arity;         //values a branch carries
+    };
+
+    const module& mod;
+    std::vector<host_function> imports;
+    std::vector<uint64_t> globals;
+    std::vector<int64_t> table;
+    std::vector<uint64_t> stack;
+    int depth = 0;
+
+    static float f32 (uint64_t v) { float f; uint32_t b = (uint32_t)v; std::memcpy(&f, &b, 4); return f; }
+    static double f64 (uint64_t v) { double d; std::memcpy(&d, &v, 8); return d; }
+    static uint64_t bits (float f) { uint32_t b; std::memcpy(&b, &f, 4); return b; }
+    static uint64_t bits (double d) { uint64_t b; std::memcpy(&b, &d, 8); return b; }
+
+    template <typename F>
+    static F fmin (F a, F b) {
+      if (std::isnan(a) || std::isnan(b)) { return std::numeric_limits<F>::quiet_NaN(); }
+      if (a == b) { return std::signbit(a) ? a : b; }
+      return a < b ? a : b;
+    }
+
+    template <typename F>
+    static F fmax (F a, F b) {
+      if (std::isnan(a) || std::isnan(b)) { return std::numeric_limits<F>::quiet_NaN(); }
+      if (a == b) { return std::signbit(a) ? b : a; }
+      return a > b ? a : b;
+    }
+
+    //float to integer truncation traps on NaN and on values outside (low, high)
+    static double truncate (double x, double low, double high) {
+      if (std::isnan(x)) { throw trap("invalid conversion to integer"); }
+      if (!(x > low && x < high)) { throw trap("integer overflow"); }
+      return std::trunc(x);
+    }
+
+    static uint32_t rotl32 (uint32_t v, uint32_t n) { n &= 31; return n ? (v << n) | (v >> (32 - n)) : v; }
+    static uint64_t rotl64 (uint64_t v, uint64_t n) { n &= 63; return n ? (v << n) | (v >> (64 - n)) : v; }
+
+    uint64_t pop () {
+      uint64_t v = stack.back();
+      stack.pop_back();
+      return v;
+    }
+
+    void push (uint64_t v) { stack.push_back(v); }
+
+    //keeps the top 'arity' values and drops everything above 'height' below them
+    void unwind (uint32_t height, uint8_t arity) {
+      if (arity > 0) {
+        std::memmove(&stack[height], &stack[stack.size() - arity], arity * sizeof(uint64_t));
+      }
+      stack.resize(height + arity);
+    }
+
+    void invoke (
+      uint32_t function_index
+    ) {
+      const function& f = mod.functions[function_index];
+      const func_type& t = mod.types[f.type_index];
+      uint8_t result_arity = t.results.size();
+
+      if (f.imported) {
+        size_t argc = t.params.size();
+        std::vector<uint64_t> args(stack.end() - argc, stack.end());
+        stack.resize(stack.size() - argc);
+        uint64_t result = imports[function_index](args.data());
+        if (result_arity) {
+          push(result);
+        }
+        return;
+      }
+
+      if (++depth > MAX_CALL_DEPTH) {
+        throw trap("call stack exhausted");
+      }
+
+      std::vector<uint64_t> locals(t.params.size() + f.locals.size(), 0);
+      for (size_t i = t.params.size(); i > 0; --i) {
+        locals[i - 1] = pop();
+      }
+      uint32_t base = stack.size();
+
+      std::vector<label> labels;
+      labels.push_back(label { f.code_end - 1, base, result_arity });
+
+      const std::vector<uint8_t>& bytes = mod.bytes;
+      reader r { bytes, f.code_begin };
+
+      auto branch = [&](uint32_t n) {
+        labels.resize(labels.size() - n);
+        label& target = labels.back();
+        unwind(target.height, target.arity);
+        r.pos = target.continuation;
+      };
+
+      auto load_address = [&](uint32_t size) -> uint8_t* {
+        r.uleb();
+        uint64_t offset = r.uleb();
+        return memory_at((uint64_t)(uint32_t)pop() + offset, size);
+      };
+
+      auto store_address = [&](uint32_t size, uint64_t& value) -> uint8_t* {
+        r.uleb();
+        uint64_t offset = r.uleb();
+        value = pop();
+        return memory_at((uint64_t)(uint32_t)pop() + offset, size);
+      };
+
+      #define WASM_LOAD(TYPE, WIDEN) { TYPE v; std::memcpy(&v, load_address(sizeof(TYPE)), sizeof(TYPE)); push((uint64_t)(WIDEN)v); break; }
+      #define WASM_STORE(TYPE) { uint64_t v; uint8_t* p = store_address(sizeof(TYPE), v); TYPE n = (TYPE)v; std::memcpy(p, &n, sizeof(TYPE)); break; }
+      #define WASM_I32_BINARY(EXPR) { uint32_t b = pop(); uint32_t a = pop(); push((uint32_t)(EXPR)); break; }
+      #define WASM_I64_BINARY(EXPR) { uint64_t b = pop(); uint64_t a = pop(); push((uint64_t)(EXPR)); break; }
+      #define WASM_F32_BINARY(EXPR) { float b = f32(pop()); float a = f32(pop()); push(bits((float)(EXPR))); break; }
+      #define WASM_F64_BINARY(EXPR) { double b = f64(pop()); double a = f64(pop()); push(bits((double)(EXPR))); break; }
+      #define WASM_F32_COMPARE(EXPR) { float b = f32(pop()); float a = f32(pop()); push((EXPR) ? 1 : 0); break; }
+      #define WASM_F64_COMPARE(EXPR) { double b = f64(pop()); double a = f64(pop()); push((EXPR) ? 1 : 0); break; }
+      #define WASM_F32_UNARY(EXPR) { float a = f32(pop()); push(bits((float)(EXPR))); break; }
+      #define WASM_F64_UNARY(EXPR) { double a = f64(pop()); push(bits((double)(EXPR))); break; }
+
+      while (true) {
+        uint32_t at = r.pos;
+        uint8_t op = bytes[r.pos++];
+        ++instructions;
+
+        switch (op) {
+          case 0x00 : throw trap("unreachable executed");
+          case 0x01 : break;
+
+          case 0x02 : case 0x03 : {
+            uint8_t type = r.u8();
+            uint8_t arity = type == BLOCK_EMPTY ? 0 : 1;
+            if (op == 0x02) {
+              labels.push_back(label { f.end_of.at(at), (uint32_t)stack.size(), arity });
+            } else {
+              labels.push_back(label { r.pos, (uint32_t)stack.size(), 0 });
+            }
+            break;
+          }
+          case 0x04 : {
+            uint8_t type = r.u8();
+            uint8_t arity = type == BLOCK_EMPTY ? 0 : 1;
+            bool condition = (uint32_t)pop() != 0;
+            uint32_t end = f.end_of.at(at);
+            if (condition) {
+              labels.push_back(label { end, (uint32_t)stack.size(), arity });
+            } else {
+              auto else_itr = f.else_of.find(at);
+              if (else_itr != f.else_of.end()) {
+                labels.push_back(label { end, (uint32_t)stack.size(), arity });
+                r.pos = else_itr->second + 1;
+              } else {
+                r.pos = end + 1;
+              }
+            }
+            break;
+          }
+          case 0x05 :
+            //end of the true branch of an if
+            r.pos = f.end_of.at(at);
+            break;
+          case 0x0B :
+            labels.pop_back();
+            if (labels.empty()) {
+              --depth;
+              return;
+            }
+            break;
+
+          case 0x0C : branch(r.uleb()); break;
+          case 0x0D : {
+            uint32_t n = r.uleb();
+            if ((uint32_t)pop() != 0) {
+              branch(n);
+            }
+            break;
+          }
+          case 0x0E : {
+            uint32_t count = r.uleb();
+            uint32_t index = pop();
+            uint32_t n = 0;
+            for (uint32_t i = 0; i <= count; ++i) {
+              uint32_t target = r.uleb();
+              if (i == index || i == count) {
+                n = target;
+                break;
+              }
+            }
+            branch(n);
+            break;
+          }
+          case 0x0F :
+            unwind(base, result_arity);
+            --depth;
+            return;
+
+          case 0x10 : invoke(r.uleb()); break;
+          case 0x11 : {
+            uint32_t type_index = r.uleb();
+            r.u8();
+            uint32_t element = pop();
+            if (element >= table.size() || table[element] < 0) {
+              throw trap("undefined table element");
+            }
+            if (!(mod.types[mod.functions[table[element]].type_index] == mod.types[type_index])) {
+              throw trap("indirect call type mismatch");
+            }
+            invoke(table[element]);
+            break;
+          }
+
+          case 0x1A : pop(); break;
+          case 0x1B : {
+            uint32_t condition = pop();
+            uint64_t b = pop();
+            uint64_t a = pop();
+            push(condition ? a : b);
+            break;
+          }
+
+          case 0x20 : push(locals[r.uleb()]); break;
+          case 0x21 : locals[r.uleb()] = pop(); break;
+          case 0x22 : locals[r.uleb()] = stack.back(); break;
+          case 0x23 : push(globals[r.uleb()]); break;
+          case 0x24 : globals[r.uleb()] = pop(); break;
+
+          case 0x28 : WASM_LOAD(uint32_t, uint32_t)
+          case 0x29 : WASM_LOAD(uint64_t, uint64_t)
+          case 0x2A : WASM_LOAD(uint32_t, uint32_t)
+          case 0x2B : WASM_LOAD(uint64_t, uint64_t)
+          case 0x2C : WASM_LOAD(int8_t, uint32_t)
+          case 0x2D : WASM_LOAD(uint8_t, uint32_t)
+          case 0x2E : WASM_LOAD(int16_t, uint32_t)
+          case 0x2F : WASM_LOAD(uint16_t, uint32_t)
+          case 0x30 : WASM_LOAD(int8_t, int64_t)
+          case 0x31 : WASM_LOAD(uint8_t, uint64_t)
+          case 0x32 : WASM_LOAD(int16_t, int64_t)
+          case 0x33 : WASM_LOAD(uint16_t, uint64_t)
+          case 0x34 : WASM_LOAD(int32_t, int64_t)
+          case 0x35 : WASM_LOAD(uint32_t, uint64_t)
+          case 0x36 : WASM_STORE(uint32_t)
+          case 0x37 : WASM_STORE(uint64_t)
+          case 0x38 : WASM_STORE(uint32_t)
+          case 0x39 : WASM_STORE(uint64_t)
+          case 0x3A : WASM_STORE(uint8_t)
+          case 0x3B : WASM_STORE(uint16_t)
+          case 0x3C : WASM_STORE(uint8_t)
+          case 0x3D : WASM_STORE(uint16_t)
+          case 0x3E : WASM_STORE(uint32_t)
+
+          case 0x3F :
+            r.u8();
+            push(memory.size() / PAGE_SIZE);
+            break;
+          case 0x40 : {
+            r.u8();
+            uint32_t grow = pop();
+            uint64_t pages = memory.size() / PAGE_SIZE;
+            if (pages + grow > mod.memory_max_pages) {
+              push((uint32_t)-1);
+            } else {
+              memory.resize((pages + grow) * PAGE_SIZE, 0);
+              push(pages);
+            }
+            break;
+          }
+
+          case 0x41 : push((uint32_t)r.sleb()); break;
+          case 0x42 : push((uint64_t)r.sleb()); break;
+          case 0x43 : push(r.fixed(4)); break;
+          case 0x44 : push(r.fixed(8)); break;
+
+          case 0x45 : push((uint32_t)pop() == 0 ? 1 : 0); break;
+          case 0x46 : WASM_I32_BINARY(a == b)
+          case 0x47 : WASM_I32_BINARY(a != b)
+          case 0x48 : WASM_I32_BINARY((int32_t)a < (int32_t)b)
+          case 0x49 : WASM_I32_BINARY(a < b)
+          case 0x4A : WASM_I32_BINARY((int32_t)a > (int32_t)b)
+          case 0x4B : WASM_I32_BINARY(a > b)
+          case 0x4C : WASM_I32_BINARY((int32_t)a <= (int32_t)b)
+          case 0x4D : WASM_I32_BINARY(a <= b)
+          case 0x4E : WASM_I32_BINARY((int32_t)a >= (int32_t)b)
+          case 0x4F : WASM_I32_BINARY(a >= b)
+
+          case 0x50 : push(pop() == 0 ? 1 : 0); break;
+          case 0x51 : WASM_I64_BINARY(a == b)
+          case 0x52 : WASM_I64_BINARY(a != b)
+          case 0x53 : WASM_I64_BINARY((int64_t)a < (int64_t)b)
+          case 0x54 : WASM_I64_BINARY(a < b)
+          case 0x55 : WASM_I64_BINARY((int64_t)a > (int64_t)b)
+          case 0x56 : WASM_I64_BINARY(a > b)
+          case 0x57 : WASM_I64_BINARY((int64_t)a <= (int64_t)b)
+          case 0x58 : WASM_I64_BINARY(a <= b)
+          case 0x59 : WASM_I64_BINARY((int64_t)a >= (int64_t)b)
+          case 0x5A : WASM_I64_BINARY(a >= b)
+
+          case 0x5B : WASM_F32_COMPARE(a == b)
+          case 0x5C : WASM_F32_COMPARE(a != b)
+          case 0x5D : WASM_F32_COMPARE(a < b)
+          case 0x5E : WASM_F32_COMPARE(a > b)
+          case 0x5F : WASM_F32_COMPARE(a <= b)
+          case 0x60 : WASM_F32_COMPARE(a >= b)
+          case 0x61 : WASM_F64_COMPARE(a == b)
+          case 0x62 : WASM_F64_COMPARE(a != b)
+          case 0x63 : WASM_F64_COMPARE(a < b)
+          case 0x64 : WASM_F64_COMPARE(a > b)
+          case 0x65 : WASM_F64_COMPARE(a <= b)
+          case 0x66 : WASM_F64_COMPARE(a >= b)
+
+          case 0x67 : { uint32_t a = pop(); push(a == 0 ? 32 : __builtin_clz(a)); break; }
+          case 0x68 : { uint32_t a = pop(); push(a == 0 ? 32 : __builtin_ctz(a)); break; }
+          case 0x69 : push(__builtin_popcount((uint32_t)pop())); break;
+          case 0x6A : WASM_I32_BINARY(a + b)
+          case 0x6B : WASM_I32_BINARY(a - b)
+          case 0x6C : WASM_I32_BINARY(a * b)
+          case 0x6D : {
+            int32_t b = pop();
+            int32_t a = pop();
+            if (b == 0) { throw trap("integer divide by zero"); }
+            if (a == std::numeric_limits<int32_t>::min() && b == -1) { throw trap("integer overflow"); }
+            push((uint32_t)(a / b));
+            break;
+          }
+          case 0x6E : {
+            uint32_t b = pop();
+            uint32_t a = pop();
+            if (b == 0) { throw trap("integer divide by zero"); }
+            push(a / b);
+            break;
+          }
+          case 0x6F : {
+            int32_t b = pop();
+            int32_t a = pop();
+            if (b == 0) { throw trap("integer divide by zero"); }
+            push(b == -1 ? 0 : (uint32_t)(a % b));
+            break;
+          }
+          case 0x70 : {
+            uint32_t b = pop();
+            uint32_t a = pop();
+            if (b == 0) { throw trap("integer divide by zero"); }
+            push(a % b);
+            break;
+          }
+          case 0x71 : WASM_I32_BINARY(a & b)
+          case 0x72 : WASM_I32_BINARY(a | b)
+          case 0x73 : WASM_I32_BINARY(a ^ b)
+          case 0x74 : WASM_I32_BINARY(a << (b & 31))
+          case 0x75 : WASM_I32_BINARY((int32_t)a >> (b & 31))
+          case 0x76 : WASM_I32_BINARY(a >> (b & 31))
+          case 0x77 : WASM_I32_BINARY(rotl32(a, b))
+          case 0x78 : WASM_I32_BINARY(rotl32(a, 32 - (b & 31)))
+
+          case 0x79 : { uint64_t a = pop(); push(a == 0 ? 64 : __builtin_clzll(a)); break; }
+          case 0x7A : { uint64_t a = pop(); push(a == 0 ? 64 : __builtin_ctzll(a)); break; }
+          case 0x7B : push(__builtin_popcountll(pop())); break;
+          case 0x7C : WASM_I64_BINARY(a + b)
+          case 0x7D : WASM_I64_BINARY(a - b)
+          case 0x7E : WASM_I64_BINARY(a * b)
+          case 0x7F : {
+            int64_t b = pop();
+            int64_t a = pop();
+            if (b == 0) { throw trap("integer divide by zero"); }
+            if (a == std::numeric_limits<int64_t>::min() && b == -1) { throw trap("integer overflow"); }
+            push((uint64_t)(a / b));
+            break;
+          }
+          case 0x80 : {
+            uint64_t b = pop();
+            uint64_t a = pop();
+            if (b == 0) { throw trap("integer divide by zero"); }
+            push(a / b);
+            break;
+          }
+          case 0x81 : {
+            int64_t b = pop();
+            int64_t a = pop();
+            if (b == 0) { throw trap("integer divide by zero"); }
+            push(b == -1 ? 0 : (uint64_t)(a % b));
+            break;
+          }
+          case 0x82 : {
+            uint64_t b = pop();
+            uint64_t a = pop();
+            if (b == 0) { throw trap("integer divide by zero"); }
+            push(a % b);
+            break;
+          }
+          case 0x83 : WASM_I64_BINARY(a & b)
+          case 0x84 : WASM_I64_BINARY(a | b)
+          case 0x85 : WASM_I64_BINARY(a ^ b)
+          case 0x86 : WASM_I64_BINARY(a << (b & 63))
+          case 0x87 : WASM_I64_BINARY((int64_t)a >> (b & 63))
+          case 0x88 : WASM_I64_BINARY(a >> (b & 63))
+          case 0x89 : WASM_I64_BINARY(rotl64(a, b))
+          case 0x8A : WASM_I64_BINARY(rotl64(a, 64 - (b & 63)))
+
+          case 0x8B : WASM_F32_UNARY(std::fabs(a))
+          case 0x8C : WASM_F32_UNARY(-a)
+          case 0x8D : WASM_F32_UNARY(std::ceil(a))
+          case 0x8E : WASM_F32_UNARY(std::floor(a))
+          case 0x8F : WASM_F32_UNARY(std::trunc(a))
+          case 0x90 : WASM_F32_UNARY(std::nearbyint(a))
+          case 0x91 : WASM_F32_UNARY(std::sqrt(a))
+          case 0x92 : WASM_F32_BINARY(a + b)
+          case 0x93 : WASM_F32_BINARY(a - b)
+          case 0x94 : WASM_F32_BINARY(a * b)
+          case 0x95 : WASM_F32_BINARY(a / b)
+          case 0x96 : WASM_F32_BINARY(fmin(a, b))
+          case 0x97 : WASM_F32_BINARY(fmax(a, b))
+          case 0x98 : WASM_F32_BINARY(std::copysign(a, b))
+
+          case 0x99 : WASM_F64_UNARY(std::fabs(a))
+          case 0x9A : WASM_F64_UNARY(-a)
+          case 0x9B : WASM_F64_UNARY(std::ceil(a))
+          case 0x9C : WASM_F64_UNARY(std::floor(a))
+          case 0x9D : WASM_F64_UNARY(std::trunc(a))
+          case 0x9E : WASM_F64_UNARY(std::nearbyint(a))
+          case 0x9F : WASM_F64_UNARY(std::sqrt(a))
+          case 0xA0 : WASM_F64_BINARY(a + b)
+          case 0xA1 : WASM_F64_BINARY(a - b)
+          case 0xA2 : WASM_F64_BINARY(a * b)
+          case 0xA3 : WASM_F64_BINARY(a / b)
+          case 0xA4 : WASM_F64_BINARY(fmin(a, b))
+          case 0xA5 : WASM_F64_BINARY(fmax(a, b))
+          case 0xA6 : WASM_F64_BINARY(std::copysign(a, b))
+
+          case 0xA7 : push((uint32_t)pop()); break;
+          case 0xA8 : push((uint32_t)(int32_t)truncate(f32(pop()), -2147483649.0, 2147483648.0)); break;
+          case 0xA9 : push((uint32_t)truncate(f32(pop()), -1.0, 4294967296.0)); break;
+          case 0xAA : push((uint32_t)(int32_t)truncate(f64(pop()), -2147483649.0, 2147483648.0)); break;
+          case 0xAB : push((uint32_t)truncate(f64(pop()), -1.0, 4294967296.0)); break;
+          case 0xAC : push((uint64_t)(int64_t)(int32_t)pop()); break;
+          case 0xAD : push((uint32_t)pop()); break;
+          case 0xAE : push((uint64_t)(int64_t)truncate(f32(pop()), -9223372036854777856.0, 9223372036854775808.0)); break;
+          case 0xAF : push((uint64_t)truncate(f32(pop()), -1.0, 18446744073709551616.0)); break;
+          case 0xB0 : push((uint64_t)(int64_t)truncate(f64(pop()), -9223372036854777856.0, 9223372036854775808.0)); break;
+          case 0xB1 : push((uint64_t)truncate(f64(pop()), -1.0, 18446744073709551616.0)); break;
+          case 0xB2 : push(bits((float)(int32_t)pop())); break;
+          case 0xB3 : push(bits((float)(uint32_t)pop())); break;
+          case 0xB4 : push(bits((float)(int64_t)pop())); break;
+          case 0xB5 : push(bits((float)pop())); break;
+          case 0xB6 : push(bits((float)f64(pop()))); break;
+          case 0xB7 : push(bits((double)(int32_t)pop())); break;
+          case 0xB8 : push(bits((double)(uint32_t)pop())); break;
+          case 0xB9 : push(bits((double)(int64_t)pop())); break;
+          case 0xBA : push(bits((double)pop())); break;
+          case 0xBB : push(bits((double)f32(pop()))); break;
+          case 0xBC : case 0xBD : case 0xBE : case 0xBF :
+            //reinterpretations leave the bits alone
+            break;
+
+          case 0xC0 : push((uint32_t)(int32_t)(int8_t)pop()); break;
+          case 0xC1 : push((uint32_t)(int32_t)(int16_t)pop()); break;
+          case 0xC2 : push((uint64_t)(int64_t)(int8_t)pop()); break;
+          case 0xC3 : push((uint64_t)(int64_t)(int16_t)pop()); break;
+          case 0xC4 : push((uint64_t)(int64_t)(int32_t)pop()); break;
+
+          default :
+            throw trap("unsupported opcode " + std::to_string(op));
+        }
+      }
+
+      #undef WASM_LOAD
+      #undef WASM_STORE
+      #undef WASM_I32_BINARY
+      #undef WASM_I64_BINARY
+      #undef WASM_F32_BINARY
+      #undef WASM_F64_BINARY
+      #undef WASM_F32_COMPARE
+      #undef WASM_F64_COMPARE
+      #undef WASM_F32_UNARY
+      #undef WASM_F64_UNARY
+    }
+};
+
+} // namespace wasm
@@ -1,6 +1,16 @@
 #include <eosio/eosio.hpp>
 #include <eosio/print.hpp>
 #include <eosio/multi_index.hpp>
+#include <eosio/binary_extension.hpp>
+
+#include <algorithm>
+
+//CHESS_STATS_TABLE stores the rule counters as well as printing them; see 'Rule stats' in chess_rules.hpp
+#if defined(CHESS_STATS_TABLE) && !defined(CHESS_STATS)
+#define CHESS_STATS
+#endif
+
+#include "chess_rules.hpp"
 
 /* *
  * The game table array 'piece_positions' contains the 
@@ -42,7 +52,7 @@
  *  Example 1) the starting space of the white king will be space 5, so player_pieces[0] == 5 at the start of the game.
  *
  *  Example 2) Black wants to move their left knight from its starting space to space 43.  They will call move as follows-
- *  cleos push action chess move '["black_player_account", "game_id_number", "20", "43", "0"]' -p black_player_account@active
+ *  cleos push action chess move '["black_player_account", "chess", "game_id_number", "20", "43", "0"]' -p black_player_account@active
  *
  * Castling - 
  *  the castle variable is used to track if the kings and rooks have been moved, according to the following masks-
@@ -64,17 +74,67 @@
  *  These values are passed into the 'promotion_type' argument of the 'move' action when moving a pawn to the promotion rank.  The value will be ignored if a pawn is not being promoted, but must always be specified (use any value).
  *    0 = bishop : 1 = knight : 2 = rook : 3 = queen
  *
+ * Attack Maps -
+ *  white_attacks and black_attacks are 64 bit masks of the squares each side attacks, bit (location - 1) for each
+ *  location, and checkers has a bit set for the location of every piece checking the player whose turn it is to move.
+ *  They are brought up to date on every move and let castling, check and checkmate be worked out without searching the board
+ *  again; see 'Attack maps' in chess_rules.hpp.
+ *
+ * Row Layout -
+ *  the fields after piece_positions were added to the 'games' row after games had been played, so they are
+ *  binary_extensions: rows written before them end at piece_positions and still read back, with the extensions empty.
+ *  game_state_of rebuilds the attack maps of such a row from its pieces, and empty premove lists stand in for the
+ *  rest.  A row is written back with every extension, an empty one as zeros, so every action that modifies a row calls
+ *  upgrade_row first to fill them in properly.  New fields go at the end, as binary_extensions from the change that
+ *  adds them - a plain field, even for one release, would leave every row written before it unreadable - and
+ *  upgrade_row fills them in.  A field is never removed or reordered once games have been played with it.
+ *
+ * Checkmate -
+ *  normally a move that checkmates ends the game.  Building with -DCHESS_LAZY_MATE leaves the mate search out of every
+ *  move; the player who delivered mate calls 'claimmate' instead, which makes the same test in one call, and until then
+ *  the mated player can't move.  Either way, 'claimdraw' ends a game in stalemate.
+ *
+ * Premoves -
+ *  premoves_w and premoves_b hold each player's conditional replies, set with the 'premove' action.  Each entry is
+ *  (if_move | reply << 16), both packed moves (piece_id | new_position << 5 | promotion_type << 12, see 'Packed moves'
+ *  in chess_rules.hpp; the promotion type of if_move only matters if it promotes a pawn).  When the opponent plays
+ *  if_move, 'move' plays the reply in the same action, through the same rules, and drops the entry - and the reply can
+ *  trigger one of the opponent's premoves in turn.  A move that matches no entry clears the list, since the line it was
+ *  written for has been left.  Lists hold at most MAX_PREMOVES entries, which caps the work one 'move' can do.
+ *  Like the rest of the row, premoves are public: anyone can read the opponent's with 'cleos get table', so they
+ *  suit forced lines, not moves a player wants to keep hidden.
+ *
+ * Game Events -
+ *  every action that changes a game sends a 'gameevent' inline action to the contract itself, which does nothing but
+ *  leave a record in the action trace: the kind of event (newgame, move, concede, draw, claimmate, claimdraw, or
+ *  dropgame when 'dropscope' erases it), the game's scope and id, the ply (move_count after the event), the packed move
+ *  and captured piece index (0 and 32 when there is none) and the winner so far ("" while the game goes on, the contract
+ *  account for a draw).  A 'move' that triggers premoves sends one event per ply.  Sending inline actions needs the eosio.code permission on the contract's active key; see
+ *  setup.sh.
+ *
+ * Scopes -
+ *  games are kept in one 'games' table per scope, a name chosen by whoever creates them - a season or a tournament,
+ *  or the contract account itself for games outside any of them.  Every action takes the scope ahead of the game id,
+ *  and ids are handed out per scope, starting from 0, so each table (and get_table_rows over it) only grows with its
+ *  own games.  The 'scopeids' table keeps the next id of every scope, and outlives the scope's games, so an id is never
+ *  handed out twice: an archive or index keyed by scope and id stays valid after the games are dropped.  'dropscope'
+ *  erases a scope's ended games, a bounded number per call, once they have been archived (see tools/export.cpp), and
+ *  leaves any still being played.
+ *
+ * Line Checks -
+ *  'checkline' plays a list of packed moves from a game's current position on a copy of its state, through the same
+ *  play_move as 'move', and reports each ply with one character - '.' legal, '+' check, '#' checkmate, 'x' illegal -
+ *  then the FEN of the last position reached.  The line stops at its first illegal move or at mate.  The action never
+ *  changes a table: it always fails, with the report as its assertion message, so the transaction is never included in
+ *  a block and never billed, and the report comes back in the error from push_transaction.  nodeos cuts assertion
+ *  messages off at MAX_ASSERT_MESSAGE bytes (max_assert_message), which is why the report is this terse: with a full
+ *  line of MAX_LINE_MOVES moves it stays under 300.  The cap also bounds the cpu a node spends on one line.
+ *
  * */
 
-#define W_CAS_Q 0x01
-#define W_CAS_K 0x02
-#define B_CAS_Q 0x04
-#define B_CAS_K 0x08
-
-#define PROMOTED_BISHOP 0x00
-#define PROMOTED_KNIGHT 0x01
-#define PROMOTED_ROOK   0x02
-#define PROMOTED_QUEEN  0x03
+#define MAX_PREMOVES 8
+#define MAX_LINE_MOVES 64
+#define MAX_ASSERT_MESSAGE 1024
 
 using namespace eosio;
 
@@ -86,27 +146,36 @@ class [[eosio::contract("chess")]] chess : public contract {
 	public:
 		using contract::contract;
 
-		chess(name receiver, name code, datastream<const char*> ds): contract(receiver, code, ds), game_index(receiver, code.value) {}
-
 		[[eosio::action]]
 		void newgame (
+      name& scope,
       name& player_w, 
       name& player_b
     ) {
       //only the contract account can set up new games
 			require_auth(_self);
+      if (scope == ""_n) {
+        print("A game needs a scope");
+        return;
+      }
 
-			//set up game state and initialize pieces to starting positions
+			//set up game state and initialize pieces to starting positions, with the next id of the scope; see 'Scopes' above
+      games game_index(get_self(), scope.value);
+			uint64_t game_id = next_game_id(scope, game_index);
 			game_index.emplace(get_self(), [&]( auto& row ) {
-				row.game_id = game_index.available_primary_key();
+				row.game_id = game_id;
 				row.player_w = player_w;
 				row.player_b = player_b;
+				upgrade_row(row);
 			});
+
+			emit_event("newgame"_n, scope, game_id, 0, 0, 32, ""_n);
 		}
 
 		[[eosio::action]]
 		void concede (
       name& player,
+      name& scope,
       uint64_t& game_id
     ) {
       //player must provide credentials to concede
@@ -114,6 +183,7 @@ class [[eosio::contract("chess")]] chess : public contract {
 
       //find the specified game, check that the calling account is one of the players, and set the other player to the winner
 			name winner;
+      games game_index(get_self(), scope.value);
 			auto itr = game_index.find(game_id);
 			if (itr != game_index.end()) {
 				if (player == itr->player_b) {
@@ -127,8 +197,11 @@ class [[eosio::contract("chess")]] chess : public contract {
 
         //update the game record
 				game_index.modify(itr, player, [&](auto& game_row) {
+					upgrade_row(game_row);
 					game_row.winner = winner;
 				});
+
+				emit_event("concede"_n, scope, game_id, itr->move_count, 0, 32, winner);
 			} else {
 				print("Unable to find a game with ID ", game_id);
 				return;
@@ -138,22 +211,38 @@ class [[eosio::contract("chess")]] chess : public contract {
     [[eosio::action]]
     void draw (
       name& player,
+      name& scope,
       uint64_t& game_id
     ) {
       //player must provide credentials to declare a draw
 			require_auth(player);
 
       //find the specified game, check that the calling account is one of the players
+      games game_index(get_self(), scope.value);
 			auto itr = game_index.find(game_id);
 			if (itr != game_index.end()) {
+        if (itr->winner != ""_n) {
+          print("This game has already ended");
+          return;
+        }
         if (itr->player_w == player || itr->player_b == player) {
+          //a repeated offer changes nothing and sends no event
+          bool offer = itr->draw_decl == ""_n;
+          bool accept = !offer && ((player == itr->player_b && itr->draw_decl == itr->player_w) || (player == itr->player_w && itr->draw_decl == itr->player_b));
+          if (!offer && !accept) {
+            return;
+          }
+
           game_index.modify(itr, player, [&](auto& game_row) {
-            if (itr->draw_decl == ""_n) {
+            upgrade_row(game_row);
+            if (offer) {
               game_row.draw_decl = player;
-            } else if ((player == itr->player_b && itr->draw_decl == itr->player_w) || (player == itr->player_w && itr->draw_decl == itr->player_b)) {
+            } else {
               game_row.winner = get_self();
             }
           });
+
+          emit_event("draw"_n, scope, game_id, itr->move_count, 0, 32, itr->winner);
         } else {
           print("You are not a player in this game");
           return;
@@ -164,6 +253,7 @@ class [[eosio::contract("chess")]] chess : public contract {
 		[[eosio::action]]
 		void move (
       name& player, 
+      name& scope,
       uint64_t& game_id, 
       uint8_t& piece_id, 
       uint8_t& new_position, 
@@ -172,6 +262,10 @@ class [[eosio::contract("chess")]] chess : public contract {
       //player must provide authentication to make a move
 			require_auth(player);
 
+#ifdef CHESS_STATS
+      stats_report report;
+#endif
+
 			//bounds check on position and piece IDs before iterating through game table
 			if (new_position > 64 || new_position == 0) {
 				print("Invalid position ID; must be a value between 1 - 64");
@@ -184,6 +278,7 @@ class [[eosio::contract("chess")]] chess : public contract {
 			}
 
 			//find game record
+      games game_index(get_self(), scope.value);
 			auto itr = game_index.find(game_id);
 			if (itr != game_index.end()) {
 
@@ -196,14 +291,6 @@ class [[eosio::contract("chess")]] chess : public contract {
 					return;
 				}
 
-        //set up some variables needed to check the move's validity
-        uint8_t captured_piece_index = 32;
-        uint8_t castle = itr->castle;
-        uint8_t en_passant_idx = itr->en_passant_idx;
-        uint16_t promoted_pawns = itr->promoted_pawns;
-        uint32_t promoted_pawn_types = itr->promoted_pawn_types;
-        bool checkmate = false;
-
 				//check that player is one of the players in this game
 				if (player == itr->player_w) {
 					//check that it's white player's turn
@@ -217,52 +304,6 @@ class [[eosio::contract("chess")]] chess : public contract {
 						print("Piece ", piece_id, " is not your piece");
 						return;
 					}
-
-					//check that the move is valid, and get a reference to any captured piece index, and set variables for any special rules
-					if (valid_move(piece_id, new_position, itr->piece_positions, castle, en_passant_idx, promoted_pawns, promoted_pawn_types, promotion_type, captured_piece_index, checkmate)) {
-
-						game_index.modify(itr, player, [&](auto& game_row) {
-
-              //update piece position
-							game_row.piece_positions[piece_id] = new_position;
-
-              //update move counter
-							game_row.move_count = game_row.move_count + 1;
-
-              //check if an enemy piece was captured and remove it;
-							if (captured_piece_index < 32) {
-								game_row.piece_positions[captured_piece_index] = 0;
-							}
-
-              //check if castling occurred (castle variable will be updated by the call to valid_move)
-							if (itr->castle != castle) {
-								game_row.castle = castle;
-
-                //if the king is castling, move the appropriate rook as well
-								if (piece_id == 0) {
-									if (new_position == 2) {
-										game_row.piece_positions[6] = 3;
-									} else if (new_position == 6) {
-										game_row.piece_positions[7] = 5;
-									}
-								}
-							}
-
-              //valid_move will update promoted_pawns and promoted_pawn_type if any pawns were promoted
-              game_row.promoted_pawns = promoted_pawns;
-              game_row.promoted_pawn_types = promoted_pawn_types;
-
-              //valid_move will use en_passant_idx to specify any pawn that was moved two spaces forward, meaning it is eligible to be captured by the en passant rule on the next turn.
-							game_row.en_passant_idx = en_passant_idx;
-
-              if (checkmate) {
-                game_row.winner = player;
-              }
-						});
-					} else {
-            print("Move invalid");
-						return;
-					}
 				} else if (player == itr->player_b) {
 					//check that it's black player's turn
 					if (itr->move_count % 2 == 0) {
@@ -275,995 +316,582 @@ class [[eosio::contract("chess")]] chess : public contract {
 						print("Piece ", piece_id, " is not your piece");
 						return;
 					}
-
-					//check that the move is valid, and get a reference to any captured piece index, and set variables for any special rules
-					if (valid_move(piece_id, new_position, itr->piece_positions, castle, en_passant_idx, promoted_pawns, promoted_pawn_types, promotion_type, captured_piece_index, checkmate)) {
-						game_index.modify(itr, player, [&](auto& game_row) {
-
-              //update piece position
-							game_row.piece_positions[piece_id] = new_position;
-
-              //update move counter
-							game_row.move_count = game_row.move_count + 1;
-
-              //check if an enemy piece was captured and remove it;
-							if (captured_piece_index < 32) {
-								game_row.piece_positions[captured_piece_index] = 0;
-							}
-
-              //check if castling occurred (castle variable will be updated by the call to valid_move)
-							if (itr->castle != castle) {
-								game_row.castle = castle;
-
-                //if the king is castling, move the appropriate rook as well
-								if (piece_id == 16) {
-									if (new_position == 58) {
-										game_row.piece_positions[22] = 59;
-									}
-									if (new_position == 62) {
-										game_row.piece_positions[23] = 61;
-									}
-								}
-							}
-
-              //valid_move will update promoted_pawns and promoted_pawn_type if any pawns were promoted
-              game_row.promoted_pawns = promoted_pawns;
-              game_row.promoted_pawn_types = promoted_pawn_types;
-
-              //valid_move will use en_passant_idx to specify any pawn that was moved two spaces forward, meaning it is eligible to be captured by the en passant rule on the next turn.
-							game_row.en_passant_idx = en_passant_idx;
-
-              if (checkmate) {
-                game_row.winner = player;
-              }
-						});
-					} else {
-            print ("Move invalid");
-						return;
-					}
 				} else {
 					print("You are not a player in this game");
 					return;
 				}
-			} else {
-				print("Unable to find a game with ID ", game_id);
-				return;
-			}
-    }
-
-  /***************************************
-   * Private Helper Functions
-   ***************************************/
-  private:
-
-    /* *
-     * valid_move
-     *  checks the following-
-     *  - is this piece alive?
-     *  - is the path to the new position valid and unblocked?
-     *  - does this move leave player's king unchecked?
-     *  - was any piece captured? - if so, update captured_piece_index
-     *  - are we castling? - if so, update castle
-     *  - was a pawn moved two spaces from it's start? - if so, update en_passant_idx, if not, reset en_passant_idx
-     *  - was a pawn promoted? - if so, update promoted_pawns and promoted_pawn_index
-     *  - does this move lead to checkmate?
-     *  - TODO: does this move lead to stalemate / draw?
-     * */		
-		bool valid_move (
-			uint8_t piece_id, 
-			uint8_t new_position, 
-			const std::vector<uint8_t>& piece_positions, 
-			uint8_t& castle,
-			uint8_t& en_passant_idx, 
-			uint16_t& promoted_pawns, 
-			uint32_t& promoted_pawn_types, 
-      uint8_t promotion_type,
-			uint8_t& captured_piece_index,
-      bool& checkmate
-		) {
 
-      //get the current position of piece_id from the array
-			uint8_t current_position = piece_positions[piece_id];
-      bool is_whites_move = piece_id < 16;
-
-      //reset en_passant_idx
-      en_passant_idx = 32;
-
-      //make sure this piece is still uncaptured
-			if (current_position == 0) {
-				return false;
-			}
-
-      //make sure the new position is different than the current position
-			if (current_position == new_position) {
-				return false;
-			}
+        //check that the move is valid and work out the new game state; see play_move in chess_rules.hpp
+        rules::game_state state = game_state_of(*itr);
+        uint8_t captured_piece_index = 32;
+        bool checkmate = false;
+        uint16_t promoted_pawns = state.promoted_pawns;
+        if (!rules::play_move(state, piece_id, new_position, promotion_type, captured_piece_index, checkmate)) {
+          print("Move invalid");
+          return;
+        }
 
-      switch ( piece_id ) {
-				case 0 : //white king
-          if (!valid_king_move(current_position, new_position, castle, piece_positions, is_whites_move, captured_piece_index)) {
-            //check castling special case
-            if (
-              (((castle & W_CAS_K) == 0) && current_position == 4 && new_position == 2) ||
-              (((castle & W_CAS_Q) == 0) && current_position == 4 && new_position == 6)
-            ) {
-              //check that the path is unblocked
-              uint8_t rook_index = is_whites_move ? (new_position == 2 ? 6 : 7) : (new_position == 58 ? 22 : 23);
-              uint8_t rook_pos = piece_positions[rook_index];
-
-              for (uint8_t index = 0; index < 32; ++index) {
-                if (blocked(current_position, new_position, piece_positions[index]) || blocked(rook_pos, new_position, piece_positions[index])) {
-                  return false;
-                }
-              }
-
-              //king cannot castle out of check
-              if (in_check(is_whites_move, piece_positions, promoted_pawns, promoted_pawn_types)) {
-                return false;
-              }
-
-              //king cannot castle through check
-              std::vector<uint8_t> new_piece_positions (piece_positions);
-              new_piece_positions[is_whites_move ? 0 : 16] = ((current_position + new_position) / 2);
-              if (in_check(is_whites_move, new_piece_positions, promoted_pawns, promoted_pawn_types)) {
-                return false;
-              }
-            } else {
-              return false;
-            }
-          }
-          //king move was valid, so disable castling
-          castle = castle | W_CAS_K | W_CAS_Q;
-					break;
-				case 1 : //white queen
-          if (!valid_queen_move(current_position, new_position, piece_positions, is_whites_move, captured_piece_index)) {
-            return false;
-          }
-					break;
-				case 2 ... 3 : //white bishop
-          if (!valid_bishop_move(current_position, new_position, piece_positions, is_whites_move, captured_piece_index)) {
-            return false;
-          }
-					break;
-				case 4 ... 5 : //white knight
-          if (!valid_knight_move(current_position, new_position, piece_positions, is_whites_move, captured_piece_index)) {
-            return false;
-          }
-					break;
-				case 6 : //white rook, king side
-          if (!valid_rook_move(current_position, new_position, piece_positions, is_whites_move, captured_piece_index)) {
-            return false;
-          } else {
-            castle = castle | W_CAS_K;
+        //a move can trigger the other player's premove, whose reply can trigger one of ours, and so on.  Every reply uses
+        //up an entry, so this stops after at most 2 * MAX_PREMOVES moves
+        std::vector<uint32_t> premoves_w = itr->premoves_w.value_or(std::vector<uint32_t>());
+        std::vector<uint32_t> premoves_b = itr->premoves_b.value_or(std::vector<uint32_t>());
+        name winner = checkmate ? player : ""_n;
+        bool white_moved = piece_id < 16;
+        uint16_t played = rules::pack_move(piece_id, new_position, state.promoted_pawns != promoted_pawns ? promotion_type : 0);
+        std::vector<std::pair<uint16_t, uint8_t>> plies { { played, captured_piece_index } };
+        while (winner == ""_n) {
+          std::vector<uint32_t>& premoves = white_moved ? premoves_b : premoves_w;
+          if (premoves.empty()) {
+            break;
+          }
+          bool premove_checkmate = false;
+          played = play_premove(state, premoves, played, captured_piece_index, premove_checkmate);
+          if (played == 0) {
+            break;
+          }
+          plies.push_back({ played, captured_piece_index });
+          white_moved = !white_moved;
+          if (premove_checkmate) {
+            winner = white_moved ? itr->player_w : itr->player_b;
           }
-        case 7 : //white rook, queen side
-          if (!valid_rook_move(current_position, new_position, piece_positions, is_whites_move, captured_piece_index)) {
-            return false;
-          } else {
-            castle = castle | W_CAS_Q;
-          }
-					break;
-				case 8 ... 15 : //white pawn
-          if (!valid_pawn_move(piece_id, new_position, piece_positions, is_whites_move, captured_piece_index, promoted_pawns, promoted_pawn_types, en_passant_idx)) {
-            return false;
-          } else if (new_position > 56) {
-            //pawn has reached promotion rank
-            promote_pawn(piece_id, promoted_pawns, promoted_pawn_types, promotion_type);
-          }
-          break;
-				case 16 : //black king
-          if (!valid_king_move(current_position, new_position, castle, piece_positions, is_whites_move, captured_piece_index)) {
-            //check castling special case
-            if (
-              (((castle & B_CAS_K) == 0) && current_position == 60 && new_position == 58) ||
-              (((castle & B_CAS_Q) == 0) && current_position == 60 && new_position == 62)
-            ) {
-              //check that the path is unblocked
-              uint8_t rook_index = is_whites_move ? (new_position == 2 ? 6 : 7) : (new_position == 58 ? 22 : 23);
-              uint8_t rook_pos = piece_positions[rook_index];
-              for (uint8_t index = 0; index < 32; ++index) {
-                if (blocked(current_position, new_position, piece_positions[index]) || blocked(rook_pos, new_position, piece_positions[index])) {
-                  return false;
-                }
-              }
-
-              //king cannot castle out of check
-              if (in_check(is_whites_move, piece_positions, promoted_pawns, promoted_pawn_types)) {
-                return false;
-              }
-
-              //king cannot castle through check
-              std::vector<uint8_t> new_piece_positions (piece_positions);
-              new_piece_positions[is_whites_move ? 0 : 16] = ((current_position + new_position) / 2);
-              if (in_check(is_whites_move, new_piece_positions, promoted_pawns, promoted_pawn_types)) {
-                return false;
-              }
-            } else {
-              return false;
-            }
-          }
-          //king move was valid, so disable castling
-          castle = castle | B_CAS_K | B_CAS_Q;
-          break;
-				case 17 : //black queen
-          if (!valid_queen_move(current_position, new_position, piece_positions, is_whites_move, captured_piece_index)) {
-            return false;
-          }
-          break;
-				case 18 ... 19 : //black bishop
-          if (!valid_bishop_move(current_position, new_position, piece_positions, is_whites_move, captured_piece_index)) {
-            return false;
-          }
-          break;
-				case 20 ... 21 : //black knight
-          if (!valid_knight_move(current_position, new_position, piece_positions, is_whites_move, captured_piece_index)) {
-            return false;
-          }
-					break;
-				case 22 : //black rook, king side
-          if (!valid_rook_move(current_position, new_position, piece_positions, is_whites_move, captured_piece_index)) {
-            return false;
-          } else {
-            castle = castle | B_CAS_K;
-          }
-					break;
-        case 23 : //black rook, queen side
-          if (!valid_rook_move(current_position, new_position, piece_positions, is_whites_move, captured_piece_index)) {
-            return false;
-          } else {
-            castle = castle | B_CAS_Q;
-          }
-          break;
-				case 24 ... 31 : //black pawn
-          if (!valid_pawn_move(piece_id, new_position, piece_positions, is_whites_move, captured_piece_index, promoted_pawns, promoted_pawn_types, en_passant_idx)) {
-            return false;
-          } else if (new_position < 9) {
-            //pawn has reached promotion rank
-            promote_pawn(piece_id, promoted_pawns, promoted_pawn_types, promotion_type);
-          }
-					break;
-      }
-
-      //create a new position vector to examine the new board state
-      std::vector<uint8_t> new_piece_positions(piece_positions); 
-      new_piece_positions[piece_id] = new_position;
-      if (captured_piece_index < 32) {
-        new_piece_positions[captured_piece_index] = 0;
-      }
+        }
 
-      //can't make a move that leaves our king in check
-      if (in_check(is_whites_move, new_piece_positions, promoted_pawns, promoted_pawn_types)) {
-        return false;
-      }
+				game_index.modify(itr, player, [&](auto& game_row) {
+          game_row.move_count = state.move_count;
+          game_row.castle = state.castle;
+          game_row.en_passant_idx = state.en_passant_idx;
+          game_row.promoted_pawns = state.promoted_pawns;
+          game_row.promoted_pawn_types = state.promoted_pawn_types;
+          game_row.piece_positions = state.piece_positions;
+          RULES_STAT(vector_copies);
+          game_row.white_attacks.emplace(state.attacks.white);
+          game_row.black_attacks.emplace(state.attacks.black);
+          game_row.checkers.emplace(state.attacks.checkers);
+
+          game_row.premoves_w.emplace(premoves_w);
+          game_row.premoves_b.emplace(premoves_b);
+          game_row.winner = winner;
+				});
 
-      //figure out if the enemy king is in checkmate
-      checkmate = in_checkmate(!is_whites_move, new_piece_positions, promoted_pawns, promoted_pawn_types);
+        //one event per ply played, the result going on the last
+        uint32_t ply = state.move_count - plies.size();
+        for (size_t i = 0; i < plies.size(); ++i) {
+          emit_event("move"_n, scope, game_id, ++ply, plies[i].first, plies[i].second, i + 1 == plies.size() ? winner : ""_n);
+        }
 
-      return true;
+#ifdef CHESS_STATS_TABLE
+        record_stats(player, scope, game_id, state.move_count, piece_id, new_position);
+#endif
+			} else {
+				print("Unable to find a game with ID ", game_id);
+				return;
+			}
     }
 
-    /* *
-     * returns true if the position specified is checked by the opposing color.
-     *  @param is_white_piece - specifies the color of the current player ex) is_white_piece == true means to check if any black pieces are checking position
-     *  @param piece_positions - vector of all piece positions
-     *  @param promoted_pawns - bit vector specifying which pawns are promoted
-     *  @param promoted_pawn_type - specifies what type of piece a pawn has been promoted to
-     * */
-    bool in_check (
-      bool is_whites_move,
-      const std::vector<uint8_t>& piece_positions,
-			uint16_t promoted_pawns,
-			uint32_t promoted_pawn_types
+    [[eosio::action]]
+    void claimmate (
+      name& player,
+      name& scope,
+      uint64_t& game_id
     ) {
-      //find out which enemy pieces are threatening the king
-      uint8_t throwaway = 0; //validity functions return the index of any enemy piece in the target 'position', but we don't care about that here so we use this throwaway variable as a placeholder
-      uint8_t position = is_whites_move ? piece_positions[0] : piece_positions[16]; //position of the king we are checking
-
-      //check enemy king - no possibility of another piece being in between, so we can just check if the enemy king is next to this space
-      uint8_t enemy_king_pos = is_whites_move ? piece_positions[16] : piece_positions[0];
-      if (valid_king_move(enemy_king_pos, position, 0xFF, piece_positions, is_whites_move, throwaway)) {
-        return true;
-      }
-
-      uint8_t enemy_queen_pos = is_whites_move ? piece_positions[17] : piece_positions[1];
-      if (valid_queen_move(enemy_queen_pos, position, piece_positions, !is_whites_move, throwaway)) {
-        return true;
-      }
-
-      uint8_t enemy_bishop1_pos = is_whites_move ? piece_positions[18] : piece_positions[2];
-      if (valid_bishop_move(enemy_bishop1_pos, position, piece_positions, !is_whites_move, throwaway)) {
-        return true;
-      }
-
-      uint8_t enemy_bishop2_pos = is_whites_move ? piece_positions[19] : piece_positions[3];
-      if (valid_bishop_move(enemy_bishop2_pos, position, piece_positions, !is_whites_move, throwaway)) {
-        return true;
-      }
-
-      uint8_t enemy_knight1_pos = is_whites_move ? piece_positions[20] : piece_positions[4];
-      if (valid_knight_move(enemy_knight1_pos, position, piece_positions, !is_whites_move, throwaway)) {
-        return true;
-      }
-
-      uint8_t enemy_knight2_pos = is_whites_move ? piece_positions[21] : piece_positions[5];
-      if (valid_knight_move(enemy_knight2_pos, position, piece_positions, !is_whites_move, throwaway)) {
-        return true;
-      }
+      //player must provide credentials to claim a win
+			require_auth(player);
 
-      uint8_t enemy_rook1_pos = is_whites_move ? piece_positions[22] : piece_positions[6];
-      if (valid_rook_move(enemy_rook1_pos, position, piece_positions, !is_whites_move, throwaway)) {
-        return true;
-      }
+      //find the specified game, check that it's still going and that the calling account is the player who just moved
+      games game_index(get_self(), scope.value);
+			auto itr = game_index.find(game_id);
+			if (itr == game_index.end()) {
+				print("Unable to find a game with ID ", game_id);
+				return;
+			}
+			if (itr->winner != ""_n) {
+				print("This game has already ended");
+				return;
+			}
+			if (!((player == itr->player_w && itr->move_count % 2 != 0) || (player == itr->player_b && itr->move_count % 2 == 0))) {
+				print("Only the player who just moved can claim checkmate");
+				return;
+			}
 
-      uint8_t enemy_rook2_pos = is_whites_move ? piece_positions[23] : piece_positions[7];
-      if (valid_rook_move(enemy_rook2_pos, position, piece_positions, !is_whites_move, throwaway)) {
-        return true;
+      //the opponent must be in check, with no king move that gets out of it
+      if (!rules::is_checkmate(game_state_of(*itr))) {
+        print("Not checkmate");
+        return;
       }
 
-      uint8_t enemy_pawn_index_offset = is_whites_move ? 24 : 8;
-      for (uint8_t index = 0; index < 8; ++index) {
-        uint8_t enemy_pawn_index = index + enemy_pawn_index_offset;
-        uint8_t ep_invalid = 32; //can't check a space using en passant, so pass in the invalid index to the pawn validation function
-        if (valid_pawn_move(enemy_pawn_index, position, piece_positions, !is_whites_move, throwaway, promoted_pawns, promoted_pawn_types, ep_invalid)) {
-          return true;
-        }
-      }
+			game_index.modify(itr, player, [&](auto& game_row) {
+				upgrade_row(game_row);
+				game_row.winner = player;
+			});
 
-      return false;
+			emit_event("claimmate"_n, scope, game_id, itr->move_count, 0, 32, player);
     }
 
-    bool in_checkmate (
-      bool check_white,
-      const std::vector<uint8_t> piece_positions,
-			uint16_t promoted_pawns,
-			uint32_t promoted_pawn_types
+    [[eosio::action]]
+    void claimdraw (
+      name& player,
+      name& scope,
+      uint64_t& game_id
     ) {
-      uint8_t king_pos = check_white ? piece_positions[0] : piece_positions[16];
-      uint8_t captured_idx = 32;
-      std::vector<uint8_t> new_piece_positions (piece_positions);
-
-      //first, check if the king can move 1 space in any direction
-      new_piece_positions[king_pos] = piece_positions[king_pos] + 1;
-      if (valid_king_move(piece_positions[king_pos], new_piece_positions[king_pos], 0xFF, piece_positions, check_white, captured_idx)) {
-        //remove any captured piece in the new positions array
-        if (captured_idx < 32) {
-          new_piece_positions[captured_idx] = 0;
-        }
-        if (!in_check(check_white, new_piece_positions, promoted_pawns, promoted_pawn_types)) {
-          return false;
-        }
-        //reset any captured piece to its initial position
-        if (captured_idx < 32) {
-          new_piece_positions[captured_idx] = piece_positions[captured_idx];
-          captured_idx = 32;
-        }
-
-      }
-
-      new_piece_positions[king_pos] = piece_positions[king_pos] - 1;
-      if (valid_king_move(piece_positions[king_pos], new_piece_positions[king_pos], 0xFF, piece_positions, check_white, captured_idx)) {
-        //remove any captured piece in the new positions array
-        if (captured_idx < 32) {
-          new_piece_positions[captured_idx] = 0;
-        }
-        if (!in_check(check_white, new_piece_positions, promoted_pawns, promoted_pawn_types)) {
-          return false;
-        }
-        //reset any captured piece to its initial position
-        if (captured_idx < 32) {
-          new_piece_positions[captured_idx] = piece_positions[captured_idx];
-          captured_idx = 32;
-        }
-      }
+      //player must provide credentials to claim a draw
+			require_auth(player);
 
-      for (int offset = -9; offset < -6; ++offset) {
-        uint8_t king_pos = check_white ? 0 : 16;
-        new_piece_positions[king_pos] = piece_positions[king_pos] + offset;
-        if (valid_king_move(piece_positions[king_pos], new_piece_positions[king_pos], 0xFF, piece_positions, check_white, captured_idx)) {
-          //remove any captured piece in the new positions array
-          if (captured_idx < 32) {
-            new_piece_positions[captured_idx] = 0;
-          }
-          if (!in_check(check_white, new_piece_positions, promoted_pawns, promoted_pawn_types)) {
-            return false;
-          }
-          //reset any captured piece to its initial position
-          if (captured_idx < 32) {
-            new_piece_positions[captured_idx] = piece_positions[captured_idx];
-            captured_idx = 32;
-          }
-        }
-      }
+      //find the specified game, check that it's still going and that the calling account is one of the players
+      games game_index(get_self(), scope.value);
+			auto itr = game_index.find(game_id);
+			if (itr == game_index.end()) {
+				print("Unable to find a game with ID ", game_id);
+				return;
+			}
+			if (itr->winner != ""_n) {
+				print("This game has already ended");
+				return;
+			}
+			if (player != itr->player_w && player != itr->player_b) {
+				print("You are not a player in this game");
+				return;
+			}
 
-      for (int offset = 7; offset < 10; ++offset) {
-        uint8_t king_pos = check_white ? 0 : 16;
-        new_piece_positions[king_pos] = piece_positions[king_pos] + offset;
-        if (valid_king_move(piece_positions[king_pos], new_piece_positions[king_pos], 0xFF, piece_positions, check_white, captured_idx)) {
-          //remove any captured piece in the new positions array
-          if (captured_idx < 32) {
-            new_piece_positions[captured_idx] = 0;
-          }
-          if (!in_check(check_white, new_piece_positions, promoted_pawns, promoted_pawn_types)) {
-            return false;
-          }
-          //reset any captured piece to its initial position
-          if (captured_idx < 32) {
-            new_piece_positions[captured_idx] = piece_positions[captured_idx];
-            captured_idx = 32;
-          }
-        }
+      //the player to move must have no legal move, without being in check
+      if (!rules::is_stalemate(game_state_of(*itr))) {
+        print("Not stalemate");
+        return;
       }
 
-      //TODO: look for any pieces that threaten the king's current position.  If any exist, see if they are capturable in one move, or if they can be blocked by a non-king move.
-      //if all valid king moves are checked, see if the current position is checked
-      if (!in_check(check_white, piece_positions, promoted_pawns, promoted_pawn_types)) {
-        return false;
-      } else {
-      }
+			game_index.modify(itr, player, [&](auto& game_row) {
+				upgrade_row(game_row);
+				game_row.winner = get_self();
+			});
 
-      return true;
+			emit_event("claimdraw"_n, scope, game_id, itr->move_count, 0, 32, get_self());
     }
 
-    bool valid_king_move (
-      uint8_t current_position,
-      uint8_t new_position,
-      uint8_t castle,
-      const std::vector<uint8_t>& piece_positions,
-      bool is_whites_move,
-      uint8_t& captured_piece_index
+    [[eosio::action]]
+    void premove (
+      name& player,
+      name& scope,
+      uint64_t& game_id,
+      uint16_t if_move,
+      uint16_t reply
     ) {
-      int diff = new_position - current_position;
-      int abs_diff = std::abs(diff);
+      //player must provide credentials to set a premove
+			require_auth(player);
 
-      //check that the king has only moved 1 space in any direction
-			if (abs_diff != 1 && abs_diff != 7 && abs_diff != 8 && abs_diff != 9) {
-				return false;
+      //find the specified game, check that it's still going and that the calling account is one of the players
+      games game_index(get_self(), scope.value);
+			auto itr = game_index.find(game_id);
+			if (itr == game_index.end()) {
+				print("Unable to find a game with ID ", game_id);
+				return;
 			}
-
-      //check that the king has not moved off the edge
-			if ( ((diff == -7 || diff == 1 || diff == 9) && current_position % 8 == 0) ||
-				((diff == -9 || diff == -8 || diff == -7) && current_position < 9) ||
-				((diff == -9 || diff == -1 || diff == 7) && current_position % 8 == 1) ||
-				((diff == 7 || diff == 8 || diff == 9) && current_position > 56) )
-			{
-				return false;
+			if (itr->winner != ""_n) {
+				print("This game has already ended");
+				return;
+			}
+			if (player != itr->player_w && player != itr->player_b) {
+				print("You are not a player in this game");
+				return;
 			}
 
-      //search through other pieces to see if one of them has been captured, or if a friendly piece is blocking this move
-      for (int index = 0; index < 32; ++index) {
-        if (piece_positions[index] == new_position) {
-          if (is_enemy_piece(is_whites_move, index)) {
-            captured_piece_index = index;
-          } else {
-            return false;
-          }
-        }
-      }
-
-			return true;
-    }
-
-    bool valid_queen_move (
-      uint8_t current_position,
-      uint8_t new_position,
-      const std::vector<uint8_t>& piece_positions,
-      bool is_whites_move,
-      uint8_t& captured_piece_index
-    ) {
-
-      //current position zero means this piece has already been captured
-      if (current_position == 0) {
-        return false;
+      //if_move has to be one of the opponent's pieces, and reply one of ours.  A reply of 0 removes the entry for if_move
+      bool is_white = player == itr->player_w;
+      uint8_t if_piece = rules::packed_piece_id(if_move);
+      uint8_t if_position = rules::packed_new_position(if_move);
+      if ((is_white ? if_piece < 16 : if_piece > 15) || if_position == 0 || if_position > 64) {
+        print("Invalid if_move; it must be a move by your opponent");
+        return;
       }
-
-      //check that the move is on a row, column, or diagonal
-      if (
-        !same_row(current_position, new_position) &&
-        !same_col(current_position, new_position) &&
-        !same_ne_diag(current_position, new_position) &&
-        !same_nw_diag(current_position, new_position) &&
-        !same_se_diag(current_position, new_position) &&
-        !same_sw_diag(current_position, new_position)
-      ) {
-        return false;
-      }  
-
-      //check that none of the other uncaptured pieces on the board are blocking this move, and figure out if this move captures another piece
-      for (uint8_t index = 0; index < 32; ++index) {
-        if (piece_positions[index] == new_position) {
-          if (is_enemy_piece(is_whites_move, index)) {
-            captured_piece_index = index;
-          } else {
-            return false;
-          }
-        } else if (piece_positions[index] != current_position && piece_positions[index] != 0) {
-          if (blocked(current_position, new_position, piece_positions[index])) {
-            return false;
-          }
-        }
+      uint8_t reply_piece = rules::packed_piece_id(reply);
+      uint8_t reply_position = rules::packed_new_position(reply);
+      if (reply != 0 && ((is_white ? reply_piece > 15 : reply_piece < 16) || reply_position == 0 || reply_position > 64)) {
+        print("Invalid reply; it must be a move by you");
+        return;
       }
 
-      return true;
-    }
-
-    bool valid_bishop_move (
-      uint8_t current_position,
-      uint8_t new_position,
-      const std::vector<uint8_t>& piece_positions,
-      bool is_whites_move,
-      uint8_t& captured_piece_index
-    ) {
-
-      //current position zero means this piece has already been captured
-      if (current_position == 0) {
-        return false;
+      //'move' matches premoves against the move played with its promotion type zeroed unless it promotes, so store
+      //both moves the same way, or an entry with stray promotion bits could never fire
+      if_move = rules::pack_move(if_piece, if_position,
+        rules::promotes(if_piece, if_position, itr->promoted_pawns, itr->promoted_pawn_types) ? rules::packed_promotion_type(if_move) : 0);
+      if (reply != 0) {
+        reply = rules::pack_move(reply_piece, reply_position,
+          rules::promotes(reply_piece, reply_position, itr->promoted_pawns, itr->promoted_pawn_types) ? rules::packed_promotion_type(reply) : 0);
       }
 
-      //check move is on a diagonal from current position
-      if (
-        !same_ne_diag(current_position, new_position) &&
-        !same_nw_diag(current_position, new_position) &&
-        !same_se_diag(current_position, new_position) &&
-        !same_sw_diag(current_position, new_position)
-      ) {
-        return false;
+      std::vector<uint32_t> premoves = (is_white ? itr->premoves_w : itr->premoves_b).value_or(std::vector<uint32_t>());
+      auto entry = std::find_if(premoves.begin(), premoves.end(), [&](uint32_t p) { return (p & 0xFFFF) == if_move; });
+      if (entry != premoves.end()) {
+        premoves.erase(entry);
       }
-
-      //check for other pieces blocking this move, and find any captured pieces
-      for (uint8_t index = 0; index < 32; ++index) {
-        if (piece_positions[index] == new_position) {
-          if (is_enemy_piece(is_whites_move, index)) {
-            captured_piece_index = index;
-          } else {
-            return false;
-          }
-        } else if (piece_positions[index] != current_position && piece_positions[index] != 0) {
-          if (blocked(current_position, new_position, piece_positions[index])) {
-            return false;
-          }
+      if (reply != 0) {
+        if (premoves.size() >= MAX_PREMOVES) {
+          print("You already have ", MAX_PREMOVES, " premoves in this game");
+          return;
         }
+        premoves.push_back(if_move | ((uint32_t)reply << 16));
       }
 
-      return true;
-    }
-
-    bool valid_knight_move (
-      uint8_t current_position,
-      uint8_t new_position,
-      const std::vector<uint8_t>& piece_positions,
-      bool is_whites_move,
-      uint8_t& captured_piece_index
-    ) {
-			int diff = new_position - current_position;
-			int abs_diff = std::abs(diff);
-
-      //current position zero means this piece has already been captured
-      if (current_position == 0) {
-        return false;
-      }
-
-      //check that the move is valid
-			if (abs_diff != 6 && abs_diff != 10 && abs_diff != 15 && abs_diff != 17) {
-				return false;
-			}
-
-      //check that the move does not send the knight off the edge
-			if (((diff == 6  || diff == -10) && ((current_position - 1) % 8) < 2) ||
-				((diff == 15 || diff == -17) && ((current_position - 1) % 8) < 1) ||
-				((diff == 17 || diff == -15) && ((current_position - 1) % 8) > 6) ||
-				((diff == 10 || diff ==  -6) && ((current_position - 1) % 8) > 5) ||
-				((diff == -17 || diff == -15) && (current_position < 17)) ||
-				((diff == -10 || diff == -6) && (current_position < 9)) ||
-				((diff == 6 || diff == 10) && (current_position > 56)) ||
-				((diff == 15 || diff == 17) && (current_position > 48)) )
-			{
-				return false;
-			}
-      
-      for (int index = 0; index < 32; ++index) {
-        if (piece_positions[index] == new_position) {
-          if (is_enemy_piece(is_whites_move, index)) {
-            captured_piece_index = index;
-          } else {
-            return false;
-          }
+			game_index.modify(itr, player, [&](auto& game_row) {
+        upgrade_row(game_row);
+        if (is_white) {
+          game_row.premoves_w.emplace(premoves);
+        } else {
+          game_row.premoves_b.emplace(premoves);
         }
-      }
-
-      return true;
+			});
     }
 
-    bool valid_rook_move (
-      uint8_t current_position,
-      uint8_t new_position,
-      const std::vector<uint8_t>& piece_positions,
-      bool is_whites_move,
-      uint8_t& captured_piece_index
+    /* *
+     * dropscope
+     *  looks at up to 'count' games of a scope, from game id 'from_id' up, and erases the ones that have ended, to clear
+     *  out a season or tournament once it has been archived; see 'Scopes' above.  Games still being played are kept, so
+     *  a mistyped scope can't take a live game, and every game erased sends a 'dropgame' event.  Prints the id to carry
+     *  on from.
+     * */
+    [[eosio::action]]
+    void dropscope (
+      name& scope,
+      uint64_t from_id,
+      uint32_t count
     ) {
+      //only the contract account can drop games
+			require_auth(_self);
 
-      //current position zero means this piece has already been captured
-      if (current_position == 0) {
-        return false;
-      }
-
-      //check move is on a row or column from current position
-      if (
-        !same_row(current_position, new_position) &&
-        !same_col(current_position, new_position)
-      ) {
-        return false;
-      }
-
-      for (uint8_t index = 0; index < 32; ++index) {
-        if (piece_positions[index] == new_position) {
-          if (is_enemy_piece(is_whites_move, index)) {
-            captured_piece_index = index;
-          } else {
-            return false;
-          }
-        } else {
-          if (blocked(current_position, new_position, piece_positions[index])) {
-            return false;
-          }
+      games game_index(get_self(), scope.value);
+      auto itr = game_index.lower_bound(from_id);
+      uint32_t dropped = 0;
+      uint32_t kept = 0;
+      for (uint32_t i = 0; i < count && itr != game_index.end(); ++i) {
+        if (itr->winner == ""_n) {
+          ++kept;
+          ++itr;
+          continue;
         }
+        emit_event("dropgame"_n, scope, itr->game_id, itr->move_count, 0, 32, itr->winner);
+        itr = game_index.erase(itr);
+        ++dropped;
       }
 
-      return true;
+      print("Dropped ", dropped, " games from ", scope, ", kept ", kept, " still being played.  ");
+      if (itr == game_index.end()) {
+        print("No games left after them");
+      } else {
+        print("Carry on from game ID ", itr->game_id);
+      }
     }
 
-    bool valid_pawn_move (
-      uint8_t pawn_index, //NOTICE: this needs an index instead of a position
-      uint8_t new_position,
-      const std::vector<uint8_t>& piece_positions,
-      bool is_whites_move,
-      uint8_t& captured_piece_index,
-      uint16_t promoted_pawns,
-      uint32_t promoted_pawn_types,
-      uint8_t& en_passant_idx
+    /* *
+     * checkline
+     *  checks a line of moves from a game's current position without playing it; see 'Line Checks' above.  Anyone can
+     *  call it, and it always fails, so the report is in the assertion message:
+     *   {"game_id":0,"ply":0,"line":"..+x","fen":"..."}
+     *  where ply is the game's move_count before the line, and line holds one character per ply checked.
+     * */
+    [[eosio::action]]
+    void checkline (
+      name& scope,
+      uint64_t& game_id,
+      std::vector<uint16_t>& moves
     ) {
+      if (moves.size() > MAX_LINE_MOVES) {
+        check(false, "A line can have at most " + std::to_string(MAX_LINE_MOVES) + " moves");
+      }
+      games game_index(get_self(), scope.value);
+			auto itr = game_index.find(game_id);
+			if (itr == game_index.end()) {
+        check(false, "Unable to find a game with ID " + std::to_string(game_id));
+			}
+			if (itr->winner != ""_n) {
+				check(false, "This game has already ended");
+			}
 
-      uint8_t current_position = piece_positions[pawn_index];
+      rules::game_state state = game_state_of(*itr);
+      std::string line;
+      for (size_t i = 0; i < moves.size(); ++i) {
+        uint8_t piece_id = rules::packed_piece_id(moves[i]);
+        uint8_t new_position = rules::packed_new_position(moves[i]);
+        uint8_t captured_piece_index = 32;
+        bool checkmate = false;
 
-      //current position zero means this piece has already been captured
-      if (current_position == 0) {
-        return false;
-      }
+        //the same turn and bounds checks as 'move', and a failed play_move leaves state where it was
+        bool own_piece = state.move_count % 2 == 0 ? piece_id < 16 : piece_id > 15;
+        bool legal = own_piece && new_position != 0 && new_position <= 64 &&
+          rules::play_move(state, piece_id, new_position, rules::packed_promotion_type(moves[i]), captured_piece_index, checkmate);
 
-      //first, check if this pawn has been promoted
-      uint8_t promoted_pawn_type = 0;
-      if (is_pawn_promoted(pawn_index, promoted_pawns, promoted_pawn_types, promoted_pawn_type)) {
-        //promoted pawn
-        if (promoted_pawn_type == PROMOTED_BISHOP) {
-          return valid_bishop_move(current_position, new_position, piece_positions, is_whites_move, captured_piece_index);
-        } else if (promoted_pawn_type == PROMOTED_KNIGHT) {
-          return valid_knight_move(current_position, new_position, piece_positions, is_whites_move, captured_piece_index);
-        } else if (promoted_pawn_type == PROMOTED_ROOK) {
-          return valid_rook_move(current_position, new_position, piece_positions, is_whites_move, captured_piece_index);
-        } else if (promoted_pawn_type == PROMOTED_QUEEN) {
-          return valid_queen_move(current_position, new_position, piece_positions, is_whites_move, captured_piece_index);
-        } else {
-          return false;
+        if (!legal) {
+          line += 'x';
+          break;
         }
-      } else {
-        //normal pawn
-        int diff = new_position - current_position;
-        if (is_whites_move) {
-          //white pawns can only move down
-          if (diff == 8 || diff == 16) {
-            //straight moves must be unblocked
-            for (int index = 0; index < 32; ++index) {
-              if (piece_positions[index] == new_position || piece_positions[index] == current_position + 8) {
-                return false;
-              }
-            }
-            en_passant_idx = diff == 16 ? pawn_index : 32;
-          } else if (diff == 7) {
-            //diagonal moves must capture
-            for (int index = 0; index < 32; ++index) {
-              if (is_enemy_piece(is_whites_move, index)) {
-                //check for enemy piece in target position, or in the en passant position
-                if (piece_positions[index] == new_position || (index == en_passant_idx && piece_positions[index] == (current_position - 1))) {
-                  captured_piece_index = index;
-                  break;
-                }
-              } else {
-                if (piece_positions[index] == new_position) {
-                  return false;
-                }
-              }
-            }
-          } else if (diff == 9) {
-            //diagonal moves must capture
-            for (int index = 0; index < 32; ++index) {
-              if (is_enemy_piece(is_whites_move, index)) {
-                //check for enemy piece in target position, or in the en passant position
-                if (piece_positions[index] == new_position || (index == en_passant_idx && piece_positions[index] == (current_position + 1))) {
-                  captured_piece_index = index;
-                  break;
-                }
-              } else {
-                if (piece_positions[index] == new_position) {
-                  return false;
-                }
-              }
-            }
-          } else {
-            return false;
-          }
-        } else {
-          //black pawns can only move up
-          if (diff == -8 || diff == -16) {
-            //straight moves must be unblocked
-            for (int index = 0; index < 32; ++index) {
-              if (piece_positions[index] == new_position || piece_positions[index] == current_position - 8) {
-                return false;
-              }
-            }
-            en_passant_idx = diff == -16 ? pawn_index : 32;
-          } else if (diff == -7) {
-            //diagonal moves must capture
-            for (int index = 0; index < 32; ++index) {
-              if (is_enemy_piece(is_whites_move, index)) {
-                //check for enemy piece in target position, or in the en passant position
-                if (piece_positions[index] == new_position || (index == en_passant_idx && piece_positions[index] == (current_position + 1))) {
-                  captured_piece_index = index;
-                  break;
-                }
-              } else {
-                if (piece_positions[index] == new_position) {
-                  return false;
-                }
-              }
-            }
-          } else if (diff == -9) {
-            //diagonal moves must capture
-            for (int index = 0; index < 32; ++index) {
-              if (is_enemy_piece(is_whites_move, index)) {
-                //check for enemy piece in target position, or in the en passant position
-                if (piece_positions[index] == new_position || (index == en_passant_idx && piece_positions[index] == (current_position - 1))) {
-                  captured_piece_index = index;
-                  break;
-                }
-              } else {
-                if (piece_positions[index] == new_position) {
-                  return false;
-                }
-              }
-            }
-          } else {
-            return false;
-          }
+        bool in_check = state.attacks.checkers != 0;
+#ifdef CHESS_LAZY_MATE
+        checkmate = in_check && rules::is_checkmate(state);
+#endif
+        line += checkmate ? '#' : in_check ? '+' : '.';
+        if (checkmate) {
+          break;
         }
       }
 
-      return true;
+      std::string report = "{\"game_id\":" + std::to_string(game_id) + ",\"ply\":" + std::to_string(itr->move_count) +
+        ",\"line\":\"" + line + "\",\"fen\":\"" + rules::fen(state) + "\"}";
+      //a longer message would come back cut off, and no longer parse
+      check(report.size() < MAX_ASSERT_MESSAGE, "Line report too long");
+      check(false, report);
     }
 
     /* *
-     * is_pawn_promoted
-     *  convenience function for checking pawn promotion
-     *  returns true if the pawn in pawn_index is alive, and has been promoted.  If so, returns the piece type in the promoted_pawn_type variable
+     * gameevent
+     *  does nothing; the contract sends it to itself as an inline action so indexers can follow games from action traces
+     *  instead of reading the games table.  See 'Game Events' above.
      * */
-    bool is_pawn_promoted (
-      uint8_t pawn_index,
-      uint16_t promoted_pawns,
-      uint32_t promoted_pawn_types,
-      uint8_t& promoted_pawn_type
+    [[eosio::action]]
+    void gameevent (
+      name event,
+      name scope,
+      uint64_t game_id,
+      uint32_t ply,
+      uint16_t move,
+      uint8_t captured_piece,
+      name winner
     ) {
-      if (pawn_index > 31) {
-        return false;
-      }
+			require_auth(get_self());
+    }
 
-      uint8_t offset = 0;
-      if (pawn_index < 16) {
-        offset = pawn_index - 8;
-      } else {
-        offset = pawn_index - 16;
-      }
+  /***************************************
+   * Private Helper Functions
+   ***************************************/
+  private:
 
-      bool promoted = (promoted_pawns & (0x01 << offset)) > 0;
+		struct [[eosio::table]] game {
+			uint64_t game_id;
+			name player_b;
+			name player_w;
+			name winner = ""_n;
+      name draw_decl = ""_n;
+			uint32_t move_count = 0;
+			uint8_t castle = 0;
+			uint8_t en_passant_idx = 32;
+			uint16_t promoted_pawns = 0;
+			uint32_t promoted_pawn_types = 0;
+			std::vector<uint8_t> piece_positions {4, 5, 3, 6, 2, 7, 1, 8, 9, 10, 11, 12, 13, 14, 15, 16, 60, 61, 59, 62, 58, 63, 57, 64, 49, 50, 51, 52, 53, 54, 55, 56};
 
-      if (promoted) {
-        promoted_pawn_type = (promoted_pawn_types & (0x03 << (offset * 2))) >> (offset * 2);
-      }
+			//added after the first games were played; see 'Row Layout' above
+			eosio::binary_extension<uint64_t> white_attacks;
+			eosio::binary_extension<uint64_t> black_attacks;
+			eosio::binary_extension<uint64_t> checkers;
+			eosio::binary_extension<std::vector<uint32_t>> premoves_w;
+			eosio::binary_extension<std::vector<uint32_t>> premoves_b;
 
-      return promoted;
-    }
+			auto primary_key() const { return game_id; }
+		};
+
+		typedef eosio::multi_index<"games"_n, game> games;
 
     /* *
-     * promote_pawn
-     *  convenience function for promoting a pawn
-     *  updates promoted_pawns and promoted_pawn_types
+     * scopeid
+     *  the id the next game of a scope gets; see 'Scopes' above
      * */
-    void promote_pawn (
-      uint8_t pawn_index,
-      uint16_t& promoted_pawns,
-      uint32_t& promoted_pawn_types,
-      uint8_t promoted_pawn_type
-    ) {
-      if (pawn_index > 31) {
-        return;
-      }
-      
-      uint8_t offset = 0;
-      if (pawn_index < 16) {
-        offset = pawn_index - 8;
-      } else {
-        offset = pawn_index - 16;
-      }
+		struct [[eosio::table]] scopeid {
+			name scope;
+			uint64_t next_game_id;
 
-      promoted_pawns = (promoted_pawns | (0x01 << offset));
-      promoted_pawn_types = (promoted_pawn_types | ((promoted_pawn_type & 0x03) << (offset * 2)));
-    }
+			auto primary_key() const { return scope.value; }
+		};
+
+		typedef eosio::multi_index<"scopeids"_n, scopeid> scopeids;
 
     /* *
-     * same_row
-     *  returns true if the two positions are valid and on the same row
+     * next_game_id
+     *  hands out the next game id of a scope and moves its counter on.  A scope whose games predate the counter starts
+     *  it after the highest id left in its table.
      * */
-    bool same_row (
-      uint8_t position1, 
-      uint8_t position2
+    uint64_t next_game_id (
+      name scope,
+      games& game_index
     ) {
-      if (position1 < 65 && position2 < 65) {
-        if (((position1 - 1) / 8) == ((position2 - 1) / 8)) {
-          return true;
-        }
-      }
-      return false;
+      scopeids ids(get_self(), get_self().value);
+      auto itr = ids.find(scope.value);
+      if (itr == ids.end()) {
+        uint64_t game_id = game_index.available_primary_key();
+        ids.emplace(get_self(), [&](auto& row) {
+          row.scope = scope;
+          row.next_game_id = game_id + 1;
+        });
+        return game_id;
+      }
+      uint64_t game_id = itr->next_game_id;
+      ids.modify(itr, get_self(), [&](auto& row) {
+        row.next_game_id = game_id + 1;
+      });
+      return game_id;
     }
 
     /* *
-     * same_col
-     *  returns true if the two positions are valid and on the same column
+     * game_state_of
+     *  copies the rule-relevant fields of a game row into a rules::game_state, rebuilding the attack maps of a row
+     *  written before they were stored
      * */
-    bool same_col(
-      uint8_t position1, 
-      uint8_t position2
+    static rules::game_state game_state_of (
+      const game& row
     ) {
-      if (position1 < 65 && position2 < 65) {
-        if ((position1 % 8) == (position2 % 8)) {
-          return true;
-        }
+      RULES_STAT(vector_copies);
+      rules::game_state state { row.move_count, row.castle, row.en_passant_idx, row.promoted_pawns, row.promoted_pawn_types, row.piece_positions,
+        { row.white_attacks.value_or(0), row.black_attacks.value_or(0), row.checkers.value_or(0) } };
+      if (!row.white_attacks.has_value() || !row.black_attacks.has_value() || !row.checkers.has_value()) {
+        rules::update_attacks(state);
       }
-      return false;
+      return state;
     }
 
     /* *
-     * same_nw_diag
-     *  returns true if the two positions are valid, and position 2 is on position 1's northwest diagonal
+     * upgrade_row
+     *  fills in the binary_extension fields a row written before them doesn't have, so any of them can be set; see
+     *  'Row Layout' above
      * */
-    bool same_nw_diag (
-      uint8_t position1, 
-      uint8_t position2
+    static void upgrade_row (
+      game& row
     ) {
-      if (position1 < 65 && position2 < 65) {
-        uint8_t diff = std::abs(position2 - position1);
-        uint8_t col1 = (position1 - 1) % 8;
-        uint8_t col2 = (position2 - 1) % 8;
-        if ((position1 > position2) && (col1 > col2) && (diff % 9 == 0)) {
-          return true;
-        }
+      if (!row.white_attacks.has_value() || !row.black_attacks.has_value() || !row.checkers.has_value()) {
+        rules::game_state state = game_state_of(row);
+        row.white_attacks.emplace(state.attacks.white);
+        row.black_attacks.emplace(state.attacks.black);
+        row.checkers.emplace(state.attacks.checkers);
+      }
+      if (!row.premoves_w.has_value()) {
+        row.premoves_w.emplace();
+      }
+      if (!row.premoves_b.has_value()) {
+        row.premoves_b.emplace();
       }
-      return false;
     }
 
     /* *
-     * same_ne_diag
-     *  returns true if the two positions are valid, and position 2 is on position 1's northeast diagonal
+     * emit_event
+     *  sends a 'gameevent' inline action
      * */
-    bool same_ne_diag (
-      uint8_t position1, 
-      uint8_t position2
+    void emit_event (
+      name event,
+      name scope,
+      uint64_t game_id,
+      uint32_t ply,
+      uint16_t move,
+      uint8_t captured_piece,
+      name winner
     ) {
-      if (position1 < 65 && position2 < 65) {
-        uint8_t diff = std::abs(position2 - position1);
-        uint8_t col1 = (position1 - 1) % 8;
-        uint8_t col2 = (position2 - 1) % 8;
-
-        if ((position1 > position2) && (col1 < col2) && (diff % 7 == 0)) {
-          return true;
-        }
-      }
-      return false;
+      action(permission_level{ get_self(), "active"_n }, get_self(), "gameevent"_n,
+        std::make_tuple(event, scope, game_id, ply, move, captured_piece, winner)).send();
     }
 
     /* *
-     * same_sw_diag
-     *  returns true if the two positions are valid, and position 2 is on position 1's southwest diagonal
+     * play_premove
+     *  looks in premoves for the entry matching the move just played.  If there is one, it's removed and its reply
+     *  played on state, with any capture in captured_piece_index; if not, premoves is cleared.  Returns the reply as it
+     *  should be matched against the other player's premoves (promotion type only kept for a promotion), or 0 if no
+     *  reply was played.
      * */
-    bool same_sw_diag (
-      uint8_t position1, 
-      uint8_t position2
+    static uint16_t play_premove (
+      rules::game_state& state,
+      std::vector<uint32_t>& premoves,
+      uint16_t played,
+      uint8_t& captured_piece_index,
+      bool& checkmate
     ) {
-      if (position1 < 65 && position2 < 65) {
-        uint8_t diff = std::abs(position2 - position1);
-        uint8_t col1 = (position1 - 1) % 8;
-        uint8_t col2 = (position2 - 1) % 8;
-
-        if ((position1 < position2) && (col1 > col2) && (diff % 7 == 0)) {
-          return true;
-        }
-      }
-      return false;
+      auto entry = std::find_if(premoves.begin(), premoves.end(), [&](uint32_t p) { return (p & 0xFFFF) == played; });
+      if (entry == premoves.end()) {
+        premoves.clear();
+        return 0;
+      }
+      uint16_t reply = *entry >> 16;
+      premoves.erase(entry);
+
+      //an illegal reply is dropped along with the rest of the list, and the player moves by hand
+      uint8_t piece_id = rules::packed_piece_id(reply);
+      uint8_t new_position = rules::packed_new_position(reply);
+      uint8_t promotion_type = rules::packed_promotion_type(reply);
+      uint16_t promoted_pawns = state.promoted_pawns;
+      if (!rules::play_move(state, piece_id, new_position, promotion_type, captured_piece_index, checkmate)) {
+        premoves.clear();
+        return 0;
+      }
+      return rules::pack_move(piece_id, new_position, state.promoted_pawns != promoted_pawns ? promotion_type : 0);
     }
 
+#ifdef CHESS_STATS
     /* *
-     * same_se_diag
-     *  returns true if the two positions are valid, and position 2 is on position 1's southeast diagonal
+     * stats_report
+     *  prints the rule counters for this action when it goes out of scope, so every way out of 'move' reports them
      * */
-    bool same_se_diag (
-      uint8_t position1, 
-      uint8_t position2
-    ) {
-      if (position1 < 65 && position2 < 65) {
-        uint8_t diff = std::abs(position2 - position1);
-        uint8_t col1 = (position1 - 1) % 8;
-        uint8_t col2 = (position2 - 1) % 8;
-
-        if ((position1 < position2) && (col1 < col2) && (diff % 9 == 0)) {
-          return true;
-        }
-      }
-      return false;
-    }
-
+    struct stats_report {
+      ~stats_report () {
+        const rules::rule_stats& s = rules::stats();
+        print(" [stats] valid_move ", s.valid_move, " king ", s.king_moves, " queen ", s.queen_moves, " bishop ", s.bishop_moves,
+          " knight ", s.knight_moves, " rook ", s.rook_moves, " pawn ", s.pawn_moves, " blocked ", s.blocked,
+          " attack_maps ", s.attack_maps, " piece_scans ", s.piece_scans,
+          " vector_copies ", s.vector_copies);
+      }
+    };
+#endif
+
+#ifdef CHESS_STATS_TABLE
     /* *
-     * blocked
-     *  returns true if the test_position is between current_position and new_position on a row, column, or diagonal
+     * movestat
+     *  the rule counters of one accepted move, stored in the 'movestats' table
      * */
-    bool blocked (
-      uint8_t current_position,
-      uint8_t new_position,
-      uint8_t test_position
-    ) {
-      if ((current_position < 65) && (new_position < 65) && (test_position < 65)) {
-        if (
-          (same_row(current_position, new_position) && same_row(current_position, test_position)) ||
-          (same_col(current_position, new_position) && same_col(current_position, test_position)) ||
-          (same_ne_diag(current_position, new_position) && same_ne_diag(current_position, test_position)) ||
-          (same_nw_diag(current_position, new_position) && same_nw_diag(current_position, test_position)) ||
-          (same_se_diag(current_position, new_position) && same_se_diag(current_position, test_position)) ||
-          (same_sw_diag(current_position, new_position) && same_sw_diag(current_position, test_position))
-        ) {
-          if ((current_position < new_position) && (current_position < test_position) && (test_position < new_position)) {
-            return true;
-          }
-          if ((current_position > new_position) && (current_position > test_position) && (test_position > new_position)) {
-            return true;
-          }
-        }
-      }
-      return false;
-    }
-
-    bool is_enemy_piece (
-      bool is_whites_move,
-      uint8_t piece_index
-    ) {
-      if (is_whites_move && piece_index > 15) { return true; }
-      else if (!is_whites_move && piece_index < 16) { return true; }
-      return false;
-    }
-
-		struct [[eosio::table]] game {
+		struct [[eosio::table]] movestat {
+			uint64_t id;
+			name scope;
 			uint64_t game_id;
-			name player_b;
-			name player_w;
-			name winner = ""_n;
-      name draw_decl = ""_n;
-			uint32_t move_count = 0;
-			uint8_t castle = 0;
-			uint8_t en_passant_idx = 32;
-			uint16_t promoted_pawns = 0;
-			uint32_t promoted_pawn_types = 0;
-			std::vector<uint8_t> piece_positions {4, 5, 3, 6, 2, 7, 1, 8, 9, 10, 11, 12, 13, 14, 15, 16, 60, 61, 59, 62, 58, 63, 57, 64, 49, 50, 51, 52, 53, 54, 55, 56};
-
-			auto primary_key() const { return game_id; }
+			uint32_t move_count;
+			uint8_t piece_id;
+			uint8_t new_position;
+			uint32_t valid_move;
+			uint32_t king_moves;
+			uint32_t queen_moves;
+			uint32_t bishop_moves;
+			uint32_t knight_moves;
+			uint32_t rook_moves;
+			uint32_t pawn_moves;
+			uint32_t blocked;
+			uint32_t attack_maps;
+			uint32_t piece_scans;
+			uint32_t vector_copies;
+
+			auto primary_key() const { return id; }
 		};
 
-		typedef eosio::multi_index<"games"_n, game> games;
+		typedef eosio::multi_index<"movestats"_n, movestat> movestats;
+
+    void record_stats (
+      name player,
+      name scope,
+      uint64_t game_id,
+      uint32_t move_count,
+      uint8_t piece_id,
+      uint8_t new_position
+    ) {
+      const rules::rule_stats& s = rules::stats();
+      movestats stats_index(get_self(), get_self().value);
+      stats_index.emplace(player, [&](auto& row) {
+        row.id = stats_index.available_primary_key();
+        row.scope = scope;
+        row.game_id = game_id;
+        row.move_count = move_count;
+        row.piece_id = piece_id;
+        row.new_position = new_position;
+        row.valid_move = s.valid_move;
+        row.king_moves = s.king_moves;
+        row.queen_moves = s.queen_moves;
+        row.bishop_moves = s.bishop_moves;
+        row.knight_moves = s.knight_moves;
+        row.rook_moves = s.rook_moves;
+        row.pawn_moves = s.pawn_moves;
+        row.blocked = s.blocked;
+        row.attack_maps = s.attack_maps;
+        row.piece_scans = s.piece_scans;
+        row.vector_copies = s.vector_copies;
+      });
+    }
+#endif
 
-		games game_index;
 };
 
-EOSIO_DISPATCH( chess, (newgame) (move) (concede) (draw) )
+EOSIO_DISPATCH( chess, (newgame) (move) (concede) (draw) (claimmate) (claimdraw) (premove) (dropscope) (checkline) (gameevent) )
@@ -0,0 +1,1844 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <string>
+#include <vector>
+
+//native builds look slider attacks up in tables (see tools/sliders.hpp); the contract keeps the ray walk
+#if !defined(__wasm__) && !defined(CHESS_RAY_SLIDERS)
+#define CHESS_TABLE_SLIDERS
+#include "tools/sliders.hpp"
+#endif
+
+/* *
+ * chess_rules.hpp
+ *  the move validation rules used by the chess contract.  Nothing in here depends on eosio, so the same code can be
+ *  compiled natively for the tools in the tools/ directory, which need to agree exactly with the contract about
+ *  which moves are legal.
+ *
+ *  See the comment at the top of chess.cpp for the board location, piece index, castling, en passant and pawn
+ *  promotion encodings used throughout.
+ * */
+
+#define W_CAS_Q 0x01
+#define W_CAS_K 0x02
+#define B_CAS_Q 0x04
+#define B_CAS_K 0x08
+
+#define PROMOTED_BISHOP 0x00
+#define PROMOTED_KNIGHT 0x01
+#define PROMOTED_ROOK   0x02
+#define PROMOTED_QUEEN  0x03
+
+namespace rules {
+
+/* *
+ * Rule stats
+ *  building with -DCHESS_STATS counts how often each expensive rules path runs, so a costly 'move' action can be tied
+ *  to the code that made it costly.  The counters are plain statics; the contract gets a fresh copy for every action,
+ *  and native code can clear them with reset_stats.  Without CHESS_STATS, RULES_STAT expands to nothing.
+ * */
+#ifdef CHESS_STATS
+struct rule_stats {
+  uint32_t valid_move = 0;
+  uint32_t king_moves = 0;
+  uint32_t queen_moves = 0;
+  uint32_t bishop_moves = 0;
+  uint32_t knight_moves = 0;
+  uint32_t rook_moves = 0;
+  uint32_t pawn_moves = 0;
+  uint32_t blocked = 0;
+  uint32_t attack_maps = 0;
+  uint32_t piece_scans = 0;   //loops over all 32 entries of piece_positions
+  uint32_t vector_copies = 0; //copies of piece_positions
+};
+
+inline rule_stats& stats () {
+  static rule_stats counters;
+  return counters;
+}
+
+inline void reset_stats () {
+  stats() = rule_stats();
+}
+
+#define RULES_STAT(counter) (++rules::stats().counter)
+#else
+#define RULES_STAT(counter)
+#endif
+
+/* *
+ * Compile-time rules
+ *  the rules are constexpr, so they can run in constant expressions - the perft checks at the bottom of this file
+ *  play the first plies of the game at compile time, and break the build if a change to the rules alters the move
+ *  counts.  Counting rule stats means writing to a static, which a constant expression can't do, so with CHESS_STATS
+ *  the rules are plain inline functions and the checks are skipped.  RULES_CONSTANT_EVALUATED() is true while a rule
+ *  runs in a constant expression, where native builds can't use their runtime tables.
+ * */
+#ifdef CHESS_STATS
+#define RULES_CONSTEXPR inline
+#define RULES_CONSTANT_EVALUATED() false
+#else
+#define RULES_CONSTEXPR constexpr
+#define RULES_CONSTANT_EVALUATED() __builtin_is_constant_evaluated()
+#endif
+
+constexpr int absolute (
+  int n
+) {
+  return n < 0 ? -n : n;
+}
+
+/* *
+ * piece_array
+ *  the 32 piece positions of a game (see the top of chess.cpp), held in place so positions can be copied without an
+ *  allocation and used in constant expressions.  The games table stores them as a vector, which converts both ways.
+ * */
+struct piece_array {
+  uint8_t positions[32] = {};
+
+  constexpr piece_array () = default;
+
+  constexpr piece_array (
+    std::initializer_list<uint8_t> values
+  ) {
+    size_t index = 0;
+    for (uint8_t value : values) {
+      if (index < 32) {
+        positions[index++] = value;
+      }
+    }
+  }
+
+  piece_array (
+    const std::vector<uint8_t>& values
+  ) {
+    for (size_t index = 0; index < 32 && index < values.size(); ++index) {
+      positions[index] = values[index];
+    }
+  }
+
+  operator std::vector<uint8_t> () const {
+    return std::vector<uint8_t>(positions, positions + 32);
+  }
+
+  constexpr uint8_t& operator[] (size_t index) { return positions[index]; }
+  constexpr const uint8_t& operator[] (size_t index) const { return positions[index]; }
+  static constexpr size_t size () { return 32; }
+  constexpr uint8_t* data () { return positions; }
+  constexpr const uint8_t* data () const { return positions; }
+  constexpr uint8_t* begin () { return positions; }
+  constexpr uint8_t* end () { return positions + 32; }
+  constexpr const uint8_t* begin () const { return positions; }
+  constexpr const uint8_t* end () const { return positions + 32; }
+
+  constexpr bool operator== (const piece_array& other) const {
+    for (size_t index = 0; index < 32; ++index) {
+      if (positions[index] != other.positions[index]) {
+        return false;
+      }
+    }
+    return true;
+  }
+  constexpr bool operator!= (const piece_array& other) const { return !(*this == other); }
+};
+
+/* *
+ * same_row
+ *  returns true if the two positions are valid and on the same row
+ * */
+RULES_CONSTEXPR bool same_row (
+  uint8_t position1, 
+  uint8_t position2
+) {
+  if (position1 < 65 && position2 < 65) {
+    if (((position1 - 1) / 8) == ((position2 - 1) / 8)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+/* *
+ * same_col
+ *  returns true if the two positions are valid and on the same column
+ * */
+RULES_CONSTEXPR bool same_col(
+  uint8_t position1, 
+  uint8_t position2
+) {
+  if (position1 < 65 && position2 < 65) {
+    if ((position1 % 8) == (position2 % 8)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+/* *
+ * same_nw_diag
+ *  returns true if the two positions are valid, and position 2 is on position 1's northwest diagonal
+ * */
+RULES_CONSTEXPR bool same_nw_diag (
+  uint8_t position1, 
+  uint8_t position2
+) {
+  if (position1 < 65 && position2 < 65) {
+    uint8_t diff = absolute(position2 - position1);
+    uint8_t col1 = (position1 - 1) % 8;
+    uint8_t col2 = (position2 - 1) % 8;
+    if ((position1 > position2) && (col1 > col2) && (diff % 9 == 0)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+/* *
+ * same_ne_diag
+ *  returns true if the two positions are valid, and position 2 is on position 1's northeast diagonal
+ * */
+RULES_CONSTEXPR bool same_ne_diag (
+  uint8_t position1, 
+  uint8_t position2
+) {
+  if (position1 < 65 && position2 < 65) {
+    uint8_t diff = absolute(position2 - position1);
+    uint8_t col1 = (position1 - 1) % 8;
+    uint8_t col2 = (position2 - 1) % 8;
+
+    if ((position1 > position2) && (col1 < col2) && (diff % 7 == 0)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+/* *
+ * same_sw_diag
+ *  returns true if the two positions are valid, and position 2 is on position 1's southwest diagonal
+ * */
+RULES_CONSTEXPR bool same_sw_diag (
+  uint8_t position1, 
+  uint8_t position2
+) {
+  if (position1 < 65 && position2 < 65) {
+    uint8_t diff = absolute(position2 - position1);
+    uint8_t col1 = (position1 - 1) % 8;
+    uint8_t col2 = (position2 - 1) % 8;
+
+    if ((position1 < position2) && (col1 > col2) && (diff % 7 == 0)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+/* *
+ * same_se_diag
+ *  returns true if the two positions are valid, and position 2 is on position 1's southeast diagonal
+ * */
+RULES_CONSTEXPR bool same_se_diag (
+  uint8_t position1, 
+  uint8_t position2
+) {
+  if (position1 < 65 && position2 < 65) {
+    uint8_t diff = absolute(position2 - position1);
+    uint8_t col1 = (position1 - 1) % 8;
+    uint8_t col2 = (position2 - 1) % 8;
+
+    if ((position1 < position2) && (col1 < col2) && (diff % 9 == 0)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+/* *
+ * blocked
+ *  returns true if the test_position is between current_position and new_position on a row, column, or diagonal
+ * */
+RULES_CONSTEXPR bool blocked (
+  uint8_t current_position,
+  uint8_t new_position,
+  uint8_t test_position
+) {
+  RULES_STAT(blocked);
+  if ((current_position < 65) && (new_position < 65) && (test_position < 65)) {
+    if (
+      (same_row(current_position, new_position) && same_row(current_position, test_position)) ||
+      (same_col(current_position, new_position) && same_col(current_position, test_position)) ||
+      (same_ne_diag(current_position, new_position) && same_ne_diag(current_position, test_position)) ||
+      (same_nw_diag(current_position, new_position) && same_nw_diag(current_position, test_position)) ||
+      (same_se_diag(current_position, new_position) && same_se_diag(current_position, test_position)) ||
+      (same_sw_diag(current_position, new_position) && same_sw_diag(current_position, test_position))
+    ) {
+      if ((current_position < new_position) && (current_position < test_position) && (test_position < new_position)) {
+        return true;
+      }
+      if ((current_position > new_position) && (current_position > test_position) && (test_position > new_position)) {
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+RULES_CONSTEXPR bool is_enemy_piece (
+  bool is_whites_move,
+  uint8_t piece_index
+) {
+  if (is_whites_move && piece_index > 15) { return true; }
+  else if (!is_whites_move && piece_index < 16) { return true; }
+  return false;
+}
+
+/* *
+ * is_pawn_promoted
+ *  convenience function for checking pawn promotion
+ *  returns true if the pawn in pawn_index is alive, and has been promoted.  If so, returns the piece type in the promoted_pawn_type variable
+ * */
+RULES_CONSTEXPR bool is_pawn_promoted (
+  uint8_t pawn_index,
+  uint16_t promoted_pawns,
+  uint32_t promoted_pawn_types,
+  uint8_t& promoted_pawn_type
+) {
+  if (pawn_index > 31) {
+    return false;
+  }
+
+  uint8_t offset = 0;
+  if (pawn_index < 16) {
+    offset = pawn_index - 8;
+  } else {
+    offset = pawn_index - 16;
+  }
+
+  bool promoted = (promoted_pawns & (0x01 << offset)) > 0;
+
+  if (promoted) {
+    promoted_pawn_type = (promoted_pawn_types & (0x03 << (offset * 2))) >> (offset * 2);
+  }
+
+  return promoted;
+}
+
+/* *
+ * promote_pawn
+ *  convenience function for promoting a pawn
+ *  updates promoted_pawns and promoted_pawn_types
+ * */
+RULES_CONSTEXPR void promote_pawn (
+  uint8_t pawn_index,
+  uint16_t& promoted_pawns,
+  uint32_t& promoted_pawn_types,
+  uint8_t promoted_pawn_type
+) {
+  if (pawn_index > 31) {
+    return;
+  }
+  
+  uint8_t offset = 0;
+  if (pawn_index < 16) {
+    offset = pawn_index - 8;
+  } else {
+    offset = pawn_index - 16;
+  }
+
+  promoted_pawns = (promoted_pawns | (0x01 << offset));
+  promoted_pawn_types = (promoted_pawn_types | ((promoted_pawn_type & 0x03) << (offset * 2)));
+}
+
+//a position's bit in a board of 64 bits (bit position - 1), none for position 0
+constexpr uint64_t square_bit (
+  uint8_t position
+) {
+  return position == 0 ? 0 : (uint64_t)1 << (position - 1);
+}
+
+/* *
+ * attack_tables
+ *  the squares attacked from every board position on an empty board, worked out at compile time so they end up in
+ *  the contract's data segment.  rays holds the eight sliding directions, positive steps first.
+ * */
+inline constexpr int ray_steps[8][2] = { {1, 1}, {8, 0}, {7, -1}, {9, 1}, {-1, -1}, {-8, 0}, {-7, 1}, {-9, -1} };
+
+struct attack_tables {
+  uint64_t rays[8][65] = {};
+  uint64_t knight[65] = {};
+  uint64_t pawn[2][65] = {}; //[0] black, [1] white
+};
+
+constexpr attack_tables build_attack_tables () {
+  attack_tables tables;
+  const int jumps[8][2] = { {6, -2}, {10, 2}, {15, -1}, {17, 1}, {-6, 2}, {-10, -2}, {-15, 1}, {-17, -1} };
+  for (int position = 1; position < 65; ++position) {
+    int col = (position - 1) % 8;
+    for (int dir = 0; dir < 8; ++dir) {
+      for (int next = position + ray_steps[dir][0], next_col = col + ray_steps[dir][1];
+        next > 0 && next < 65 && next_col >= 0 && next_col < 8;
+        next += ray_steps[dir][0], next_col += ray_steps[dir][1]) {
+        tables.rays[dir][position] |= square_bit(next);
+      }
+    }
+    for (int jump = 0; jump < 8; ++jump) {
+      int next = position + jumps[jump][0];
+      if (next > 0 && next < 65 && col + jumps[jump][1] >= 0 && col + jumps[jump][1] < 8) {
+        tables.knight[position] |= square_bit(next);
+      }
+    }
+    //no edge check on pawn diagonals, like valid_pawn_move
+    for (int diff : {7, 9}) {
+      if (position + diff < 65) {
+        tables.pawn[1][position] |= square_bit(position + diff);
+      }
+      if (position - diff > 0) {
+        tables.pawn[0][position] |= square_bit(position - diff);
+      }
+    }
+  }
+  return tables;
+}
+
+inline constexpr attack_tables empty_board_attacks = build_attack_tables();
+
+/* *
+ * ray_attacks
+ *  the squares attacked from position in direction dir, up to and including the first square in occupied.  Square 64
+ *  (or 1, for the backwards directions) always counts as a blocker, which saves a branch for rays that reach the edge -
+ *  no ray in that direction starts from there.
+ * */
+RULES_CONSTEXPR uint64_t ray_attacks (
+  uint8_t position,
+  uint8_t dir,
+  uint64_t occupied
+) {
+  uint64_t ray = empty_board_attacks.rays[dir][position];
+  uint8_t blocker = dir < 4 ?
+    __builtin_ctzll((ray & occupied) | square_bit(64)) + 1 :
+    64 - __builtin_clzll((ray & occupied) | square_bit(1));
+  return ray ^ empty_board_attacks.rays[dir][blocker];
+}
+
+/* *
+ * rook_attacks, bishop_attacks
+ *  the squares a rook or bishop on position attacks, up to and including the first square in occupied along each
+ *  line.  Native builds look them up in the tables of tools/sliders.hpp, outside of constant expressions.
+ * */
+RULES_CONSTEXPR uint64_t rook_attacks (
+  uint8_t position,
+  uint64_t occupied
+) {
+#ifdef CHESS_TABLE_SLIDERS
+  if (!RULES_CONSTANT_EVALUATED() && sliders::tables.kind != sliders::SLIDERS_RAYS) {
+    return sliders::rook_attacks(position, occupied);
+  }
+#endif
+  return ray_attacks(position, 0, occupied) | ray_attacks(position, 1, occupied) |
+    ray_attacks(position, 4, occupied) | ray_attacks(position, 5, occupied);
+}
+
+RULES_CONSTEXPR uint64_t bishop_attacks (
+  uint8_t position,
+  uint64_t occupied
+) {
+#ifdef CHESS_TABLE_SLIDERS
+  if (!RULES_CONSTANT_EVALUATED() && sliders::tables.kind != sliders::SLIDERS_RAYS) {
+    return sliders::bishop_attacks(position, occupied);
+  }
+#endif
+  return ray_attacks(position, 2, occupied) | ray_attacks(position, 3, occupied) |
+    ray_attacks(position, 6, occupied) | ray_attacks(position, 7, occupied);
+}
+
+RULES_CONSTEXPR bool valid_king_move (
+  uint8_t current_position,
+  uint8_t new_position,
+  uint8_t castle,
+  const piece_array& piece_positions,
+  bool is_whites_move,
+  uint8_t& captured_piece_index
+) {
+  RULES_STAT(king_moves);
+  int diff = new_position - current_position;
+  int abs_diff = absolute(diff);
+
+  //check that the king has only moved 1 space in any direction
+	if (abs_diff != 1 && abs_diff != 7 && abs_diff != 8 && abs_diff != 9) {
+		return false;
+	}
+
+  //check that the king has not moved off the edge
+	if ( ((diff == -7 || diff == 1 || diff == 9) && current_position % 8 == 0) ||
+		((diff == -9 || diff == -8 || diff == -7) && current_position < 9) ||
+		((diff == -9 || diff == -1 || diff == 7) && current_position % 8 == 1) ||
+		((diff == 7 || diff == 8 || diff == 9) && current_position > 56) )
+	{
+		return false;
+	}
+
+  //search through other pieces to see if one of them has been captured, or if a friendly piece is blocking this move
+  RULES_STAT(piece_scans);
+  for (int index = 0; index < 32; ++index) {
+    if (piece_positions[index] == new_position) {
+      if (is_enemy_piece(is_whites_move, index)) {
+        captured_piece_index = index;
+      } else {
+        return false;
+      }
+    }
+  }
+
+	return true;
+}
+
+RULES_CONSTEXPR bool valid_queen_move (
+  uint8_t current_position,
+  uint8_t new_position,
+  const piece_array& piece_positions,
+  bool is_whites_move,
+  uint8_t& captured_piece_index
+) {
+  RULES_STAT(queen_moves);
+
+  //current position zero means this piece has already been captured
+  if (current_position == 0) {
+    return false;
+  }
+
+  //check that the move is on a row, column, or diagonal
+  if (
+    !same_row(current_position, new_position) &&
+    !same_col(current_position, new_position) &&
+    !same_ne_diag(current_position, new_position) &&
+    !same_nw_diag(current_position, new_position) &&
+    !same_se_diag(current_position, new_position) &&
+    !same_sw_diag(current_position, new_position)
+  ) {
+    return false;
+  }  
+
+  //check that none of the other uncaptured pieces on the board are blocking this move, and figure out if this move captures another piece
+  RULES_STAT(piece_scans);
+  uint64_t occupied = 0;
+  uint8_t captured = 32;
+  for (uint8_t index = 0; index < 32; ++index) {
+    if (piece_positions[index] == new_position) {
+      if (is_enemy_piece(is_whites_move, index)) {
+        captured = index;
+      } else {
+        return false;
+      }
+    }
+    occupied |= square_bit(piece_positions[index]);
+  }
+  if (((rook_attacks(current_position, occupied) | bishop_attacks(current_position, occupied)) & square_bit(new_position)) == 0) {
+    return false;
+  }
+
+  if (captured < 32) {
+    captured_piece_index = captured;
+  }
+  return true;
+}
+
+RULES_CONSTEXPR bool valid_bishop_move (
+  uint8_t current_position,
+  uint8_t new_position,
+  const piece_array& piece_positions,
+  bool is_whites_move,
+  uint8_t& captured_piece_index
+) {
+  RULES_STAT(bishop_moves);
+
+  //current position zero means this piece has already been captured
+  if (current_position == 0) {
+    return false;
+  }
+
+  //check move is on a diagonal from current position
+  if (
+    !same_ne_diag(current_position, new_position) &&
+    !same_nw_diag(current_position, new_position) &&
+    !same_se_diag(current_position, new_position) &&
+    !same_sw_diag(current_position, new_position)
+  ) {
+    return false;
+  }
+
+  //check for other pieces blocking this move, and find any captured pieces
+  RULES_STAT(piece_scans);
+  uint64_t occupied = 0;
+  uint8_t captured = 32;
+  for (uint8_t index = 0; index < 32; ++index) {
+    if (piece_positions[index] == new_position) {
+      if (is_enemy_piece(is_whites_move, index)) {
+        captured = index;
+      } else {
+        return false;
+      }
+    }
+    occupied |= square_bit(piece_positions[index]);
+  }
+  if ((bishop_attacks(current_position, occupied) & square_bit(new_position)) == 0) {
+    return false;
+  }
+
+  if (captured < 32) {
+    captured_piece_index = captured;
+  }
+  return true;
+}
+
+RULES_CONSTEXPR bool valid_knight_move (
+  uint8_t current_position,
+  uint8_t new_position,
+  const piece_array& piece_positions,
+  bool is_whites_move,
+  uint8_t& captured_piece_index
+) {
+  RULES_STAT(knight_moves);
+	int diff = new_position - current_position;
+	int abs_diff = absolute(diff);
+
+  //current position zero means this piece has already been captured
+  if (current_position == 0) {
+    return false;
+  }
+
+  //check that the move is valid
+	if (abs_diff != 6 && abs_diff != 10 && abs_diff != 15 && abs_diff != 17) {
+		return false;
+	}
+
+  //check that the move does not send the knight off the edge
+	if (((diff == 6  || diff == -10) && ((current_position - 1) % 8) < 2) ||
+		((diff == 15 || diff == -17) && ((current_position - 1) % 8) < 1) ||
+		((diff == 17 || diff == -15) && ((current_position - 1) % 8) > 6) ||
+		((diff == 10 || diff ==  -6) && ((current_position - 1) % 8) > 5) ||
+		((diff == -17 || diff == -15) && (current_position < 17)) ||
+		((diff == -10 || diff == -6) && (current_position < 9)) ||
+		((diff == 6 || diff == 10) && (current_position > 56)) ||
+		((diff == 15 || diff == 17) && (current_position > 48)) )
+	{
+		return false;
+	}
+  
+  RULES_STAT(piece_scans);
+  for (int index = 0; index < 32; ++index) {
+    if (piece_positions[index] == new_position) {
+      if (is_enemy_piece(is_whites_move, index)) {
+        captured_piece_index = index;
+      } else {
+        return false;
+      }
+    }
+  }
+
+  return true;
+}
+
+RULES_CONSTEXPR bool valid_rook_move (
+  uint8_t current_position,
+  uint8_t new_position,
+  const piece_array& piece_positions,
+  bool is_whites_move,
+  uint8_t& captured_piece_index
+) {
+  RULES_STAT(rook_moves);
+
+  //current position zero means this piece has already been captured
+  if (current_position == 0) {
+    return false;
+  }
+
+  //check move is on a row or column from current position
+  if (
+    !same_row(current_position, new_position) &&
+    !same_col(current_position, new_position)
+  ) {
+    return false;
+  }
+
+  RULES_STAT(piece_scans);
+  uint64_t occupied = 0;
+  uint8_t captured = 32;
+  for (uint8_t index = 0; index < 32; ++index) {
+    if (piece_positions[index] == new_position) {
+      if (is_enemy_piece(is_whites_move, index)) {
+        captured = index;
+      } else {
+        return false;
+      }
+    }
+    occupied |= square_bit(piece_positions[index]);
+  }
+  if ((rook_attacks(current_position, occupied) & square_bit(new_position)) == 0) {
+    return false;
+  }
+
+  if (captured < 32) {
+    captured_piece_index = captured;
+  }
+  return true;
+}
+
+RULES_CONSTEXPR bool valid_pawn_move (
+  uint8_t pawn_index, //NOTICE: this needs an index instead of a position
+  uint8_t new_position,
+  const piece_array& piece_positions,
+  bool is_whites_move,
+  uint8_t& captured_piece_index,
+  uint16_t promoted_pawns,
+  uint32_t promoted_pawn_types,
+  uint8_t& en_passant_idx
+) {
+  RULES_STAT(pawn_moves);
+
+  uint8_t current_position = piece_positions[pawn_index];
+
+  //current position zero means this piece has already been captured
+  if (current_position == 0) {
+    return false;
+  }
+
+  //first, check if this pawn has been promoted
+  uint8_t promoted_pawn_type = 0;
+  if (is_pawn_promoted(pawn_index, promoted_pawns, promoted_pawn_types, promoted_pawn_type)) {
+    //promoted pawn
+    if (promoted_pawn_type == PROMOTED_BISHOP) {
+      return valid_bishop_move(current_position, new_position, piece_positions, is_whites_move, captured_piece_index);
+    } else if (promoted_pawn_type == PROMOTED_KNIGHT) {
+      return valid_knight_move(current_position, new_position, piece_positions, is_whites_move, captured_piece_index);
+    } else if (promoted_pawn_type == PROMOTED_ROOK) {
+      return valid_rook_move(current_position, new_position, piece_positions, is_whites_move, captured_piece_index);
+    } else if (promoted_pawn_type == PROMOTED_QUEEN) {
+      return valid_queen_move(current_position, new_position, piece_positions, is_whites_move, captured_piece_index);
+    } else {
+      return false;
+    }
+  } else {
+    //normal pawn
+    int diff = new_position - current_position;
+    if (is_whites_move) {
+      //white pawns can only move down
+      if (diff == 8 || diff == 16) {
+        //straight moves must be unblocked
+        RULES_STAT(piece_scans);
+        for (int index = 0; index < 32; ++index) {
+          if (piece_positions[index] == new_position || piece_positions[index] == current_position + 8) {
+            return false;
+          }
+        }
+        en_passant_idx = diff == 16 ? pawn_index : 32;
+      } else if (diff == 7) {
+        //diagonal moves must capture
+        RULES_STAT(piece_scans);
+        for (int index = 0; index < 32; ++index) {
+          if (is_enemy_piece(is_whites_move, index)) {
+            //check for enemy piece in target position, or in the en passant position
+            if (piece_positions[index] == new_position || (index == en_passant_idx && piece_positions[index] == (current_position - 1))) {
+              captured_piece_index = index;
+              break;
+            }
+          } else {
+            if (piece_positions[index] == new_position) {
+              return false;
+            }
+          }
+        }
+      } else if (diff == 9) {
+        //diagonal moves must capture
+        RULES_STAT(piece_scans);
+        for (int index = 0; index < 32; ++index) {
+          if (is_enemy_piece(is_whites_move, index)) {
+            //check for enemy piece in target position, or in the en passant position
+            if (piece_positions[index] == new_position || (index == en_passant_idx && piece_positions[index] == (current_position + 1))) {
+              captured_piece_index = index;
+              break;
+            }
+          } else {
+            if (piece_positions[index] == new_position) {
+              return false;
+            }
+          }
+        }
+      } else {
+        return false;
+      }
+    } else {
+      //black pawns can only move up
+      if (diff == -8 || diff == -16) {
+        //straight moves must be unblocked
+        RULES_STAT(piece_scans);
+        for (int index = 0; index < 32; ++index) {
+          if (piece_positions[index] == new_position || piece_positions[index] == current_position - 8) {
+            return false;
+          }
+        }
+        en_passant_idx = diff == -16 ? pawn_index : 32;
+      } else if (diff == -7) {
+        //diagonal moves must capture
+        RULES_STAT(piece_scans);
+        for (int index = 0; index < 32; ++index) {
+          if (is_enemy_piece(is_whites_move, index)) {
+            //check for enemy piece in target position, or in the en passant position
+            if (piece_positions[index] == new_position || (index == en_passant_idx && piece_positions[index] == (current_position + 1))) {
+              captured_piece_index = index;
+              break;
+            }
+          } else {
+            if (piece_positions[index] == new_position) {
+              return false;
+            }
+          }
+        }
+      } else if (diff == -9) {
+        //diagonal moves must capture
+        RULES_STAT(piece_scans);
+        for (int index = 0; index < 32; ++index) {
+          if (is_enemy_piece(is_whites_move, index)) {
+            //check for enemy piece in target position, or in the en passant position
+            if (piece_positions[index] == new_position || (index == en_passant_idx && piece_positions[index] == (current_position - 1))) {
+              captured_piece_index = index;
+              break;
+            }
+          } else {
+            if (piece_positions[index] == new_position) {
+              return false;
+            }
+          }
+        }
+      } else {
+        return false;
+      }
+    }
+  }
+
+  return true;
+}
+
+/* *
+ * returns true if the position specified is checked by the opposing color.
+ *  @param is_white_piece - specifies the color of the current player ex) is_white_piece == true means to check if any black pieces are checking position
+ *  @param piece_positions - vector of all piece positions
+ *  @param promoted_pawns - bit vector specifying which pawns are promoted
+ *  @param promoted_pawn_type - specifies what type of piece a pawn has been promoted to
+ * */
+RULES_CONSTEXPR bool in_check (
+  bool is_whites_move,
+  const piece_array& piece_positions,
+	uint16_t promoted_pawns,
+	uint32_t promoted_pawn_types
+) {
+  //find out which enemy pieces are threatening the king
+  uint8_t throwaway = 0; //validity functions return the index of any enemy piece in the target 'position', but we don't care about that here so we use this throwaway variable as a placeholder
+  uint8_t position = is_whites_move ? piece_positions[0] : piece_positions[16]; //position of the king we are checking
+
+  //check enemy king - no possibility of another piece being in between, so we can just check if the enemy king is next to this space
+  uint8_t enemy_king_pos = is_whites_move ? piece_positions[16] : piece_positions[0];
+  if (valid_king_move(enemy_king_pos, position, 0xFF, piece_positions, is_whites_move, throwaway)) {
+    return true;
+  }
+
+  uint8_t enemy_queen_pos = is_whites_move ? piece_positions[17] : piece_positions[1];
+  if (valid_queen_move(enemy_queen_pos, position, piece_positions, !is_whites_move, throwaway)) {
+    return true;
+  }
+
+  uint8_t enemy_bishop1_pos = is_whites_move ? piece_positions[18] : piece_positions[2];
+  if (valid_bishop_move(enemy_bishop1_pos, position, piece_positions, !is_whites_move, throwaway)) {
+    return true;
+  }
+
+  uint8_t enemy_bishop2_pos = is_whites_move ? piece_positions[19] : piece_positions[3];
+  if (valid_bishop_move(enemy_bishop2_pos, position, piece_positions, !is_whites_move, throwaway)) {
+    return true;
+  }
+
+  uint8_t enemy_knight1_pos = is_whites_move ? piece_positions[20] : piece_positions[4];
+  if (valid_knight_move(enemy_knight1_pos, position, piece_positions, !is_whites_move, throwaway)) {
+    return true;
+  }
+
+  uint8_t enemy_knight2_pos = is_whites_move ? piece_positions[21] : piece_positions[5];
+  if (valid_knight_move(enemy_knight2_pos, position, piece_positions, !is_whites_move, throwaway)) {
+    return true;
+  }
+
+  uint8_t enemy_rook1_pos = is_whites_move ? piece_positions[22] : piece_positions[6];
+  if (valid_rook_move(enemy_rook1_pos, position, piece_positions, !is_whites_move, throwaway)) {
+    return true;
+  }
+
+  uint8_t enemy_rook2_pos = is_whites_move ? piece_positions[23] : piece_positions[7];
+  if (valid_rook_move(enemy_rook2_pos, position, piece_positions, !is_whites_move, throwaway)) {
+    return true;
+  }
+
+  uint8_t enemy_pawn_index_offset = is_whites_move ? 24 : 8;
+  for (uint8_t index = 0; index < 8; ++index) {
+    uint8_t enemy_pawn_index = index + enemy_pawn_index_offset;
+    uint8_t ep_invalid = 32; //can't check a space using en passant, so pass in the invalid index to the pawn validation function
+    if (valid_pawn_move(enemy_pawn_index, position, piece_positions, !is_whites_move, throwaway, promoted_pawns, promoted_pawn_types, ep_invalid)) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+RULES_CONSTEXPR bool in_checkmate (
+  bool check_white,
+  const piece_array piece_positions,
+	uint16_t promoted_pawns,
+	uint32_t promoted_pawn_types
+) {
+  RULES_STAT(vector_copies); //piece_positions is passed by value
+  uint8_t king_pos = check_white ? 0 : 16; //index of the king being checked, not its board position
+  uint8_t captured_idx = 32;
+  RULES_STAT(vector_copies);
+  piece_array new_piece_positions (piece_positions);
+
+  //first, check if the king can move 1 space in any direction
+  new_piece_positions[king_pos] = piece_positions[king_pos] + 1;
+  if (valid_king_move(piece_positions[king_pos], new_piece_positions[king_pos], 0xFF, piece_positions, check_white, captured_idx)) {
+    //remove any captured piece in the new positions array
+    if (captured_idx < 32) {
+      new_piece_positions[captured_idx] = 0;
+    }
+    if (!in_check(check_white, new_piece_positions, promoted_pawns, promoted_pawn_types)) {
+      return false;
+    }
+    //reset any captured piece to its initial position
+    if (captured_idx < 32) {
+      new_piece_positions[captured_idx] = piece_positions[captured_idx];
+      captured_idx = 32;
+    }
+
+  }
+
+  new_piece_positions[king_pos] = piece_positions[king_pos] - 1;
+  if (valid_king_move(piece_positions[king_pos], new_piece_positions[king_pos], 0xFF, piece_positions, check_white, captured_idx)) {
+    //remove any captured piece in the new positions array
+    if (captured_idx < 32) {
+      new_piece_positions[captured_idx] = 0;
+    }
+    if (!in_check(check_white, new_piece_positions, promoted_pawns, promoted_pawn_types)) {
+      return false;
+    }
+    //reset any captured piece to its initial position
+    if (captured_idx < 32) {
+      new_piece_positions[captured_idx] = piece_positions[captured_idx];
+      captured_idx = 32;
+    }
+  }
+
+  for (int offset = -9; offset < -6; ++offset) {
+    uint8_t king_pos = check_white ? 0 : 16;
+    new_piece_positions[king_pos] = piece_positions[king_pos] + offset;
+    if (valid_king_move(piece_positions[king_pos], new_piece_positions[king_pos], 0xFF, piece_positions, check_white, captured_idx)) {
+      //remove any captured piece in the new positions array
+      if (captured_idx < 32) {
+        new_piece_positions[captured_idx] = 0;
+      }
+      if (!in_check(check_white, new_piece_positions, promoted_pawns, promoted_pawn_types)) {
+        return false;
+      }
+      //reset any captured piece to its initial position
+      if (captured_idx < 32) {
+        new_piece_positions[captured_idx] = piece_positions[captured_idx];
+        captured_idx = 32;
+      }
+    }
+  }
+
+  for (int offset = 7; offset < 10; ++offset) {
+    uint8_t king_pos = check_white ? 0 : 16;
+    new_piece_positions[king_pos] = piece_positions[king_pos] + offset;
+    if (valid_king_move(piece_positions[king_pos], new_piece_positions[king_pos], 0xFF, piece_positions, check_white, captured_idx)) {
+      //remove any captured piece in the new positions array
+      if (captured_idx < 32) {
+        new_piece_positions[captured_idx] = 0;
+      }
+      if (!in_check(check_white, new_piece_positions, promoted_pawns, promoted_pawn_types)) {
+        return false;
+      }
+      //reset any captured piece to its initial position
+      if (captured_idx < 32) {
+        new_piece_positions[captured_idx] = piece_positions[captured_idx];
+        captured_idx = 32;
+      }
+    }
+  }
+
+  //TODO: look for any pieces that threaten the king's current position.  If any exist, see if they are capturable in one move, or if they can be blocked by a non-king move.
+  //if all valid king moves are checked, see if the current position is checked
+  if (!in_check(check_white, piece_positions, promoted_pawns, promoted_pawn_types)) {
+    return false;
+  } else {
+  }
+
+  return true;
+}
+
+/* *
+ * piece_type
+ *  returns the type of piece at piece_index, taking pawn promotion into account
+ * */
+#define PIECE_KING   0
+#define PIECE_QUEEN  1
+#define PIECE_BISHOP 2
+#define PIECE_KNIGHT 3
+#define PIECE_ROOK   4
+#define PIECE_PAWN   5
+
+RULES_CONSTEXPR uint8_t piece_type (
+  uint8_t piece_index,
+  uint16_t promoted_pawns,
+  uint32_t promoted_pawn_types
+) {
+  switch (piece_index % 16) {
+    case 0 : return PIECE_KING;
+    case 1 : return PIECE_QUEEN;
+    case 2 ... 3 : return PIECE_BISHOP;
+    case 4 ... 5 : return PIECE_KNIGHT;
+    case 6 ... 7 : return PIECE_ROOK;
+  }
+
+  uint8_t promoted_pawn_type = 0;
+  if (is_pawn_promoted(piece_index, promoted_pawns, promoted_pawn_types, promoted_pawn_type)) {
+    switch (promoted_pawn_type) {
+      case PROMOTED_BISHOP : return PIECE_BISHOP;
+      case PROMOTED_KNIGHT : return PIECE_KNIGHT;
+      case PROMOTED_ROOK   : return PIECE_ROOK;
+      default              : return PIECE_QUEEN;
+    }
+  }
+  return PIECE_PAWN;
+}
+
+/* *
+ * Attack maps
+ *  the squares one side attacks, one bit per board position (bit position - 1).  A square is attacked if in_check
+ *  would find a king of the other side standing on it in check, so squares holding the side's own pieces count, kings
+ *  attack nothing (valid_king_move won't move onto the other king), and pawn diagonals aren't stopped by the edge of
+ *  the board, just like valid_pawn_move.
+ *
+ *  The king under attack is left off the board while a map is built, so squares behind it on an attacker's line count
+ *  as attacked - it can't escape a check by stepping back along the checking line.
+ *
+ *  The game row stores both maps for the current position, along with the squares of any pieces checking the player
+ *  to move.  valid_move builds the maps of the position after a move once, then castling, self-check and checkmate
+ *  are all lookups in them.  Most moves only rebuild the mover's map: the enemy's can only change if a line of theirs
+ *  ran through a square the move emptied or filled, or a piece of theirs was captured.
+ * */
+#define INITIAL_WHITE_ATTACKS 0x0000000001FFFB6AULL
+#define INITIAL_BLACK_ATTACKS 0x6AFBFF8000000000ULL
+
+struct attack_maps {
+  uint64_t white = INITIAL_WHITE_ATTACKS;
+  uint64_t black = INITIAL_BLACK_ATTACKS;
+  uint64_t checkers = 0; //squares of the pieces checking the player to move
+};
+
+/* *
+ * piece_attacks
+ *  the squares attacked by a piece of the given type on position, with the squares in occupied blocking sliders
+ * */
+RULES_CONSTEXPR uint64_t piece_attacks (
+  uint8_t type,
+  uint8_t position,
+  bool white,
+  uint64_t occupied
+) {
+  switch (type) {
+    case PIECE_QUEEN :
+      return rook_attacks(position, occupied) | bishop_attacks(position, occupied);
+    case PIECE_ROOK :
+      return rook_attacks(position, occupied);
+    case PIECE_BISHOP :
+      return bishop_attacks(position, occupied);
+    case PIECE_KNIGHT :
+      return empty_board_attacks.knight[position];
+    case PIECE_PAWN :
+      return empty_board_attacks.pawn[white ? 1 : 0][position];
+  }
+  return 0;
+}
+
+/* *
+ * attacks_of
+ *  builds the attack map of one side.  The square of every piece attacking the other side's king is added to checkers.
+ * */
+RULES_CONSTEXPR uint64_t attacks_of (
+  bool white,
+  const piece_array& piece_positions,
+  uint16_t promoted_pawns,
+  uint32_t promoted_pawn_types,
+  uint64_t& checkers
+) {
+  RULES_STAT(attack_maps);
+  uint8_t enemy_king_index = white ? 16 : 0;
+  uint64_t enemy_king = square_bit(piece_positions[enemy_king_index]);
+
+  RULES_STAT(piece_scans);
+  uint64_t occupied = 0;
+  for (uint8_t index = 0; index < 32; ++index) {
+    if (index != enemy_king_index) {
+      occupied |= square_bit(piece_positions[index]);
+    }
+  }
+
+  //skip the king, it doesn't attack anything
+  uint64_t attacks = 0;
+  uint8_t first_piece = white ? 0 : 16;
+  for (uint8_t index = first_piece + 1; index < first_piece + 16; ++index) {
+    uint8_t position = piece_positions[index];
+    if (position == 0) {
+      continue;
+    }
+    uint64_t squares = piece_attacks(piece_type(index, promoted_pawns, promoted_pawn_types), position, white, occupied);
+    if (squares & enemy_king) {
+      checkers |= square_bit(position);
+    }
+    attacks |= squares;
+  }
+  return attacks;
+}
+
+/* *
+ * king_can_move
+ *  returns true if the king has a move to a square outside enemy_attacks.  These are the king moves in_checkmate tries.
+ * */
+RULES_CONSTEXPR bool king_can_move (
+  bool white,
+  const piece_array& piece_positions,
+  uint64_t enemy_attacks
+) {
+  uint8_t king_position = piece_positions[white ? 0 : 16];
+  for (int step : {1, -1, -9, -8, -7, 7, 8, 9}) {
+    uint8_t new_position = king_position + step;
+    uint8_t captured_idx = 32;
+    if (valid_king_move(king_position, new_position, 0xFF, piece_positions, white, captured_idx) && (enemy_attacks & square_bit(new_position)) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+/* *
+ * valid_move
+ *  checks the following-
+ *  - is this piece alive?
+ *  - is the path to the new position valid and unblocked?
+ *  - does this move leave player's king unchecked?
+ *  - was any piece captured? - if so, update captured_piece_index
+ *  - are we castling? - if so, update castle
+ *  - was a pawn moved two spaces from it's start? - if so, update en_passant_idx, if not, reset en_passant_idx
+ *  - was a pawn promoted? - if so, update promoted_pawns and promoted_pawn_index
+ *  - does this move lead to checkmate? (not worked out when built with CHESS_LAZY_MATE)
+ *  attacks holds the attack maps of the position before the move, and is updated to the position after it
+ *  - TODO: does this move lead to stalemate / draw?
+ * */		
+RULES_CONSTEXPR bool valid_move (
+	uint8_t piece_id, 
+	uint8_t new_position, 
+	const piece_array& piece_positions, 
+	uint8_t& castle,
+	uint8_t& en_passant_idx, 
+	uint16_t& promoted_pawns, 
+	uint32_t& promoted_pawn_types, 
+  uint8_t promotion_type,
+  attack_maps& attacks,
+	uint8_t& captured_piece_index,
+  bool& checkmate
+) {
+  RULES_STAT(valid_move);
+
+  //get the current position of piece_id from the array
+	uint8_t current_position = piece_positions[piece_id];
+  bool is_whites_move = piece_id < 16;
+
+  //reset en_passant_idx
+  en_passant_idx = 32;
+
+  //make sure this piece is still uncaptured
+	if (current_position == 0) {
+		return false;
+	}
+
+#ifdef CHESS_LAZY_MATE
+  //mate wasn't looked for when the opponent moved, so a player who has been mated can't move, only wait for the claim
+  if (attacks.checkers != 0 && !king_can_move(is_whites_move, piece_positions, is_whites_move ? attacks.black : attacks.white)) {
+    return false;
+  }
+#endif
+
+  //make sure the new position is different than the current position
+	if (current_position == new_position) {
+		return false;
+	}
+
+  switch ( piece_id ) {
+		case 0 : //white king
+      if (!valid_king_move(current_position, new_position, castle, piece_positions, is_whites_move, captured_piece_index)) {
+        //check castling special case
+        if (
+          (((castle & W_CAS_K) == 0) && current_position == 4 && new_position == 2) ||
+          (((castle & W_CAS_Q) == 0) && current_position == 4 && new_position == 6)
+        ) {
+          //check that the path is unblocked
+          uint8_t rook_index = is_whites_move ? (new_position == 2 ? 6 : 7) : (new_position == 58 ? 22 : 23);
+          uint8_t rook_pos = piece_positions[rook_index];
+
+          RULES_STAT(piece_scans);
+          for (uint8_t index = 0; index < 32; ++index) {
+            if (blocked(current_position, new_position, piece_positions[index]) || blocked(rook_pos, new_position, piece_positions[index])) {
+              return false;
+            }
+          }
+
+          //king cannot castle out of check
+          if (attacks.checkers != 0) {
+            return false;
+          }
+
+          //king cannot castle through check
+          if ((is_whites_move ? attacks.black : attacks.white) & square_bit((current_position + new_position) / 2)) {
+            return false;
+          }
+        } else {
+          return false;
+        }
+      }
+      //king move was valid, so disable castling
+      castle = castle | W_CAS_K | W_CAS_Q;
+			break;
+		case 1 : //white queen
+      if (!valid_queen_move(current_position, new_position, piece_positions, is_whites_move, captured_piece_index)) {
+        return false;
+      }
+			break;
+		case 2 ... 3 : //white bishop
+      if (!valid_bishop_move(current_position, new_position, piece_positions, is_whites_move, captured_piece_index)) {
+        return false;
+      }
+			break;
+		case 4 ... 5 : //white knight
+      if (!valid_knight_move(current_position, new_position, piece_positions, is_whites_move, captured_piece_index)) {
+        return false;
+      }
+			break;
+		case 6 : //white rook, king side
+      if (!valid_rook_move(current_position, new_position, piece_positions, is_whites_move, captured_piece_index)) {
+        return false;
+      } else {
+        castle = castle | W_CAS_K;
+      }
+    case 7 : //white rook, queen side
+      if (!valid_rook_move(current_position, new_position, piece_positions, is_whites_move, captured_piece_index)) {
+        return false;
+      } else {
+        castle = castle | W_CAS_Q;
+      }
+			break;
+		case 8 ... 15 : //white pawn
+      if (!valid_pawn_move(piece_id, new_position, piece_positions, is_whites_move, captured_piece_index, promoted_pawns, promoted_pawn_types, en_passant_idx)) {
+        return false;
+      } else if (new_position > 56) {
+        //pawn has reached promotion rank
+        promote_pawn(piece_id, promoted_pawns, promoted_pawn_types, promotion_type);
+      }
+      break;
+		case 16 : //black king
+      if (!valid_king_move(current_position, new_position, castle, piece_positions, is_whites_move, captured_piece_index)) {
+        //check castling special case
+        if (
+          (((castle & B_CAS_K) == 0) && current_position == 60 && new_position == 58) ||
+          (((castle & B_CAS_Q) == 0) && current_position == 60 && new_position == 62)
+        ) {
+          //check that the path is unblocked
+          uint8_t rook_index = is_whites_move ? (new_position == 2 ? 6 : 7) : (new_position == 58 ? 22 : 23);
+          uint8_t rook_pos = piece_positions[rook_index];
+          RULES_STAT(piece_scans);
+          for (uint8_t index = 0; index < 32; ++index) {
+            if (blocked(current_position, new_position, piece_positions[index]) || blocked(rook_pos, new_position, piece_positions[index])) {
+              return false;
+            }
+          }
+
+          //king cannot castle out of check
+          if (attacks.checkers != 0) {
+            return false;
+          }
+
+          //king cannot castle through check
+          if ((is_whites_move ? attacks.black : attacks.white) & square_bit((current_position + new_position) / 2)) {
+            return false;
+          }
+        } else {
+          return false;
+        }
+      }
+      //king move was valid, so disable castling
+      castle = castle | B_CAS_K | B_CAS_Q;
+      break;
+		case 17 : //black queen
+      if (!valid_queen_move(current_position, new_position, piece_positions, is_whites_move, captured_piece_index)) {
+        return false;
+      }
+      break;
+		case 18 ... 19 : //black bishop
+      if (!valid_bishop_move(current_position, new_position, piece_positions, is_whites_move, captured_piece_index)) {
+        return false;
+      }
+      break;
+		case 20 ... 21 : //black knight
+      if (!valid_knight_move(current_position, new_position, piece_positions, is_whites_move, captured_piece_index)) {
+        return false;
+      }
+			break;
+		case 22 : //black rook, king side
+      if (!valid_rook_move(current_position, new_position, piece_positions, is_whites_move, captured_piece_index)) {
+        return false;
+      } else {
+        castle = castle | B_CAS_K;
+      }
+			break;
+    case 23 : //black rook, queen side
+      if (!valid_rook_move(current_position, new_position, piece_positions, is_whites_move, captured_piece_index)) {
+        return false;
+      } else {
+        castle = castle | B_CAS_Q;
+      }
+      break;
+		case 24 ... 31 : //black pawn
+      if (!valid_pawn_move(piece_id, new_position, piece_positions, is_whites_move, captured_piece_index, promoted_pawns, promoted_pawn_types, en_passant_idx)) {
+        return false;
+      } else if (new_position < 9) {
+        //pawn has reached promotion rank
+        promote_pawn(piece_id, promoted_pawns, promoted_pawn_types, promotion_type);
+      }
+			break;
+  }
+
+  //create a new position vector to examine the new board state
+  RULES_STAT(vector_copies);
+  piece_array new_piece_positions(piece_positions);
+  new_piece_positions[piece_id] = new_position;
+  if (captured_piece_index < 32) {
+    new_piece_positions[captured_piece_index] = 0;
+  }
+
+  //build the attack maps of the new position, and use them to make sure this move doesn't leave our king in check.  If
+  //our king wasn't in check and didn't move, nothing was captured, and no enemy piece attacked the square this piece
+  //left or the one it moved to, then no enemy line runs through either square: the enemy's attacks are the same as
+  //before the move, and they didn't reach our king, so only our own map needs building
+  uint64_t checkers = 0;
+  uint64_t our_attacks = attacks_of(is_whites_move, new_piece_positions, promoted_pawns, promoted_pawn_types, checkers);
+  uint64_t enemy_attacks = is_whites_move ? attacks.black : attacks.white;
+  bool may_expose_king = attacks.checkers != 0 || piece_id == 0 || piece_id == 16 || captured_piece_index < 32 ||
+    (enemy_attacks & (square_bit(current_position) | square_bit(new_position))) != 0;
+  if (may_expose_king) {
+    uint64_t self_checkers = 0;
+    enemy_attacks = attacks_of(!is_whites_move, new_piece_positions, promoted_pawns, promoted_pawn_types, self_checkers);
+    if (self_checkers != 0) {
+      return false;
+    }
+  }
+
+  attacks.white = is_whites_move ? our_attacks : enemy_attacks;
+  attacks.black = is_whites_move ? enemy_attacks : our_attacks;
+  attacks.checkers = checkers;
+
+  //if the enemy king is in check, it's checkmate unless the king can move out of it.  Built with -DCHESS_LAZY_MATE,
+  //moves only record the check in the attack maps, and mate is left for a claim to prove with is_checkmate
+#ifndef CHESS_LAZY_MATE
+  checkmate = checkers != 0 && !king_can_move(!is_whites_move, new_piece_positions, our_attacks);
+#else
+  checkmate = false;
+#endif
+
+  return true;
+}
+
+/* *
+ * Packed moves
+ *  the arguments of a 'move' action packed into 16 bits, used for move lists in the tools
+ *   bits 0-4   : piece_id
+ *   bits 5-11  : new_position
+ *   bits 12-13 : promotion_type
+ * */
+RULES_CONSTEXPR uint16_t pack_move (
+  uint8_t piece_id,
+  uint8_t new_position,
+  uint8_t promotion_type
+) {
+  return (piece_id & 0x1F) | ((new_position & 0x7F) << 5) | ((promotion_type & 0x03) << 12);
+}
+
+RULES_CONSTEXPR uint8_t packed_piece_id (uint16_t move) { return move & 0x1F; }
+RULES_CONSTEXPR uint8_t packed_new_position (uint16_t move) { return (move >> 5) & 0x7F; }
+RULES_CONSTEXPR uint8_t packed_promotion_type (uint16_t move) { return (move >> 12) & 0x03; }
+
+/* *
+ * promotes
+ *  returns true if piece_id is a pawn that hasn't been promoted and new_position is on its last rank - the only moves
+ *  whose promotion type counts.  Packed moves played by 'move' keep the promotion type only when this holds.
+ * */
+RULES_CONSTEXPR bool promotes (
+  uint8_t piece_id,
+  uint8_t new_position,
+  uint16_t promoted_pawns,
+  uint32_t promoted_pawn_types
+) {
+  return piece_type(piece_id, promoted_pawns, promoted_pawn_types) == PIECE_PAWN && (piece_id < 16 ? new_position > 56 : new_position < 9);
+}
+
+/* *
+ * game_state
+ *  the rule-relevant fields of a row in the 'games' table, with the same defaults as a freshly created game
+ * */
+struct game_state {
+  uint32_t move_count = 0;
+  uint8_t castle = 0;
+  uint8_t en_passant_idx = 32;
+  uint16_t promoted_pawns = 0;
+  uint32_t promoted_pawn_types = 0;
+  piece_array piece_positions {4, 5, 3, 6, 2, 7, 1, 8, 9, 10, 11, 12, 13, 14, 15, 16, 60, 61, 59, 62, 58, 63, 57, 64, 49, 50, 51, 52, 53, 54, 55, 56};
+  attack_maps attacks;
+};
+
+/* *
+ * update_attacks
+ *  rebuilds the attack maps of state from scratch, for a position that wasn't reached through play_move
+ * */
+RULES_CONSTEXPR void update_attacks (
+  game_state& state
+) {
+  uint64_t white_checkers = 0;
+  uint64_t black_checkers = 0;
+  state.attacks.white = attacks_of(true, state.piece_positions, state.promoted_pawns, state.promoted_pawn_types, white_checkers);
+  state.attacks.black = attacks_of(false, state.piece_positions, state.promoted_pawns, state.promoted_pawn_types, black_checkers);
+  state.attacks.checkers = state.move_count % 2 == 0 ? black_checkers : white_checkers;
+}
+
+/* *
+ * play_move
+ *  validates a move with valid_move, and if it is valid applies it to state exactly the way the 'move' action updates
+ *  the game row.  Turn order and piece ownership are left to the caller.
+ *  returns false and leaves state untouched if the move is invalid.
+ * */
+RULES_CONSTEXPR bool play_move (
+  game_state& state,
+  uint8_t piece_id,
+  uint8_t new_position,
+  uint8_t promotion_type,
+  uint8_t& captured_piece_index,
+  bool& checkmate
+) {
+  uint8_t castle = state.castle;
+  uint8_t en_passant_idx = state.en_passant_idx;
+  uint16_t promoted_pawns = state.promoted_pawns;
+  uint32_t promoted_pawn_types = state.promoted_pawn_types;
+  captured_piece_index = 32;
+  checkmate = false;
+
+  attack_maps attacks = state.attacks;
+  if (!valid_move(piece_id, new_position, state.piece_positions, castle, en_passant_idx, promoted_pawns, promoted_pawn_types, promotion_type, attacks, captured_piece_index, checkmate)) {
+    return false;
+  }
+
+  //update piece position and move counter
+  state.piece_positions[piece_id] = new_position;
+  state.move_count = state.move_count + 1;
+
+  //check if an enemy piece was captured and remove it
+  if (captured_piece_index < 32) {
+    state.piece_positions[captured_piece_index] = 0;
+  }
+
+  //check if castling occurred (castle variable will be updated by the call to valid_move)
+  bool rook_castled = false;
+  if (state.castle != castle) {
+    state.castle = castle;
+
+    //if the king is castling, move the appropriate rook as well
+    if (piece_id == 0) {
+      if (new_position == 2) {
+        state.piece_positions[6] = 3;
+        rook_castled = true;
+      } else if (new_position == 6) {
+        state.piece_positions[7] = 5;
+        rook_castled = true;
+      }
+    } else if (piece_id == 16) {
+      if (new_position == 58) {
+        state.piece_positions[22] = 59;
+        rook_castled = true;
+      }
+      if (new_position == 62) {
+        state.piece_positions[23] = 61;
+        rook_castled = true;
+      }
+    }
+  }
+
+  //valid_move will update promoted_pawns and promoted_pawn_type if any pawns were promoted
+  state.promoted_pawns = promoted_pawns;
+  state.promoted_pawn_types = promoted_pawn_types;
+
+  //valid_move will use en_passant_idx to specify any pawn that was moved two spaces forward, meaning it is eligible to be captured by the en passant rule on the next turn.
+  state.en_passant_idx = en_passant_idx;
+
+  //valid_move builds the attack maps of the new position, but before a castling rook has moved
+  state.attacks = attacks;
+  if (rook_castled) {
+    update_attacks(state);
+  }
+
+  return true;
+}
+
+/* *
+ * legal_moves
+ *  lists every move valid_move accepts for the side to move, as packed moves.  A pawn reaching the last rank gets one
+ *  move for each promotion type.
+ * */
+inline std::vector<uint16_t> legal_moves (
+  const game_state& state
+) {
+  std::vector<uint16_t> moves;
+  uint8_t first_piece = state.move_count % 2 == 0 ? 0 : 16;
+
+  for (uint8_t piece_id = first_piece; piece_id < first_piece + 16; ++piece_id) {
+    if (state.piece_positions[piece_id] == 0) {
+      continue;
+    }
+    bool is_pawn = piece_type(piece_id, state.promoted_pawns, state.promoted_pawn_types) == PIECE_PAWN;
+
+    for (uint8_t new_position = 1; new_position < 65; ++new_position) {
+      uint8_t castle = state.castle;
+      uint8_t en_passant_idx = state.en_passant_idx;
+      uint16_t promoted_pawns = state.promoted_pawns;
+      uint32_t promoted_pawn_types = state.promoted_pawn_types;
+      uint8_t captured_piece_index = 32;
+      attack_maps attacks = state.attacks;
+      bool checkmate = false;
+      if (!valid_move(piece_id, new_position, state.piece_positions, castle, en_passant_idx, promoted_pawns, promoted_pawn_types, 0, attacks, captured_piece_index, checkmate)) {
+        continue;
+      }
+
+      if (is_pawn && (first_piece == 0 ? new_position > 56 : new_position < 9)) {
+        for (uint8_t promotion_type = PROMOTED_BISHOP; promotion_type <= PROMOTED_QUEEN; ++promotion_type) {
+          moves.push_back(pack_move(piece_id, new_position, promotion_type));
+        }
+      } else {
+        moves.push_back(pack_move(piece_id, new_position, 0));
+      }
+    }
+  }
+  return moves;
+}
+
+/* *
+ * fen
+ *  the FEN string of a game state, for the contract's line checks as well as the tools.  The contract doesn't count
+ *  moves since the last capture or pawn move, so the halfmove clock is always 0.
+ * */
+inline std::string fen (
+  const game_state& state
+) {
+  static const char letters[] = "kqbnrp";
+  char board[65] = {};
+  for (uint8_t piece_id = 0; piece_id < 32; ++piece_id) {
+    uint8_t position = state.piece_positions[piece_id];
+    if (position != 0) {
+      char letter = letters[piece_type(piece_id, state.promoted_pawns, state.promoted_pawn_types)];
+      board[position] = piece_id < 16 ? (char)(letter - 'a' + 'A') : letter;
+    }
+  }
+
+  //location 64 is a8, and each rank runs from the a file at its highest location down to the h file
+  std::string out;
+  for (int rank = 7; rank >= 0; --rank) {
+    int empty = 0;
+    for (int file = 0; file < 8; ++file) {
+      char letter = board[rank * 8 + 8 - file];
+      if (letter == 0) {
+        ++empty;
+        continue;
+      }
+      if (empty > 0) {
+        out += (char)('0' + empty);
+        empty = 0;
+      }
+      out += letter;
+    }
+    if (empty > 0) {
+      out += (char)('0' + empty);
+    }
+    out += rank == 0 ? ' ' : '/';
+  }
+
+  out += state.move_count % 2 == 0 ? "w " : "b ";
+  std::string castling;
+  if (!(state.castle & W_CAS_K)) { castling += 'K'; }
+  if (!(state.castle & W_CAS_Q)) { castling += 'Q'; }
+  if (!(state.castle & B_CAS_K)) { castling += 'k'; }
+  if (!(state.castle & B_CAS_Q)) { castling += 'q'; }
+  out += castling.empty() ? "-" : castling;
+
+  //the square the pawn that just moved two squares passed over
+  out += ' ';
+  if (state.en_passant_idx < 32 && state.piece_positions[state.en_passant_idx] != 0) {
+    uint8_t position = state.piece_positions[state.en_passant_idx];
+    uint8_t passed = state.en_passant_idx < 16 ? position - 8 : position + 8;
+    out += (char)('a' + 7 - (passed - 1) % 8);
+    out += (char)('1' + (passed - 1) / 8);
+  } else {
+    out += '-';
+  }
+  return out + " 0 " + std::to_string(state.move_count / 2 + 1);
+}
+
+/* *
+ * has_legal_move
+ *  returns true if valid_move accepts any move for the side to move.  Stops at the first one it finds.
+ * */
+RULES_CONSTEXPR bool has_legal_move (
+  const game_state& state
+) {
+  uint8_t first_piece = state.move_count % 2 == 0 ? 0 : 16;
+  for (uint8_t piece_id = first_piece; piece_id < first_piece + 16; ++piece_id) {
+    if (state.piece_positions[piece_id] == 0) {
+      continue;
+    }
+    for (uint8_t new_position = 1; new_position < 65; ++new_position) {
+      uint8_t castle = state.castle;
+      uint8_t en_passant_idx = state.en_passant_idx;
+      uint16_t promoted_pawns = state.promoted_pawns;
+      uint32_t promoted_pawn_types = state.promoted_pawn_types;
+      attack_maps attacks = state.attacks;
+      uint8_t captured_piece_index = 32;
+      bool checkmate = false;
+      if (valid_move(piece_id, new_position, state.piece_positions, castle, en_passant_idx, promoted_pawns, promoted_pawn_types, 0, attacks, captured_piece_index, checkmate)) {
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+/* *
+ * is_checkmate / is_stalemate
+ *  the end of game tests behind the 'claimmate' and 'claimdraw' actions.  is_checkmate is the same test valid_move
+ *  makes after a checking move - the king is in check and has nowhere to go - so a claim ends a game exactly where an
+ *  eager build would have.  is_stalemate looks for any legal move at all.
+ * */
+RULES_CONSTEXPR bool is_checkmate (
+  const game_state& state
+) {
+  bool white = state.move_count % 2 == 0;
+  return state.attacks.checkers != 0 && !king_can_move(white, state.piece_positions, white ? state.attacks.black : state.attacks.white);
+}
+
+RULES_CONSTEXPR bool is_stalemate (
+  const game_state& state
+) {
+  return state.attacks.checkers == 0 && !has_legal_move(state);
+}
+
+/* *
+ * perft
+ *  the number of move sequences depth plies long from state, with every move valid_move accepts for the side to move
+ *  and a pawn reaching the last rank counted once per promotion type, as legal_moves lists it.  A checkmating move
+ *  ends the game, so nothing is counted after it.
+ * */
+RULES_CONSTEXPR uint64_t perft (
+  const game_state& state,
+  uint32_t depth
+) {
+  if (depth == 0) {
+    return 1;
+  }
+
+  uint64_t nodes = 0;
+  uint8_t first_piece = state.move_count % 2 == 0 ? 0 : 16;
+  for (uint8_t piece_id = first_piece; piece_id < first_piece + 16; ++piece_id) {
+    if (state.piece_positions[piece_id] == 0) {
+      continue;
+    }
+    bool is_pawn = piece_type(piece_id, state.promoted_pawns, state.promoted_pawn_types) == PIECE_PAWN;
+
+    for (uint8_t new_position = 1; new_position < 65; ++new_position) {
+      uint8_t promotion_types = is_pawn && (first_piece == 0 ? new_position > 56 : new_position < 9) ? 4 : 1;
+      for (uint8_t promotion_type = 0; promotion_type < promotion_types; ++promotion_type) {
+        game_state next = state;
+        uint8_t captured_piece_index = 32;
+        bool checkmate = false;
+        if (!play_move(next, piece_id, new_position, promotion_type, captured_piece_index, checkmate)) {
+          break;
+        }
+        nodes += depth == 1 ? 1 : checkmate ? 0 : perft(next, depth - 1);
+      }
+    }
+  }
+  return nodes;
+}
+
+/* *
+ * Position hash
+ *  a 64 bit Zobrist hash of a game state, for finding the same position across games.  Pieces are hashed by type and
+ *  colour rather than by index, so a position reached with the two knights swapped, or with a promoted pawn standing
+ *  where the original queen would, hashes the same.  The side to move and the four castling flags are hashed as well,
+ *  and so is the square of a pawn that just moved two squares - but only if an enemy pawn stands beside it to take it
+ *  en passant, so that 1. e4 e5 2. Nf3 and 1. Nf3 e5 2. e4 reach the same hash.
+ *
+ *  The keys are generated at compile time from a fixed seed and must never change, since hashes are stored on disk.
+ * */
+struct zobrist_keys {
+  uint64_t pieces[12][65]; //[type + 6 for black][position]
+  uint64_t castle[4];      //one per castle flag bit
+  uint64_t en_passant[65]; //position of the pawn that just moved two squares
+  uint64_t black_to_move;
+};
+
+constexpr uint64_t splitmix64 (
+  uint64_t& seed
+) {
+  uint64_t z = (seed += 0x9E3779B97F4A7C15ULL);
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+  return z ^ (z >> 31);
+}
+
+constexpr zobrist_keys build_zobrist_keys () {
+  zobrist_keys keys {};
+  uint64_t seed = 0x636865737300ULL; //"chess"
+  for (int piece = 0; piece < 12; ++piece) {
+    for (int position = 1; position < 65; ++position) {
+      keys.pieces[piece][position] = splitmix64(seed);
+    }
+  }
+  for (int flag = 0; flag < 4; ++flag) {
+    keys.castle[flag] = splitmix64(seed);
+  }
+  for (int position = 1; position < 65; ++position) {
+    keys.en_passant[position] = splitmix64(seed);
+  }
+  keys.black_to_move = splitmix64(seed);
+  return keys;
+}
+
+inline constexpr zobrist_keys zobrist = build_zobrist_keys();
+
+RULES_CONSTEXPR uint64_t position_hash (
+  const game_state& state
+) {
+  uint64_t hash = state.move_count % 2 == 0 ? 0 : zobrist.black_to_move;
+  for (uint8_t piece_id = 0; piece_id < 32; ++piece_id) {
+    uint8_t position = state.piece_positions[piece_id];
+    if (position != 0 && position < 65) {
+      hash ^= zobrist.pieces[piece_type(piece_id, state.promoted_pawns, state.promoted_pawn_types) + (piece_id < 16 ? 0 : 6)][position];
+    }
+  }
+  for (int flag = 0; flag < 4; ++flag) {
+    if (state.castle & (1 << flag)) {
+      hash ^= zobrist.castle[flag];
+    }
+  }
+  if (state.en_passant_idx < 32 && state.piece_positions[state.en_passant_idx] != 0) {
+    uint8_t position = state.piece_positions[state.en_passant_idx];
+    uint8_t first_enemy_pawn = state.en_passant_idx < 16 ? 24 : 8;
+    for (uint8_t pawn = first_enemy_pawn; pawn < first_enemy_pawn + 8; ++pawn) {
+      uint8_t beside = state.piece_positions[pawn];
+      if ((beside == position + 1 || beside + 1 == position) && same_row(beside, position) &&
+        piece_type(pawn, state.promoted_pawns, state.promoted_pawn_types) == PIECE_PAWN) {
+        hash ^= zobrist.en_passant[position];
+        break;
+      }
+    }
+  }
+  return hash;
+}
+
+/* *
+ * Perft checks
+ *  the number of move sequences from the starting position, CHESS_PERFT_DEPTH plies deep (1 unless the build sets it,
+ *  0 to skip the checks).  There are more than standard chess's 20 and 400, as a pawn may also step diagonally onto an
+ *  empty square under these rules.  Depth 2 takes the compiler a few seconds for every file that includes this one,
+ *  and more constant evaluation steps than clang allows by default.
+ *
+ *  The starting position only moves pawns and knights, so a few small positions check the other rules at depth 1:
+ *  castling both ways for either side, a pawn that just moved two squares beside an enemy pawn, promotion with and
+ *  without a capture next to a promoted pawn, a king in check, and a mated king.  Their counts are this rule set's,
+ *  not standard chess's (see the list of quirks in tools/movegen.hpp), and were taken from movegen::legal_moves, which
+ *  shares no code with valid_move.
+ * */
+#ifndef CHESS_PERFT_DEPTH
+#define CHESS_PERFT_DEPTH 1
+#endif
+
+#if !defined(CHESS_STATS) && CHESS_PERFT_DEPTH >= 1
+RULES_CONSTEXPR game_state perft_position (
+  uint32_t move_count,
+  uint8_t castle,
+  uint8_t en_passant_idx,
+  uint16_t promoted_pawns,
+  uint32_t promoted_pawn_types,
+  piece_array piece_positions
+) {
+  game_state state;
+  state.move_count = move_count;
+  state.castle = castle;
+  state.en_passant_idx = en_passant_idx;
+  state.promoted_pawns = promoted_pawns;
+  state.promoted_pawn_types = promoted_pawn_types;
+  state.piece_positions = piece_positions;
+  update_attacks(state);
+  return state;
+}
+
+static_assert(perft(game_state(), 1) == 35, "rules: perft(1) from the starting position changed");
+
+//kings and rooks on their starting squares, castling allowed
+static_assert(perft(perft_position(0, 0, 32, 0, 0,
+  {4, 0, 0, 0, 0, 0, 1, 8, 0, 0, 0, 0, 0, 0, 0, 0, 60, 0, 0, 0, 0, 0, 57, 64, 0, 0, 0, 0, 0, 0, 0, 0}), 1) == 26,
+  "rules: perft(1) with white to castle changed");
+static_assert(perft(perft_position(1, 0, 32, 0, 0,
+  {4, 0, 0, 0, 0, 0, 1, 8, 0, 0, 0, 0, 0, 0, 0, 0, 60, 0, 0, 0, 0, 0, 57, 64, 0, 0, 0, 0, 0, 0, 0, 0}), 1) == 26,
+  "rules: perft(1) with black to castle changed");
+static_assert(perft(perft_position(0, 0x0F, 32, 0, 0,
+  {4, 0, 0, 0, 0, 0, 1, 8, 0, 0, 0, 0, 0, 0, 0, 0, 60, 0, 0, 0, 0, 0, 57, 64, 0, 0, 0, 0, 0, 0, 0, 0}), 1) == 24,
+  "rules: perft(1) with castling given up changed");
+
+//white pawn on e5, black pawn just moved d7-d5
+static_assert(perft(perft_position(2, 0x0F, 28, 0, 0,
+  {4, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 36, 0, 0, 0, 0, 60, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 37, 0, 0, 0}), 1) == 9,
+  "rules: perft(1) after a two square pawn move changed");
+
+//white pawn on b7 with a black rook on a8, and a white pawn promoted to a queen on d4
+static_assert(perft(perft_position(0, 0x0F, 32, 1 << 5, 3 << 10,
+  {4, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 29, 55, 0, 60, 0, 0, 0, 0, 0, 0, 64, 0, 0, 0, 0, 0, 0, 0, 0}), 1) == 44,
+  "rules: perft(1) with a pawn to promote changed");
+
+//white king on e1 checked by a rook on e8
+static_assert(perft(perft_position(0, 0x0F, 32, 0, 0,
+  {4, 0, 0, 0, 7, 0, 0, 8, 0, 0, 0, 0, 0, 0, 0, 0, 57, 0, 0, 0, 0, 0, 60, 0, 0, 0, 0, 0, 0, 0, 0, 0}), 1) == 4,
+  "rules: perft(1) in check changed");
+
+//white king on h1 behind its pawns, mated by a rook on a1
+static_assert(perft(perft_position(0, 0x0F, 32, 0, 0,
+  {1, 0, 0, 0, 0, 0, 0, 0, 9, 10, 0, 0, 0, 0, 0, 0, 60, 0, 0, 0, 0, 0, 8, 0, 0, 0, 0, 0, 0, 0, 0, 0}), 1) == 0,
+  "rules: perft(1) in checkmate changed");
+#endif
+#if !defined(CHESS_STATS) && CHESS_PERFT_DEPTH >= 2
+static_assert(perft(game_state(), 2) == 1225, "rules: perft(2) from the starting position changed");
+#endif
+
+} // namespace rules
@@ -14,7 +14,12 @@ gameid = '0'
 if len(sys.argv) > 1:
   gameid = sys.argv[1]
 
-payload = '{"code":"chess", "table":"games", "scope":"chess", "json":"true", "index":"primary", "limit":"1", "lower_bound":"' + gameid + '"}'
+#the games table scope, a season or tournament; games outside any are under the contract account
+scope = 'chess'
+if len(sys.argv) > 2:
+  scope = sys.argv[2]
+
+payload = '{"code":"chess", "table":"games", "scope":"' + scope + '", "json":"true", "index":"primary", "limit":"1", "lower_bound":"' + gameid + '"}'
 
 response = requests.post(url, headers=headers, data=payload)
 
@@ -334,7 +334,7 @@ def generate_cleos_command(move, boardstate, turn, gameid) :
           if not whites_move and piece_pos == pos + 8 :
             boardstate[index] = 0
     boardstate[idx] = pos
-  return (boardstate, "cleos push action chess move \'[\"" + player + "\", \"" + str(gameid) + "\", \"" + str(idx) + "\", \"" + str(pos) + "\", \"" + str(promotion) + "\"]\' -p " + player + "@active\n")
+  return (boardstate, "cleos push action chess move \'[\"" + player + "\", \"chess\", \"" + str(gameid) + "\", \"" + str(idx) + "\", \"" + str(pos) + "\", \"" + str(promotion) + "\"]\' -p " + player + "@active\n")
 
 
 def parse_move(movetext) :
@@ -383,7 +383,7 @@ for index, filename in enumerate(sys.argv) :
     boardstate = [4, 5, 3, 6, 2, 7, 1, 8, 9, 10, 11, 12, 13, 14, 15, 16, 60, 61, 59, 62, 58, 63, 57, 64, 49, 50, 51, 52, 53, 54, 55, 56]
     gsindex = 0
     turn = 1
-    testfile.write("cleos push action chess newgame \'[\"alice\", \"bob\"]\' -p chess@active\n")
+    testfile.write("cleos push action chess newgame \'[\"chess\", \"alice\", \"bob\"]\' -p chess@active\n")
     for move in moves :
       if move.find('.') != -1 :
         move = (move.split('.') [1])
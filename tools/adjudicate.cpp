@@ -0,0 +1,348 @@
+#include <cstdio>
+#include <iostream>
+#include <map>
+#include <string>
+
+#include "columnar.hpp"
+#include "games_table.hpp"
+#include "pgn.hpp"
+#include "syzygy.hpp"
+#include "syzygy_check.hpp"
+#include "transaction.hpp"
+
+/* *
+ * adjudicate
+ *  settles unfinished games that are down to a few pieces with Syzygy endgame tablebases (see syzygy.hpp), read from
+ *  local files.
+ *
+ *  Games come from a games snapshot (see export) - every unfinished game with no more pieces than the largest table -
+ *  or from the chain with --game-id, or a FEN with --fen.  Each game the tables answer prints a comment line with its
+ *  material, side to move, result, the winning player and distance to zeroing (when the .rtbz files are there),
+ *  followed by the concede action for the losing player or the draw actions for both, so the output can be checked and
+ *  then run.
+ *
+ *  The actions are only printed once the tables have passed the check of syzygy_check.hpp, which compares every
+ *  position of KQvK and KRvK (and KBvK and KNvK, if they are there) with results solved from scratch.  If those tables
+ *  are missing or any position comes out wrong, the decoder can't be trusted with these files, and only the verdicts
+ *  are printed.  --check-tables runs the check on its own.
+ *
+ *  The contract has no fifty move rule, so cursed wins and blessed losses are adjudicated as wins and losses.  The
+ *  tables are of standard chess, which the contract's rules differ from (see syzygy.hpp), most of all for pawns, which
+ *  step diagonally in the contract; games with pawns are left alone unless --with-pawns asks for their verdicts, and
+ *  even then get no actions.
+ * */
+
+static void usage () {
+  std::cerr <<
+    "usage: adjudicate --tb DIRS (--snapshot FILE | --game-id N [--url URL] | --fen FEN | --check-tables) [options]\n"
+    "  --tb DIRS          directories of .rtbw and .rtbz files, separated by ':'\n"
+    "  --snapshot FILE    adjudicate every unfinished game of a games snapshot\n"
+    "  --game-id N        adjudicate one game, read from the chain\n"
+    "  --fen FEN          probe one position\n"
+    "  --check-tables     only check the decoder against solved KQvK, KRvK, KBvK and KNvK\n"
+    "  --url URL          nodeos endpoint (default http://127.0.0.1:8888)\n"
+    "  --contract NAME    chess contract account (default chess)\n"
+    "  --scope NAME       games table scope of the games (default the contract account)\n"
+    "  --with-pawns       also give verdicts, but no actions, for positions with pawns\n"
+    "  --verbose          also list the games that couldn't be adjudicated, and why\n";
+  std::exit(1);
+}
+
+struct verdict {
+  bool probed = false;
+  std::string why;            //why not, when it wasn't
+  std::string material;
+  syzygy::wdl_score wdl = syzygy::WDL_DRAW;
+  int dtz = 0;
+  bool has_dtz = false;
+  int winner = -1;            //0 white, 1 black, -1 a draw
+  bool pawns = false;         //advisory only, so no actions
+};
+
+static verdict adjudicate (
+  syzygy::tablebase& tb,
+  const rules::game_state& state,
+  bool with_pawns
+) {
+  verdict out;
+  syzygy::board b;
+  if (!syzygy::from_state(state, b, out.why)) {
+    return out;
+  }
+  out.material = b.material(0) + "v" + b.material(1);
+  if (b.piece_count() > tb.largest()) {
+    out.why = "no tables of " + std::to_string(b.piece_count()) + " pieces";
+    return out;
+  }
+  out.pawns = (b.pieces[0][SYZYGY_PAWN] | b.pieces[1][SYZYGY_PAWN]) != 0;
+  if (out.pawns && !with_pawns) {
+    out.why = "pawns";
+    return out;
+  }
+
+  syzygy::probe_state result;
+  out.wdl = tb.probe_wdl(b, result);
+  if (result == syzygy::PROBE_FAIL) {
+    out.why = "no table for " + out.material;
+    return out;
+  }
+  out.probed = true;
+  if (tb.dtz_count() != 0) {
+    out.dtz = tb.probe_dtz(b, result);
+    out.has_dtz = result != syzygy::PROBE_FAIL;
+  }
+  if (out.wdl != syzygy::WDL_DRAW) {
+    out.winner = (out.wdl > 0) == (b.black_to_move == 0) ? 0 : 1;
+  }
+  return out;
+}
+
+static std::string describe (
+  const verdict& v,
+  uint32_t move_count,
+  const std::string& player_w,
+  const std::string& player_b
+) {
+  std::string out = v.material + ", " + (move_count % 2 ? "black" : "white") + " to move, ";
+  out += v.winner < 0 ? "draw" : std::string(v.winner ? "black" : "white") + " wins";
+  const std::string& winner = v.winner == 0 ? player_w : player_b;
+  if (v.winner >= 0 && !winner.empty()) {
+    out += " (" + winner + ")";
+  }
+  if (v.wdl == syzygy::WDL_CURSED_WIN || v.wdl == syzygy::WDL_BLESSED_LOSS) {
+    out += " (beyond the fifty move rule)";
+  }
+  if (v.has_dtz && v.dtz != 0) {
+    out += ", dtz " + std::to_string(v.dtz);
+  }
+  if (v.pawns) {
+    out += " (pawns, advisory)";
+  }
+  return out;
+}
+
+/* *
+ * check_decoder
+ *  runs the check of syzygy_check.hpp and prints what it found.  Returns an empty string if the tables can be trusted
+ *  with settling games, or why not.
+ * */
+static std::string check_decoder (
+  syzygy::tablebase& tb
+) {
+  std::string why;
+  for (auto& r : syzygy::check_tables(tb)) {
+    if (!r.found) {
+      std::printf("# check %s: no table\n", r.material.c_str());
+      if (r.material == "KQvK" || r.material == "KRvK") {
+        why = "no " + r.material + " table to check the decoder against";
+      }
+      continue;
+    }
+    std::printf("# check %s: %llu positions, %llu with dtz, %llu wrong\n", r.material.c_str(), (unsigned long long)r.positions,
+      (unsigned long long)r.dtz_checked, (unsigned long long)(r.wdl_wrong + r.dtz_wrong));
+    if (!r.passed()) {
+      std::printf("#   first wrong: %s\n", r.first_wrong.c_str());
+      why = r.material + " doesn't match the solved results";
+    }
+  }
+  return why;
+}
+
+/* *
+ * print_actions
+ *  the actions that settle a game the way the tables say: the loser concedes, or both players agree a draw
+ * */
+static void print_actions (
+  const std::string& contract,
+  const std::string& scope,
+  uint64_t game_id,
+  const std::string& player_w,
+  const std::string& player_b,
+  const verdict& v
+) {
+  std::string id = std::to_string(game_id);
+  if (v.winner < 0) {
+    for (const std::string& player : { player_w, player_b }) {
+      std::printf("cleos push action %s draw '[\"%s\", \"%s\", \"%s\"]' -p %s@active\n", contract.c_str(), player.c_str(),
+        scope.c_str(), id.c_str(), player.c_str());
+    }
+  } else {
+    const std::string& loser = v.winner == 0 ? player_b : player_w;
+    std::printf("cleos push action %s concede '[\"%s\", \"%s\", \"%s\"]' -p %s@active\n", contract.c_str(), loser.c_str(),
+      scope.c_str(), id.c_str(), loser.c_str());
+  }
+}
+
+/* *
+ * adjudicate_snapshot
+ *  every unfinished game of a snapshot.  Only games with few enough pieces are turned into game states; the rest are
+ *  passed over on their piece_positions alone.
+ * */
+static int adjudicate_snapshot (
+  syzygy::tablebase& tb,
+  const std::string& filename,
+  const std::string& contract,
+  const std::string& scope,
+  bool with_pawns,
+  bool actions,
+  bool verbose
+) {
+  columnar::snapshot_reader snapshot(filename);
+  const uint64_t* game_id = snapshot.column<uint64_t>("game_id");
+  const uint64_t* player_w = snapshot.column<uint64_t>("player_w");
+  const uint64_t* player_b = snapshot.column<uint64_t>("player_b");
+  const uint8_t* result = snapshot.column<uint8_t>("result");
+  const uint32_t* move_count = snapshot.column<uint32_t>("move_count");
+  const uint8_t* castle = snapshot.column<uint8_t>("castle");
+  const uint8_t* en_passant_idx = snapshot.column<uint8_t>("en_passant_idx");
+  const uint16_t* promoted_pawns = snapshot.column<uint16_t>("promoted_pawns");
+  const uint32_t* promoted_pawn_types = snapshot.column<uint32_t>("promoted_pawn_types");
+
+  uint64_t playing = 0;
+  uint64_t candidates = 0;
+  uint64_t decided[3] = {};   //white, black, draw
+  std::map<std::string, uint64_t> skipped;
+  for (uint64_t i = 0; i < snapshot.rows(); ++i) {
+    if (result[i] != RESULT_PLAYING) {
+      continue;
+    }
+    ++playing;
+    const uint8_t* positions = snapshot.piece_positions(i);
+    int on_board = 0;
+    for (int piece = 0; piece < 32; ++piece) {
+      on_board += positions[piece] != 0;
+    }
+    if (on_board > tb.largest()) {
+      continue;
+    }
+    ++candidates;
+
+    rules::game_state state;
+    state.move_count = move_count[i];
+    state.castle = castle[i];
+    state.en_passant_idx = en_passant_idx[i];
+    state.promoted_pawns = promoted_pawns[i];
+    state.promoted_pawn_types = promoted_pawn_types[i];
+    for (int piece = 0; piece < 32; ++piece) {
+      state.piece_positions[piece] = positions[piece];
+    }
+
+    verdict v = adjudicate(tb, state, with_pawns);
+    if (!v.probed) {
+      ++skipped[v.why];
+      if (verbose) {
+        std::printf("# game %llu: skipped, %s\n", (unsigned long long)game_id[i], v.why.c_str());
+      }
+      continue;
+    }
+    ++decided[v.winner < 0 ? 2 : v.winner];
+    std::string white = eos::name_to_string(player_w[i]);
+    std::string black = eos::name_to_string(player_b[i]);
+    std::printf("# game %llu: %s\n", (unsigned long long)game_id[i], describe(v, state.move_count, white, black).c_str());
+    if (actions && !v.pawns) {
+      print_actions(contract, scope, game_id[i], white, black, v);
+    }
+  }
+
+  std::printf("# %llu games, %llu unfinished, %llu with at most %d pieces\n", (unsigned long long)snapshot.rows(),
+    (unsigned long long)playing, (unsigned long long)candidates, tb.largest());
+  std::printf("# adjudicated %llu: %llu white wins, %llu black wins, %llu draws\n",
+    (unsigned long long)(decided[0] + decided[1] + decided[2]), (unsigned long long)decided[0],
+    (unsigned long long)decided[1], (unsigned long long)decided[2]);
+  for (auto& reason : skipped) {
+    std::printf("# skipped %llu: %s\n", (unsigned long long)reason.second, reason.first.c_str());
+  }
+  return 0;
+}
+
+int main (int argc, char** argv) {
+  std::string tb_dirs;
+  std::string snapshot_file;
+  std::string game_id_text;
+  std::string fen;
+  std::string node_url = "http://127.0.0.1:8888";
+  std::string contract = "chess";
+  std::string scope;
+  bool check_only = false;
+  bool with_pawns = false;
+  bool verbose = false;
+
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    auto next = [&]() -> std::string {
+      if (i + 1 >= argc) { usage(); }
+      return argv[++i];
+    };
+    if (arg == "--tb") { tb_dirs = next(); }
+    else if (arg == "--snapshot") { snapshot_file = next(); }
+    else if (arg == "--game-id") { game_id_text = next(); }
+    else if (arg == "--fen") { fen = next(); }
+    else if (arg == "--url") { node_url = next(); }
+    else if (arg == "--contract") { contract = next(); }
+    else if (arg == "--scope") { scope = next(); }
+    else if (arg == "--check-tables") { check_only = true; }
+    else if (arg == "--with-pawns") { with_pawns = true; }
+    else if (arg == "--verbose") { verbose = true; }
+    else { usage(); }
+  }
+  if (scope.empty()) {
+    scope = contract;
+  }
+  if (tb_dirs.empty() || snapshot_file.empty() + game_id_text.empty() + fen.empty() + !check_only != 3) {
+    usage();
+  }
+
+  try {
+    syzygy::tablebase tb(tb_dirs);
+    if (tb.wdl_count() == 0) {
+      throw std::runtime_error("no .rtbw files in " + tb_dirs);
+    }
+    std::printf("# %zu wdl and %zu dtz tables, up to %d pieces\n", tb.wdl_count(), tb.dtz_count(), tb.largest());
+
+    std::string untrusted = check_decoder(tb);
+    if (check_only) {
+      return untrusted.empty() ? 0 : 1;
+    }
+    if (!untrusted.empty()) {
+      std::printf("# verdicts only, no actions: %s\n", untrusted.c_str());
+    }
+
+    if (!snapshot_file.empty()) {
+      return adjudicate_snapshot(tb, snapshot_file, contract, scope, with_pawns, untrusted.empty(), verbose);
+    }
+
+    rules::game_state state;
+    std::string player_w;
+    std::string player_b;
+    if (!fen.empty()) {
+      state = pgn::from_fen(fen);
+    } else {
+      http_client node(node_url);
+      json::value row;
+      if (!games_table::read_game(node, contract, scope, std::stoull(game_id_text), row)) {
+        throw std::runtime_error("no game " + game_id_text);
+      }
+      if (row["winner"].as_string() != "") {
+        std::cout << "# game " << game_id_text << " is over\n";
+        return 0;
+      }
+      state = games_table::to_state(row);
+      player_w = row["player_w"].as_string();
+      player_b = row["player_b"].as_string();
+    }
+
+    verdict v = adjudicate(tb, state, with_pawns);
+    if (!v.probed) {
+      std::cout << "# " << pgn::fen(state) << ": not adjudicated, " << v.why << "\n";
+      return 1;
+    }
+    std::cout << "# " << pgn::fen(state) << ": " << describe(v, state.move_count, player_w, player_b) << std::endl;
+    if (untrusted.empty() && !v.pawns && !game_id_text.empty()) {
+      print_actions(contract, scope, std::stoull(game_id_text), player_w, player_b, v);
+    }
+  } catch (const std::exception& e) {
+    std::cerr << "adjudicate: " << e.what() << "\n";
+    return 1;
+  }
+  return 0;
+}
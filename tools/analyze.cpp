@@ -0,0 +1,114 @@
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <thread>
+
+#include "engine.hpp"
+#include "games_table.hpp"
+
+/* *
+ * analyze
+ *  searches a position for the best line under the contract's rules (see engine.hpp).
+ *
+ *  The position is a live game, read from the games table with --game-id, or a FEN.  Each completed depth prints its
+ *  score from the point of view of the side to move, the nodes searched so far across all threads, nodes per second
+ *  and the principal variation in coordinate notation.
+ * */
+
+static void usage () {
+  std::cerr <<
+    "usage: analyze (--fen FEN | --game-id N [--url URL] [--contract NAME] [--scope NAME]) [options]\n"
+    "  --fen FEN          position to analyse\n"
+    "  --game-id N        game to analyse, read from the chain\n"
+    "  --url URL          nodeos endpoint (default http://127.0.0.1:8888)\n"
+    "  --contract NAME    chess contract account (default chess)\n"
+    "  --scope NAME       games table scope (default the contract account)\n"
+    "  --depth N          deepest search, in plies (default 40)\n"
+    "  --time MS          stop after this many milliseconds (default 10000, 0 for no limit)\n"
+    "  --threads N        search threads (default one per core)\n"
+    "  --hash MB          transposition table size (default 64)\n";
+  std::exit(1);
+}
+
+int main (int argc, char** argv) {
+  std::string fen;
+  std::string node_url = "http://127.0.0.1:8888";
+  std::string contract = "chess";
+  std::string scope;
+  std::string game_id_text;
+  int depth = 40;
+  int64_t millis = 10000;
+  size_t threads = std::max(std::thread::hardware_concurrency(), 1u);
+  size_t hash_mb = 64;
+
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    auto next = [&]() -> std::string {
+      if (i + 1 >= argc) { usage(); }
+      return argv[++i];
+    };
+    if (arg == "--fen") { fen = next(); }
+    else if (arg == "--game-id") { game_id_text = next(); }
+    else if (arg == "--url") { node_url = next(); }
+    else if (arg == "--contract") { contract = next(); }
+    else if (arg == "--scope") { scope = next(); }
+    else if (arg == "--depth") { depth = std::stoi(next()); }
+    else if (arg == "--time") { millis = std::stoll(next()); }
+    else if (arg == "--threads") { threads = std::stoul(next()); }
+    else if (arg == "--hash") { hash_mb = std::stoul(next()); }
+    else { usage(); }
+  }
+  if (scope.empty()) {
+    scope = contract;
+  }
+  if (fen.empty() == game_id_text.empty() || depth < 1 || depth >= ENGINE_MAX_PLY / 2 || threads == 0) {
+    usage();
+  }
+
+  try {
+    rules::game_state state;
+    if (!fen.empty()) {
+      state = pgn::from_fen(fen);
+    } else {
+      http_client node(node_url);
+      json::value row;
+      if (!games_table::read_game(node, contract, scope, std::stoull(game_id_text), row)) {
+        throw std::runtime_error("no game " + game_id_text);
+      }
+      if (row["winner"].as_string() != "") {
+        std::cout << "game " << game_id_text << " is over\n";
+        return 0;
+      }
+      state = games_table::to_state(row);
+    }
+    std::cout << pgn::fen(state) << "\n";
+
+    if (rules::is_checkmate(state) || !rules::has_legal_move(state)) {
+      std::cout << (state.attacks.checkers != 0 ? "checkmate" : "stalemate") << "\n";
+      return 0;
+    }
+
+    engine::transposition_table tt(hash_mb);
+    engine::searcher search(tt, threads);
+    auto report = [&](const engine::depth_report& r) {
+      std::string line;
+      rules::game_state position = state;
+      for (uint16_t move : r.pv) {
+        line += " " + engine::move_text(position, move);
+        uint8_t captured_piece_index = 32;
+        bool checkmate = false;
+        rules::play_move(position, rules::packed_piece_id(move), rules::packed_new_position(move), rules::packed_promotion_type(move), captured_piece_index, checkmate);
+      }
+      std::printf("depth %2d  score %-10s nodes %12llu  nps %9.0f  time %7.2fs  pv%s\n", r.depth, engine::score_text(r.score).c_str(),
+        (unsigned long long)r.nodes, r.seconds > 0 ? r.nodes / r.seconds : 0.0, r.seconds, line.c_str());
+      std::fflush(stdout);
+    };
+    engine::depth_report best = search.run(state, depth, millis, report);
+    std::printf("bestmove %s  (%zu threads, %llu nodes, %.0f nps)\n", engine::move_text(state, best.pv.empty() ? 0 : best.pv[0]).c_str(),
+      threads, (unsigned long long)best.nodes, best.seconds > 0 ? best.nodes / best.seconds : 0.0);
+  } catch (const std::exception& e) {
+    std::cerr << "analyze: " << e.what() << "\n";
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,235 @@
+#pragma once
+
+#include <deque>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include <poll.h>
+
+#include "http_client.hpp"
+
+/* *
+ * async_http.hpp
+ *  a pool of non-blocking keep-alive connections to one server, driven by poll().
+ *  Requests are queued with post() and handed to the next idle connection; the caller owns the poll loop, so several
+ *  pools (nodeos and keosd, say) can share one thread:
+ *
+ *    std::vector<pollfd> fds;
+ *    node.add_poll_fds(fds);
+ *    wallet.add_poll_fds(fds);
+ *    poll(fds.data(), fds.size(), 10);
+ *    node.handle_poll(fds);
+ *    wallet.handle_poll(fds);
+ * */
+
+class async_http {
+  public:
+    //error is empty on success; any http status is a success at this level
+    using callback = std::function<void(const http_response& response, const std::string& error)>;
+
+    async_http (
+      const std::string& url,
+      size_t max_connections
+    ) : endpoint(url), conns(max_connections) {}
+
+    ~async_http () {
+      for (auto& c : conns) {
+        if (c.fd >= 0) { close(c.fd); }
+      }
+    }
+
+    async_http (const async_http&) = delete;
+    async_http& operator= (const async_http&) = delete;
+
+    void post (
+      const std::string& path,
+      const std::string& body,
+      callback cb
+    ) {
+      //requests are handed to connections from the poll loop, so callbacks can safely post follow-up requests
+      queue.push_back(request { endpoint.request(path, body), std::move(cb), false });
+    }
+
+    //requests queued or in flight
+    size_t pending () const {
+      size_t busy = 0;
+      for (auto& c : conns) {
+        busy += c.busy ? 1 : 0;
+      }
+      return queue.size() + busy;
+    }
+
+    int connections () const { return connect_count; }
+
+    /* *
+     * add_poll_fds
+     *  appends an entry for every connection with a request in flight
+     * */
+    void add_poll_fds (
+      std::vector<pollfd>& fds
+    ) {
+      dispatch();
+      poll_offset = fds.size();
+      polled.clear();
+      for (size_t i = 0; i < conns.size(); ++i) {
+        connection& c = conns[i];
+        if (!c.busy) {
+          continue;
+        }
+        short events = POLLIN;
+        if (c.connecting || c.out_pos < c.current.bytes.size()) {
+          events |= POLLOUT;
+        }
+        fds.push_back(pollfd { c.fd, events, 0 });
+        polled.push_back(i);
+      }
+    }
+
+    /* *
+     * handle_poll
+     *  does whatever reading and writing the entries added by add_poll_fds are ready for, and runs the callbacks of any
+     *  requests that finished
+     * */
+    void handle_poll (
+      const std::vector<pollfd>& fds
+    ) {
+      for (size_t n = 0; n < polled.size(); ++n) {
+        const pollfd& p = fds[poll_offset + n];
+        connection& c = conns[polled[n]];
+        if (p.revents == 0 || p.fd != c.fd) {
+          continue;
+        }
+
+        if (c.connecting) {
+          int err = 0;
+          socklen_t len = sizeof(err);
+          getsockopt(c.fd, SOL_SOCKET, SO_ERROR, &err, &len);
+          if (err != 0) {
+            fail(c, "connect to " + endpoint.describe() + " failed");
+            continue;
+          }
+          c.connecting = false;
+        }
+
+        if ((p.revents & POLLOUT) && c.out_pos < c.current.bytes.size()) {
+          ssize_t sent = send(c.fd, c.current.bytes.data() + c.out_pos, c.current.bytes.size() - c.out_pos, MSG_NOSIGNAL);
+          if (sent < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+            fail(c, "send to " + endpoint.describe() + " failed");
+            continue;
+          }
+          c.out_pos += sent > 0 ? sent : 0;
+        }
+
+        if (p.revents & (POLLIN | POLLHUP | POLLERR)) {
+          read_available(c);
+        }
+      }
+      dispatch();
+    }
+
+  private:
+    struct request {
+      std::string bytes;
+      callback cb;
+      bool retried;
+    };
+
+    struct connection {
+      int fd = -1;
+      bool busy = false;
+      bool connecting = false;
+      bool reused = false; //the connection had already served a request when this one was sent
+      size_t out_pos = 0;
+      std::string in;
+      request current;
+    };
+
+    http_endpoint endpoint;
+    std::vector<connection> conns;
+    std::deque<request> queue;
+    std::vector<size_t> polled;
+    size_t poll_offset = 0;
+    int connect_count = 0;
+
+    void dispatch () {
+      for (auto& c : conns) {
+        if (queue.empty()) {
+          return;
+        }
+        if (c.busy) {
+          continue;
+        }
+
+        c.reused = c.fd >= 0;
+        if (c.fd < 0) {
+          try {
+            c.fd = endpoint.open(true);
+          } catch (const std::exception& e) {
+            request r = std::move(queue.front());
+            queue.pop_front();
+            r.cb(http_response(), e.what());
+            continue;
+          }
+          c.connecting = true;
+          ++connect_count;
+        }
+        c.current = std::move(queue.front());
+        queue.pop_front();
+        c.busy = true;
+        c.out_pos = 0;
+        c.in.clear();
+      }
+    }
+
+    void read_available (
+      connection& c
+    ) {
+      char chunk[16384];
+      bool closed = false;
+      while (true) {
+        ssize_t n = recv(c.fd, chunk, sizeof(chunk), 0);
+        if (n > 0) {
+          c.in.append(chunk, n);
+          continue;
+        }
+        if (n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK)) {
+          closed = true;
+        }
+        break;
+      }
+
+      http_response response;
+      if (parse_http_response(c.in, closed, response)) {
+        request done = std::move(c.current);
+        c.busy = false;
+        if (response.close || closed) {
+          close(c.fd);
+          c.fd = -1;
+        }
+        done.cb(response, "");
+      } else if (closed) {
+        //a kept-alive connection the server dropped before answering gets one more try on a fresh connection
+        if (c.reused && c.in.empty() && !c.current.retried) {
+          c.current.retried = true;
+          queue.push_front(std::move(c.current));
+          c.busy = false;
+          close(c.fd);
+          c.fd = -1;
+        } else {
+          fail(c, "connection to " + endpoint.describe() + " closed");
+        }
+      }
+    }
+
+    void fail (
+      connection& c,
+      const std::string& error
+    ) {
+      request done = std::move(c.current);
+      c.busy = false;
+      close(c.fd);
+      c.fd = -1;
+      done.cb(http_response(), error);
+    }
+};
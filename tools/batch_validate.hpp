@@ -0,0 +1,613 @@
+#pragma once
+
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "../chess_rules.hpp"
+
+/* *
+ * batch_validate.hpp
+ *  checks many independent (position, move) pairs per call, with the same answers as rules::valid_move.
+ *
+ *  Positions and moves are held as structure of arrays - piece 0 of every lane, then piece 1 of every lane, and so on,
+ *  followed by one array per game row field - so a kernel loads the same field of several lanes in one go.  The
+ *  kernels work on bitboards (bit position - 1 of a 64 bit board, as in the attack maps): a lane's occupancy is built
+ *  from its 32 piece positions, the move is tested against step tables and Kogge-Stone slider fills, and the attack
+ *  maps of the new position come from whole-board shifts, without the piece scans and the copy of piece_positions
+ *  valid_move makes.  The same kernel is compiled at three lane widths - 4 (AVX2), 2 (SSE4.2) and 1 (any x86-64 or
+ *  other cpu) - and the widest the cpu supports is picked at run time.
+ *
+ *  The kernels reproduce valid_move exactly, including the parts of it that aren't chess: a pawn can advance two
+ *  squares from any rank and step diagonally without capturing, en passant never captures (valid_move clears
+ *  en_passant_idx before the pawn looks at it), pawn diagonals wrap around the edge of the board, rook 6 also gives up
+ *  queen side castling (case 6 falls through to case 7), and a promoted pawn reaching the last rank again has the
+ *  promotion type ORed into its type bits.  Lanes the kernels don't model are handed to valid_move itself:
+ *   - king moves of two squares (castling)
+ *   - a new_position off the board
+ *   - moves capturing a king
+ *   - positions with a missing king, two pieces on one square or a piece off the board
+ *
+ *  As with valid_move, results other than 'valid' are only meaningful for valid moves.  A piece_id above 31 is invalid
+ *  rather than read out of bounds.
+ * */
+
+namespace batch {
+
+/* *
+ * move_batch
+ *  lanes of positions (the rule fields of a games row) and a move to check in each
+ * */
+class move_batch {
+  public:
+    void resize (size_t lanes) {
+      count = lanes;
+      capacity = (lanes + 3) & ~(size_t)3; //whole AVX2 blocks, so kernels never read past the end
+      pieces.assign(32 * capacity, 0);
+      castle.assign(capacity, 0);
+      en_passant_idx.assign(capacity, 32);
+      promoted_pawns.assign(capacity, 0);
+      promoted_pawn_types.assign(capacity, 0);
+      white_attacks.assign(capacity, 0);
+      black_attacks.assign(capacity, 0);
+      checkers.assign(capacity, 0);
+      piece_id.assign(capacity, 0);
+      new_position.assign(capacity, 0);
+      promotion_type.assign(capacity, 0);
+    }
+
+    size_t size () const { return count; }
+    size_t stride () const { return capacity; }
+
+    void set (size_t lane, const rules::game_state& state, uint16_t move) {
+      for (size_t index = 0; index < 32; ++index) {
+        pieces[index * capacity + lane] = state.piece_positions[index];
+      }
+      castle[lane] = state.castle;
+      en_passant_idx[lane] = state.en_passant_idx;
+      promoted_pawns[lane] = state.promoted_pawns;
+      promoted_pawn_types[lane] = state.promoted_pawn_types;
+      white_attacks[lane] = state.attacks.white;
+      black_attacks[lane] = state.attacks.black;
+      checkers[lane] = state.attacks.checkers;
+      piece_id[lane] = rules::packed_piece_id(move);
+      new_position[lane] = rules::packed_new_position(move);
+      promotion_type[lane] = rules::packed_promotion_type(move);
+    }
+
+    rules::game_state state (size_t lane) const {
+      rules::game_state state;
+      for (size_t index = 0; index < 32; ++index) {
+        state.piece_positions[index] = pieces[index * capacity + lane];
+      }
+      state.castle = castle[lane];
+      state.en_passant_idx = en_passant_idx[lane];
+      state.promoted_pawns = promoted_pawns[lane];
+      state.promoted_pawn_types = promoted_pawn_types[lane];
+      state.attacks.white = white_attacks[lane];
+      state.attacks.black = black_attacks[lane];
+      state.attacks.checkers = checkers[lane];
+      return state;
+    }
+
+    std::vector<uint8_t> pieces; //[index * stride() + lane]
+    std::vector<uint8_t> castle;
+    std::vector<uint8_t> en_passant_idx;
+    std::vector<uint16_t> promoted_pawns;
+    std::vector<uint32_t> promoted_pawn_types;
+    std::vector<uint64_t> white_attacks;
+    std::vector<uint64_t> black_attacks;
+    std::vector<uint64_t> checkers;
+    std::vector<uint8_t> piece_id;
+    std::vector<uint8_t> new_position;
+    std::vector<uint8_t> promotion_type;
+
+  private:
+    size_t count = 0;
+    size_t capacity = 0;
+};
+
+/* *
+ * move_results
+ *  what valid_move returns and updates, one lane per lane of the batch
+ * */
+struct move_results {
+  void resize (size_t lanes) {
+    size_t capacity = (lanes + 3) & ~(size_t)3;
+    valid.assign(capacity, 0);
+    captured_piece_index.assign(capacity, 32);
+    castle.assign(capacity, 0);
+    en_passant_idx.assign(capacity, 32);
+    promoted_pawns.assign(capacity, 0);
+    promoted_pawn_types.assign(capacity, 0);
+    white_attacks.assign(capacity, 0);
+    black_attacks.assign(capacity, 0);
+    checkers.assign(capacity, 0);
+    checkmate.assign(capacity, 0);
+  }
+
+  std::vector<uint8_t> valid;
+  std::vector<uint8_t> captured_piece_index;
+  std::vector<uint8_t> castle;
+  std::vector<uint8_t> en_passant_idx;
+  std::vector<uint16_t> promoted_pawns;
+  std::vector<uint32_t> promoted_pawn_types;
+  std::vector<uint64_t> white_attacks;
+  std::vector<uint64_t> black_attacks;
+  std::vector<uint64_t> checkers;
+  std::vector<uint8_t> checkmate;
+};
+
+/* *
+ * validate_scalar
+ *  one lane through rules::valid_move
+ * */
+inline void validate_scalar (
+  const move_batch& moves,
+  size_t lane,
+  move_results& results
+) {
+  results.captured_piece_index[lane] = 32;
+  results.checkmate[lane] = 0;
+  uint8_t piece_id = moves.piece_id[lane];
+  if (piece_id > 31) {
+    results.valid[lane] = 0;
+    results.en_passant_idx[lane] = 32;
+    return;
+  }
+
+  rules::game_state state = moves.state(lane);
+  uint8_t captured_piece_index = 32;
+  bool checkmate = false;
+  results.valid[lane] = rules::valid_move(piece_id, moves.new_position[lane], state.piece_positions, state.castle,
+    state.en_passant_idx, state.promoted_pawns, state.promoted_pawn_types, moves.promotion_type[lane], state.attacks,
+    captured_piece_index, checkmate);
+  results.captured_piece_index[lane] = captured_piece_index;
+  results.castle[lane] = state.castle;
+  results.en_passant_idx[lane] = state.en_passant_idx;
+  results.promoted_pawns[lane] = state.promoted_pawns;
+  results.promoted_pawn_types[lane] = state.promoted_pawn_types;
+  results.white_attacks[lane] = state.attacks.white;
+  results.black_attacks[lane] = state.attacks.black;
+  results.checkers[lane] = state.attacks.checkers;
+  results.checkmate[lane] = checkmate;
+}
+
+namespace kernel {
+
+//the kernels are inlined into one function per instruction set, so vectors never cross a call
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpsabi"
+
+#define KERNEL_INLINE __attribute__((always_inline)) inline
+
+template <int W> struct lanes {
+  typedef uint64_t u __attribute__((vector_size(8 * W)));
+};
+
+#define COL0 0x0101010101010101ULL //bits of column 0 (the h file); column c is COL0 << c
+
+//the board one step in direction dir of ray_steps, with squares that wrapped around the edge dropped
+template <class U, int dir> KERNEL_INLINE U step (U x, int times = 1) {
+  switch (dir) {
+    case 0  : return x << times;
+    case 1  : return x << (8 * times);
+    case 2  : return x << (7 * times);
+    case 3  : return x << (9 * times);
+    case 4  : return x >> times;
+    case 5  : return x >> (8 * times);
+    case 6  : return x >> (7 * times);
+    default : return x >> (9 * times);
+  }
+}
+
+template <int dir> constexpr uint64_t wrap_mask () {
+  return dir == 1 || dir == 5 ? ~0ULL : dir == 0 || dir == 3 || dir == 6 ? ~COL0 : ~(COL0 << 7);
+}
+
+//squares attacked in direction dir by the sliders in gen, up to and including the first square not in empty
+template <class U, int dir> KERNEL_INLINE U slide (U gen, U empty) {
+  U pro = empty & wrap_mask<dir>();
+  gen |= pro & step<U, dir>(gen, 1);
+  pro &= step<U, dir>(pro, 1);
+  gen |= pro & step<U, dir>(gen, 2);
+  pro &= step<U, dir>(pro, 2);
+  gen |= pro & step<U, dir>(gen, 4);
+  return step<U, dir>(gen, 1) & wrap_mask<dir>();
+}
+
+template <class U> KERNEL_INLINE U orthogonal (U gen, U empty) {
+  return slide<U, 0>(gen, empty) | slide<U, 1>(gen, empty) | slide<U, 4>(gen, empty) | slide<U, 5>(gen, empty);
+}
+
+template <class U> KERNEL_INLINE U diagonal (U gen, U empty) {
+  return slide<U, 2>(gen, empty) | slide<U, 3>(gen, empty) | slide<U, 6>(gen, empty) | slide<U, 7>(gen, empty);
+}
+
+template <class U> KERNEL_INLINE U king_steps (U x) {
+  const uint64_t not_0 = ~COL0, not_7 = ~(COL0 << 7);
+  return ((x << 1) & not_0) | (x << 8) | ((x << 7) & not_7) | ((x << 9) & not_0) |
+    ((x >> 1) & not_7) | (x >> 8) | ((x >> 7) & not_0) | ((x >> 9) & not_7);
+}
+
+template <class U> KERNEL_INLINE U knight_jumps (U x) {
+  const uint64_t not_0 = ~COL0, not_01 = ~(COL0 | COL0 << 1), not_7 = ~(COL0 << 7), not_67 = ~(COL0 << 6 | COL0 << 7);
+  return ((x << 6) & not_67) | ((x << 10) & not_01) | ((x << 15) & not_7) | ((x << 17) & not_0) |
+    ((x >> 6) & not_01) | ((x >> 10) & not_67) | ((x >> 15) & not_0) | ((x >> 17) & not_7);
+}
+
+//square_bit for each lane, 0 for positions off the board
+template <class U> KERNEL_INLINE U square_bits (U position) {
+  U one = (position & 0) + 1;
+  return (U)(position - 1 < 64) & (one << ((position - 1) & 63));
+}
+
+/* *
+ * line_tables
+ *  for every pair of squares, the squares strictly between them and whether they share a row or column (bit 0) or a
+ *  diagonal (bit 1), so a slider's move is two lookups instead of a fill
+ * */
+struct line_tables {
+  uint64_t between[65][65] = {};
+  uint8_t lines[65][65] = {};
+};
+
+constexpr line_tables build_line_tables () {
+  line_tables tables;
+  for (int from = 1; from < 65; ++from) {
+    for (int dir = 0; dir < 8; ++dir) {
+      uint64_t passed = 0;
+      for (int to = from + rules::ray_steps[dir][0], col = (from - 1) % 8 + rules::ray_steps[dir][1];
+        to > 0 && to < 65 && col >= 0 && col < 8;
+        to += rules::ray_steps[dir][0], col += rules::ray_steps[dir][1]) {
+        tables.between[from][to] = passed;
+        tables.lines[from][to] = dir == 1 || dir == 5 || dir == 0 || dir == 4 ? 1 : 2;
+        passed |= rules::square_bit(to);
+      }
+    }
+  }
+  return tables;
+}
+
+inline constexpr line_tables lines = build_line_tables();
+
+template <class U> KERNEL_INLINE bool any (U mask) {
+  bool found = false;
+  for (size_t l = 0; l < sizeof(U) / 8; ++l) {
+    found |= mask[l] != 0;
+  }
+  return found;
+}
+
+template <class U> KERNEL_INLINE U select (U mask, U a, U b) {
+  return (mask & a) | (~mask & b);
+}
+
+//one side's pieces as bitboards, by how they attack
+template <class U> struct side_boards {
+  U king, pawns, knights, diagonal, orthogonal, all;
+};
+
+template <class U> KERNEL_INLINE side_boards<U> select (U mask, const side_boards<U>& a, const side_boards<U>& b) {
+  return { select(mask, a.king, b.king), select(mask, a.pawns, b.pawns), select(mask, a.knights, b.knights),
+    select(mask, a.diagonal, b.diagonal), select(mask, a.orthogonal, b.orthogonal), select(mask, a.all, b.all) };
+}
+
+template <class U> KERNEL_INLINE side_boards<U> boards_of (const U* positions, U promoted_pawns, U promoted_pawn_types, int first_piece) {
+  side_boards<U> b;
+  b.king = square_bits(positions[first_piece]);
+  U queen = square_bits(positions[first_piece + 1]);
+  b.diagonal = queen | square_bits(positions[first_piece + 2]) | square_bits(positions[first_piece + 3]);
+  b.knights = square_bits(positions[first_piece + 4]) | square_bits(positions[first_piece + 5]);
+  b.orthogonal = queen | square_bits(positions[first_piece + 6]) | square_bits(positions[first_piece + 7]);
+  b.pawns = b.king & 0;
+  for (int pawn = 8; pawn < 16; ++pawn) {
+    b.pawns |= square_bits(positions[first_piece + pawn]);
+  }
+
+  //white pawns have promotion bits 0-7 and black pawns 8-15
+  U side_promoted = (promoted_pawns >> (first_piece / 2)) & 0xFF;
+  if (any(side_promoted)) {
+    for (int offset = 0; offset < 8; ++offset) {
+      U bit = square_bits(positions[first_piece + 8 + offset]);
+      U promoted = bit & (U)(((side_promoted >> offset) & 1) != 0);
+      U type = (promoted_pawn_types >> (2 * (offset + first_piece / 2))) & 3;
+      b.pawns &= ~promoted;
+      b.knights |= promoted & (U)(type == PROMOTED_KNIGHT);
+      b.diagonal |= promoted & (U)(type == PROMOTED_BISHOP || type == PROMOTED_QUEEN);
+      b.orthogonal |= promoted & (U)(type == PROMOTED_ROOK || type == PROMOTED_QUEEN);
+    }
+  }
+  b.all = b.king | b.pawns | b.knights | b.diagonal | b.orthogonal;
+  return b;
+}
+
+//attacks_of: the squares a side attacks, with every piece but the enemy king blocking sliders
+template <class U> KERNEL_INLINE U attacks_of (const side_boards<U>& side, U white, U empty) {
+  U pawn_attacks = (white & ((side.pawns << 7) | (side.pawns << 9))) | (~white & ((side.pawns >> 7) | (side.pawns >> 9)));
+  return pawn_attacks | knight_jumps(side.knights) | diagonal(side.diagonal, empty) | orthogonal(side.orthogonal, empty);
+}
+
+//the squares of the side's pieces attacking king, with the same blockers as attacks_of
+template <class U> KERNEL_INLINE U checkers_of (const side_boards<U>& side, U white, U king, U empty) {
+  U pawn_squares = (white & ((king >> 7) | (king >> 9))) | (~white & ((king << 7) | (king << 9)));
+  return (pawn_squares & side.pawns) | (knight_jumps(king) & side.knights) |
+    (diagonal(king, empty) & side.diagonal) | (orthogonal(king, empty) & side.orthogonal);
+}
+
+/* *
+ * validate_block
+ *  W lanes starting at lane.  Lanes the kernel doesn't model are flagged in fallback and left for validate_scalar.
+ * */
+template <int W> KERNEL_INLINE void validate_block (
+  const move_batch& moves,
+  size_t lane,
+  move_results& results,
+  uint8_t* fallback
+) {
+  typedef typename lanes<W>::u U;
+  const size_t stride = moves.stride();
+  const uint8_t* pieces = moves.pieces.data() + lane;
+
+  U positions[32];
+  U piece_id, new_position, current_position, promotion_type, castle, promoted_pawns, promoted_pawn_types;
+  for (int l = 0; l < W; ++l) {
+    for (int index = 0; index < 32; ++index) {
+      positions[index][l] = pieces[index * stride + l];
+    }
+    piece_id[l] = moves.piece_id[lane + l];
+    new_position[l] = moves.new_position[lane + l];
+    current_position[l] = piece_id[l] < 32 ? pieces[piece_id[l] * stride + l] : 0;
+    promotion_type[l] = moves.promotion_type[lane + l];
+    castle[l] = moves.castle[lane + l];
+    promoted_pawns[l] = moves.promoted_pawns[lane + l];
+    promoted_pawn_types[l] = moves.promoted_pawn_types[lane + l];
+  }
+  const U zero = piece_id & 0;
+  const U white = (U)(piece_id < 16);
+
+  //the board, and whether the kernel can model it; the pieces by type are only needed once some lane is valid
+  U occupied = zero, white_pieces = zero, stacked = zero, off_board = zero;
+  for (int index = 0; index < 32; ++index) {
+    U bit = square_bits(positions[index]);
+    stacked |= occupied & bit;
+    occupied |= bit;
+    off_board |= (U)(positions[index] > 64);
+    if (index == 15) {
+      white_pieces = occupied;
+    }
+  }
+  U own_pieces = select(white, white_pieces, occupied & ~white_pieces);
+  U enemy_king = square_bits(select(white, positions[16], positions[0]));
+  U from_bit = square_bits(current_position);
+  U to_bit = square_bits(new_position);
+
+  //what the moving piece moves like: pawn slots go by their promotion bits, everything else by index
+  U slot = piece_id & 15;
+  U pawn_offset = ((slot - 8) & 7) | (~white & 8);
+  U is_pawn_slot = (U)(slot >= 8);
+  U promoted = is_pawn_slot & (U)(((promoted_pawns >> pawn_offset) & 1) != 0);
+  U promoted_type = (promoted_pawn_types >> (2 * pawn_offset)) & 3;
+  U is_king = (U)(slot == 0);
+  U is_pawn = is_pawn_slot & ~promoted;
+  U moves_diagonally = (U)(slot == 1 || slot == 2 || slot == 3) | (promoted & (U)(promoted_type == PROMOTED_BISHOP || promoted_type == PROMOTED_QUEEN));
+  U moves_orthogonally = (U)(slot == 1 || slot == 6 || slot == 7) | (promoted & (U)(promoted_type == PROMOTED_ROOK || promoted_type == PROMOTED_QUEEN));
+  U jumps = (U)(slot == 4 || slot == 5) | (promoted & (U)(promoted_type == PROMOTED_KNIGHT));
+
+  //kings, knights and sliders: the target is a step, a jump, or along a line with nothing in between, and not our own
+  U between, line;
+  for (int l = 0; l < W; ++l) {
+    uint8_t from = current_position[l] < 65 ? current_position[l] : 0;
+    uint8_t to = new_position[l] < 65 ? new_position[l] : 0;
+    between[l] = lines.between[from][to];
+    line[l] = lines.lines[from][to];
+  }
+  U slides = (moves_orthogonally & (U)((line & 1) != 0)) | (moves_diagonally & (U)((line & 2) != 0));
+  U reach = (is_king & king_steps(from_bit)) | (jumps & knight_jumps(from_bit)) | (slides & (U)((between & occupied) == 0) & to_bit);
+  U piece_ok = (U)((reach & to_bit) != 0) & (U)((own_pieces & to_bit) == 0);
+
+  //unpromoted pawns go by the difference in position: 8 or 16 forward onto an empty square with the square in
+  //front empty too, or 7 or 9 forward onto anything but our own piece
+  U forward = select(white, new_position - current_position, current_position - new_position);
+  U in_front = square_bits(select(white, current_position + 8, current_position - 8));
+  U pawn_ok = ((U)(forward == 8 || forward == 16) & (U)((occupied & (to_bit | in_front)) == 0)) |
+    ((U)(forward == 7 || forward == 9) & (U)((own_pieces & to_bit) == 0));
+
+  U valid = (U)(current_position != 0) & (U)(current_position != new_position) & select(is_pawn, pawn_ok, piece_ok);
+#ifdef CHESS_LAZY_MATE
+  U own_king = square_bits(select(white, positions[0], positions[16]));
+  U attacks_white, attacks_black, checkers_in;
+  for (int l = 0; l < W; ++l) {
+    attacks_white[l] = moves.white_attacks[lane + l];
+    attacks_black[l] = moves.black_attacks[lane + l];
+    checkers_in[l] = moves.checkers[lane + l];
+  }
+  U mated = (U)(checkers_in != 0) & (U)((king_steps(own_king) & ~own_pieces & ~select(white, attacks_black, attacks_white)) == 0);
+  valid &= ~mated;
+#endif
+
+  U castling = is_king & (U)(new_position == current_position + 2 || current_position == new_position + 2);
+  U takes_king = (U)((enemy_king & to_bit) != 0);
+  //a black pawn on the first rank would be blocked by any captured piece, off the board at position 0
+  U pawn_over_zero = is_pawn & ~white & (U)(current_position < 9);
+  U unmodelled = (U)(new_position - 1 >= 64) | (U)(stacked != 0) | off_board | (U)(positions[0] == 0) |
+    (U)(positions[16] == 0) | castling | takes_king | pawn_over_zero;
+  for (int l = 0; l < W; ++l) {
+    fallback[l] = unmodelled[l] != 0 && piece_id[l] < 32;
+  }
+
+  //most blocks of a move list have no valid move at all, and then nothing after the move needs working out
+  valid &= ~unmodelled & (U)(piece_id < 32);
+  if (!any(valid)) {
+    for (int l = 0; l < W; ++l) {
+      results.valid[lane + l] = 0;
+    }
+    return;
+  }
+
+  side_boards<U> white_side = boards_of(positions, promoted_pawns, promoted_pawn_types, 0);
+  side_boards<U> black_side = boards_of(positions, promoted_pawns, promoted_pawn_types, 16);
+  side_boards<U> own = select(white, white_side, black_side);
+  side_boards<U> enemy = select(white, black_side, white_side);
+
+  //game row updates
+  static constexpr uint8_t castle_bits[32] = { W_CAS_K | W_CAS_Q, 0, 0, 0, 0, 0, W_CAS_K | W_CAS_Q, W_CAS_Q, 0, 0, 0, 0, 0, 0, 0, 0,
+    B_CAS_K | B_CAS_Q, 0, 0, 0, 0, 0, B_CAS_K, B_CAS_Q, 0, 0, 0, 0, 0, 0, 0, 0 };
+  U castle_out;
+  for (int l = 0; l < W; ++l) {
+    castle_out[l] = castle[l] | castle_bits[piece_id[l] & 31];
+  }
+  U en_passant_out = select(is_pawn & (U)(forward == 16), piece_id, zero + 32);
+  U promotes = is_pawn_slot & select(white, (U)(new_position > 56), (U)(new_position < 9));
+  U promoted_pawns_out = promoted_pawns | (promotes & ((zero + 1) << pawn_offset));
+  U promoted_pawn_types_out = promoted_pawn_types | (promotes & ((promotion_type & 3) << (2 * pawn_offset)));
+
+  //the boards after the move: the captured piece, if any, is whatever enemy piece stood on the target square, and
+  //the moving piece lands as whatever it is now - a promoting pawn as its new type
+  U type_after = (promoted_pawn_types_out >> (2 * pawn_offset)) & 3;
+  U promoted_after = promoted | promotes;
+  U captures = valid & (U)((enemy.all & to_bit) != 0);
+  enemy.pawns &= ~to_bit;
+  enemy.knights &= ~to_bit;
+  enemy.diagonal &= ~to_bit;
+  enemy.orthogonal &= ~to_bit;
+  enemy.all &= ~to_bit;
+  own.king = (own.king & ~from_bit) | (is_king & to_bit);
+  own.pawns = (own.pawns & ~from_bit) | (is_pawn_slot & ~promoted_after & to_bit);
+  own.knights = (own.knights & ~from_bit) | (((U)(slot == 4 || slot == 5) | (promoted_after & (U)(type_after == PROMOTED_KNIGHT))) & to_bit);
+  own.diagonal = (own.diagonal & ~from_bit) |
+    (((U)(slot == 1 || slot == 2 || slot == 3) | (promoted_after & (U)(type_after == PROMOTED_BISHOP || type_after == PROMOTED_QUEEN))) & to_bit);
+  own.orthogonal = (own.orthogonal & ~from_bit) |
+    (((U)(slot == 1 || slot == 6 || slot == 7) | (promoted_after & (U)(type_after == PROMOTED_ROOK || type_after == PROMOTED_QUEEN))) & to_bit);
+  own.all = (own.all & ~from_bit) | to_bit;
+  U occupied_after = own.all | enemy.all;
+
+  //attack maps of the new position; the move is only valid if the enemy doesn't attack our king
+  U our_attacks = attacks_of(own, white, ~(occupied_after & ~enemy.king));
+  U enemy_attacks = attacks_of(enemy, ~white, ~(occupied_after & ~own.king));
+  valid &= (U)((enemy_attacks & own.king) == 0);
+
+  //checks are rare, so the checking pieces are only looked for when there is one
+  U checkers = zero;
+  U checkmate = zero;
+  U check = valid & (U)((our_attacks & enemy.king) != 0);
+  if (any(check)) {
+    checkers = check & checkers_of(own, white, enemy.king, ~(occupied_after & ~enemy.king));
+#ifndef CHESS_LAZY_MATE
+    checkmate = check & (U)((king_steps(enemy.king) & ~enemy.all & ~our_attacks) == 0);
+#endif
+  }
+
+  U white_attacks = select(white, our_attacks, enemy_attacks);
+  U black_attacks = select(white, enemy_attacks, our_attacks);
+  for (int l = 0; l < W; ++l) {
+    results.valid[lane + l] = valid[l] != 0;
+    results.captured_piece_index[lane + l] = 32;
+    if (captures[l] != 0) {
+      int first_enemy = piece_id[l] < 16 ? 16 : 0;
+      for (int index = first_enemy; index < first_enemy + 16; ++index) {
+        if (positions[index][l] == new_position[l]) {
+          results.captured_piece_index[lane + l] = index;
+          break;
+        }
+      }
+    }
+    results.castle[lane + l] = castle_out[l];
+    results.en_passant_idx[lane + l] = en_passant_out[l];
+    results.promoted_pawns[lane + l] = promoted_pawns_out[l];
+    results.promoted_pawn_types[lane + l] = promoted_pawn_types_out[l];
+    results.white_attacks[lane + l] = white_attacks[l];
+    results.black_attacks[lane + l] = black_attacks[l];
+    results.checkers[lane + l] = checkers[l];
+    results.checkmate[lane + l] = checkmate[l] != 0;
+  }
+}
+
+template <int W> KERNEL_INLINE void validate_lanes (
+  const move_batch& moves,
+  move_results& results
+) {
+  uint8_t fallback[W];
+  for (size_t lane = 0; lane < moves.size(); lane += W) {
+    validate_block<W>(moves, lane, results, fallback);
+    for (int l = 0; l < W && lane + l < moves.size(); ++l) {
+      if (fallback[l]) {
+        validate_scalar(moves, lane + l, results);
+      }
+    }
+  }
+}
+
+__attribute__((target("avx2"))) inline void validate_avx2 (const move_batch& moves, move_results& results) {
+  validate_lanes<4>(moves, results);
+}
+
+__attribute__((target("sse4.2"))) inline void validate_sse4 (const move_batch& moves, move_results& results) {
+  validate_lanes<2>(moves, results);
+}
+
+inline void validate_portable (const move_batch& moves, move_results& results) {
+  validate_lanes<1>(moves, results);
+}
+
+#undef KERNEL_INLINE
+#pragma GCC diagnostic pop
+
+} // namespace kernel
+
+enum kernel_kind { KERNEL_AUTO, KERNEL_AVX2, KERNEL_SSE4, KERNEL_PORTABLE, KERNEL_SCALAR };
+
+inline const char* kernel_name (
+  kernel_kind kind
+) {
+  switch (kind) {
+    case KERNEL_AVX2     : return "avx2";
+    case KERNEL_SSE4     : return "sse4.2";
+    case KERNEL_PORTABLE : return "portable";
+    case KERNEL_SCALAR   : return "valid_move";
+    default              : return "auto";
+  }
+}
+
+/* *
+ * best_kernel
+ *  the widest kernel this cpu runs
+ * */
+inline kernel_kind best_kernel () {
+  static const kernel_kind best = []() {
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2") ? KERNEL_AVX2 : __builtin_cpu_supports("sse4.2") ? KERNEL_SSE4 : KERNEL_PORTABLE;
+  }();
+  return best;
+}
+
+/* *
+ * validate
+ *  checks every lane of moves, with the given kernel or the best one for this cpu.  KERNEL_SCALAR runs every lane
+ *  through valid_move, for comparison.
+ * */
+inline void validate (
+  const move_batch& moves,
+  move_results& results,
+  kernel_kind kind = KERNEL_AUTO
+) {
+  results.resize(moves.size());
+  if (kind == KERNEL_AUTO) {
+    kind = best_kernel();
+  }
+  if ((kind == KERNEL_AVX2 && !__builtin_cpu_supports("avx2")) || (kind == KERNEL_SSE4 && !__builtin_cpu_supports("sse4.2"))) {
+    throw std::runtime_error(std::string("batch: this cpu doesn't support ") + kernel_name(kind));
+  }
+  switch (kind) {
+    case KERNEL_AVX2     : kernel::validate_avx2(moves, results); break;
+    case KERNEL_SSE4     : kernel::validate_sse4(moves, results); break;
+    case KERNEL_PORTABLE : kernel::validate_portable(moves, results); break;
+    default :
+      for (size_t lane = 0; lane < moves.size(); ++lane) {
+        validate_scalar(moves, lane, results);
+      }
+  }
+}
+
+} // namespace batch
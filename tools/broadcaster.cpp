@@ -0,0 +1,677 @@
+#include <chrono>
+#include <condition_variable>
+#include <csignal>
+#include <cstdio>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <sys/un.h>
+
+#include "http_client.hpp"
+#include "json.hpp"
+#include "pgn.hpp"
+#include "websocket.hpp"
+
+/* *
+ * broadcaster
+ *  pushes games to spectators over WebSockets as they are played, so viewers don't each poll the chain API for the
+ *  board (as test_games/gen_fenurl.py does).
+ *
+ *  Follows the contract's action traces like the indexer - from a nodeos running the history plugin (--url), or from a
+ *  file of one JSON action per line (--file, which --follow keeps reading as it grows) - and keeps the current state of
+ *  every game of one scope (--scope; see 'Scopes' in chess.cpp), replaying each 'gameevent' move through
+ *  rules::play_move.  Games created before the traces start aren't known.
+ *
+ *  Clients connect to ws://ADDRESS/games/<id> to watch a game, or to ws://ADDRESS/ and send {"subscribe": <id>} and
+ *  {"unsubscribe": <id>} to watch up to 64 games on one connection.  Each game they watch is sent as a snapshot, then
+ *  as one message per change -
+ *   {"type": "snapshot", "game_id", "ply", "player_w", "player_b", "winner", "ended_by", "diverged", "fen", "castle",
+ *    "en_passant_idx", "promoted_pawns", "promoted_pawn_types", "piece_positions"}
+ *   {"type": "move", "game_id", "ply", "move", "piece_id", "new_position", "promotion_type", "captured_piece",
+ *    "winner", "fen"}
+ *   {"type": "event", "game_id", "ply", "event", "winner"}  concede, claimmate, claimdraw, a draw (an offer when
+ *                                                            winner is empty), or dropgame, after which the game is
+ *                                                            gone and its viewers are unsubscribed
+ *   {"type": "error", "game_id", "message"}
+ *
+ *  Every message is encoded once and the same frame is queued on all of its game's viewers (see websocket.hpp).  A
+ *  viewer that falls --max-queue bytes behind stops being sent moves, and gets fresh snapshots of its games once it has
+ *  caught up; one that is still behind after --lag-timeout is disconnected.
+ * */
+
+static volatile std::sig_atomic_t stopping = 0;
+
+static void on_signal (int) {
+  stopping = 1;
+}
+
+#define BROADCAST_MAX_SUBSCRIPTIONS 64
+
+/* *
+ * action_source
+ *  reads action traces on its own thread, so a slow node never holds up the clients, and hands them to the
+ *  broadcaster's loop.  Waits while the loop has a backlog of unapplied actions.
+ * */
+class action_source {
+  public:
+    action_source () {
+      if (pipe(wake) != 0) {
+        throw std::runtime_error("unable to create a pipe");
+      }
+      fcntl(wake[0], F_SETFL, fcntl(wake[0], F_GETFL) | O_NONBLOCK);
+      fcntl(wake[1], F_SETFL, fcntl(wake[1], F_GETFL) | O_NONBLOCK);
+    }
+
+    ~action_source () {
+      if (reader.joinable()) {
+        reader.join();
+      }
+      close(wake[0]);
+      close(wake[1]);
+    }
+
+    //readable when there are actions to take
+    int fd () const { return wake[0]; }
+
+    void read_history (
+      const std::string& node_url,
+      const std::string& contract,
+      size_t page,
+      int poll_ms
+    ) {
+      reader = std::thread([this, node_url, contract, page, poll_ms]() {
+        http_client node(node_url);
+        int64_t cursor = -1;
+        while (!stopping) {
+          size_t count = 0;
+          try {
+            json::value request = json::value::object();
+            request.set("account_name", contract);
+            request.set("pos", cursor + 1);
+            request.set("offset", (int64_t)page - 1);
+            http_response response = node.post("/v1/history/get_actions", request.dump());
+            if (response.status != 200) {
+              throw std::runtime_error("get_actions failed: " + response.body);
+            }
+            json::value actions = json::parse(response.body)["actions"];
+            count = actions.size();
+            for (size_t i = 0; i < count; ++i) {
+              int64_t seq = actions.at(i)["account_action_seq"].as_int64();
+              if (seq > cursor) {
+                cursor = seq;
+                put(actions.at(i));
+              }
+            }
+          } catch (const std::exception& e) {
+            std::cerr << "broadcaster: " << e.what() << "\n";
+          }
+          if (count < page) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(poll_ms));
+          }
+        }
+      });
+    }
+
+    /* *
+     * read_file
+     *  one action per line; a line holding a get_actions response or an array gives each of its actions.  With follow,
+     *  waits at the end of the file for more lines instead of finishing.
+     * */
+    void read_file (
+      const std::string& filename,
+      bool follow,
+      int poll_ms
+    ) {
+      int file = open(filename.c_str(), O_RDONLY);
+      if (file < 0) {
+        throw std::runtime_error("unable to open " + filename);
+      }
+      reader = std::thread([this, file, follow, poll_ms]() {
+        std::string pending;
+        char chunk[65536];
+        while (!stopping) {
+          ssize_t n = ::read(file, chunk, sizeof(chunk));
+          if (n <= 0) {
+            if (!follow) {
+              break;
+            }
+            //a line still being written stays in pending until its newline arrives
+            std::this_thread::sleep_for(std::chrono::milliseconds(poll_ms));
+            continue;
+          }
+          pending.append(chunk, n);
+          size_t start = 0;
+          size_t end;
+          while ((end = pending.find('\n', start)) != std::string::npos) {
+            put_line(pending.substr(start, end - start));
+            start = end + 1;
+          }
+          pending.erase(0, start);
+        }
+        if (!stopping && !follow) {
+          put_line(pending);
+        }
+        ::close(file);
+        notify();
+      });
+    }
+
+    //the actions read since the last call
+    std::deque<json::value> take () {
+      char drain[256];
+      while (::read(wake[0], drain, sizeof(drain)) > 0) {
+      }
+      std::deque<json::value> out;
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        out.swap(queue);
+      }
+      room.notify_all();
+      return out;
+    }
+
+  private:
+    static constexpr size_t backlog = 4096;
+
+    int wake[2];
+    std::thread reader;
+    std::mutex mutex;
+    std::condition_variable room;
+    std::deque<json::value> queue;
+
+    void put (
+      const json::value& entry
+    ) {
+      std::unique_lock<std::mutex> lock(mutex);
+      while (queue.size() >= backlog && !stopping) {
+        room.wait_for(lock, std::chrono::milliseconds(100));
+      }
+      queue.push_back(entry);
+      lock.unlock();
+      notify();
+    }
+
+    void put_line (
+      const std::string& line
+    ) {
+      if (line.find_first_not_of(" \t\r") == std::string::npos) {
+        return;
+      }
+      try {
+        json::value doc = json::parse(line);
+        const json::value& actions = doc.is_array() ? doc : doc["actions"];
+        if (actions.is_array()) {
+          for (const json::value& entry : actions.items) {
+            put(entry);
+          }
+        } else {
+          put(doc);
+        }
+      } catch (const std::exception& e) {
+        std::cerr << "broadcaster: skipping a line that isn't JSON: " << e.what() << "\n";
+      }
+    }
+
+    void notify () {
+      char one = 1;
+      (void)!::write(wake[1], &one, 1);
+    }
+};
+
+struct watched_game {
+  std::string player_w;
+  std::string player_b;
+  std::string winner;
+  std::string ended_by;
+  bool diverged = false;
+  rules::game_state state;
+  std::set<int> viewers;
+  websocket::message snapshot; //encoded on demand, and dropped whenever the game changes
+};
+
+/* *
+ * broadcaster
+ *  the games, their viewers, and the messages between them
+ * */
+class broadcaster {
+  public:
+    broadcaster (websocket::server& ws, const std::string& contract, const std::string& scope)
+      : ws(ws), contract(contract), scope(scope) {}
+
+    uint64_t applied () const { return actions; }
+    uint64_t encoded () const { return messages; }
+    uint64_t sent () const { return frames; }
+    size_t game_count () const { return games.size(); }
+
+    /* *
+     * apply
+     *  one entry of a get_actions response, or a bare action trace
+     * */
+    void apply (
+      const json::value& entry
+    ) {
+      ++actions;
+      const json::value& trace = entry["action_trace"].is_null() ? entry : entry["action_trace"];
+      const json::value& act = trace["act"];
+      const json::value& receiver = trace["receipt"]["receiver"];
+      if (act["account"].as_string() != contract || !(receiver.is_null() || receiver.as_string() == contract) ||
+        !act["data"].is_object()) {
+        return;
+      }
+      if (act["name"].as_string() == "newgame") {
+        pending_w = act["data"]["player_w"].as_string();
+        pending_b = act["data"]["player_b"].as_string();
+      } else if (act["name"].as_string() == "gameevent") {
+        apply_event(act["data"]);
+      }
+    }
+
+    void open (
+      int client,
+      const std::string& path
+    ) {
+      subscriptions[client];
+      if (path.compare(0, 7, "/games/") == 0) {
+        subscribe(client, std::strtoull(path.c_str() + 7, nullptr, 10));
+      }
+    }
+
+    void text (
+      int client,
+      const std::string& text
+    ) {
+      json::value command;
+      try {
+        command = json::parse(text);
+      } catch (const std::exception&) {
+        send_error(client, 0, "not JSON");
+        return;
+      }
+      if (!command["subscribe"].is_null()) {
+        subscribe(client, command["subscribe"].as_uint64());
+      } else if (!command["unsubscribe"].is_null()) {
+        uint64_t game_id = command["unsubscribe"].as_uint64();
+        subscriptions[client].erase(game_id);
+        auto found = games.find(game_id);
+        if (found != games.end()) {
+          found->second.viewers.erase(client);
+        }
+      } else {
+        send_error(client, 0, "expected subscribe or unsubscribe");
+      }
+    }
+
+    //a client that fell behind has caught up; what it missed is replaced by snapshots
+    void drain (
+      int client
+    ) {
+      for (uint64_t game_id : subscriptions[client]) {
+        auto found = games.find(game_id);
+        if (found != games.end()) {
+          send(client, snapshot(game_id, found->second));
+        }
+      }
+    }
+
+    void close (
+      int client
+    ) {
+      for (uint64_t game_id : subscriptions[client]) {
+        auto found = games.find(game_id);
+        if (found != games.end()) {
+          found->second.viewers.erase(client);
+        }
+      }
+      subscriptions.erase(client);
+    }
+
+  private:
+    websocket::server& ws;
+    std::string contract;
+    std::string scope;
+    std::unordered_map<uint64_t, watched_game> games;
+    std::unordered_map<int, std::set<uint64_t>> subscriptions;
+    std::string pending_w;
+    std::string pending_b;
+    uint64_t actions = 0;
+    uint64_t messages = 0;
+    uint64_t frames = 0;
+
+    void apply_event (
+      const json::value& data
+    ) {
+      std::string event = data["event"].as_string();
+      uint64_t game_id = data["game_id"].as_uint64();
+      uint32_t ply = data["ply"].as_uint64();
+      std::string winner = data["winner"].as_string();
+
+      if (data["scope"].as_string() != scope) {
+        return;
+      }
+      if (event == "newgame") {
+        watched_game& game = games[game_id];
+        game.player_w = pending_w;
+        game.player_b = pending_b;
+        return;
+      }
+
+      auto found = games.find(game_id);
+      if (found == games.end()) {
+        return;
+      }
+      watched_game& game = found->second;
+
+      //games nobody is watching are kept up to date, but nothing is encoded for them
+      json::value msg = json::value::object();
+      if (event == "move") {
+        if (game.diverged || ply <= game.state.move_count) {
+          return;
+        }
+        uint16_t move = data["move"].as_uint64();
+        uint8_t captured_piece = data["captured_piece"].as_uint64();
+        uint8_t captured_piece_index = 32;
+        bool checkmate = false;
+        if (ply != game.state.move_count + 1 ||
+          !rules::play_move(game.state, rules::packed_piece_id(move), rules::packed_new_position(move), rules::packed_promotion_type(move), captured_piece_index, checkmate) ||
+          captured_piece_index != captured_piece) {
+          std::cerr << "broadcaster: game " << game_id << " ply " << ply << " doesn't replay; its moves won't be sent\n";
+          game.diverged = true;
+          game.snapshot = nullptr;
+          msg.set("type", "error");
+          msg.set("game_id", game_id);
+          msg.set("message", "the game no longer replays from its moves");
+          broadcast(game, encode(msg));
+          return;
+        }
+        if (!winner.empty()) {
+          game.winner = winner;
+          game.ended_by = "checkmate";
+        }
+        game.snapshot = nullptr;
+        if (game.viewers.empty()) {
+          return;
+        }
+        msg.set("type", "move");
+        msg.set("game_id", game_id);
+        msg.set("ply", ply);
+        msg.set("move", (uint32_t)move);
+        msg.set("piece_id", (int)rules::packed_piece_id(move));
+        msg.set("new_position", (int)rules::packed_new_position(move));
+        msg.set("promotion_type", (int)rules::packed_promotion_type(move));
+        msg.set("captured_piece", (int)captured_piece);
+        msg.set("winner", winner);
+        msg.set("fen", pgn::fen(game.state));
+      } else if (event == "dropgame") {
+        //the game's row is gone from the contract; viewers get the event, and the game and its subscriptions go too
+        msg.set("type", "event");
+        msg.set("game_id", game_id);
+        msg.set("ply", ply);
+        msg.set("event", event);
+        msg.set("winner", winner);
+        if (!game.viewers.empty()) {
+          broadcast(game, encode(msg));
+        }
+        for (int client : game.viewers) {
+          subscriptions[client].erase(game_id);
+        }
+        games.erase(found);
+        return;
+      } else {
+        if (!winner.empty()) {
+          game.winner = winner;
+          game.ended_by = event;
+        }
+        game.snapshot = nullptr;
+        if (game.viewers.empty()) {
+          return;
+        }
+        msg.set("type", "event");
+        msg.set("game_id", game_id);
+        msg.set("ply", ply);
+        msg.set("event", event);
+        msg.set("winner", winner);
+      }
+      broadcast(game, encode(msg));
+    }
+
+    void subscribe (
+      int client,
+      uint64_t game_id
+    ) {
+      auto found = games.find(game_id);
+      if (found == games.end()) {
+        send_error(client, game_id, "no game " + std::to_string(game_id));
+        return;
+      }
+      std::set<uint64_t>& watching = subscriptions[client];
+      if (watching.count(game_id) == 0 && watching.size() >= BROADCAST_MAX_SUBSCRIPTIONS) {
+        send_error(client, game_id, "already watching " + std::to_string(BROADCAST_MAX_SUBSCRIPTIONS) + " games");
+        return;
+      }
+      watching.insert(game_id);
+      found->second.viewers.insert(client);
+      send(client, snapshot(game_id, found->second));
+    }
+
+    //the game's snapshot message, encoded at most once per change
+    const websocket::message& snapshot (
+      uint64_t game_id,
+      watched_game& game
+    ) {
+      if (game.snapshot) {
+        return game.snapshot;
+      }
+      const rules::game_state& state = game.state;
+      json::value msg = json::value::object();
+      msg.set("type", "snapshot");
+      msg.set("game_id", game_id);
+      msg.set("ply", state.move_count);
+      msg.set("player_w", game.player_w);
+      msg.set("player_b", game.player_b);
+      msg.set("winner", game.winner);
+      msg.set("ended_by", game.ended_by);
+      msg.set("diverged", game.diverged);
+      msg.set("fen", pgn::fen(state));
+      msg.set("castle", (int)state.castle);
+      msg.set("en_passant_idx", (int)state.en_passant_idx);
+      msg.set("promoted_pawns", (int)state.promoted_pawns);
+      msg.set("promoted_pawn_types", state.promoted_pawn_types);
+      json::value& positions = msg.set("piece_positions", json::value::array());
+      for (uint8_t position : state.piece_positions) {
+        positions.push((int)position);
+      }
+      game.snapshot = encode(msg);
+      return game.snapshot;
+    }
+
+    websocket::message encode (
+      const json::value& msg
+    ) {
+      ++messages;
+      return websocket::make_text(msg.dump());
+    }
+
+    void broadcast (
+      const watched_game& game,
+      const websocket::message& msg
+    ) {
+      for (int client : game.viewers) {
+        send(client, msg);
+      }
+    }
+
+    void send (
+      int client,
+      const websocket::message& msg
+    ) {
+      frames += ws.send(client, msg);
+    }
+
+    void send_error (
+      int client,
+      uint64_t game_id,
+      const std::string& message
+    ) {
+      json::value msg = json::value::object();
+      msg.set("type", "error");
+      msg.set("game_id", game_id);
+      msg.set("message", message);
+      send(client, encode(msg));
+    }
+};
+
+/* *
+ * listen_on
+ *  opens the listening socket for 'host:port' or 'unix:///path'
+ * */
+static int listen_on (
+  const std::string& address
+) {
+  int fd = -1;
+  if (address.compare(0, 7, "unix://") == 0) {
+    std::string path = address.substr(7);
+    sockaddr_un addr {};
+    addr.sun_family = AF_UNIX;
+    path.copy(addr.sun_path, sizeof(addr.sun_path) - 1);
+    unlink(path.c_str());
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || bind(fd, (sockaddr*)&addr, sizeof(addr)) != 0) {
+      throw std::runtime_error("unable to listen on " + path);
+    }
+  } else {
+    size_t colon = address.rfind(':');
+    sockaddr_in addr {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(std::stoi(address.substr(colon + 1)));
+    std::string host = address.substr(0, colon);
+    if (inet_pton(AF_INET, host == "localhost" ? "127.0.0.1" : host.c_str(), &addr.sin_addr) != 1) {
+      throw std::runtime_error("bad listen address " + address);
+    }
+    fd = socket(AF_INET, SOCK_STREAM, 0);
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    if (fd < 0 || bind(fd, (sockaddr*)&addr, sizeof(addr)) != 0) {
+      throw std::runtime_error("unable to listen on " + address);
+    }
+  }
+  if (listen(fd, 1024) != 0) {
+    throw std::runtime_error("unable to listen on " + address);
+  }
+  return fd;
+}
+
+static void usage () {
+  std::cerr <<
+    "usage: broadcaster [options] (--url URL | --file FILE)\n"
+    "  --url URL          nodeos endpoint with the history plugin\n"
+    "  --file FILE        action traces to read instead, one per line\n"
+    "  --follow           keep reading --file as it grows\n"
+    "  --contract NAME    chess contract account (default chess)\n"
+    "  --scope NAME       games table scope (default the contract account)\n"
+    "  --listen ADDRESS   host:port or unix:///path (default 127.0.0.1:8891)\n"
+    "  --page N           actions per get_actions request (default 100)\n"
+    "  --poll MS          wait for new actions (default 500)\n"
+    "  --max-clients N    connections to accept (default 10000)\n"
+    "  --max-queue KB     unsent data per connection before it is behind (default 256)\n"
+    "  --lag-timeout MS   disconnect connections behind for this long (default 10000)\n";
+  std::exit(1);
+}
+
+int main (int argc, char** argv) {
+  std::string node_url;
+  std::string trace_file;
+  bool follow = false;
+  std::string contract = "chess";
+  std::string scope;
+  std::string address = "127.0.0.1:8891";
+  size_t page = 100;
+  int poll_ms = 500;
+  size_t max_clients = 10000;
+  size_t max_queue_kb = 256;
+  int lag_timeout_ms = 10000;
+
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    auto next = [&]() -> std::string {
+      if (i + 1 >= argc) { usage(); }
+      return argv[++i];
+    };
+    if (arg == "--url") { node_url = next(); }
+    else if (arg == "--file") { trace_file = next(); }
+    else if (arg == "--follow") { follow = true; }
+    else if (arg == "--contract") { contract = next(); }
+    else if (arg == "--scope") { scope = next(); }
+    else if (arg == "--listen") { address = next(); }
+    else if (arg == "--page") { page = std::stoul(next()); }
+    else if (arg == "--poll") { poll_ms = std::stoi(next()); }
+    else if (arg == "--max-clients") { max_clients = std::stoul(next()); }
+    else if (arg == "--max-queue") { max_queue_kb = std::stoul(next()); }
+    else if (arg == "--lag-timeout") { lag_timeout_ms = std::stoi(next()); }
+    else { usage(); }
+  }
+  if (scope.empty()) {
+    scope = contract;
+  }
+  if (node_url.empty() == trace_file.empty() || page == 0 || max_clients == 0 || max_queue_kb == 0) {
+    usage();
+  }
+
+  std::signal(SIGINT, on_signal);
+  std::signal(SIGTERM, on_signal);
+  std::signal(SIGPIPE, SIG_IGN);
+
+  try {
+    websocket::server ws(listen_on(address), max_clients, max_queue_kb * 1024, lag_timeout_ms);
+    broadcaster games(ws, contract, scope);
+    ws.on_open = [&](int client, const std::string& path) { games.open(client, path); };
+    ws.on_text = [&](int client, const std::string& text) { games.text(client, text); };
+    ws.on_drain = [&](int client) { games.drain(client); };
+    ws.on_close = [&](int client) { games.close(client); };
+
+    action_source source;
+    if (!node_url.empty()) {
+      source.read_history(node_url, contract, page, poll_ms);
+    } else {
+      source.read_file(trace_file, follow, poll_ms);
+    }
+    std::cerr << "broadcaster: listening on " << address << "\n";
+
+    auto start = std::chrono::steady_clock::now();
+    size_t peak_clients = 0;
+    std::vector<pollfd> fds;
+    while (!stopping) {
+      fds.clear();
+      fds.push_back(pollfd { source.fd(), POLLIN, 0 });
+      ws.add_poll_fds(fds);
+      if (poll(fds.data(), fds.size(), 100) < 0 && errno != EINTR) {
+        throw std::runtime_error("poll failed");
+      }
+      if (fds[0].revents & POLLIN) {
+        for (const json::value& entry : source.take()) {
+          games.apply(entry);
+        }
+      }
+      ws.handle_poll(fds);
+      peak_clients = std::max(peak_clients, ws.client_count());
+    }
+
+    const websocket::server_stats& stats = ws.stats();
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cerr << games.applied() << " actions, " << games.game_count() << " games in " << seconds << "s\n"
+      << stats.accepted << " connections (at most " << peak_clients << " at once), " << games.encoded()
+      << " messages encoded, " << games.sent() << " sent, " << stats.bytes << " bytes\n"
+      << stats.lagged << " times a client fell behind, " << stats.dropped << " messages dropped, " << stats.timed_out
+      << " clients disconnected for lagging\n";
+  } catch (const std::exception& e) {
+    std::cerr << "broadcaster: " << e.what() << "\n";
+    return 1;
+  }
+  return 0;
+}
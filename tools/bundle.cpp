@@ -0,0 +1,132 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "pgn.hpp"
+#include "transaction.hpp"
+
+/* *
+ * bundle
+ *  replays test games against the chess contract without forking cleos for every ply.
+ *
+ *  Reads games from PGN files or packed move lists, and packs the 'newgame' and alternating 'move' actions of each
+ *  game into as few transactions as possible (a transaction can carry both players' authorizations, so one
+ *  transaction holds up to --batch plies).  Transactions are signed by keosd and either printed as signed transaction
+ *  JSON, one per line, or pushed to nodeos with --push.  All requests share one kept-alive connection to each server.
+ *
+ *  Games get consecutive ids starting at --game-id, the same way parse_pgn.py numbers them.
+ * */
+
+static void usage () {
+  std::cerr <<
+    "usage: bundle [options] <game.pgn | game.moves>...\n"
+    "  --url URL          nodeos endpoint (default http://127.0.0.1:8888)\n"
+    "  --wallet-url URL   keosd endpoint (default unix://~/eosio-wallet/keosd.sock)\n"
+    "  --contract NAME    chess contract account (default chess)\n"
+    "  --scope NAME       games table scope (default the contract account)\n"
+    "  --white NAME       white player (default alice)\n"
+    "  --black NAME       black player (default bob)\n"
+    "  --game-id N        id of the first game (default 0)\n"
+    "  --batch N          most actions in one transaction (default 32)\n"
+    "  --no-newgame       only send moves, for games that already exist\n"
+    "  --push             push the transactions instead of printing them\n";
+  std::exit(1);
+}
+
+int main (int argc, char** argv) {
+  std::string node_url = "http://127.0.0.1:8888";
+  std::string wallet_url = "unix://~/eosio-wallet/keosd.sock";
+  std::string contract = "chess";
+  std::string scope;
+  std::string player_w = "alice";
+  std::string player_b = "bob";
+  uint64_t first_game_id = 0;
+  size_t batch = 32;
+  bool newgame = true;
+  bool push = false;
+  std::vector<std::string> files;
+
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    auto next = [&]() -> std::string {
+      if (i + 1 >= argc) { usage(); }
+      return argv[++i];
+    };
+    if (arg == "--url") { node_url = next(); }
+    else if (arg == "--wallet-url") { wallet_url = next(); }
+    else if (arg == "--contract") { contract = next(); }
+    else if (arg == "--scope") { scope = next(); }
+    else if (arg == "--white") { player_w = next(); }
+    else if (arg == "--black") { player_b = next(); }
+    else if (arg == "--game-id") { first_game_id = std::stoull(next()); }
+    else if (arg == "--batch") { batch = std::stoul(next()); }
+    else if (arg == "--no-newgame") { newgame = false; }
+    else if (arg == "--push") { push = true; }
+    else if (arg[0] == '-') { usage(); }
+    else { files.push_back(arg); }
+  }
+  if (scope.empty()) {
+    scope = contract;
+  }
+  if (files.empty() || batch == 0) {
+    usage();
+  }
+
+  try {
+    //turn every game into its list of actions, in the order they have to execute
+    std::vector<eos::action> actions;
+    uint64_t game_id = first_game_id;
+    for (auto& file : files) {
+      for (auto& moves : pgn::load_games(file)) {
+        if (newgame) {
+          actions.push_back(eos::newgame_action(contract, scope, player_w, player_b));
+        }
+        for (size_t ply = 0; ply < moves.size(); ++ply) {
+          uint16_t move = moves[ply];
+          actions.push_back(eos::move_action(contract, ply % 2 == 0 ? player_w : player_b, scope, game_id,
+            rules::packed_piece_id(move), rules::packed_new_position(move), rules::packed_promotion_type(move)));
+        }
+        ++game_id;
+      }
+    }
+
+    eos::chain_session session(node_url, wallet_url);
+    auto start = std::chrono::steady_clock::now();
+    size_t transactions = 0;
+    uint64_t total_cpu_us = 0;
+
+    for (size_t offset = 0; offset < actions.size(); offset += batch) {
+      eos::transaction trx;
+      size_t end = std::min(actions.size(), offset + batch);
+      trx.actions.assign(actions.begin() + offset, actions.begin() + end);
+      session.prepare(trx);
+      json::value signed_trx = session.sign(trx);
+      ++transactions;
+
+      if (!push) {
+        std::cout << signed_trx.dump() << "\n";
+        continue;
+      }
+
+      json::value result = session.push(trx, signed_trx);
+      uint64_t cpu_us = result["processed"]["receipt"]["cpu_usage_us"].as_uint64();
+      total_cpu_us += cpu_us;
+      std::cout << result["transaction_id"].as_string() << " actions " << trx.actions.size() << " cpu " << cpu_us << "us\n";
+    }
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cerr << game_id - first_game_id << " games, " << actions.size() << " actions in " << transactions << " transactions, "
+      << seconds << "s, " << session.connections() << " connections";
+    if (push) {
+      std::cerr << ", " << total_cpu_us << "us billed cpu";
+    }
+    std::cerr << "\n";
+  } catch (const std::exception& e) {
+    std::cerr << "bundle: " << e.what() << "\n";
+    return 1;
+  }
+  return 0;
+}
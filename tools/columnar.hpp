@@ -0,0 +1,284 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* *
+ * columnar.hpp
+ *  a column-per-field binary snapshot of the games table, for analytics scans that shouldn't go through JSON.
+ *
+ *  Every column is a packed array of one fixed-width field, one entry per game, so a scan reads only the columns it
+ *  uses and reads them straight out of the page cache.  snapshot_writer appends rows without holding them in memory,
+ *  and snapshot_reader maps a finished file and hands out typed pointers into it.
+ *
+ *  File layout (little endian) -
+ *   header     magic "CHESSCOL", version, column count, row count
+ *   directory  per column: a 24 byte name, the width of one entry in bytes, and the offset of its array in the file
+ *   columns    each array starts on an 8 byte boundary, rows in the order they were written
+ *
+ *  Names are stored in their 64 bit eosio form (eos::string_to_name), and piece_positions as 32 bytes.
+ * */
+
+namespace columnar {
+
+#define COLUMNAR_MAGIC   "CHESSCOL"
+#define COLUMNAR_VERSION 1
+
+#define RESULT_PLAYING 0
+#define RESULT_WHITE   1
+#define RESULT_BLACK   2
+#define RESULT_DRAW    3
+
+struct file_header {
+  char magic[8];
+  uint32_t version;
+  uint32_t columns;
+  uint64_t rows;
+};
+
+struct column_entry {
+  char name[24];
+  uint32_t width;
+  uint32_t reserved;
+  uint64_t offset;
+};
+
+/* *
+ * games_columns
+ *  the columns of a games snapshot, in file order
+ * */
+static const column_entry games_columns[] = {
+  { "game_id",             8,  0, 0 },
+  { "player_w",            8,  0, 0 },
+  { "player_b",            8,  0, 0 },
+  { "winner",              8,  0, 0 },
+  { "result",              1,  0, 0 },
+  { "move_count",          4,  0, 0 },
+  { "castle",              1,  0, 0 },
+  { "en_passant_idx",      1,  0, 0 },
+  { "promoted_pawns",      2,  0, 0 },
+  { "promoted_pawn_types", 4,  0, 0 },
+  { "piece_positions",     32, 0, 0 },
+};
+
+#define GAMES_COLUMN_COUNT (sizeof(games_columns) / sizeof(games_columns[0]))
+
+struct game_row {
+  uint64_t game_id = 0;
+  uint64_t player_w = 0;
+  uint64_t player_b = 0;
+  uint64_t winner = 0;
+  uint8_t result = RESULT_PLAYING;
+  uint32_t move_count = 0;
+  uint8_t castle = 0;
+  uint8_t en_passant_idx = 32;
+  uint16_t promoted_pawns = 0;
+  uint32_t promoted_pawn_types = 0;
+  uint8_t piece_positions[32] = {};
+};
+
+/* *
+ * snapshot_writer
+ *  streams rows into one temporary file per column, and joins them behind the header in finish().  Memory use doesn't
+ *  grow with the number of rows.
+ * */
+class snapshot_writer {
+  public:
+    snapshot_writer (const std::string& filename) : filename(filename) {
+      for (size_t i = 0; i < GAMES_COLUMN_COUNT; ++i) {
+        std::string part = part_name(i);
+        FILE* f = std::fopen(part.c_str(), "wb+");
+        if (f == nullptr) {
+          throw std::runtime_error("columnar: unable to create " + part);
+        }
+        parts.push_back(f);
+      }
+    }
+
+    ~snapshot_writer () {
+      close_parts();
+    }
+
+    snapshot_writer (const snapshot_writer&) = delete;
+    snapshot_writer& operator= (const snapshot_writer&) = delete;
+
+    void append (const game_row& row) {
+      const void* fields[GAMES_COLUMN_COUNT] = {
+        &row.game_id, &row.player_w, &row.player_b, &row.winner, &row.result, &row.move_count, &row.castle,
+        &row.en_passant_idx, &row.promoted_pawns, &row.promoted_pawn_types, row.piece_positions,
+      };
+      for (size_t i = 0; i < GAMES_COLUMN_COUNT; ++i) {
+        std::fwrite(fields[i], games_columns[i].width, 1, parts[i]);
+      }
+      ++rows;
+    }
+
+    uint64_t row_count () const { return rows; }
+
+    //writes the file and removes the temporary column files
+    void finish () {
+      FILE* out = std::fopen(filename.c_str(), "wb");
+      if (out == nullptr) {
+        throw std::runtime_error("columnar: unable to create " + filename);
+      }
+
+      file_header header {};
+      std::memcpy(header.magic, COLUMNAR_MAGIC, 8);
+      header.version = COLUMNAR_VERSION;
+      header.columns = GAMES_COLUMN_COUNT;
+      header.rows = rows;
+
+      std::vector<column_entry> directory(games_columns, games_columns + GAMES_COLUMN_COUNT);
+      uint64_t offset = sizeof(file_header) + sizeof(column_entry) * directory.size();
+      for (auto& column : directory) {
+        column.offset = align(offset);
+        offset = column.offset + column.width * rows;
+      }
+
+      std::fwrite(&header, sizeof(header), 1, out);
+      std::fwrite(directory.data(), sizeof(column_entry), directory.size(), out);
+      uint64_t written = sizeof(file_header) + sizeof(column_entry) * directory.size();
+      char buffer[65536];
+      for (size_t i = 0; i < parts.size(); ++i) {
+        static const char padding[8] = {};
+        std::fwrite(padding, 1, directory[i].offset - written, out);
+        std::rewind(parts[i]);
+        size_t n;
+        while ((n = std::fread(buffer, 1, sizeof(buffer), parts[i])) > 0) {
+          std::fwrite(buffer, 1, n, out);
+        }
+        written = directory[i].offset + directory[i].width * rows;
+      }
+
+      bool failed = std::ferror(out) != 0;
+      failed = std::fclose(out) != 0 || failed;
+      close_parts();
+      if (failed) {
+        throw std::runtime_error("columnar: error writing " + filename);
+      }
+    }
+
+  private:
+    std::string filename;
+    std::vector<FILE*> parts;
+    uint64_t rows = 0;
+
+    std::string part_name (size_t column) const { return filename + "." + games_columns[column].name + ".tmp"; }
+
+    static uint64_t align (uint64_t offset) { return (offset + 7) & ~(uint64_t)7; }
+
+    void close_parts () {
+      for (size_t i = 0; i < parts.size(); ++i) {
+        std::fclose(parts[i]);
+        std::remove(part_name(i).c_str());
+      }
+      parts.clear();
+    }
+};
+
+/* *
+ * snapshot_reader
+ *  maps a snapshot file read-only.  Columns are looked up by name once and then indexed directly; nothing is copied or
+ *  parsed, and the kernel only pages in the columns a scan touches.
+ * */
+class snapshot_reader {
+  public:
+    snapshot_reader (const std::string& filename) {
+      int fd = ::open(filename.c_str(), O_RDONLY);
+      struct stat st;
+      if (fd < 0 || fstat(fd, &st) != 0) {
+        if (fd >= 0) { ::close(fd); }
+        throw std::runtime_error("columnar: unable to open " + filename);
+      }
+      size = st.st_size;
+      if (size >= sizeof(file_header)) {
+        data = (const uint8_t*)mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+      }
+      ::close(fd);
+      if (data == nullptr || data == MAP_FAILED) {
+        data = nullptr;
+        throw std::runtime_error("columnar: unable to map " + filename);
+      }
+
+      //the destructor doesn't run if the constructor throws
+      auto invalid = [&](const std::string& why) {
+        munmap((void*)data, size);
+        data = nullptr;
+        throw std::runtime_error("columnar: " + filename + why);
+      };
+      header = (const file_header*)data;
+      directory = (const column_entry*)(data + sizeof(file_header));
+      if (std::memcmp(header->magic, COLUMNAR_MAGIC, 8) != 0 || header->version != COLUMNAR_VERSION ||
+        sizeof(file_header) + sizeof(column_entry) * header->columns > size) {
+        invalid(" is not a games snapshot");
+      }
+      for (uint32_t i = 0; i < header->columns; ++i) {
+        if (directory[i].offset + directory[i].width * header->rows > size) {
+          invalid(" is truncated");
+        }
+      }
+      madvise((void*)data, size, MADV_SEQUENTIAL);
+    }
+
+    ~snapshot_reader () {
+      if (data != nullptr) {
+        munmap((void*)data, size);
+      }
+    }
+
+    snapshot_reader (const snapshot_reader&) = delete;
+    snapshot_reader& operator= (const snapshot_reader&) = delete;
+
+    uint64_t rows () const { return header->rows; }
+
+    /* *
+     * column
+     *  the array of a column, checked against the width of T.  Throws if the snapshot doesn't have the column.
+     * */
+    template <typename T>
+    const T* column (
+      const char* name
+    ) const {
+      const column_entry& entry = find(name);
+      if (entry.width != sizeof(T)) {
+        throw std::runtime_error(std::string("columnar: column ") + name + " is " + std::to_string(entry.width) + " bytes wide");
+      }
+      return (const T*)(data + entry.offset);
+    }
+
+    //piece_positions of row i, 32 bytes
+    const uint8_t* piece_positions (uint64_t i) const {
+      if (positions == nullptr) {
+        positions = data + find("piece_positions").offset;
+      }
+      return positions + 32 * i;
+    }
+
+  private:
+    const uint8_t* data = nullptr;
+    size_t size = 0;
+    const file_header* header = nullptr;
+    const column_entry* directory = nullptr;
+    mutable const uint8_t* positions = nullptr;
+
+    const column_entry& find (const char* name) const {
+      for (uint32_t i = 0; i < header->columns; ++i) {
+        if (std::strncmp(directory[i].name, name, sizeof(directory[i].name)) == 0) {
+          return directory[i];
+        }
+      }
+      throw std::runtime_error(std::string("columnar: no column ") + name);
+    }
+};
+
+} // namespace columnar
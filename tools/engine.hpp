@@ -0,0 +1,551 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "pgn.hpp"
+
+/* *
+ * engine.hpp
+ *  an alpha-beta search over the contract's rules, for analysing games natively.
+ *
+ *  Moves come from rules::legal_moves and are made with rules::play_move, so the search plays exactly the game the
+ *  contract referees - its promotion encoding, its castling and en passant, and its idea of checkmate: a move that
+ *  checks a king with no square to go to wins on the spot.  A side with no legal moves at all has lost if it is in
+ *  check and is stalemated (a draw, by 'claimdraw') if not.  The contract has no repetition or fifty move rule, and
+ *  neither does the search.
+ *
+ *  The search is iterative deepening negamax with a principal variation window, null move pruning, check extensions
+ *  and a captures-only quiescence search.  Moves are tried transposition table move first, then captures by most
+ *  valuable victim, then killers and the history table.
+ *
+ *  Threads search the same position together (Lazy SMP): each runs its own iterative deepening loop, half of them a ply
+ *  deeper than the main thread, and they share nothing but the transposition table and the stop flag.  The table is
+ *  lock-free - every slot is two 64 bit atomics, the data and the key xor the data, so a slot torn by two threads
+ *  writing at once fails its key check instead of returning another position's move.  The main thread alone decides
+ *  when to stop and reports each depth it completes.
+ * */
+
+namespace engine {
+
+#define ENGINE_MATE    30000
+#define ENGINE_INF     32000
+#define ENGINE_MAX_PLY 96
+
+#define BOUND_EXACT 1
+#define BOUND_LOWER 2
+#define BOUND_UPPER 3
+
+static const int piece_values[6] = { 0, 900, 330, 320, 500, 100 }; //by PIECE_ type
+
+inline bool is_mate_score (int score) { return score > ENGINE_MATE - ENGINE_MAX_PLY || score < -ENGINE_MATE + ENGINE_MAX_PLY; }
+
+/* *
+ * transposition_table
+ *  a shared table of search results keyed by rules::position_hash.  One entry per slot, replaced by a deeper search of
+ *  any position or by any search from a newer call to searcher::run.
+ *   data bits 0-15  : best move (packed)
+ *   data bits 16-31 : score, offset by 32768
+ *   data bits 32-39 : depth
+ *   data bits 40-41 : bound
+ *   data bits 42-49 : generation
+ * */
+class transposition_table {
+  public:
+    struct entry {
+      uint16_t move = 0;
+      int score = 0;
+      int depth = -1;
+      int bound = 0;
+    };
+
+    transposition_table (size_t megabytes) {
+      size_t slots = 1;
+      while (slots * 2 * sizeof(slot) <= megabytes * 1024 * 1024) {
+        slots *= 2;
+      }
+      table.reset(new slot[slots]);
+      mask = slots - 1;
+      clear();
+    }
+
+    void clear () {
+      for (size_t i = 0; i <= mask; ++i) {
+        table[i].check.store(0, std::memory_order_relaxed);
+        table[i].data.store(0, std::memory_order_relaxed);
+      }
+    }
+
+    void new_search () { generation = (generation + 1) & 0xFF; }
+
+    bool probe (uint64_t hash, entry& found) const {
+      const slot& s = table[hash & mask];
+      uint64_t data = s.data.load(std::memory_order_relaxed);
+      if ((s.check.load(std::memory_order_relaxed) ^ data) != hash || data == 0) {
+        return false;
+      }
+      found.move = data & 0xFFFF;
+      found.score = (int)((data >> 16) & 0xFFFF) - 32768;
+      found.depth = (data >> 32) & 0xFF;
+      found.bound = (data >> 40) & 0x03;
+      return true;
+    }
+
+    void store (uint64_t hash, uint16_t move, int score, int depth, int bound) {
+      slot& s = table[hash & mask];
+      uint64_t old = s.data.load(std::memory_order_relaxed);
+      bool same = (s.check.load(std::memory_order_relaxed) ^ old) == hash;
+      if (old != 0 && ((old >> 42) & 0xFF) == generation && (int)((old >> 32) & 0xFF) > depth + (same ? 2 : 0)) {
+        return;
+      }
+      if (same && move == 0) {
+        move = old & 0xFFFF;
+      }
+      uint64_t data = (uint64_t)move | (uint64_t)(score + 32768) << 16 | (uint64_t)(std::max(depth, 0) & 0xFF) << 32 |
+        (uint64_t)bound << 40 | (uint64_t)generation << 42;
+      s.data.store(data, std::memory_order_relaxed);
+      s.check.store(hash ^ data, std::memory_order_relaxed);
+    }
+
+    size_t size_bytes () const { return (mask + 1) * sizeof(slot); }
+
+  private:
+    struct slot {
+      std::atomic<uint64_t> check;
+      std::atomic<uint64_t> data;
+    };
+
+    std::unique_ptr<slot[]> table;
+    size_t mask = 0;
+    uint64_t generation = 0;
+};
+
+/* *
+ * evaluate
+ *  a static score of state in centipawns, from the point of view of the side to move: material, pawns by how far they
+ *  have come, minor pieces and the queen towards the centre, and the king kept home while the queens are on.
+ * */
+inline int evaluate (
+  const rules::game_state& state
+) {
+  bool queens_on = false;
+  for (uint8_t piece_id = 0; piece_id < 32; ++piece_id) {
+    if (state.piece_positions[piece_id] != 0 &&
+      rules::piece_type(piece_id, state.promoted_pawns, state.promoted_pawn_types) == PIECE_QUEEN) {
+      queens_on = true;
+    }
+  }
+
+  int score = 0;
+  for (uint8_t piece_id = 0; piece_id < 32; ++piece_id) {
+    uint8_t position = state.piece_positions[piece_id];
+    if (position == 0) {
+      continue;
+    }
+    bool white = piece_id < 16;
+    uint8_t type = rules::piece_type(piece_id, state.promoted_pawns, state.promoted_pawn_types);
+    int row = (position - 1) / 8;
+    int col = (position - 1) % 8;
+    int advance = white ? row : 7 - row;
+    int centre = 3 - std::max(std::abs(2 * row - 7), std::abs(2 * col - 7)) / 2; //0 on the edge, 3 in the middle
+
+    int value = piece_values[type];
+    switch (type) {
+      case PIECE_PAWN   : value += advance * advance * 2 + (col >= 2 && col <= 5 ? advance * 3 : 0); break;
+      case PIECE_KNIGHT : value += centre * 10 - (advance == 0 ? 10 : 0); break;
+      case PIECE_BISHOP : value += centre * 5 - (advance == 0 ? 10 : 0); break;
+      case PIECE_QUEEN  : value += centre * 2; break;
+      case PIECE_KING   : value += queens_on ? (advance == 0 ? 10 : -10 * advance) : centre * 8; break;
+    }
+    score += white ? value : -value;
+  }
+  return state.move_count % 2 == 0 ? score : -score;
+}
+
+/* *
+ * move_text
+ *  a move in coordinate notation ('e2e4', 'e7e8q'), given the position it is played from
+ * */
+inline std::string move_text (
+  const rules::game_state& state,
+  uint16_t move
+) {
+  uint8_t piece_id = rules::packed_piece_id(move);
+  uint8_t new_position = rules::packed_new_position(move);
+  std::string text = pgn::position_to_square(state.piece_positions[piece_id]) + pgn::position_to_square(new_position);
+  if (rules::piece_type(piece_id, state.promoted_pawns, state.promoted_pawn_types) == PIECE_PAWN &&
+    (new_position > 56 || new_position < 9)) {
+    text += "bnrq"[rules::packed_promotion_type(move)];
+  }
+  return text;
+}
+
+/* *
+ * score_text
+ *  'cp 35', or 'mate 3' / 'mate -2' in moves for a forced mate
+ * */
+inline std::string score_text (
+  int score
+) {
+  if (!is_mate_score(score)) {
+    return "cp " + std::to_string(score);
+  }
+  int plies = ENGINE_MATE - std::abs(score);
+  return "mate " + std::to_string(score > 0 ? (plies + 1) / 2 : -(plies / 2));
+}
+
+struct depth_report {
+  int depth = 0;
+  int score = 0;
+  uint64_t nodes = 0;
+  double seconds = 0;
+  std::vector<uint16_t> pv;
+};
+
+/* *
+ * searcher
+ *  searches one position at a time with a fixed number of threads and a shared transposition table
+ * */
+class searcher {
+  public:
+    searcher (transposition_table& tt, size_t thread_count) : tt(tt), thread_count(std::max<size_t>(thread_count, 1)) {}
+
+    /* *
+     * run
+     *  searches state to max_depth plies, or until max_millis have passed (0 for no limit), calling report with the
+     *  result of each depth the main thread completes.  Returns the last of them.  state must have a legal move.
+     * */
+    depth_report run (
+      const rules::game_state& state,
+      int max_depth,
+      int64_t max_millis,
+      const std::function<void(const depth_report&)>& report = nullptr
+    ) {
+      tt.new_search();
+      stop.store(false);
+      start = std::chrono::steady_clock::now();
+      deadline = max_millis > 0 ? start + std::chrono::milliseconds(max_millis) : std::chrono::steady_clock::time_point::max();
+
+      workers.clear();
+      for (size_t i = 0; i < thread_count; ++i) {
+        workers.emplace_back(new worker(*this, i));
+      }
+      std::vector<std::thread> helpers;
+      for (size_t i = 1; i < thread_count; ++i) {
+        helpers.emplace_back([this, i, &state, max_depth]() { workers[i]->iterate(state, max_depth, nullptr); });
+      }
+      depth_report last = workers[0]->iterate(state, max_depth, report);
+      stop.store(true);
+      for (auto& helper : helpers) {
+        helper.join();
+      }
+      last.nodes = nodes();
+      last.seconds = elapsed();
+      return last;
+    }
+
+    uint64_t nodes () const {
+      uint64_t total = 0;
+      for (auto& w : workers) {
+        total += w->nodes.load(std::memory_order_relaxed);
+      }
+      return total;
+    }
+
+  private:
+    struct worker {
+      worker (searcher& owner, size_t index) : owner(owner), index(index) {}
+
+      searcher& owner;
+      size_t index;
+      std::atomic<uint64_t> nodes { 0 };
+      uint64_t local_nodes = 0;
+      int root_depth = 0;
+      uint16_t killers[ENGINE_MAX_PLY][2] = {};
+      int history[32][65] = {};
+      uint16_t pv[ENGINE_MAX_PLY][ENGINE_MAX_PLY] = {};
+      int pv_length[ENGINE_MAX_PLY] = {};
+
+      bool stopped () {
+        if ((++local_nodes & 1023) == 0) {
+          nodes.store(local_nodes, std::memory_order_relaxed);
+          //the main thread always finishes depth 1, so there is a move to report
+          if (index == 0 && root_depth > 1 && std::chrono::steady_clock::now() >= owner.deadline) {
+            owner.stop.store(true);
+          }
+        }
+        return owner.stop.load(std::memory_order_relaxed) && (index != 0 || root_depth > 1);
+      }
+
+      depth_report iterate (const rules::game_state& state, int max_depth, const std::function<void(const depth_report&)>& report) {
+        depth_report best;
+        for (int depth = 1 + (index % 2); depth <= max_depth; ++depth) {
+          root_depth = depth;
+          int score = search(state, -ENGINE_INF, ENGINE_INF, depth, 0, false);
+          if (owner.stop.load() && (index != 0 || depth > 1)) {
+            break;
+          }
+          nodes.store(local_nodes, std::memory_order_relaxed);
+          best.depth = depth;
+          best.score = score;
+          best.pv.assign(pv[0], pv[0] + pv_length[0]);
+          if (index == 0) {
+            best.nodes = owner.nodes();
+            best.seconds = owner.elapsed();
+            if (report) {
+              report(best);
+            }
+            //a mate found is as good as it gets, and a deeper search won't finish before the deadline anyway
+            if (is_mate_score(score) || std::chrono::steady_clock::now() + (std::chrono::steady_clock::now() - owner.start) > owner.deadline) {
+              break;
+            }
+          }
+        }
+        nodes.store(local_nodes, std::memory_order_relaxed);
+        return best;
+      }
+
+      int search (const rules::game_state& state, int alpha, int beta, int depth, int ply, bool after_null) {
+        pv_length[ply] = 0;
+        bool in_check = state.attacks.checkers != 0;
+        if (in_check && ply < ENGINE_MAX_PLY / 2) {
+          ++depth;
+        }
+        if (depth <= 0 || ply >= ENGINE_MAX_PLY - 1) {
+          return quiesce(state, alpha, beta, ply);
+        }
+        if (stopped()) {
+          return 0;
+        }
+
+        uint64_t hash = rules::position_hash(state);
+        transposition_table::entry found;
+        uint16_t tt_move = 0;
+        if (owner.tt.probe(hash, found)) {
+          tt_move = found.move;
+          int score = from_tt(found.score, ply);
+          if (ply > 0 && found.depth >= depth && (found.bound == BOUND_EXACT ||
+            (found.bound == BOUND_LOWER && score >= beta) || (found.bound == BOUND_UPPER && score <= alpha))) {
+            return score;
+          }
+        }
+
+        //null move: if passing still holds beta, a real move will too
+        if (!in_check && !after_null && ply > 0 && depth >= 3 && beta - alpha == 1 && has_pieces(state) && evaluate(state) >= beta) {
+          rules::game_state passed = state;
+          passed.move_count += 1;
+          passed.en_passant_idx = 32;
+          rules::update_attacks(passed);
+          int score = -search(passed, -beta, -beta + 1, depth - 3, ply + 1, true);
+          if (owner.stop.load(std::memory_order_relaxed)) {
+            return 0;
+          }
+          if (score >= beta && !is_mate_score(score)) {
+            return beta;
+          }
+        }
+
+        std::vector<uint16_t> moves = rules::legal_moves(state);
+        if (moves.empty()) {
+          return in_check ? -(ENGINE_MATE - ply) : 0;
+        }
+        order_moves(state, moves, tt_move, ply);
+
+        int original_alpha = alpha;
+        int best_score = -ENGINE_INF;
+        uint16_t best_move = moves[0];
+        for (size_t i = 0; i < moves.size(); ++i) {
+          uint16_t move = moves[i];
+          rules::game_state child = state;
+          uint8_t captured_piece_index = 32;
+          bool checkmate = false;
+          rules::play_move(child, rules::packed_piece_id(move), rules::packed_new_position(move), rules::packed_promotion_type(move), captured_piece_index, checkmate);
+
+          int score;
+          if (checkmate) {
+            score = ENGINE_MATE - (ply + 1);
+          } else if (i == 0) {
+            score = -search(child, -beta, -alpha, depth - 1, ply + 1, false);
+          } else {
+            score = -search(child, -alpha - 1, -alpha, depth - 1, ply + 1, false);
+            if (score > alpha && score < beta) {
+              score = -search(child, -beta, -alpha, depth - 1, ply + 1, false);
+            }
+          }
+          if (owner.stop.load(std::memory_order_relaxed) && (index != 0 || root_depth > 1)) {
+            return 0;
+          }
+
+          if (score > best_score) {
+            best_score = score;
+            best_move = move;
+            if (score > alpha) {
+              alpha = score;
+              pv[ply][0] = move;
+              std::copy(pv[ply + 1], pv[ply + 1] + pv_length[ply + 1], pv[ply] + 1);
+              pv_length[ply] = checkmate ? 1 : pv_length[ply + 1] + 1;
+              if (score >= beta) {
+                if (captured_piece_index == 32) {
+                  if (killers[ply][0] != move) {
+                    killers[ply][1] = killers[ply][0];
+                    killers[ply][0] = move;
+                  }
+                  history[rules::packed_piece_id(move)][rules::packed_new_position(move)] += depth * depth;
+                }
+                break;
+              }
+            }
+          }
+        }
+
+        int bound = best_score >= beta ? BOUND_LOWER : best_score > original_alpha ? BOUND_EXACT : BOUND_UPPER;
+        owner.tt.store(hash, best_move, to_tt(best_score, ply), depth, bound);
+        return best_score;
+      }
+
+      int quiesce (const rules::game_state& state, int alpha, int beta, int ply) {
+        pv_length[ply] = 0;
+        if (stopped()) {
+          return 0;
+        }
+        bool in_check = state.attacks.checkers != 0;
+        int best_score = -ENGINE_INF;
+        if (!in_check) {
+          best_score = evaluate(state);
+          if (best_score >= beta || ply >= ENGINE_MAX_PLY - 1) {
+            return best_score;
+          }
+          alpha = std::max(alpha, best_score);
+        }
+
+        std::vector<uint16_t> moves = rules::legal_moves(state);
+        if (moves.empty()) {
+          return in_check ? -(ENGINE_MATE - ply) : 0;
+        }
+        if (!in_check) {
+          //out of check, only captures and queen promotions are worth a look
+          uint8_t board[65];
+          occupancy(state, board);
+          bool white = state.move_count % 2 == 0;
+          moves.erase(std::remove_if(moves.begin(), moves.end(), [&](uint16_t move) {
+            uint8_t target = board[rules::packed_new_position(move)];
+            bool capture = target < 32 && (target < 16) != white;
+            bool promotion = is_promotion(state, move) && rules::packed_promotion_type(move) == PROMOTED_QUEEN;
+            return !capture && !promotion;
+          }), moves.end());
+        }
+        order_moves(state, moves, 0, ply);
+
+        for (uint16_t move : moves) {
+          rules::game_state child = state;
+          uint8_t captured_piece_index = 32;
+          bool checkmate = false;
+          rules::play_move(child, rules::packed_piece_id(move), rules::packed_new_position(move), rules::packed_promotion_type(move), captured_piece_index, checkmate);
+          int score = checkmate ? ENGINE_MATE - (ply + 1) : -quiesce(child, -beta, -alpha, ply + 1);
+          if (owner.stop.load(std::memory_order_relaxed) && (index != 0 || root_depth > 1)) {
+            return 0;
+          }
+          if (score > best_score) {
+            best_score = score;
+            if (score > alpha) {
+              alpha = score;
+              pv[ply][0] = move;
+              std::copy(pv[ply + 1], pv[ply + 1] + pv_length[ply + 1], pv[ply] + 1);
+              pv_length[ply] = checkmate ? 1 : pv_length[ply + 1] + 1;
+              if (score >= beta) {
+                break;
+              }
+            }
+          }
+        }
+        return best_score;
+      }
+
+      void order_moves (const rules::game_state& state, std::vector<uint16_t>& moves, uint16_t tt_move, int ply) {
+        uint8_t board[65];
+        occupancy(state, board);
+        std::vector<std::pair<int, uint16_t>> scored;
+        scored.reserve(moves.size());
+        for (uint16_t move : moves) {
+          uint8_t piece_id = rules::packed_piece_id(move);
+          uint8_t target = board[rules::packed_new_position(move)];
+          int score;
+          if (move == tt_move) {
+            score = 1 << 30;
+          } else if (target < 32) {
+            uint8_t victim = rules::piece_type(target, state.promoted_pawns, state.promoted_pawn_types);
+            uint8_t attacker = rules::piece_type(piece_id, state.promoted_pawns, state.promoted_pawn_types);
+            score = (1 << 28) + piece_values[victim] * 16 - piece_values[attacker] / 16;
+          } else if (is_promotion(state, move)) {
+            score = (1 << 27) + rules::packed_promotion_type(move);
+          } else if (move == killers[ply][0] || move == killers[ply][1]) {
+            score = (1 << 26) + (move == killers[ply][0]);
+          } else {
+            score = std::min(history[piece_id][rules::packed_new_position(move)], (1 << 26) - 1);
+          }
+          scored.push_back({ score, move });
+        }
+        std::stable_sort(scored.begin(), scored.end(), [](const std::pair<int, uint16_t>& a, const std::pair<int, uint16_t>& b) {
+          return a.first > b.first;
+        });
+        for (size_t i = 0; i < moves.size(); ++i) {
+          moves[i] = scored[i].second;
+        }
+      }
+
+      static void occupancy (const rules::game_state& state, uint8_t board[65]) {
+        std::fill(board, board + 65, 32);
+        for (uint8_t piece_id = 0; piece_id < 32; ++piece_id) {
+          board[state.piece_positions[piece_id]] = piece_id;
+        }
+        board[0] = 32;
+      }
+
+      static bool is_promotion (const rules::game_state& state, uint16_t move) {
+        uint8_t new_position = rules::packed_new_position(move);
+        return (new_position > 56 || new_position < 9) &&
+          rules::piece_type(rules::packed_piece_id(move), state.promoted_pawns, state.promoted_pawn_types) == PIECE_PAWN;
+      }
+
+      //whether the side to move has anything but pawns, outside of which a null move can't be trusted
+      static bool has_pieces (const rules::game_state& state) {
+        uint8_t first_piece = state.move_count % 2 == 0 ? 0 : 16;
+        for (uint8_t piece_id = first_piece + 1; piece_id < first_piece + 16; ++piece_id) {
+          if (state.piece_positions[piece_id] != 0 &&
+            rules::piece_type(piece_id, state.promoted_pawns, state.promoted_pawn_types) != PIECE_PAWN) {
+            return true;
+          }
+        }
+        return false;
+      }
+
+      //mate scores are stored as distance from the position rather than from the root
+      static int to_tt (int score, int ply) {
+        return score > ENGINE_MATE - ENGINE_MAX_PLY ? score + ply : score < -ENGINE_MATE + ENGINE_MAX_PLY ? score - ply : score;
+      }
+
+      static int from_tt (int score, int ply) {
+        return score > ENGINE_MATE - ENGINE_MAX_PLY ? score - ply : score < -ENGINE_MATE + ENGINE_MAX_PLY ? score + ply : score;
+      }
+    };
+
+    double elapsed () const {
+      return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    transposition_table& tt;
+    size_t thread_count;
+    std::vector<std::unique_ptr<worker>> workers;
+    std::atomic<bool> stop { false };
+    std::chrono::steady_clock::time_point start;
+    std::chrono::steady_clock::time_point deadline;
+};
+
+} // namespace engine
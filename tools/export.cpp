@@ -0,0 +1,169 @@
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <string>
+
+#include "columnar.hpp"
+#include "transaction.hpp"
+
+/* *
+ * export
+ *  writes one scope of the contract's games table to a columnar snapshot (see columnar.hpp) for analytics, or to
+ *  archive a season before its games are dropped (see 'Scopes' in chess.cpp).
+ *
+ *  Rows are paged out of nodeos with get_table_rows, --page at a time from the next_key of the last page, and appended
+ *  to the snapshot as they arrive, so neither the table nor the JSON of more than one page is ever held in memory.
+ *  Games created or changed while the export runs may or may not be in it, the same as any paged read of a table.
+ *
+ *  --summary reads a snapshot back instead, and prints totals by result and the average game length - a scan over
+ *  three of its columns, as an example of using snapshot_reader.
+ * */
+
+static void usage () {
+  std::cerr <<
+    "usage: export [options] --out FILE\n"
+    "       export --summary FILE\n"
+    "  --url URL          nodeos endpoint (default http://127.0.0.1:8888)\n"
+    "  --contract NAME    chess contract account (default chess)\n"
+    "  --scope NAME       games table scope (default the contract account)\n"
+    "  --out FILE         snapshot to write\n"
+    "  --page N           rows per get_table_rows request (default 500)\n"
+    "  --summary FILE     print totals from a snapshot\n";
+  std::exit(1);
+}
+
+/* *
+ * to_row
+ *  converts one row of get_table_rows JSON to a snapshot row
+ * */
+static columnar::game_row to_row (
+  const json::value& row,
+  uint64_t contract
+) {
+  columnar::game_row out;
+  out.game_id = row["game_id"].as_uint64();
+  out.player_w = eos::string_to_name(row["player_w"].as_string());
+  out.player_b = eos::string_to_name(row["player_b"].as_string());
+  out.winner = eos::string_to_name(row["winner"].as_string());
+  if (out.winner == contract) {
+    out.result = RESULT_DRAW;
+  } else if (out.winner != 0) {
+    out.result = out.winner == out.player_w ? RESULT_WHITE : RESULT_BLACK;
+  }
+  out.move_count = row["move_count"].as_uint64();
+  out.castle = row["castle"].as_uint64();
+  out.en_passant_idx = row["en_passant_idx"].as_uint64();
+  out.promoted_pawns = row["promoted_pawns"].as_uint64();
+  out.promoted_pawn_types = row["promoted_pawn_types"].as_uint64();
+  const json::value& positions = row["piece_positions"];
+  for (size_t i = 0; i < positions.size() && i < 32; ++i) {
+    out.piece_positions[i] = positions.at(i).as_uint64();
+  }
+  return out;
+}
+
+static int summary (
+  const std::string& filename
+) {
+  columnar::snapshot_reader snapshot(filename);
+  const uint8_t* result = snapshot.column<uint8_t>("result");
+  const uint32_t* move_count = snapshot.column<uint32_t>("move_count");
+
+  uint64_t games[4] = {};
+  uint64_t plies = 0;
+  for (uint64_t i = 0; i < snapshot.rows(); ++i) {
+    ++games[result[i] & 3];
+    plies += move_count[i];
+  }
+
+  std::printf("games    %llu\n", (unsigned long long)snapshot.rows());
+  std::printf("playing  %llu\n", (unsigned long long)games[RESULT_PLAYING]);
+  std::printf("white    %llu\n", (unsigned long long)games[RESULT_WHITE]);
+  std::printf("black    %llu\n", (unsigned long long)games[RESULT_BLACK]);
+  std::printf("draw     %llu\n", (unsigned long long)games[RESULT_DRAW]);
+  std::printf("plies    %.1f per game\n", snapshot.rows() == 0 ? 0.0 : (double)plies / snapshot.rows());
+  return 0;
+}
+
+int main (int argc, char** argv) {
+  std::string node_url = "http://127.0.0.1:8888";
+  std::string contract = "chess";
+  std::string scope;
+  std::string out_file;
+  std::string summary_file;
+  size_t page = 500;
+
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    auto next = [&]() -> std::string {
+      if (i + 1 >= argc) { usage(); }
+      return argv[++i];
+    };
+    if (arg == "--url") { node_url = next(); }
+    else if (arg == "--contract") { contract = next(); }
+    else if (arg == "--scope") { scope = next(); }
+    else if (arg == "--out") { out_file = next(); }
+    else if (arg == "--page") { page = std::stoul(next()); }
+    else if (arg == "--summary") { summary_file = next(); }
+    else { usage(); }
+  }
+  if (scope.empty()) {
+    scope = contract;
+  }
+  if (out_file.empty() == summary_file.empty() || page == 0) {
+    usage();
+  }
+
+  try {
+    if (!summary_file.empty()) {
+      return summary(summary_file);
+    }
+
+    http_client node(node_url);
+    columnar::snapshot_writer writer(out_file);
+    uint64_t contract_name = eos::string_to_name(contract);
+    auto start = std::chrono::steady_clock::now();
+    std::string lower_bound;
+    size_t requests = 0;
+
+    while (true) {
+      json::value request = json::value::object();
+      request.set("code", contract);
+      request.set("scope", scope);
+      request.set("table", "games");
+      request.set("json", true);
+      request.set("limit", (int64_t)page);
+      if (!lower_bound.empty()) {
+        request.set("lower_bound", lower_bound);
+      }
+      http_response response = node.post("/v1/chain/get_table_rows", request.dump());
+      ++requests;
+      if (response.status != 200) {
+        throw std::runtime_error("get_table_rows failed: " + response.body);
+      }
+
+      json::value result = json::parse(response.body);
+      const json::value& rows = result["rows"];
+      for (size_t i = 0; i < rows.size(); ++i) {
+        writer.append(to_row(rows.at(i), contract_name));
+      }
+      if (!result["more"].as_bool() || rows.size() == 0) {
+        break;
+      }
+
+      //older nodeos versions don't send next_key, so carry on from the last game id
+      lower_bound = result["next_key"].as_string();
+      if (lower_bound.empty()) {
+        lower_bound = std::to_string(rows.at(rows.size() - 1)["game_id"].as_uint64() + 1);
+      }
+    }
+    writer.finish();
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cerr << writer.row_count() << " games in " << requests << " requests, " << seconds << "s\n";
+  } catch (const std::exception& e) {
+    std::cerr << "export: " << e.what() << "\n";
+    return 1;
+  }
+  return 0;
+}
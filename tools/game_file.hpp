@@ -0,0 +1,147 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+/* *
+ * game_file.hpp
+ *  a compact binary file of games as packed moves (see pack_move in chess_rules.hpp), written by gamegen.  Every tool
+ *  that reads packed move lists reads these as well (pgn::load_games tells them apart by the magic).
+ *
+ *  File layout (little endian) -
+ *   header  magic "CHESSGMS", version, the seed the games were generated from, game count
+ *   games   per game: how it ended (one byte, GAME_END_), its ply count (two bytes), then two bytes per packed move
+ * */
+
+namespace game_file {
+
+#define GAME_FILE_MAGIC   "CHESSGMS"
+#define GAME_FILE_VERSION 1
+
+#define GAME_END_PLIES      0 //reached the ply limit
+#define GAME_END_CHECKMATE  1 //the last move was checkmate
+#define GAME_END_NO_MOVES   2 //the side to move has no legal move
+#define GAME_END_KING_TAKEN 3 //the last move took a king
+
+struct file_header {
+  char magic[8];
+  uint32_t version;
+  uint32_t reserved;
+  uint64_t seed;
+  uint64_t games;
+};
+
+/* *
+ * encode
+ *  appends one game to out in the file's game layout
+ * */
+inline void encode (
+  std::string& out,
+  uint8_t end,
+  const std::vector<uint16_t>& moves
+) {
+  uint16_t plies = moves.size();
+  out.push_back((char)end);
+  out.append((const char*)&plies, sizeof(plies));
+  out.append((const char*)moves.data(), moves.size() * sizeof(uint16_t));
+}
+
+/* *
+ * writer
+ *  writes encoded games behind a header, and fills in the game count when closed
+ * */
+class writer {
+  public:
+    writer (const std::string& filename, uint64_t seed) : filename(filename) {
+      out = std::fopen(filename.c_str(), "wb");
+      if (out == nullptr) {
+        throw std::runtime_error("game_file: unable to create " + filename);
+      }
+      header = {};
+      std::memcpy(header.magic, GAME_FILE_MAGIC, sizeof(header.magic));
+      header.version = GAME_FILE_VERSION;
+      header.seed = seed;
+      std::fwrite(&header, sizeof(header), 1, out);
+    }
+
+    ~writer () {
+      if (out != nullptr) {
+        std::fclose(out);
+      }
+    }
+
+    writer (const writer&) = delete;
+    writer& operator= (const writer&) = delete;
+
+    //games holds game_count games, already encoded
+    void append (const std::string& games, uint64_t game_count) {
+      if (std::fwrite(games.data(), 1, games.size(), out) != games.size()) {
+        throw std::runtime_error("game_file: unable to write " + filename);
+      }
+      header.games += game_count;
+    }
+
+    void close () {
+      std::fseek(out, 0, SEEK_SET);
+      std::fwrite(&header, sizeof(header), 1, out);
+      if (std::fclose(out) != 0) {
+        out = nullptr;
+        throw std::runtime_error("game_file: unable to write " + filename);
+      }
+      out = nullptr;
+    }
+
+  private:
+    std::string filename;
+    FILE* out = nullptr;
+    file_header header;
+};
+
+inline bool is_game_file (
+  const std::string& data
+) {
+  return data.size() >= sizeof(file_header) && data.compare(0, 8, GAME_FILE_MAGIC) == 0;
+}
+
+/* *
+ * read_games
+ *  decodes a whole file's contents.  ends, if given, gets how each game ended.
+ * */
+inline std::vector<std::vector<uint16_t>> read_games (
+  const std::string& data,
+  std::vector<uint8_t>* ends = nullptr
+) {
+  file_header header;
+  std::memcpy(&header, data.data(), sizeof(header));
+  if (!is_game_file(data) || header.version != GAME_FILE_VERSION) {
+    throw std::runtime_error("game_file: not a version " + std::to_string(GAME_FILE_VERSION) + " game file");
+  }
+
+  std::vector<std::vector<uint16_t>> games;
+  size_t at = sizeof(header);
+  for (uint64_t game = 0; game < header.games; ++game) {
+    uint16_t plies = 0;
+    if (at + 3 > data.size()) {
+      throw std::runtime_error("game_file: truncated at game " + std::to_string(game + 1));
+    }
+    uint8_t end = data[at];
+    std::memcpy(&plies, data.data() + at + 1, sizeof(plies));
+    at += 3;
+    if (at + plies * sizeof(uint16_t) > data.size()) {
+      throw std::runtime_error("game_file: truncated at game " + std::to_string(game + 1));
+    }
+    games.emplace_back(plies);
+    std::memcpy(games.back().data(), data.data() + at, plies * sizeof(uint16_t));
+    at += plies * sizeof(uint16_t);
+    if (ends != nullptr) {
+      ends->push_back(end);
+    }
+  }
+  return games;
+}
+
+} // namespace game_file
@@ -0,0 +1,333 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "movegen.hpp"
+#include "pgn.hpp"
+
+/* *
+ * gamegen
+ *  plays random legal games under the contract's rules, to stress the contract and to cross-check its rules.
+ *
+ *  Each ply lists the legal moves with movegen.hpp, picks one, and makes it with rules::play_move, so every game is
+ *  one the contract would accept move for move - if play_move rejects a move movegen listed, the run stops there.
+ *  --weighted picks captures, promotions, castling and two square pawn moves more often than quiet moves, to reach the
+ *  rules' corners sooner.  A game ends at checkmate, when the side to move has no legal move, when a king is taken
+ *  (kings attack nothing under the contract's rules, so they can end up side by side) or at --plies.
+ *
+ *  --differential also lists every position's moves with rules::legal_moves - every piece against every square
+ *  through valid_move - and stops at the first position where the two lists differ, printing it as FEN with the moves
+ *  leading to it and the moves only one side accepts.  It is around a hundred times slower.
+ *
+ *  Game g is played from its own random stream, seeded from --seed and g, so a run is repeatable whatever the number
+ *  of threads, and --out writes the games in order as a binary game file (see game_file.hpp) that posindex, bundle and
+ *  history_bench read like any packed move list.
+ * */
+
+#define CHUNK_GAMES 64
+
+struct run_stats {
+  uint64_t games = 0;
+  uint64_t plies = 0;
+  uint64_t captures = 0;
+  uint64_t promotions = 0;
+  uint64_t castles = 0;
+  uint64_t double_steps = 0;
+  uint64_t checks = 0;
+  uint64_t ends[4] = {};
+
+  void add (const run_stats& other) {
+    games += other.games;
+    plies += other.plies;
+    captures += other.captures;
+    promotions += other.promotions;
+    castles += other.castles;
+    double_steps += other.double_steps;
+    checks += other.checks;
+    for (int end = 0; end < 4; ++end) {
+      ends[end] += other.ends[end];
+    }
+  }
+};
+
+struct options {
+  uint64_t game_count = 10000;
+  size_t max_plies = 300;
+  size_t threads = 1;
+  uint64_t seed = 1;
+  bool weighted = false;
+  bool differential = false;
+  std::string out_file;
+};
+
+/* *
+ * run
+ *  the state shared by the worker threads: the next chunk of games to play, and the finished chunks waiting to be
+ *  written in order
+ * */
+struct run {
+  const options& opts;
+  std::atomic<uint64_t> next_chunk { 0 };
+  std::atomic<bool> stop { false };
+  std::mutex lock;
+  game_file::writer* out = nullptr;
+  uint64_t next_write = 0;
+  std::map<uint64_t, std::pair<std::string, uint64_t>> pending; //chunk -> encoded games, game count
+  run_stats totals;
+  std::string failure;
+
+  explicit run (const options& opts) : opts(opts) {}
+
+  void finish_chunk (uint64_t chunk, std::string games, uint64_t game_count, const run_stats& stats) {
+    std::lock_guard<std::mutex> guard(lock);
+    totals.add(stats);
+    if (out == nullptr) {
+      return;
+    }
+    pending[chunk] = { std::move(games), game_count };
+    for (auto it = pending.find(next_write); it != pending.end(); it = pending.find(next_write)) {
+      out->append(it->second.first, it->second.second);
+      pending.erase(it);
+      ++next_write;
+    }
+  }
+
+  void fail (const std::string& message) {
+    std::lock_guard<std::mutex> guard(lock);
+    if (failure.empty()) {
+      failure = message;
+    }
+    stop = true;
+  }
+};
+
+static std::string move_list_text (
+  const rules::game_state& state,
+  const std::vector<uint16_t>& moves
+) {
+  std::string text;
+  for (uint16_t move : moves) {
+    uint8_t piece_id = rules::packed_piece_id(move);
+    text += " " + pgn::position_to_square(state.piece_positions[piece_id]) + pgn::position_to_square(rules::packed_new_position(move));
+    if (rules::packed_promotion_type(move) != 0 || (move >> 12) != 0) {
+      text += "bnrq"[rules::packed_promotion_type(move)];
+    }
+    text += "(" + std::to_string(move) + ")";
+  }
+  return text.empty() ? " none" : text;
+}
+
+static std::string failure_text (
+  uint64_t game,
+  const rules::game_state& state,
+  const std::vector<uint16_t>& played,
+  const std::string& what
+) {
+  std::string text = "game " + std::to_string(game) + " ply " + std::to_string(played.size()) + ": " + what + "\n  fen   " + pgn::fen(state) + "\n  moves";
+  for (uint16_t move : played) {
+    text += " " + std::to_string(move);
+  }
+  return text;
+}
+
+//the moves in a but not in b; both sorted
+static std::vector<uint16_t> only_in (
+  const std::vector<uint16_t>& a,
+  const std::vector<uint16_t>& b
+) {
+  std::vector<uint16_t> difference;
+  std::set_difference(a.begin(), a.end(), b.begin(), b.end(), std::back_inserter(difference));
+  return difference;
+}
+
+/* *
+ * play_game
+ *  plays game number game into moves, returning how it ended, or 0xFF after reporting a disagreement
+ * */
+static uint8_t play_game (
+  run& r,
+  uint64_t game,
+  std::vector<uint16_t>& played,
+  run_stats& stats
+) {
+  uint64_t rng = r.opts.seed * 0x9E3779B97F4A7C15ULL + game;
+  rules::splitmix64(rng);
+  rules::game_state state;
+  std::vector<uint16_t> moves, reference;
+  std::vector<uint8_t> kinds;
+  played.clear();
+
+  while (played.size() < r.opts.max_plies) {
+    movegen::legal_moves(state, moves, &kinds);
+
+    if (r.opts.differential) {
+      reference = rules::legal_moves(state);
+      std::vector<uint16_t> sorted = moves;
+      std::sort(sorted.begin(), sorted.end());
+      std::sort(reference.begin(), reference.end());
+      if (sorted != reference) {
+        r.fail(failure_text(game, state, played, "move lists differ") +
+          "\n  only movegen   " + move_list_text(state, only_in(sorted, reference)) +
+          "\n  only valid_move" + move_list_text(state, only_in(reference, sorted)));
+        return 0xFF;
+      }
+    }
+
+    if (moves.empty()) {
+      return GAME_END_NO_MOVES;
+    }
+
+    size_t pick = 0;
+    if (r.opts.weighted) {
+      //quiet moves 1, two square pawn moves 4, captures 4, promotions and castling 16
+      static const uint32_t weights[16] = { 1, 4, 16, 16, 16, 16, 16, 16, 4, 4, 16, 16, 16, 16, 16, 16 };
+      uint32_t total = 0;
+      for (uint8_t kind : kinds) {
+        total += weights[kind];
+      }
+      uint32_t target = rules::splitmix64(rng) % total;
+      while (target >= weights[kinds[pick]]) {
+        target -= weights[kinds[pick++]];
+      }
+    } else {
+      pick = rules::splitmix64(rng) % moves.size();
+    }
+
+    uint16_t move = moves[pick];
+    uint8_t captured_piece_index = 32;
+    bool checkmate = false;
+    rules::game_state before = state;
+    if (!rules::play_move(state, rules::packed_piece_id(move), rules::packed_new_position(move), rules::packed_promotion_type(move), captured_piece_index, checkmate)) {
+      r.fail(failure_text(game, before, played, "valid_move rejects" + move_list_text(before, { move })));
+      return 0xFF;
+    }
+    played.push_back(move);
+
+    stats.plies += 1;
+    stats.captures += captured_piece_index < 32;
+    stats.promotions += (kinds[pick] & MOVE_PROMOTION) != 0;
+    stats.castles += (kinds[pick] & MOVE_CASTLE) != 0;
+    stats.double_steps += (kinds[pick] & MOVE_DOUBLE) != 0;
+    stats.checks += state.attacks.checkers != 0;
+    if (checkmate) {
+      return GAME_END_CHECKMATE;
+    }
+    if (captured_piece_index == 0 || captured_piece_index == 16) {
+      return GAME_END_KING_TAKEN;
+    }
+  }
+  return GAME_END_PLIES;
+}
+
+static void worker (
+  run& r
+) {
+  std::vector<uint16_t> played;
+  uint64_t chunks = (r.opts.game_count + CHUNK_GAMES - 1) / CHUNK_GAMES;
+  for (uint64_t chunk = r.next_chunk++; chunk < chunks && !r.stop; chunk = r.next_chunk++) {
+    std::string encoded;
+    run_stats stats;
+    uint64_t first = chunk * CHUNK_GAMES;
+    uint64_t last = std::min(first + CHUNK_GAMES, r.opts.game_count);
+    for (uint64_t game = first; game < last; ++game) {
+      uint8_t end = play_game(r, game, played, stats);
+      if (end == 0xFF) {
+        return;
+      }
+      stats.games += 1;
+      stats.ends[end] += 1;
+      if (r.out != nullptr) {
+        game_file::encode(encoded, end, played);
+      }
+    }
+    r.finish_chunk(chunk, std::move(encoded), last - first, stats);
+  }
+}
+
+static void usage () {
+  std::cerr <<
+    "usage: gamegen [options]\n"
+    "  --games N          games to play (default 10000)\n"
+    "  --plies N          longest game, at most 65535 (default 300)\n"
+    "  --threads N        threads (default one per core)\n"
+    "  --seed N           random seed (default 1)\n"
+    "  --weighted         favour captures, promotions, castling and two square pawn moves\n"
+    "  --differential     check every position's moves against rules::legal_moves, stopping at the first difference\n"
+    "  --out FILE         write the games to a binary game file\n";
+  std::exit(1);
+}
+
+int main (int argc, char** argv) {
+  options opts;
+  opts.threads = std::max(std::thread::hardware_concurrency(), 1u);
+
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    auto next = [&]() -> std::string {
+      if (i + 1 >= argc) { usage(); }
+      return argv[++i];
+    };
+    if (arg == "--games") { opts.game_count = std::stoull(next()); }
+    else if (arg == "--plies") { opts.max_plies = std::stoul(next()); }
+    else if (arg == "--threads") { opts.threads = std::stoul(next()); }
+    else if (arg == "--seed") { opts.seed = std::stoull(next()); }
+    else if (arg == "--weighted") { opts.weighted = true; }
+    else if (arg == "--differential") { opts.differential = true; }
+    else if (arg == "--out") { opts.out_file = next(); }
+    else { usage(); }
+  }
+  if (opts.threads == 0 || opts.max_plies == 0 || opts.max_plies > 0xFFFF) {
+    usage();
+  }
+
+  try {
+    run r(opts);
+    std::unique_ptr<game_file::writer> out;
+    if (!opts.out_file.empty()) {
+      out.reset(new game_file::writer(opts.out_file, opts.seed));
+      r.out = out.get();
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < opts.threads; ++i) {
+      threads.emplace_back(worker, std::ref(r));
+    }
+    for (auto& thread : threads) {
+      thread.join();
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    if (!r.failure.empty()) {
+      std::cerr << "gamegen: " << r.failure << "\n";
+      return 1;
+    }
+    if (out) {
+      out->close();
+    }
+
+    const run_stats& t = r.totals;
+    std::printf("%llu games, %llu plies in %.2fs on %zu threads: %.0f plies/s\n", (unsigned long long)t.games,
+      (unsigned long long)t.plies, seconds, opts.threads, seconds > 0 ? t.plies / seconds : 0.0);
+    std::printf("captures %llu  promotions %llu  castles %llu  two square pawn moves %llu  checks %llu\n",
+      (unsigned long long)t.captures, (unsigned long long)t.promotions, (unsigned long long)t.castles,
+      (unsigned long long)t.double_steps, (unsigned long long)t.checks);
+    std::printf("ended by checkmate %llu  no legal move %llu  king taken %llu  ply limit %llu\n",
+      (unsigned long long)t.ends[GAME_END_CHECKMATE], (unsigned long long)t.ends[GAME_END_NO_MOVES],
+      (unsigned long long)t.ends[GAME_END_KING_TAKEN], (unsigned long long)t.ends[GAME_END_PLIES]);
+    if (opts.differential) {
+      std::printf("movegen and valid_move agree on every position\n");
+    }
+  } catch (const std::exception& e) {
+    std::cerr << "gamegen: " << e.what() << "\n";
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+
+#include "http_client.hpp"
+#include "json.hpp"
+#include "../chess_rules.hpp"
+
+/* *
+ * games_table.hpp
+ *  reads single games out of the contract's games table with get_table_rows, for the tools that work on one live game.
+ * */
+
+namespace games_table {
+
+/* *
+ * read_game
+ *  the row of game_id in scope's games table, or false if there is no such game
+ * */
+inline bool read_game (
+  http_client& node,
+  const std::string& contract,
+  const std::string& scope,
+  uint64_t game_id,
+  json::value& row
+) {
+  json::value request = json::value::object();
+  request.set("code", contract);
+  request.set("scope", scope);
+  request.set("table", "games");
+  request.set("json", true);
+  request.set("lower_bound", std::to_string(game_id));
+  request.set("upper_bound", std::to_string(game_id));
+  request.set("limit", 1);
+  http_response response = node.post("/v1/chain/get_table_rows", request.dump());
+  if (response.status != 200) {
+    throw std::runtime_error("get_table_rows failed: " + response.body);
+  }
+  json::value rows = json::parse(response.body)["rows"];
+  if (rows.size() == 0 || rows.at(0)["game_id"].as_uint64() != game_id) {
+    return false;
+  }
+  row = rows.at(0);
+  return true;
+}
+
+/* *
+ * to_state
+ *  the game state of a games table row, with the attack maps as they are stored on chain, or rebuilt for a row written
+ *  before they were (see 'Row Layout' in chess.cpp)
+ * */
+inline rules::game_state to_state (
+  const json::value& row
+) {
+  rules::game_state state;
+  state.move_count = row["move_count"].as_uint64();
+  state.castle = row["castle"].as_uint64();
+  state.en_passant_idx = row["en_passant_idx"].as_uint64();
+  state.promoted_pawns = row["promoted_pawns"].as_uint64();
+  state.promoted_pawn_types = row["promoted_pawn_types"].as_uint64();
+  const json::value& positions = row["piece_positions"];
+  for (size_t i = 0; i < positions.size() && i < 32; ++i) {
+    state.piece_positions[i] = positions.at(i).as_uint64();
+  }
+  if (row["white_attacks"].is_null() || row["black_attacks"].is_null() || row["checkers"].is_null()) {
+    rules::update_attacks(state);
+    return state;
+  }
+  state.attacks.white = row["white_attacks"].as_uint64();
+  state.attacks.black = row["black_attacks"].as_uint64();
+  state.attacks.checkers = row["checkers"].as_uint64();
+  return state;
+}
+
+} // namespace games_table
@@ -0,0 +1,318 @@
+#pragma once
+
+#include <cctype>
+#include <cerrno>
+#include <cstdlib>
+#include <stdexcept>
+#include <string>
+
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+/* *
+ * http_client.hpp
+ *  a blocking HTTP/1.1 client that keeps one connection open for as many requests as the server allows.
+ *  Supports 'http://host:port' urls for nodeos, and 'unix:///path/to/socket' urls for keosd's default socket.
+ * */
+
+struct http_response {
+  int status = 0;
+  std::string body;
+  bool close = false; //server asked to close the connection after this response
+};
+
+/* *
+ * parse_http_response
+ *  tries to parse one complete response from the front of buffer.  On success the response is removed from the buffer
+ *  and true is returned; false means more data is needed.  'closed' says the server has closed the connection, which
+ *  is how a response without a length or chunked encoding ends.
+ * */
+inline bool parse_http_response (
+  std::string& buffer,
+  bool closed,
+  http_response& response
+) {
+  size_t header_end = buffer.find("\r\n\r\n");
+  if (header_end == std::string::npos || buffer.size() < 12) {
+    return false;
+  }
+
+  http_response parsed;
+  parsed.status = std::atoi(buffer.c_str() + 9);
+
+  //headers
+  long content_length = -1;
+  bool chunked = false;
+  size_t line_start = buffer.find("\r\n") + 2;
+  while (line_start < header_end) {
+    size_t line_end = buffer.find("\r\n", line_start);
+    std::string line = buffer.substr(line_start, line_end - line_start);
+    line_start = line_end + 2;
+
+    size_t colon = line.find(':');
+    if (colon == std::string::npos) {
+      continue;
+    }
+    std::string key = line.substr(0, colon);
+    std::string val = line.substr(colon + 1);
+    while (!val.empty() && val[0] == ' ') { val.erase(0, 1); }
+    for (auto& c : key) { c = std::tolower((unsigned char)c); }
+    for (auto& c : val) { c = std::tolower((unsigned char)c); }
+    if (key == "content-length") {
+      content_length = std::atol(val.c_str());
+    } else if (key == "transfer-encoding" && val.find("chunked") != std::string::npos) {
+      chunked = true;
+    } else if (key == "connection" && val == "close") {
+      parsed.close = true;
+    }
+  }
+
+  //body
+  size_t body_start = header_end + 4;
+  size_t consumed = 0;
+  if (chunked) {
+    size_t pos = body_start;
+    while (true) {
+      size_t size_end = buffer.find("\r\n", pos);
+      if (size_end == std::string::npos) {
+        return false;
+      }
+      size_t size = std::strtoul(buffer.c_str() + pos, nullptr, 16);
+      pos = size_end + 2;
+      if (size == 0) {
+        //the last chunk is followed by an (empty) trailer section
+        size_t trailer_end = buffer.find("\r\n", pos);
+        if (trailer_end == std::string::npos) {
+          return false;
+        }
+        consumed = trailer_end + 2;
+        break;
+      }
+      if (buffer.size() < pos + size + 2) {
+        return false;
+      }
+      parsed.body.append(buffer, pos, size);
+      pos += size + 2;
+    }
+  } else if (content_length >= 0) {
+    if (buffer.size() < body_start + content_length) {
+      return false;
+    }
+    parsed.body = buffer.substr(body_start, content_length);
+    consumed = body_start + content_length;
+  } else {
+    //no length given, so the body runs until the server closes the connection
+    if (!closed) {
+      return false;
+    }
+    parsed.body = buffer.substr(body_start);
+    parsed.close = true;
+    consumed = buffer.size();
+  }
+
+  buffer.erase(0, consumed);
+  response = std::move(parsed);
+  return true;
+}
+
+/* *
+ * http_endpoint
+ *  the address part of a url, and how to open a socket to it
+ * */
+struct http_endpoint {
+  std::string host;
+  std::string port;
+  std::string unix_path;
+
+  http_endpoint (const std::string& url) {
+    if (url.compare(0, 7, "unix://") == 0) {
+      unix_path = url.substr(7);
+      if (!unix_path.empty() && unix_path[0] == '~') {
+        const char* home = std::getenv("HOME");
+        unix_path = std::string(home ? home : "") + unix_path.substr(1);
+      }
+      host = "localhost";
+    } else {
+      std::string rest = url.compare(0, 7, "http://") == 0 ? url.substr(7) : url;
+      size_t slash = rest.find('/');
+      if (slash != std::string::npos) {
+        rest = rest.substr(0, slash);
+      }
+      size_t colon = rest.rfind(':');
+      host = rest.substr(0, colon);
+      port = colon == std::string::npos ? "80" : rest.substr(colon + 1);
+    }
+  }
+
+  std::string describe () const { return unix_path.empty() ? host + ":" + port : unix_path; }
+
+  /* *
+   * open
+   *  returns a connected socket.  With nonblocking set, a tcp connect may still be in progress when this returns, and
+   *  completes when the socket polls writable.  Throws std::runtime_error if the address can't be reached.
+   * */
+  int open (
+    bool nonblocking = false
+  ) const {
+    int fd = -1;
+    if (!unix_path.empty()) {
+      sockaddr_un addr {};
+      addr.sun_family = AF_UNIX;
+      unix_path.copy(addr.sun_path, sizeof(addr.sun_path) - 1);
+      fd = socket(AF_UNIX, SOCK_STREAM, 0);
+      if (fd < 0 || connect(fd, (sockaddr*)&addr, sizeof(addr)) != 0) {
+        if (fd >= 0) { close(fd); }
+        throw std::runtime_error("http: unable to connect to " + unix_path);
+      }
+      if (nonblocking) {
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+      }
+      return fd;
+    }
+
+    addrinfo hints {};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo* result = nullptr;
+    if (getaddrinfo(host.c_str(), port.c_str(), &hints, &result) != 0) {
+      throw std::runtime_error("http: unable to resolve " + host);
+    }
+    for (addrinfo* ai = result; ai != nullptr; ai = ai->ai_next) {
+      fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+      if (fd < 0) {
+        continue;
+      }
+      if (nonblocking) {
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+      }
+      if (connect(fd, ai->ai_addr, ai->ai_addrlen) == 0 || (nonblocking && errno == EINPROGRESS)) {
+        break;
+      }
+      close(fd);
+      fd = -1;
+    }
+    freeaddrinfo(result);
+    if (fd < 0) {
+      throw std::runtime_error("http: unable to connect to " + host + ":" + port);
+    }
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    return fd;
+  }
+
+  std::string request (
+    const std::string& path,
+    const std::string& body
+  ) const {
+    return "POST " + path + " HTTP/1.1\r\n"
+      "Host: " + host + "\r\n"
+      "Connection: keep-alive\r\n"
+      "Content-Type: application/json\r\n"
+      "Content-Length: " + std::to_string(body.size()) + "\r\n\r\n" + body;
+  }
+};
+
+class http_client {
+  public:
+    http_client (const std::string& url) : endpoint(url) {}
+
+    ~http_client () { disconnect(); }
+
+    http_client (const http_client&) = delete;
+    http_client& operator= (const http_client&) = delete;
+
+    /* *
+     * post
+     *  sends a POST request on the open connection (reconnecting if the server closed it) and reads the response.
+     *  Throws std::runtime_error if the server can't be reached.
+     * */
+    http_response post (
+      const std::string& path,
+      const std::string& body
+    ) {
+      std::string request = endpoint.request(path, body);
+
+      //a kept-alive connection may have been closed by the server since the last request, so retry once on a fresh one
+      for (int attempt = 0; attempt < 2; ++attempt) {
+        bool reused = fd >= 0;
+        if (!reused) {
+          connect_socket();
+        }
+
+        http_response response;
+        if (send_all(request) && read_response(response)) {
+          return response;
+        }
+        disconnect();
+        if (!reused) {
+          break;
+        }
+      }
+      throw std::runtime_error("http: request to " + endpoint.describe() + path + " failed");
+    }
+
+    //number of tcp/unix connections opened so far, to confirm that keep-alive is working
+    int connections () const { return connect_count; }
+
+  private:
+    http_endpoint endpoint;
+    std::string buffer; //bytes read past the end of the last response
+    int fd = -1;
+    int connect_count = 0;
+
+    void connect_socket () {
+      buffer.clear();
+      fd = endpoint.open();
+      ++connect_count;
+    }
+
+    void disconnect () {
+      if (fd >= 0) {
+        close(fd);
+        fd = -1;
+      }
+    }
+
+    bool send_all (const std::string& data) {
+      size_t sent = 0;
+      while (sent < data.size()) {
+        ssize_t n = send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+        if (n <= 0) {
+          return false;
+        }
+        sent += n;
+      }
+      return true;
+    }
+
+    bool fill () {
+      char chunk[16384];
+      ssize_t n = recv(fd, chunk, sizeof(chunk), 0);
+      if (n <= 0) {
+        return false;
+      }
+      buffer.append(chunk, n);
+      return true;
+    }
+
+    bool read_response (http_response& response) {
+      while (!parse_http_response(buffer, false, response)) {
+        if (!fill()) {
+          //a response without a length ends when the connection closes
+          if (!parse_http_response(buffer, true, response)) {
+            return false;
+          }
+          break;
+        }
+      }
+      if (response.close) {
+        disconnect();
+      }
+      return true;
+    }
+};
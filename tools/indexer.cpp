@@ -0,0 +1,641 @@
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "http_client.hpp"
+#include "json.hpp"
+#include "pgn.hpp"
+#include "sqlite.hpp"
+
+/* *
+ * indexer
+ *  keeps a local SQLite database of every game the chess contract has played, for queries the contract's tables can't
+ *  answer - finished games, a player's history, the position after any ply.
+ *
+ *  Reads the contract's action traces, either from a nodeos running the history plugin (--url, /v1/history/get_actions)
+ *  or from a file dump (--file: a get_actions response, a JSON array of actions, or one action per line, streamed an
+ *  action at a time).  Games are followed through the 'gameevent' records the contract sends itself (see 'Game Events'
+ *  in chess.cpp), which only exist for changes the contract accepted, so rejected actions never reach the index.  Player names come from the 'newgame'
+ *  action that sends each newgame event.  Every ply is replayed through rules::play_move, the same rules the contract
+ *  ran, and a ply that doesn't replay to the same capture marks its game as diverged instead of indexing a board the
+ *  contract never had.  A database holds the games of one scope of the games table (--scope; see 'Scopes' in
+ *  chess.cpp), and events of other scopes are passed over.
+ *
+ *  Tables -
+ *   games      one row per game: players, winner, result (white, black, draw or '' while playing), how it ended, plies
+ *   positions  one row per game and ply, ply 0 being the start: the move and capture that led to it, its FEN and the
+ *              raw game state
+ *   checkpoint the account_action_seq of the last action indexed, per contract account
+ *
+ *  Writes go in one SQLite transaction per --checkpoint actions, with the checkpoint in the same transaction, so an
+ *  interrupted run loses at most the actions since the last commit and the next run picks up from there.
+ * */
+
+static volatile std::sig_atomic_t stopping = 0;
+
+static void on_signal (int) {
+  stopping = 1;
+}
+
+static const char* schema =
+  "create table if not exists games ("
+  "  game_id integer primary key, player_w text not null, player_b text not null,"
+  "  winner text not null default '', result text not null default '', ended_by text not null default '',"
+  "  plies integer not null default 0, diverged integer not null default 0,"
+  "  created_block integer not null, updated_block integer not null);"
+  "create index if not exists games_player_w on games (player_w, result);"
+  "create index if not exists games_player_b on games (player_b, result);"
+  "create table if not exists positions ("
+  "  game_id integer not null, ply integer not null, move integer not null, captured_piece integer not null,"
+  "  fen text not null, castle integer not null, en_passant_idx integer not null, promoted_pawns integer not null,"
+  "  promoted_pawn_types integer not null, piece_positions blob not null, block_num integer not null,"
+  "  primary key (game_id, ply)) without rowid;"
+  "create index if not exists positions_fen on positions (fen);"
+  "create table if not exists checkpoint (contract text primary key, seq integer not null);";
+
+struct indexed_game {
+  std::string player_w;
+  std::string player_b;
+  std::string winner;
+  std::string ended_by;
+  bool diverged = false;
+  rules::game_state state;
+};
+
+/* *
+ * game_index
+ *  the database, and the games touched since it was opened.  Games are read back from their last position on first use,
+ *  so a restart only loads the games that are still being played.
+ * */
+class game_index {
+  public:
+    game_index (const std::string& filename, const std::string& contract) : contract(contract) {
+      if (sqlite3_open(filename.c_str(), &db) != SQLITE_OK) {
+        std::string error = "sqlite: unable to open " + filename + ": " + sqlite3_errmsg(db);
+        sqlite3_close(db);
+        throw std::runtime_error(error);
+      }
+      exec("pragma journal_mode = wal; pragma synchronous = normal;");
+      exec(schema);
+      insert_game.reset(new statement(db, "insert or replace into games values (?, ?, ?, ?, ?, ?, ?, ?, ?, ?)"));
+      update_game.reset(new statement(db, "update games set winner = ?, result = ?, ended_by = ?, plies = ?, diverged = ?, updated_block = ? where game_id = ?"));
+      insert_position.reset(new statement(db, "insert or replace into positions values (?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?)"));
+      delete_positions.reset(new statement(db, "delete from positions where game_id = ?"));
+      exec("begin");
+    }
+
+    ~game_index () {
+      insert_game.reset();
+      update_game.reset();
+      insert_position.reset();
+      delete_positions.reset();
+      sqlite3_close(db);
+    }
+
+    game_index (const game_index&) = delete;
+    game_index& operator= (const game_index&) = delete;
+
+    //account_action_seq of the last action indexed, -1 for none
+    int64_t cursor () {
+      statement query(db, "select seq from checkpoint where contract = ?");
+      query.bind(1, contract);
+      int64_t seq = -1;
+      if (query.step()) {
+        seq = query.integer(0);
+        query.done();
+      }
+      return seq;
+    }
+
+    //stores the cursor and commits everything written since the last checkpoint
+    void checkpoint (int64_t seq) {
+      statement update(db, "insert or replace into checkpoint values (?, ?)");
+      update.bind(1, contract).bind(2, seq).step();
+      exec("commit");
+      exec("begin");
+    }
+
+    //indexes a new game.  The contract never hands an id out twice, but before its per scope counter a scope dropped to
+    //the last game started again from 0; the newer game then replaces the older one, none of whose positions are kept
+    void create (uint64_t game_id, const std::string& player_w, const std::string& player_b, uint32_t block_num) {
+      if (find(game_id) != nullptr) {
+        std::cerr << "indexer: game " << game_id << " is already in the index; the new game with its id replaces it\n";
+        delete_positions->bind(1, game_id).step();
+      }
+      indexed_game& game = games[game_id];
+      game = indexed_game();
+      game.player_w = player_w;
+      game.player_b = player_b;
+      insert_game->bind(1, game_id).bind(2, player_w).bind(3, player_b).bind(4, std::string()).bind(5, std::string())
+        .bind(6, std::string()).bind(7, 0).bind(8, 0).bind(9, block_num).bind(10, block_num).step();
+      store_position(game_id, game.state, 0, 32, block_num);
+    }
+
+    //the game with this id, or nullptr if it isn't in the index
+    indexed_game* find (uint64_t game_id) {
+      auto itr = games.find(game_id);
+      if (itr != games.end()) {
+        return &itr->second;
+      }
+
+      statement game_query(db, "select player_w, player_b, winner, ended_by, diverged from games where game_id = ?");
+      game_query.bind(1, game_id);
+      if (!game_query.step()) {
+        return nullptr;
+      }
+      indexed_game game;
+      game.player_w = game_query.text(0);
+      game.player_b = game_query.text(1);
+      game.winner = game_query.text(2);
+      game.ended_by = game_query.text(3);
+      game.diverged = game_query.integer(4) != 0;
+      game_query.done();
+
+      statement position_query(db, "select ply, castle, en_passant_idx, promoted_pawns, promoted_pawn_types, piece_positions "
+        "from positions where game_id = ? order by ply desc limit 1");
+      position_query.bind(1, game_id);
+      if (position_query.step()) {
+        game.state.move_count = position_query.integer(0);
+        game.state.castle = position_query.integer(1);
+        game.state.en_passant_idx = position_query.integer(2);
+        game.state.promoted_pawns = position_query.integer(3);
+        game.state.promoted_pawn_types = position_query.integer(4);
+        game.state.piece_positions = position_query.blob(5);
+        rules::update_attacks(game.state);
+        position_query.done();
+      }
+      return &(games[game_id] = game);
+    }
+
+    //writes the game row after a ply or a result
+    void store (uint64_t game_id, const indexed_game& game, uint32_t block_num) {
+      std::string result;
+      if (game.winner == contract) {
+        result = "draw";
+      } else if (!game.winner.empty()) {
+        result = game.winner == game.player_w ? "white" : "black";
+      }
+      update_game->bind(1, game.winner).bind(2, result).bind(3, game.ended_by).bind(4, game.state.move_count)
+        .bind(5, game.diverged).bind(6, block_num).bind(7, game_id).step();
+    }
+
+    void store_position (uint64_t game_id, const rules::game_state& state, uint16_t move, uint8_t captured_piece, uint32_t block_num) {
+      insert_position->bind(1, game_id).bind(2, state.move_count).bind(3, move).bind(4, captured_piece).bind(5, pgn::fen(state))
+        .bind(6, state.castle).bind(7, state.en_passant_idx).bind(8, state.promoted_pawns).bind(9, state.promoted_pawn_types)
+        .bind(10, state.piece_positions).bind(11, block_num).step();
+    }
+
+  private:
+    sqlite3* db = nullptr;
+    std::string contract;
+    std::map<uint64_t, indexed_game> games;
+    std::unique_ptr<statement> insert_game;
+    std::unique_ptr<statement> update_game;
+    std::unique_ptr<statement> insert_position;
+    std::unique_ptr<statement> delete_positions;
+
+    void exec (const char* sql) {
+      char* error = nullptr;
+      if (sqlite3_exec(db, sql, nullptr, nullptr, &error) != SQLITE_OK) {
+        std::string message = std::string("sqlite: ") + (error ? error : "unknown error");
+        sqlite3_free(error);
+        throw std::runtime_error(message);
+      }
+    }
+};
+
+/* *
+ * indexer
+ *  applies the contract's action traces to the index, in account_action_seq order
+ * */
+class indexer {
+  public:
+    indexer (game_index& index, const std::string& contract, const std::string& scope, size_t checkpoint_every)
+      : index(index), contract(contract), scope(scope), checkpoint_every(checkpoint_every), seq(index.cursor()),
+        settled(seq) {}
+
+    int64_t cursor () const { return seq; }
+    uint64_t indexed () const { return actions; }
+    uint64_t plies () const { return ply_count; }
+
+    /* *
+     * apply
+     *  indexes one entry of a get_actions response (or a bare action trace, numbered by its position in a dump).
+     *  Entries at or before the cursor have already been indexed and are skipped.
+     * */
+    void apply (
+      const json::value& entry,
+      int64_t position
+    ) {
+      const json::value& trace = entry["action_trace"].is_null() ? entry : entry["action_trace"];
+      int64_t entry_seq = entry["account_action_seq"].is_null() ? position : entry["account_action_seq"].as_int64();
+      if (entry_seq <= seq) {
+        return;
+      }
+      seq = entry_seq;
+      ++actions;
+
+      const json::value& act = trace["act"];
+      const json::value& receiver = trace["receipt"]["receiver"];
+      const json::value& block = entry["block_num"].is_null() ? trace["block_num"] : entry["block_num"];
+      if (act["account"].as_string() == contract && (receiver.is_null() || receiver.as_string() == contract)) {
+        if (!act["data"].is_object()) {
+          throw std::runtime_error("action " + std::to_string(seq) + " has no decoded data; is the contract's abi set?");
+        }
+        if (act["name"].as_string() == "newgame") {
+          pending_w = act["data"]["player_w"].as_string();
+          pending_b = act["data"]["player_b"].as_string();
+          newgame_pending = true;
+        } else if (act["name"].as_string() == "gameevent") {
+          apply_event(act["data"], block.as_uint64());
+        }
+      }
+
+      //a newgame action and its event are indexed together, so a checkpoint never lands between them
+      if (!newgame_pending) {
+        settled = seq;
+      }
+      if (actions % checkpoint_every == 0) {
+        checkpoint();
+      }
+    }
+
+    void checkpoint () {
+      index.checkpoint(settled);
+    }
+
+  private:
+    game_index& index;
+    std::string contract;
+    std::string scope;
+    size_t checkpoint_every;
+    int64_t seq;
+    int64_t settled; //the last action that can be checkpointed
+    uint64_t actions = 0;
+    uint64_t ply_count = 0;
+    std::string pending_w;
+    std::string pending_b;
+    bool newgame_pending = false;
+
+    void apply_event (
+      const json::value& data,
+      uint32_t block_num
+    ) {
+      std::string event = data["event"].as_string();
+      uint64_t game_id = data["game_id"].as_uint64();
+      uint32_t ply = data["ply"].as_uint64();
+      std::string winner = data["winner"].as_string();
+
+      //games of other scopes have ids of their own, and belong in another database
+      if (data["scope"].as_string() != scope) {
+        if (event == "newgame") {
+          newgame_pending = false;
+        }
+        return;
+      }
+
+      if (event == "newgame") {
+        if (!newgame_pending) {
+          std::cerr << "indexer: game " << game_id << " was created by an action that isn't in the traces\n";
+        }
+        index.create(game_id, pending_w, pending_b, block_num);
+        newgame_pending = false;
+        return;
+      }
+
+      //'dropscope' only erases games that have ended, and their ids aren't handed out again, so the index keeps them
+      if (event == "dropgame") {
+        return;
+      }
+
+      indexed_game* game = index.find(game_id);
+      if (game == nullptr) {
+        std::cerr << "indexer: " << event << " for game " << game_id << ", which isn't in the index\n";
+        return;
+      }
+
+      if (event == "move") {
+        if (game->diverged || ply <= game->state.move_count) {
+          return;
+        }
+        uint16_t move = data["move"].as_uint64();
+        uint8_t captured_piece = data["captured_piece"].as_uint64();
+        uint8_t captured_piece_index = 32;
+        bool checkmate = false;
+        if (ply != game->state.move_count + 1 ||
+          !rules::play_move(game->state, rules::packed_piece_id(move), rules::packed_new_position(move), rules::packed_promotion_type(move), captured_piece_index, checkmate) ||
+          captured_piece_index != captured_piece) {
+          std::cerr << "indexer: game " << game_id << " ply " << ply << " doesn't replay; the rest of the game isn't indexed\n";
+          game->diverged = true;
+        } else {
+          index.store_position(game_id, game->state, move, captured_piece, block_num);
+          ++ply_count;
+          if (!winner.empty()) {
+            game->winner = winner;
+            game->ended_by = "checkmate";
+          }
+        }
+      } else if (!winner.empty()) {
+        //concede, claimmate, claimdraw, and the draw that accepts an offer
+        game->winner = winner;
+        game->ended_by = event;
+      } else {
+        return;
+      }
+      index.store(game_id, *game, block_num);
+    }
+};
+
+/* *
+ * dump_reader
+ *  reads the entries of a file dump one at a time: a get_actions response, a JSON array of actions, or one JSON action
+ *  per line.  Only the entry being read is held in memory, so a dump of any size streams through the indexer.  The
+ *  elements of a top level array, or of the "actions" array of a top level object, are entries; any other top level
+ *  object is an entry itself.
+ * */
+class dump_reader {
+  public:
+    explicit dump_reader (const std::string& filename) : in(filename, std::ios::binary) {
+      if (!in) {
+        throw std::runtime_error("unable to open " + filename);
+      }
+      buf = in.rdbuf();
+    }
+
+    //the next entry, or false at the end of the dump
+    bool next (
+      json::value& entry
+    ) {
+      while (true) {
+        int c = skip_separators();
+        if (c == EOF) {
+          if (in_array) {
+            throw std::runtime_error("dump ends inside an array");
+          }
+          return false;
+        }
+        if (in_array) {
+          if (c == ']') {
+            buf->sbumpc();
+            in_array = false;
+            //the rest of a get_actions response holds no actions
+            if (in_response) {
+              skip_object_rest();
+              in_response = false;
+            }
+            continue;
+          }
+          entry = json::parse(read_value());
+          return true;
+        }
+        if (c == '[') {
+          buf->sbumpc();
+          in_array = true;
+          continue;
+        }
+        if (c != '{') {
+          throw std::runtime_error(std::string("unexpected '") + (char)c + "' in dump");
+        }
+        if (read_object(entry)) {
+          return true;
+        }
+      }
+    }
+
+  private:
+    std::ifstream in;
+    std::streambuf* buf = nullptr;
+    bool in_array = false;
+    bool in_response = false; //in_array is the "actions" array of a get_actions response
+
+    int skip_separators () {
+      int c = buf->sgetc();
+      while (c == ' ' || c == '\t' || c == '\r' || c == '\n' || c == ',') {
+        c = buf->snextc();
+      }
+      return c;
+    }
+
+    //appends a string, from its opening quote, to text
+    void read_string (
+      std::string& text
+    ) {
+      text += (char)buf->sbumpc();
+      while (true) {
+        int c = buf->sbumpc();
+        if (c == EOF) {
+          throw std::runtime_error("dump ends inside a string");
+        }
+        text += (char)c;
+        if (c == '\\') {
+          int escaped = buf->sbumpc();
+          if (escaped == EOF) {
+            throw std::runtime_error("dump ends inside a string");
+          }
+          text += (char)escaped;
+        } else if (c == '"') {
+          return;
+        }
+      }
+    }
+
+    //the text of one value, an array element
+    std::string read_value () {
+      std::string text;
+      int depth = 0;
+      while (true) {
+        int c = buf->sgetc();
+        if (c == EOF) {
+          throw std::runtime_error("dump ends inside an entry");
+        }
+        if (depth == 0 && (c == ',' || c == ']') && !text.empty()) {
+          return text;
+        }
+        if (c == '"') {
+          read_string(text);
+        } else {
+          text += (char)buf->sbumpc();
+          if (c == '{' || c == '[') {
+            ++depth;
+          } else if ((c == '}' || c == ']') && --depth == 0) {
+            return text;
+          }
+        }
+      }
+    }
+
+    /* *
+     * read_object
+     *  reads a top level object into entry and returns true, unless it turns out to be a get_actions response - then it
+     *  stops at the start of its "actions" array, whose elements next() returns, and returns false
+     * */
+    bool read_object (
+      json::value& entry
+    ) {
+      std::string text;
+      std::string last_string;
+      int depth = 0;
+      while (true) {
+        int c = buf->sgetc();
+        if (c == EOF) {
+          throw std::runtime_error("dump ends inside an entry");
+        }
+        if (c == '"') {
+          size_t start = text.size();
+          read_string(text);
+          last_string = text.substr(start);
+          continue;
+        }
+        text += (char)buf->sbumpc();
+        if (c == '{' || c == '[') {
+          ++depth;
+        } else if ((c == '}' || c == ']') && --depth == 0) {
+          entry = json::parse(text);
+          return true;
+        } else if (c == ':' && depth == 1 && last_string == "\"actions\"") {
+          int value = buf->sgetc();
+          while (value == ' ' || value == '\t' || value == '\r' || value == '\n') {
+            value = buf->snextc();
+          }
+          if (value == '[') {
+            buf->sbumpc();
+            in_array = true;
+            in_response = true;
+            return false;
+          }
+        }
+      }
+    }
+
+    //skips what follows the "actions" array up to the end of its response object
+    void skip_object_rest () {
+      std::string text;
+      int depth = 1;
+      while (depth > 0) {
+        int c = buf->sgetc();
+        if (c == EOF) {
+          throw std::runtime_error("dump ends inside the get_actions response");
+        }
+        if (c == '"') {
+          text.clear();
+          read_string(text);
+          continue;
+        }
+        buf->sbumpc();
+        if (c == '{' || c == '[') {
+          ++depth;
+        } else if (c == '}' || c == ']') {
+          --depth;
+        }
+      }
+    }
+};
+
+static void usage () {
+  std::cerr <<
+    "usage: indexer [options] (--url URL | --file FILE)\n"
+    "  --url URL          nodeos endpoint with the history plugin\n"
+    "  --file FILE        action trace dump to index instead\n"
+    "  --db FILE          SQLite database (default chess.db)\n"
+    "  --contract NAME    chess contract account (default chess)\n"
+    "  --scope NAME       games table scope (default the contract account)\n"
+    "  --page N           actions per get_actions request (default 100)\n"
+    "  --checkpoint N     actions per committed checkpoint (default 1000)\n"
+    "  --follow           keep polling nodeos for new actions\n"
+    "  --poll MS          wait between polls with --follow (default 500)\n";
+  std::exit(1);
+}
+
+int main (int argc, char** argv) {
+  std::string node_url;
+  std::string dump_file;
+  std::string db_file = "chess.db";
+  std::string contract = "chess";
+  std::string scope;
+  size_t page = 100;
+  size_t checkpoint_every = 1000;
+  bool follow = false;
+  int poll_ms = 500;
+
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    auto next = [&]() -> std::string {
+      if (i + 1 >= argc) { usage(); }
+      return argv[++i];
+    };
+    if (arg == "--url") { node_url = next(); }
+    else if (arg == "--file") { dump_file = next(); }
+    else if (arg == "--db") { db_file = next(); }
+    else if (arg == "--contract") { contract = next(); }
+    else if (arg == "--scope") { scope = next(); }
+    else if (arg == "--page") { page = std::stoul(next()); }
+    else if (arg == "--checkpoint") { checkpoint_every = std::stoul(next()); }
+    else if (arg == "--follow") { follow = true; }
+    else if (arg == "--poll") { poll_ms = std::stoi(next()); }
+    else { usage(); }
+  }
+  if (scope.empty()) {
+    scope = contract;
+  }
+  if (node_url.empty() == dump_file.empty() || page == 0 || checkpoint_every == 0) {
+    usage();
+  }
+
+  std::signal(SIGINT, on_signal);
+  std::signal(SIGTERM, on_signal);
+
+  try {
+    game_index index(db_file, contract);
+    indexer idx(index, contract, scope, checkpoint_every);
+    int64_t start_cursor = idx.cursor();
+    auto start = std::chrono::steady_clock::now();
+
+    if (!dump_file.empty()) {
+      dump_reader dump(dump_file);
+      json::value entry;
+      for (int64_t i = 0; !stopping && dump.next(entry); ++i) {
+        idx.apply(entry, i);
+      }
+    } else {
+      http_client node(node_url);
+      while (!stopping) {
+        json::value request = json::value::object();
+        request.set("account_name", contract);
+        request.set("pos", idx.cursor() + 1);
+        request.set("offset", (int64_t)page - 1);
+        http_response response = node.post("/v1/history/get_actions", request.dump());
+        if (response.status != 200) {
+          throw std::runtime_error("get_actions failed: " + response.body);
+        }
+
+        json::value actions = json::parse(response.body)["actions"];
+        for (size_t i = 0; i < actions.size() && !stopping; ++i) {
+          idx.apply(actions.at(i), -1);
+        }
+        if (actions.size() < page) {
+          if (!follow) {
+            break;
+          }
+          idx.checkpoint();
+          std::this_thread::sleep_for(std::chrono::milliseconds(poll_ms));
+        }
+      }
+    }
+    idx.checkpoint();
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cerr << idx.indexed() << " actions, " << idx.plies() << " plies indexed in " << seconds << "s, from action "
+      << start_cursor + 1 << " to " << idx.cursor() << "\n";
+  } catch (const std::exception& e) {
+    std::cerr << "indexer: " << e.what() << "\n";
+    return 1;
+  }
+  return 0;
+}
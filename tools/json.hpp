@@ -0,0 +1,280 @@
+#pragma once
+
+#include <cctype>
+#include <cstdint>
+#include <cstdlib>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+/* *
+ * json.hpp
+ *  just enough JSON for talking to nodeos and keosd.  Numbers are kept as their original text, so 64 bit ids and
+ *  names survive a round trip without going through a double.
+ * */
+
+namespace json {
+
+struct value {
+  enum kind_t { null_kind, bool_kind, number_kind, string_kind, array_kind, object_kind };
+
+  kind_t kind = null_kind;
+  std::string text; //string contents, or the literal text of a number / bool
+  std::vector<value> items;
+  std::vector<std::pair<std::string, value>> members; //insertion order is kept so dumps match what was built
+
+  value () {}
+  value (const char* s) : kind(string_kind), text(s) {}
+  value (const std::string& s) : kind(string_kind), text(s) {}
+  value (bool b) : kind(bool_kind), text(b ? "true" : "false") {}
+  value (int n) : kind(number_kind), text(std::to_string(n)) {}
+  value (int64_t n) : kind(number_kind), text(std::to_string(n)) {}
+  value (uint64_t n) : kind(number_kind), text(std::to_string(n)) {}
+  value (uint32_t n) : kind(number_kind), text(std::to_string(n)) {}
+
+  static value array () { value v; v.kind = array_kind; return v; }
+  static value object () { value v; v.kind = object_kind; return v; }
+
+  bool is_null () const { return kind == null_kind; }
+  bool is_object () const { return kind == object_kind; }
+  bool is_array () const { return kind == array_kind; }
+
+  //object member lookup; returns a null value for missing members
+  const value& operator[] (const std::string& key) const {
+    static const value null_value;
+    for (auto& m : members) {
+      if (m.first == key) {
+        return m.second;
+      }
+    }
+    return null_value;
+  }
+
+  //object member insert-or-replace
+  value& set (const std::string& key, value v) {
+    kind = object_kind;
+    for (auto& m : members) {
+      if (m.first == key) {
+        m.second = std::move(v);
+        return m.second;
+      }
+    }
+    members.emplace_back(key, std::move(v));
+    return members.back().second;
+  }
+
+  value& push (value v) {
+    kind = array_kind;
+    items.push_back(std::move(v));
+    return items.back();
+  }
+
+  const value& at (size_t index) const { return items.at(index); }
+  size_t size () const { return kind == object_kind ? members.size() : items.size(); }
+
+  const std::string& as_string () const { return text; }
+  bool as_bool () const { return text == "true"; }
+  int64_t as_int64 () const { return std::strtoll(text.c_str(), nullptr, 10); }
+  uint64_t as_uint64 () const { return std::strtoull(text.c_str(), nullptr, 10); }
+  double as_double () const { return std::strtod(text.c_str(), nullptr); }
+
+  std::string dump () const {
+    std::string out;
+    dump_to(out);
+    return out;
+  }
+
+  void dump_to (std::string& out) const {
+    switch (kind) {
+      case null_kind : out += "null"; break;
+      case bool_kind :
+      case number_kind : out += text; break;
+      case string_kind : quote(text, out); break;
+      case array_kind :
+        out += '[';
+        for (size_t i = 0; i < items.size(); ++i) {
+          if (i > 0) { out += ','; }
+          items[i].dump_to(out);
+        }
+        out += ']';
+        break;
+      case object_kind :
+        out += '{';
+        for (size_t i = 0; i < members.size(); ++i) {
+          if (i > 0) { out += ','; }
+          quote(members[i].first, out);
+          out += ':';
+          members[i].second.dump_to(out);
+        }
+        out += '}';
+        break;
+    }
+  }
+
+  static void quote (const std::string& s, std::string& out) {
+    static const char* hex = "0123456789abcdef";
+    out += '"';
+    for (unsigned char c : s) {
+      switch (c) {
+        case '"' : out += "\\\""; break;
+        case '\\' : out += "\\\\"; break;
+        case '\n' : out += "\\n"; break;
+        case '\r' : out += "\\r"; break;
+        case '\t' : out += "\\t"; break;
+        default :
+          if (c < 0x20) {
+            out += "\\u00";
+            out += hex[c >> 4];
+            out += hex[c & 0x0F];
+          } else {
+            out += c;
+          }
+      }
+    }
+    out += '"';
+  }
+};
+
+class parser {
+  public:
+    parser (const std::string& text) : s(text) {}
+
+    value parse () {
+      value v = parse_value();
+      skip_ws();
+      if (pos != s.size()) {
+        fail("trailing characters");
+      }
+      return v;
+    }
+
+  private:
+    const std::string& s;
+    size_t pos = 0;
+
+    [[noreturn]] void fail (const char* what) {
+      throw std::runtime_error(std::string("json: ") + what + " at offset " + std::to_string(pos));
+    }
+
+    void skip_ws () {
+      while (pos < s.size() && (s[pos] == ' ' || s[pos] == '\n' || s[pos] == '\r' || s[pos] == '\t')) {
+        ++pos;
+      }
+    }
+
+    bool consume (const char* literal) {
+      size_t len = std::char_traits<char>::length(literal);
+      if (s.compare(pos, len, literal) == 0) {
+        pos += len;
+        return true;
+      }
+      return false;
+    }
+
+    value parse_value () {
+      skip_ws();
+      if (pos >= s.size()) {
+        fail("unexpected end of input");
+      }
+
+      char c = s[pos];
+      if (c == '{') {
+        ++pos;
+        value v = value::object();
+        skip_ws();
+        if (pos < s.size() && s[pos] == '}') { ++pos; return v; }
+        while (true) {
+          skip_ws();
+          if (pos >= s.size() || s[pos] != '"') { fail("expected member name"); }
+          std::string key = parse_string();
+          skip_ws();
+          if (pos >= s.size() || s[pos] != ':') { fail("expected ':'"); }
+          ++pos;
+          v.members.emplace_back(std::move(key), parse_value());
+          skip_ws();
+          if (pos < s.size() && s[pos] == ',') { ++pos; continue; }
+          if (pos < s.size() && s[pos] == '}') { ++pos; return v; }
+          fail("expected ',' or '}'");
+        }
+      } else if (c == '[') {
+        ++pos;
+        value v = value::array();
+        skip_ws();
+        if (pos < s.size() && s[pos] == ']') { ++pos; return v; }
+        while (true) {
+          v.items.push_back(parse_value());
+          skip_ws();
+          if (pos < s.size() && s[pos] == ',') { ++pos; continue; }
+          if (pos < s.size() && s[pos] == ']') { ++pos; return v; }
+          fail("expected ',' or ']'");
+        }
+      } else if (c == '"') {
+        return value(parse_string());
+      } else if (consume("true")) {
+        return value(true);
+      } else if (consume("false")) {
+        return value(false);
+      } else if (consume("null")) {
+        return value();
+      } else if (c == '-' || (c >= '0' && c <= '9')) {
+        size_t start = pos;
+        ++pos;
+        while (pos < s.size() && (isdigit((unsigned char)s[pos]) || s[pos] == '.' || s[pos] == 'e' || s[pos] == 'E' || s[pos] == '+' || s[pos] == '-')) {
+          ++pos;
+        }
+        value v;
+        v.kind = value::number_kind;
+        v.text = s.substr(start, pos - start);
+        return v;
+      }
+      fail("unexpected character");
+    }
+
+    std::string parse_string () {
+      std::string out;
+      ++pos; //opening quote
+      while (pos < s.size() && s[pos] != '"') {
+        char c = s[pos++];
+        if (c != '\\') {
+          out += c;
+          continue;
+        }
+        if (pos >= s.size()) { fail("unterminated escape"); }
+        char e = s[pos++];
+        switch (e) {
+          case 'n' : out += '\n'; break;
+          case 'r' : out += '\r'; break;
+          case 't' : out += '\t'; break;
+          case 'b' : out += '\b'; break;
+          case 'f' : out += '\f'; break;
+          case 'u' : {
+            if (pos + 4 > s.size()) { fail("short unicode escape"); }
+            unsigned code = std::stoul(s.substr(pos, 4), nullptr, 16);
+            pos += 4;
+            //nodeos only escapes control characters, so a basic utf-8 encoding of the BMP is enough here
+            if (code < 0x80) {
+              out += (char)code;
+            } else if (code < 0x800) {
+              out += (char)(0xC0 | (code >> 6));
+              out += (char)(0x80 | (code & 0x3F));
+            } else {
+              out += (char)(0xE0 | (code >> 12));
+              out += (char)(0x80 | ((code >> 6) & 0x3F));
+              out += (char)(0x80 | (code & 0x3F));
+            }
+            break;
+          }
+          default : out += e;
+        }
+      }
+      if (pos >= s.size()) { fail("unterminated string"); }
+      ++pos; //closing quote
+      return out;
+    }
+};
+
+inline value parse (const std::string& text) {
+  return parser(text).parse();
+}
+
+} // namespace json
@@ -0,0 +1,376 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "../chess_rules.hpp"
+#include "async_http.hpp"
+#include "transaction.hpp"
+
+/* *
+ * loadgen
+ *  measures how many concurrent games one contract account can sustain.
+ *
+ *  Creates --games games with 'newgame', then plays random legal games in all of them at once.  Legal moves come from
+ *  the contract's own rules (chess_rules.hpp), so every move should be accepted.  Each action is its own transaction,
+ *  signed by keosd and pushed to nodeos through pools of non-blocking keep-alive connections driven by one poll loop.
+ *
+ *  Games end by checkmate, by a player conceding (--concede-rate per ply), by both players agreeing a draw (--draw-rate
+ *  per ply, or when --max-plies is reached), or by a 'claimmate' or 'claimdraw' when no legal move is left (the only way
+ *  a game ends in mate against a contract built with CHESS_LAZY_MATE).
+ *
+ *  Reports throughput, and per-action latency percentiles and billed cpu broken down by action and game phase.
+ *  'rejected' actions were pushed but refused by the contract (it printed an error), 'failed' ones never made it into
+ *  a block - cpu limits, deadlines and so on.
+ * */
+
+#define PHASE_OPENING    0
+#define PHASE_MIDDLEGAME 1
+#define PHASE_ENDGAME    2
+
+static const char* phase_names[] = { "opening", "middlegame", "endgame" };
+
+/* *
+ * game_phase
+ *  opening for the first 20 plies, endgame once 6 or fewer pieces other than kings and pawns are left (promoted pawns
+ *  count as the piece they became), middlegame otherwise
+ * */
+static int game_phase (
+  const rules::game_state& state
+) {
+  if (state.move_count < 20) {
+    return PHASE_OPENING;
+  }
+  int pieces = 0;
+  for (uint8_t piece_id = 0; piece_id < 32; ++piece_id) {
+    uint8_t type = rules::piece_type(piece_id, state.promoted_pawns, state.promoted_pawn_types);
+    if (state.piece_positions[piece_id] != 0 && type != PIECE_KING && type != PIECE_PAWN) {
+      ++pieces;
+    }
+  }
+  return pieces <= 6 ? PHASE_ENDGAME : PHASE_MIDDLEGAME;
+}
+
+struct action_stats {
+  std::vector<double> latencies_ms;
+  uint64_t cpu_us = 0;
+  uint64_t accepted = 0;
+  uint64_t rejected = 0;
+  uint64_t failed = 0;
+};
+
+struct game_run {
+  uint64_t game_id;
+  rules::game_state state;
+  bool busy = false;
+  bool done = false;
+  bool draw_offered = false;
+};
+
+static void usage () {
+  std::cerr <<
+    "usage: loadgen [options]\n"
+    "  --games N          games to create and play at once (default 50)\n"
+    "  --max-plies N      plies before the players agree a draw (default 120)\n"
+    "  --draw-rate R      chance per ply of offering a draw (default 0.002)\n"
+    "  --concede-rate R   chance per ply of conceding (default 0.002)\n"
+    "  --connections N    connections to nodeos, and to keosd (default 16)\n"
+    "  --seed N           random seed (default 1)\n"
+    "  --url URL          nodeos endpoint (default http://127.0.0.1:8888)\n"
+    "  --wallet-url URL   keosd endpoint (default unix://~/eosio-wallet/keosd.sock)\n"
+    "  --contract NAME    chess contract account (default chess)\n"
+    "  --scope NAME       games table scope (default the contract account)\n"
+    "  --white NAME       white player (default alice)\n"
+    "  --black NAME       black player (default bob)\n";
+  std::exit(1);
+}
+
+int main (int argc, char** argv) {
+  std::string node_url = "http://127.0.0.1:8888";
+  std::string wallet_url = "unix://~/eosio-wallet/keosd.sock";
+  std::string contract = "chess";
+  std::string scope;
+  std::string player_w = "alice";
+  std::string player_b = "bob";
+  size_t game_count = 50;
+  uint32_t max_plies = 120;
+  double draw_rate = 0.002;
+  double concede_rate = 0.002;
+  size_t connections = 16;
+  uint64_t seed = 1;
+
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    auto next = [&]() -> std::string {
+      if (i + 1 >= argc) { usage(); }
+      return argv[++i];
+    };
+    if (arg == "--games") { game_count = std::stoul(next()); }
+    else if (arg == "--max-plies") { max_plies = std::stoul(next()); }
+    else if (arg == "--draw-rate") { draw_rate = std::stod(next()); }
+    else if (arg == "--concede-rate") { concede_rate = std::stod(next()); }
+    else if (arg == "--connections") { connections = std::stoul(next()); }
+    else if (arg == "--seed") { seed = std::stoull(next()); }
+    else if (arg == "--url") { node_url = next(); }
+    else if (arg == "--wallet-url") { wallet_url = next(); }
+    else if (arg == "--contract") { contract = next(); }
+    else if (arg == "--scope") { scope = next(); }
+    else if (arg == "--white") { player_w = next(); }
+    else if (arg == "--black") { player_b = next(); }
+    else { usage(); }
+  }
+  if (scope.empty()) {
+    scope = contract;
+  }
+  if (game_count == 0 || connections == 0) {
+    usage();
+  }
+
+  std::mt19937_64 rng(seed);
+  std::uniform_real_distribution<double> chance(0.0, 1.0);
+  std::vector<game_run> games(game_count);
+  std::map<std::string, json::value> keys; //signing keys for each actor, looked up once
+  json::value info;
+
+  //set up the games with blocking calls; only the games themselves are timed
+  try {
+    eos::chain_session session(node_url, wallet_url);
+
+    //new games get the next free primary key, so find the current last one
+    json::value request = json::value::object();
+    request.set("code", contract);
+    request.set("scope", scope);
+    request.set("table", "games");
+    request.set("json", true);
+    request.set("limit", 1);
+    request.set("reverse", true);
+    json::value rows = session.call_node("/v1/chain/get_table_rows", request.dump())["rows"];
+    uint64_t first_game_id = rows.size() > 0 ? rows.at(0)["game_id"].as_uint64() + 1 : 0;
+
+    for (size_t offset = 0; offset < game_count; offset += 32) {
+      eos::transaction trx;
+      for (size_t i = offset; i < std::min(game_count, offset + 32); ++i) {
+        trx.actions.push_back(eos::newgame_action(contract, scope, player_w, player_b));
+      }
+      trx.context_free_actions.push_back(eos::nonce_action(rng()));
+      session.prepare(trx);
+      session.push(trx, session.sign(trx));
+    }
+    for (size_t i = 0; i < game_count; ++i) {
+      games[i].game_id = first_game_id + i;
+    }
+
+    for (auto& actor : { player_w, player_b }) {
+      eos::transaction trx;
+      trx.actions.push_back(eos::draw_action(contract, actor, scope, first_game_id));
+      session.prepare(trx);
+      keys[actor] = session.required_keys(trx);
+    }
+    info = session.call_node("/v1/chain/get_info", "{}");
+  } catch (const std::exception& e) {
+    std::cerr << "loadgen: setup failed - " << e.what() << "\n";
+    return 1;
+  }
+
+  async_http node(node_url, connections);
+  async_http wallet(wallet_url, connections);
+  std::map<std::pair<std::string, int>, action_stats> stats;
+  std::map<std::string, uint64_t> failure_reasons;
+  size_t games_left = game_count;
+
+  /* *
+   * submit
+   *  signs and pushes one action, recording its latency from push to response under its action name and the phase of
+   *  the game when it was sent.  on_accepted runs if the contract accepted the action.
+   * */
+  auto submit = [&](game_run& game, eos::action act, std::function<void()> on_accepted) {
+    auto trx = std::make_shared<eos::transaction>();
+    trx->context_free_actions.push_back(eos::nonce_action(rng()));
+    trx->actions.push_back(act);
+    trx->set_tapos(info);
+    action_stats* bucket = &stats[{ act.name, game_phase(game.state) }];
+    game_run* g = &game;
+    g->busy = true;
+
+    //a game stops at its first failed or rejected action, since its state may no longer match the chain
+    auto finish = [g, &games_left](bool ok) {
+      g->busy = false;
+      if (!ok && !g->done) {
+        g->done = true;
+        --games_left;
+      }
+    };
+
+    wallet.post("/v1/wallet/sign_transaction", trx->sign_request(keys[act.authorization[0].actor], info["chain_id"].as_string()),
+      [&, trx, bucket, finish, on_accepted](const http_response& signed_response, const std::string& sign_error) {
+        if (!sign_error.empty() || (signed_response.status != 200 && signed_response.status != 201)) {
+          ++failure_reasons["sign: " + (sign_error.empty() ? eos::error_message(signed_response.body) : sign_error)];
+          ++bucket->failed;
+          finish(false);
+          return;
+        }
+        json::value signatures = json::parse(signed_response.body)["signatures"];
+        auto sent = std::chrono::steady_clock::now();
+
+        node.post("/v1/chain/push_transaction", trx->push_request(signatures),
+          [&, trx, bucket, sent, finish, on_accepted](const http_response& response, const std::string& error) {
+            bucket->latencies_ms.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - sent).count());
+            if (!error.empty() || response.status < 200 || response.status > 299) {
+              std::string reason = error;
+              if (reason.empty()) {
+                json::value err = json::parse(response.body)["error"];
+                reason = err["name"].is_null() ? eos::error_message(response.body) : err["name"].as_string();
+              }
+              ++failure_reasons[reason];
+              ++bucket->failed;
+              finish(false);
+              return;
+            }
+
+            //the contract reports rule violations by printing, not by failing the transaction
+            json::value result = json::parse(response.body);
+            bucket->cpu_us += result["processed"]["receipt"]["cpu_usage_us"].as_uint64();
+            const json::value& traces = result["processed"]["action_traces"];
+            std::string console;
+            for (size_t i = 0; i < traces.size(); ++i) {
+              if (traces.at(i)["act"]["account"].as_string() == contract) {
+                console += traces.at(i)["console"].as_string();
+              }
+            }
+            if (!console.empty()) {
+              ++failure_reasons["contract: " + console];
+              ++bucket->rejected;
+              finish(false);
+              return;
+            }
+            ++bucket->accepted;
+            on_accepted();
+            finish(true);
+          });
+      });
+  };
+
+  /* *
+   * step
+   *  picks and submits the next action for a game that has nothing in flight
+   * */
+  auto step = [&](game_run& game) {
+    bool whites_turn = game.state.move_count % 2 == 0;
+    const std::string& to_move = whites_turn ? player_w : player_b;
+    const std::string& waiting = whites_turn ? player_b : player_w;
+
+    if (game.draw_offered) {
+      //the other player accepts, which ends the game
+      submit(game, eos::draw_action(contract, waiting, scope, game.game_id), [&game, &games_left]() {
+        game.done = true;
+        --games_left;
+      });
+      return;
+    }
+
+    double roll = chance(rng);
+    std::vector<uint16_t> moves;
+    if (game.state.move_count < max_plies && roll >= concede_rate + draw_rate) {
+      moves = rules::legal_moves(game.state);
+    }
+
+    if (game.state.move_count >= max_plies || (roll >= concede_rate && roll < concede_rate + draw_rate)) {
+      submit(game, eos::draw_action(contract, to_move, scope, game.game_id), [&game]() {
+        game.draw_offered = true;
+      });
+    } else if (roll < concede_rate) {
+      submit(game, eos::concede_action(contract, to_move, scope, game.game_id), [&game, &games_left]() {
+        game.done = true;
+        --games_left;
+      });
+    } else if (moves.empty()) {
+      eos::action claim = game.state.attacks.checkers != 0 ?
+        eos::claimmate_action(contract, waiting, scope, game.game_id) : eos::claimdraw_action(contract, to_move, scope, game.game_id);
+      submit(game, claim, [&game, &games_left]() {
+        game.done = true;
+        --games_left;
+      });
+    } else {
+      uint16_t move = moves[rng() % moves.size()];
+      submit(game, eos::move_action(contract, to_move, scope, game.game_id, rules::packed_piece_id(move), rules::packed_new_position(move), rules::packed_promotion_type(move)),
+        [&game, &games_left, move]() {
+          uint8_t captured_piece_index = 32;
+          bool checkmate = false;
+          rules::play_move(game.state, rules::packed_piece_id(move), rules::packed_new_position(move), rules::packed_promotion_type(move), captured_piece_index, checkmate);
+          if (checkmate) {
+            game.done = true;
+            --games_left;
+          }
+        });
+    }
+  };
+
+  auto start = std::chrono::steady_clock::now();
+  auto last_info = start;
+  bool info_pending = false;
+
+  while (games_left > 0 || node.pending() > 0 || wallet.pending() > 0) {
+    for (auto& game : games) {
+      if (!game.busy && !game.done) {
+        step(game);
+      }
+    }
+
+    //keep TaPoS fresh so long runs don't expire their transactions
+    auto now = std::chrono::steady_clock::now();
+    if (!info_pending && now - last_info > std::chrono::milliseconds(500)) {
+      info_pending = true;
+      node.post("/v1/chain/get_info", "{}", [&](const http_response& response, const std::string& error) {
+        info_pending = false;
+        last_info = std::chrono::steady_clock::now();
+        if (error.empty() && response.status == 200) {
+          info = json::parse(response.body);
+        }
+      });
+    }
+
+    std::vector<pollfd> fds;
+    node.add_poll_fds(fds);
+    wallet.add_poll_fds(fds);
+    poll(fds.data(), fds.size(), 10);
+    node.handle_poll(fds);
+    wallet.handle_poll(fds);
+  }
+
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  //report
+  uint64_t total = 0;
+  for (auto& entry : stats) {
+    total += entry.second.latencies_ms.size();
+  }
+  printf("%zu games, %llu actions in %.2fs - %.1f actions/s, %d nodeos and %d keosd connections\n\n",
+    game_count, (unsigned long long)total, seconds, total / seconds, node.connections(), wallet.connections());
+  printf("%-8s %-11s %8s %8s %8s %8s %9s %9s %9s %9s %10s\n",
+    "action", "phase", "count", "accepted", "rejected", "failed", "p50 ms", "p90 ms", "p99 ms", "max ms", "avg cpu us");
+
+  for (auto& entry : stats) {
+    action_stats& s = entry.second;
+    std::vector<double>& l = s.latencies_ms;
+    std::sort(l.begin(), l.end());
+    auto percentile = [&](double p) { return l.empty() ? 0.0 : l[std::min(l.size() - 1, (size_t)(p * l.size()))]; };
+    printf("%-8s %-11s %8zu %8llu %8llu %8llu %9.2f %9.2f %9.2f %9.2f %10.1f\n",
+      entry.first.first.c_str(), phase_names[entry.first.second], l.size(),
+      (unsigned long long)s.accepted, (unsigned long long)s.rejected, (unsigned long long)s.failed,
+      percentile(0.5), percentile(0.9), percentile(0.99), l.empty() ? 0.0 : l.back(),
+      s.accepted + s.rejected > 0 ? (double)s.cpu_us / (s.accepted + s.rejected) : 0.0);
+  }
+
+  if (!failure_reasons.empty()) {
+    printf("\nfailures\n");
+    for (auto& reason : failure_reasons) {
+      printf("%8llu  %s\n", (unsigned long long)reason.second, reason.first.c_str());
+    }
+  }
+  return 0;
+}
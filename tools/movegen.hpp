@@ -0,0 +1,457 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "../chess_rules.hpp"
+
+/* *
+ * movegen.hpp
+ *  a move generator for the contract's rules that shares no code with valid_move, for generating games quickly and as
+ *  a reference to check valid_move against.
+ *
+ *  rules::legal_moves tries every piece against every square through valid_move.  This generator works the other way
+ *  round, the way chess engines do: each square holds the set of pieces standing on it, moves are walked out from each
+ *  piece along its rays and steps, and a move is kept if no enemy piece attacks the king afterwards - looked for by
+ *  walking out from the king.
+ *
+ *  It follows the contract's rules as they are, not as chess has them -
+ *   - a pawn moves one or two squares forward from any rank, onto an empty square with the square in front empty too
+ *   - a pawn moves one square diagonally forward whether or not it captures, and its diagonals don't stop at the edge
+ *     of the board: they are plain differences of 7 and 9 in position, so a pawn on the h file can step to the a file
+ *   - there is no en passant capture; the diagonal step onto the skipped square is just an empty square move
+ *   - kings attack nothing, so a king may stand next to the other king, and be taken by it
+ *   - castling needs the king and its rook unmoved, the squares between the king and its target and between the rook
+ *     and the target empty, no check, and the square the king crosses unattacked - the target itself may be occupied,
+ *     and whatever stands on it stays.  A captured rook doesn't stop castling: its position 0 works out to lie on the
+ *     first rank just past h1, so for white h1 must be empty as well (and the queen side path runs through the king),
+ *     and for black nothing more is needed
+ *   - when several pieces share a square, a pawn taking diagonally takes the lowest numbered enemy piece there (and a
+ *     black pawn may take onto a square that also holds its own piece), while other pieces take the highest numbered one
+ *   - a pawn reaching the last rank has one move per promotion type; a promoted pawn moves as its type, with one move
+ * */
+
+namespace movegen {
+
+#define MOVE_QUIET      0
+#define MOVE_CAPTURE    1
+#define MOVE_PROMOTION  2
+#define MOVE_CASTLE     4
+#define MOVE_DOUBLE     8 //pawn two squares forward
+
+//directions as (files, ranks) steps: 0-3 along ranks and files, 4-7 diagonally, 8-15 knight jumps
+#define DIR_ORTHOGONAL 0
+#define DIR_DIAGONAL   4
+#define DIR_KNIGHT     8
+
+inline constexpr int steps[16][2] = {
+  {1, 0}, {-1, 0}, {0, 1}, {0, -1}, {1, 1}, {1, -1}, {-1, 1}, {-1, -1},
+  {1, 2}, {2, 1}, {2, -1}, {1, -2}, {-1, -2}, {-2, -1}, {-2, 1}, {-1, 2},
+};
+
+//file 0 is the h file and rank 0 the first rank, matching the contract's numbering (h1 = 1, a1 = 8, a8 = 64)
+constexpr int file_of (int position) { return (position - 1) % 8; }
+constexpr int rank_of (int position) { return (position - 1) / 8; }
+
+/* *
+ * neighbour_table
+ *  the position one step in each direction from every position, or 0 off the board, worked out at compile time
+ * */
+struct neighbour_table {
+  uint8_t next[16][65] = {};
+};
+
+constexpr neighbour_table build_neighbours () {
+  neighbour_table table;
+  for (int dir = 0; dir < 16; ++dir) {
+    for (int position = 1; position < 65; ++position) {
+      int file = file_of(position) + steps[dir][0];
+      int rank = rank_of(position) + steps[dir][1];
+      table.next[dir][position] = (file < 0 || file > 7 || rank < 0 || rank > 7) ? 0 : rank * 8 + file + 1;
+    }
+  }
+  return table;
+}
+
+inline constexpr neighbour_table neighbours = build_neighbours();
+
+inline int offset (int position, int dir) { return neighbours.next[dir][position]; }
+
+inline int lowest (uint32_t pieces) { return __builtin_ctz(pieces); }
+inline int highest (uint32_t pieces) { return 31 - __builtin_clz(pieces); }
+
+/* *
+ * board
+ *  the pieces on each square as a set of piece ids, and the pieces of each type
+ * */
+struct board {
+  uint32_t squares[65] = {}; //bit n set when piece n stands there; square 0 is unused
+  uint32_t kings = 0, queens = 0, bishops = 0, knights = 0, rooks = 0, pawns = 0;
+
+  explicit board (const rules::game_state& state) {
+    for (int piece = 0; piece < 32; ++piece) {
+      uint8_t position = state.piece_positions[piece];
+      if (position == 0 || position > 64) {
+        continue;
+      }
+      uint32_t bit = (uint32_t)1 << piece;
+      squares[position] |= bit;
+      switch (piece % 16) {
+        case 0 : kings |= bit; break;
+        case 1 : queens |= bit; break;
+        case 2 : case 3 : bishops |= bit; break;
+        case 4 : case 5 : knights |= bit; break;
+        case 6 : case 7 : rooks |= bit; break;
+        default : {
+          //white pawns 8-15 have promotion bits 0-7, black pawns 24-31 bits 8-15
+          int bit_index = piece < 16 ? piece - 8 : piece - 16;
+          if ((state.promoted_pawns >> bit_index) & 1) {
+            switch ((state.promoted_pawn_types >> (2 * bit_index)) & 3) {
+              case PROMOTED_BISHOP : bishops |= bit; break;
+              case PROMOTED_KNIGHT : knights |= bit; break;
+              case PROMOTED_ROOK : rooks |= bit; break;
+              default : queens |= bit; break;
+            }
+          } else {
+            pawns |= bit;
+          }
+        }
+      }
+    }
+  }
+
+  /* *
+   * attacked
+   *  returns true if a piece in attackers attacks position, looking out from it along every line an attacker could
+   *  use.  A square only blocks a line if it holds a piece.
+   * */
+  bool attacked (int position, uint32_t attackers, bool by_white) const {
+    if (position == 0) {
+      return false;
+    }
+    for (int dir = DIR_KNIGHT; dir < DIR_KNIGHT + 8; ++dir) {
+      int from = offset(position, dir);
+      if (from != 0 && (squares[from] & attackers & knights)) {
+        return true;
+      }
+    }
+    //white pawns attack 7 and 9 up, black pawns 7 and 9 down, across the edge of the board
+    for (int diff : {7, 9}) {
+      int from = by_white ? position - diff : position + diff;
+      if (from > 0 && from < 65 && (squares[from] & attackers & pawns)) {
+        return true;
+      }
+    }
+    for (int dir = DIR_ORTHOGONAL; dir < DIR_DIAGONAL + 4; ++dir) {
+      uint32_t sliders = attackers & (queens | (dir < DIR_DIAGONAL ? rooks : bishops));
+      for (int from = offset(position, dir); from != 0; from = offset(from, dir)) {
+        if (squares[from] != 0) {
+          if (squares[from] & sliders) {
+            return true;
+          }
+          break;
+        }
+      }
+    }
+    return false;
+  }
+
+  /* *
+   * attacks
+   *  the squares the pieces in attackers attack, one bit per position (bit position - 1), like rules::attacks_of
+   * */
+  uint64_t attacks (uint32_t attackers, bool by_white, const uint8_t* positions) const {
+    uint64_t squares_attacked = 0;
+    auto mark = [&](int position) { squares_attacked |= (uint64_t)1 << (position - 1); };
+    for (uint32_t pieces = attackers & ~kings; pieces != 0; pieces &= pieces - 1) {
+      int piece = lowest(pieces);
+      int from = positions[piece];
+      if (from == 0 || from > 64) {
+        continue;
+      }
+      uint32_t bit = (uint32_t)1 << piece;
+      if (pawns & bit) {
+        for (int diff : {7, 9}) {
+          int to = by_white ? from + diff : from - diff;
+          if (to > 0 && to < 65) {
+            mark(to);
+          }
+        }
+      } else if (knights & bit) {
+        for (int dir = DIR_KNIGHT; dir < DIR_KNIGHT + 8; ++dir) {
+          int to = offset(from, dir);
+          if (to != 0) {
+            mark(to);
+          }
+        }
+      }
+      for (int dir = DIR_ORTHOGONAL; dir < DIR_DIAGONAL + 4; ++dir) {
+        if (!((queens | (dir < DIR_DIAGONAL ? rooks : bishops)) & bit)) {
+          continue;
+        }
+        for (int to = offset(from, dir); to != 0; to = offset(to, dir)) {
+          mark(to);
+          if (squares[to] != 0) {
+            break;
+          }
+        }
+      }
+    }
+    return squares_attacked;
+  }
+};
+
+/* *
+ * generator
+ *  lists the moves of the side to move in one position
+ * */
+class generator {
+  public:
+    generator (const rules::game_state& state, std::vector<uint16_t>& moves, std::vector<uint8_t>* kinds) :
+      state(state), b(state), moves(moves), kinds(kinds) {
+      white = state.move_count % 2 == 0;
+      own = white ? 0x0000FFFF : 0xFFFF0000;
+      enemy = ~own;
+      king = white ? 0 : 16;
+      king_safety();
+    }
+
+    void run () {
+      for (int piece = white ? 0 : 16; piece < (white ? 16 : 32); ++piece) {
+        int from = state.piece_positions[piece];
+        if (from == 0 || from > 64) {
+          continue;
+        }
+        uint32_t bit = (uint32_t)1 << piece;
+        if (b.pawns & bit) {
+          pawn_moves(piece, from);
+          continue;
+        }
+        if (b.kings & bit) {
+          step_moves(piece, from, DIR_ORTHOGONAL);
+          castling(piece);
+        }
+        if (b.knights & bit) {
+          step_moves(piece, from, DIR_KNIGHT);
+        }
+        if (b.rooks & bit || b.queens & bit) {
+          slide_moves(piece, from, DIR_ORTHOGONAL);
+        }
+        if (b.bishops & bit || b.queens & bit) {
+          slide_moves(piece, from, DIR_DIAGONAL);
+        }
+      }
+    }
+
+  private:
+    const rules::game_state& state;
+    board b;
+    std::vector<uint16_t>& moves;
+    std::vector<uint8_t>* kinds;
+    bool white;
+    uint32_t own, enemy;
+    int king;
+    bool in_check = false;
+    uint64_t enemy_attacks = 0; //with our king off the board, for king moves and castling
+    uint64_t pinned = 0; //bit position - 1 set for squares whose piece may be all that stands between the king and an enemy slider
+
+    //makes the move on the board, keeps it if our king isn't attacked afterwards, and takes it back
+    void add (int piece, int from, int to, int taken, uint8_t kind, bool promotes) {
+      //out of check, only the king itself, or a piece on a line between the king and an enemy slider, can leave the
+      //king attacked - knight and pawn attacks don't depend on what is in the way, and a capture only removes attackers
+      if (piece == king) {
+        if ((enemy_attacks >> (to - 1)) & 1) {
+          return;
+        }
+      } else if (in_check || (pinned >> (from - 1)) & 1) {
+        uint32_t bit = (uint32_t)1 << piece;
+        uint32_t taken_bit = taken < 32 ? (uint32_t)1 << taken : 0;
+        b.squares[from] &= ~bit;
+        b.squares[to] = (b.squares[to] & ~taken_bit) | bit;
+        int king_position = piece == king ? to : state.piece_positions[king];
+        bool legal = !b.attacked(king_position, enemy, !white);
+        b.squares[to] = (b.squares[to] & ~bit) | taken_bit;
+        b.squares[from] |= bit;
+        if (!legal) {
+          return;
+        }
+      }
+
+      if (taken < 32) {
+        kind |= MOVE_CAPTURE;
+      }
+      for (int promotion_type = 0; promotion_type < (promotes ? 4 : 1); ++promotion_type) {
+        moves.push_back(rules::pack_move(piece, to, promotion_type));
+        if (kinds != nullptr) {
+          kinds->push_back(promotes ? kind | MOVE_PROMOTION : kind);
+        }
+      }
+    }
+
+    //works out the enemy's attacks and whether we are in check, and marks the first occupied square on each line out
+    //from the king when the next occupied square along it holds an enemy slider that moves along that line
+    void king_safety () {
+      int king_position = state.piece_positions[king];
+      if (king_position == 0 || king_position > 64) {
+        return;
+      }
+      uint32_t king_bit = (uint32_t)1 << king;
+      b.squares[king_position] &= ~king_bit;
+      enemy_attacks = b.attacks(enemy, !white, state.piece_positions.data());
+      b.squares[king_position] |= king_bit;
+      in_check = (enemy_attacks >> (king_position - 1)) & 1;
+      for (int dir = DIR_ORTHOGONAL; dir < DIR_DIAGONAL + 4; ++dir) {
+        uint32_t sliders = enemy & (b.queens | (dir < DIR_DIAGONAL ? b.rooks : b.bishops));
+        int first = 0;
+        for (int at = offset(king_position, dir); at != 0; at = offset(at, dir)) {
+          if (b.squares[at] == 0) {
+            continue;
+          }
+          if (first != 0) {
+            if (b.squares[at] & sliders) {
+              pinned |= (uint64_t)1 << (first - 1);
+            }
+            break;
+          }
+          first = at;
+        }
+      }
+    }
+
+    //the piece a non-pawn move onto to takes, 32 for none, or -1 if our own piece stands there
+    int target (int to) const {
+      if (b.squares[to] & own) {
+        return -1;
+      }
+      return (b.squares[to] & enemy) ? highest(b.squares[to] & enemy) : 32;
+    }
+
+    //one step in each of the 8 directions from first_dir
+    void step_moves (int piece, int from, int first_dir) {
+      for (int dir = first_dir; dir < first_dir + 8; ++dir) {
+        int to = offset(from, dir);
+        int taken = to == 0 ? -1 : target(to);
+        if (taken >= 0) {
+          add(piece, from, to, taken, MOVE_QUIET, false);
+        }
+      }
+    }
+
+    //along each of the 4 directions from first_dir up to the first piece, taking it if it is the enemy's
+    void slide_moves (int piece, int from, int first_dir) {
+      for (int dir = first_dir; dir < first_dir + 4; ++dir) {
+        for (int to = offset(from, dir); to != 0; to = offset(to, dir)) {
+          int taken = target(to);
+          if (taken >= 0) {
+            add(piece, from, to, taken, MOVE_QUIET, false);
+          }
+          if (b.squares[to] != 0) {
+            break;
+          }
+        }
+      }
+    }
+
+    void pawn_moves (int piece, int from) {
+      int forward = white ? 8 : -8;
+      auto promotes = [&](int to) { return white ? to > 56 : to < 9; };
+
+      int front = from + forward;
+      if (front > 0 && front < 65 && b.squares[front] == 0) {
+        add(piece, from, front, 32, MOVE_QUIET, promotes(front));
+        int two = front + forward;
+        if (two > 0 && two < 65 && b.squares[two] == 0) {
+          add(piece, from, two, 32, MOVE_DOUBLE, promotes(two));
+        }
+      }
+
+      for (int diff : {7, 9}) {
+        int to = white ? from + diff : from - diff;
+        if (to < 1 || to > 64) {
+          continue;
+        }
+        //pieces are looked at in id order and the first enemy piece ends the search, so white's own pieces (lower ids)
+        //always block, and black's never block a capture
+        uint32_t here = b.squares[to];
+        int taken = 32;
+        if (white) {
+          if (here & own) {
+            continue;
+          }
+          if (here & enemy) {
+            taken = lowest(here & enemy);
+          }
+        } else if (here & enemy) {
+          taken = lowest(here & enemy);
+        } else if (here & own) {
+          continue;
+        }
+        add(piece, from, to, taken, MOVE_QUIET, promotes(to));
+      }
+    }
+
+    void castling (int piece) {
+      int home = white ? 4 : 60;
+      if (piece != king || state.piece_positions[piece] != home) {
+        return;
+      }
+      //king side to g1/g8 with the rook from h1/h8, queen side to c1/c8 with the rook from a1/a8
+      const uint8_t flags[2] = { (uint8_t)(white ? W_CAS_K : B_CAS_K), (uint8_t)(white ? W_CAS_Q : B_CAS_Q) };
+      const int targets[2] = { home - 2, home + 2 };
+      const int rooks[2] = { king + 6, king + 7 };
+
+      for (int side = 0; side < 2; ++side) {
+        int to = targets[side];
+        if (state.castle & flags[side]) {
+          continue;
+        }
+        if (!empty_between(home, to)) {
+          continue;
+        }
+        int rook_position = state.piece_positions[rooks[side]];
+        if (rook_position != 0 ? rank_of(rook_position) == rank_of(home) && !empty_between(rook_position, to) :
+          white && !empty_between(0, to)) {
+          continue;
+        }
+
+        //not out of check, and not across an attacked square
+        if (in_check || (enemy_attacks >> ((home + to) / 2 - 1)) & 1) {
+          continue;
+        }
+
+        //the rook moves after the check for leaving the king attacked, and nothing on the target is taken
+        add(piece, home, to, 32, MOVE_CASTLE, false);
+      }
+    }
+
+    //true if no piece stands strictly between two positions on the same rank; position 0 counts as before h1
+    bool empty_between (int from, int to) const {
+      int low = from < to ? from : to;
+      int high = from < to ? to : from;
+      for (int position = low + 1; position < high; ++position) {
+        if (b.squares[position] != 0) {
+          return false;
+        }
+      }
+      return true;
+    }
+};
+
+/* *
+ * legal_moves
+ *  the moves of the side to move, as packed moves.  They come in a different order from rules::legal_moves, so sort
+ *  both lists to compare them.  kinds, if given, gets the MOVE_ flags of each move.
+ * */
+inline void legal_moves (
+  const rules::game_state& state,
+  std::vector<uint16_t>& moves,
+  std::vector<uint8_t>* kinds = nullptr
+) {
+  moves.clear();
+  if (kinds != nullptr) {
+    kinds->clear();
+  }
+  generator(state, moves, kinds).run();
+}
+
+} // namespace movegen
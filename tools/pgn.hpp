@@ -0,0 +1,440 @@
+#pragma once
+
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "../chess_rules.hpp"
+#include "game_file.hpp"
+
+/* *
+ * pgn.hpp
+ *  reads PGN files into lists of packed moves (see pack_move in chess_rules.hpp).
+ *  Each SAN move is resolved by trying every piece of the right type through rules::play_move, so the result is exactly
+ *  what the contract will accept - a move the contract would reject is reported as illegal, with its ply number.
+ *
+ *  Packed move lists are plain text files with one game per line, each move a packed move in decimal or 0x hex, or
+ *  binary game files from gamegen (see game_file.hpp).
+ * */
+
+namespace pgn {
+
+/* *
+ * square_to_position
+ *  converts a square like 'e4' to the contract's board location numbering (h1 = 1, a1 = 8, a8 = 64)
+ * */
+inline uint8_t square_to_position (
+  char file,
+  char rank
+) {
+  return (8 * (rank - '1')) + (8 - (file - 'a'));
+}
+
+/* *
+ * position_to_square
+ *  the reverse of square_to_position; 'e4' for location 28
+ * */
+inline std::string position_to_square (
+  uint8_t position
+) {
+  return { (char)('a' + 7 - (position - 1) % 8), (char)('1' + (position - 1) / 8) };
+}
+
+/* *
+ * split_games
+ *  splits PGN text into games, each a list of SAN move tokens.  Tag pairs, comments, variations, NAGs, move numbers
+ *  and results are dropped.
+ * */
+inline std::vector<std::vector<std::string>> split_games (
+  const std::string& text
+) {
+  std::vector<std::vector<std::string>> games;
+  std::vector<std::string> moves;
+  std::string token;
+  int variation_depth = 0;
+  bool in_tags = false;
+
+  auto end_token = [&]() {
+    if (token.empty()) {
+      return;
+    }
+    if (token == "1-0" || token == "0-1" || token == "1/2-1/2" || token == "*") {
+      //results end a game
+      if (!moves.empty()) {
+        games.push_back(moves);
+        moves.clear();
+      }
+    } else if (token[0] != '$') {
+      //strip move numbers like '12.' and '12...'
+      size_t dot = token.find_last_of('.');
+      if (dot != std::string::npos) {
+        token = token.substr(dot + 1);
+      }
+      if (!token.empty() && variation_depth == 0) {
+        moves.push_back(token);
+      }
+    }
+    token.clear();
+  };
+
+  for (size_t i = 0; i < text.size(); ++i) {
+    char c = text[i];
+    if (c == '{') {
+      end_token();
+      size_t close = text.find('}', i);
+      i = close == std::string::npos ? text.size() : close;
+    } else if (c == ';') {
+      end_token();
+      size_t eol = text.find('\n', i);
+      i = eol == std::string::npos ? text.size() : eol;
+    } else if (c == '[' && variation_depth == 0) {
+      end_token();
+      //a tag section after moves with no result token still starts a new game
+      if (!moves.empty() && !in_tags) {
+        games.push_back(moves);
+        moves.clear();
+      }
+      in_tags = true;
+      size_t close = text.find(']', i);
+      i = close == std::string::npos ? text.size() : close;
+    } else if (c == '(') {
+      end_token();
+      ++variation_depth;
+    } else if (c == ')') {
+      end_token();
+      --variation_depth;
+    } else if (std::isspace((unsigned char)c)) {
+      end_token();
+    } else {
+      in_tags = false;
+      token += c;
+    }
+  }
+  end_token();
+  if (!moves.empty()) {
+    games.push_back(moves);
+  }
+  return games;
+}
+
+/* *
+ * san_to_move
+ *  resolves one SAN move against the current state, returning it as a packed move.
+ *  Throws std::runtime_error if no piece, or more than one piece, can legally make the move.
+ * */
+inline uint16_t san_to_move (
+  const rules::game_state& state,
+  std::string san
+) {
+  bool is_whites_move = state.move_count % 2 == 0;
+  uint8_t first_piece = is_whites_move ? 0 : 16;
+
+  //annotations don't matter here
+  while (!san.empty() && (san.back() == '+' || san.back() == '#' || san.back() == '!' || san.back() == '?')) {
+    san.pop_back();
+  }
+
+  if (san == "O-O" || san == "0-0") {
+    return rules::pack_move(first_piece, is_whites_move ? 2 : 58, 0);
+  }
+  if (san == "O-O-O" || san == "0-0-0") {
+    return rules::pack_move(first_piece, is_whites_move ? 6 : 62, 0);
+  }
+
+  //promotion suffix, written either 'e8=Q' or 'e8Q'
+  uint8_t promotion_type = 0;
+  size_t equals = san.find('=');
+  char promotion_char = 0;
+  if (equals != std::string::npos && equals + 1 < san.size()) {
+    promotion_char = san[equals + 1];
+    san = san.substr(0, equals);
+  } else if (san.size() > 2 && std::strchr("QRBN", san.back()) && std::isdigit((unsigned char)san[san.size() - 2])) {
+    promotion_char = san.back();
+    san.pop_back();
+  }
+  switch (promotion_char) {
+    case 'B' : promotion_type = PROMOTED_BISHOP; break;
+    case 'N' : promotion_type = PROMOTED_KNIGHT; break;
+    case 'R' : promotion_type = PROMOTED_ROOK; break;
+    case 'Q' : promotion_type = PROMOTED_QUEEN; break;
+  }
+
+  if (san.size() < 2) {
+    throw std::runtime_error("unreadable move '" + san + "'");
+  }
+
+  uint8_t type = PIECE_PAWN;
+  size_t start = 0;
+  switch (san[0]) {
+    case 'K' : type = PIECE_KING; start = 1; break;
+    case 'Q' : type = PIECE_QUEEN; start = 1; break;
+    case 'B' : type = PIECE_BISHOP; start = 1; break;
+    case 'N' : type = PIECE_KNIGHT; start = 1; break;
+    case 'R' : type = PIECE_ROOK; start = 1; break;
+  }
+
+  char file = san[san.size() - 2];
+  char rank = san[san.size() - 1];
+  if (file < 'a' || file > 'h' || rank < '1' || rank > '8') {
+    throw std::runtime_error("unreadable move '" + san + "'");
+  }
+  uint8_t new_position = square_to_position(file, rank);
+
+  //anything between the piece letter and the destination, other than a capture mark, disambiguates the moving piece
+  char from_file = 0;
+  char from_rank = 0;
+  for (size_t i = start; i + 2 < san.size(); ++i) {
+    if (san[i] >= 'a' && san[i] <= 'h') {
+      from_file = san[i];
+    } else if (san[i] >= '1' && san[i] <= '8') {
+      from_rank = san[i];
+    }
+  }
+
+  //a pawn move without a source file is a straight move, since SAN always names the file a pawn captures from
+  if (type == PIECE_PAWN && from_file == 0) {
+    from_file = file;
+  }
+
+  uint16_t found = 0;
+  int matches = 0;
+  for (uint8_t piece_id = first_piece; piece_id < first_piece + 16; ++piece_id) {
+    uint8_t current_position = state.piece_positions[piece_id];
+    if (current_position == 0 || rules::piece_type(piece_id, state.promoted_pawns, state.promoted_pawn_types) != type) {
+      continue;
+    }
+    if (from_file && (8 - (current_position - 1) % 8) != (from_file - 'a' + 1)) {
+      continue;
+    }
+    if (from_rank && ((current_position - 1) / 8) != (from_rank - '1')) {
+      continue;
+    }
+
+    rules::game_state trial = state;
+    uint8_t captured_piece_index = 32;
+    bool checkmate = false;
+    if (rules::play_move(trial, piece_id, new_position, promotion_type, captured_piece_index, checkmate)) {
+      found = rules::pack_move(piece_id, new_position, promotion_type);
+      ++matches;
+    }
+  }
+
+  if (matches == 0) {
+    throw std::runtime_error("illegal move '" + san + "'");
+  } else if (matches > 1) {
+    throw std::runtime_error("ambiguous move '" + san + "'");
+  }
+  return found;
+}
+
+/* *
+ * game_moves
+ *  plays a list of SAN tokens from the starting position, returning the packed moves
+ * */
+inline std::vector<uint16_t> game_moves (
+  const std::vector<std::string>& san_moves
+) {
+  rules::game_state state;
+  std::vector<uint16_t> moves;
+  for (auto& san : san_moves) {
+    uint16_t move = 0;
+    try {
+      move = san_to_move(state, san);
+    } catch (const std::runtime_error& e) {
+      throw std::runtime_error(std::string(e.what()) + " at ply " + std::to_string(state.move_count + 1));
+    }
+    uint8_t captured_piece_index = 32;
+    bool checkmate = false;
+    rules::play_move(state, rules::packed_piece_id(move), rules::packed_new_position(move), rules::packed_promotion_type(move), captured_piece_index, checkmate);
+    moves.push_back(move);
+  }
+  return moves;
+}
+
+inline std::string read_file (
+  const std::string& filename
+) {
+  std::ifstream in(filename, std::ios::binary);
+  if (!in) {
+    throw std::runtime_error("unable to open " + filename);
+  }
+  std::stringstream ss;
+  ss << in.rdbuf();
+  return ss.str();
+}
+
+//see rules::fen
+inline std::string fen (
+  const rules::game_state& state
+) {
+  return rules::fen(state);
+}
+
+/* *
+ * from_fen
+ *  the game state of a FEN string.  Pieces get the indexes they start the game with - the rook on h1 is 6 and the one on
+ *  a1 is 7, as castling expects - and pieces beyond the starting set (a second queen, a third knight) become promoted
+ *  pawns, using the indexes of pawns that are no longer on the board.  The halfmove clock is ignored.
+ *  Throws std::runtime_error if the FEN can't be represented.
+ * */
+inline rules::game_state from_fen (
+  const std::string& text
+) {
+  std::istringstream fields(text);
+  std::string board, side, castling, en_passant;
+  uint32_t halfmove = 0, fullmove = 1;
+  fields >> board >> side >> castling >> en_passant >> halfmove >> fullmove;
+  auto bad = [&](const std::string& why) { return std::runtime_error("bad FEN '" + text + "': " + why); };
+
+  //each side's pieces by type: [white][type] -> positions
+  std::vector<uint8_t> pieces[2][6];
+  char rank = '8';
+  char file = 'a';
+  for (char c : board) {
+    if (c == '/') {
+      if (file != 'i' || rank == '1') {
+        throw bad("rank " + std::string(1, rank) + " is not 8 squares");
+      }
+      --rank;
+      file = 'a';
+    } else if (c >= '1' && c <= '8') {
+      file += c - '0';
+    } else {
+      const char* types = "kqbnrp";
+      const char* type = std::strchr(types, std::tolower(c));
+      if (type == nullptr || *type == 0 || file > 'h') {
+        throw bad(std::string("unexpected '") + c + "'");
+      }
+      pieces[std::isupper(c) ? 1 : 0][type - types].push_back(square_to_position(file, rank));
+      ++file;
+    }
+    if (file > 'i') {
+      throw bad("rank " + std::string(1, rank) + " is not 8 squares");
+    }
+  }
+  if (rank != '1' || file != 'i') {
+    throw bad("the board is not 8 ranks");
+  }
+
+  rules::game_state state;
+  state.piece_positions = rules::piece_array();
+  for (int white = 1; white >= 0; --white) {
+    uint8_t base = white ? 0 : 16;
+    auto& own = pieces[white];
+    if (own[PIECE_KING].size() != 1) {
+      throw bad("each side needs one king");
+    }
+    if (own[PIECE_PAWN].size() > 8) {
+      throw bad("more than 8 pawns");
+    }
+
+    //pieces in the order the starting position numbers them, and rooks on their starting corners keep their own
+    //index so castling moves the right one
+    for (auto& positions : own) {
+      std::sort(positions.begin(), positions.end());
+    }
+    uint8_t h_corner = white ? 1 : 57;
+    uint8_t a_corner = white ? 8 : 64;
+    auto& rooks = own[PIECE_ROOK];
+    std::stable_sort(rooks.begin(), rooks.end(), [&](uint8_t a, uint8_t b) {
+      auto rank_of = [&](uint8_t p) { return p == h_corner ? 0 : p == a_corner ? 1 : 2; };
+      return rank_of(a) < rank_of(b);
+    });
+    if (rooks.size() == 1 && rooks[0] == a_corner) {
+      rooks.insert(rooks.begin(), 0);
+    }
+
+    struct slot { uint8_t type; uint8_t first; uint8_t count; };
+    const slot slots[] = { { PIECE_KING, 0, 1 }, { PIECE_QUEEN, 1, 1 }, { PIECE_BISHOP, 2, 2 }, { PIECE_KNIGHT, 4, 2 }, { PIECE_ROOK, 6, 2 } };
+    uint8_t next_pawn = base + 8;
+    for (uint8_t position : own[PIECE_PAWN]) {
+      state.piece_positions[next_pawn++] = position;
+    }
+    for (auto& sl : slots) {
+      auto& positions = own[sl.type];
+      for (size_t i = 0; i < positions.size(); ++i) {
+        if (i < sl.count) {
+          state.piece_positions[base + sl.first + i] = positions[i];
+          continue;
+        }
+        if (next_pawn == base + 16) {
+          throw bad("too many pieces to be promoted pawns");
+        }
+        uint8_t promoted = sl.type == PIECE_QUEEN ? PROMOTED_QUEEN : sl.type == PIECE_ROOK ? PROMOTED_ROOK :
+          sl.type == PIECE_KNIGHT ? PROMOTED_KNIGHT : PROMOTED_BISHOP;
+        rules::promote_pawn(next_pawn, state.promoted_pawns, state.promoted_pawn_types, promoted);
+        state.piece_positions[next_pawn++] = positions[i];
+      }
+    }
+  }
+
+  state.castle = W_CAS_Q | W_CAS_K | B_CAS_Q | B_CAS_K;
+  for (char c : castling) {
+    switch (c) {
+      case 'K' : state.castle &= ~W_CAS_K; break;
+      case 'Q' : state.castle &= ~W_CAS_Q; break;
+      case 'k' : state.castle &= ~B_CAS_K; break;
+      case 'q' : state.castle &= ~B_CAS_Q; break;
+    }
+  }
+
+  bool white_to_move = side != "b";
+  state.move_count = 2 * (fullmove > 0 ? fullmove - 1 : 0) + (white_to_move ? 0 : 1);
+  if (en_passant.size() == 2 && en_passant[0] >= 'a' && en_passant[0] <= 'h') {
+    //the pawn that just moved two squares stands one rank past the square it skipped
+    uint8_t pawn_position = square_to_position(en_passant[0], white_to_move ? '5' : '4');
+    for (uint8_t pawn = white_to_move ? 24 : 8; pawn < (white_to_move ? 32 : 16); ++pawn) {
+      if (state.piece_positions[pawn] == pawn_position) {
+        state.en_passant_idx = pawn;
+      }
+    }
+  }
+  rules::update_attacks(state);
+  return state;
+}
+
+/* *
+ * load_games
+ *  reads every game in a '.pgn' file, a packed move list file or a game file, as lists of packed moves
+ * */
+inline std::vector<std::vector<uint16_t>> load_games (
+  const std::string& filename
+) {
+  std::string text = read_file(filename);
+  std::vector<std::vector<uint16_t>> games;
+
+  if (filename.size() > 4 && filename.compare(filename.size() - 4, 4, ".pgn") == 0) {
+    for (auto& san_moves : split_games(text)) {
+      try {
+        games.push_back(game_moves(san_moves));
+      } catch (const std::runtime_error& e) {
+        throw std::runtime_error(filename + " game " + std::to_string(games.size() + 1) + ": " + e.what());
+      }
+    }
+  } else if (game_file::is_game_file(text)) {
+    games = game_file::read_games(text);
+  } else {
+    std::istringstream lines(text);
+    std::string line;
+    while (std::getline(lines, line)) {
+      std::istringstream values(line);
+      std::vector<uint16_t> moves;
+      std::string value;
+      while (values >> value) {
+        moves.push_back((uint16_t)std::stoul(value, nullptr, 0));
+      }
+      if (!moves.empty()) {
+        games.push_back(moves);
+      }
+    }
+  }
+  return games;
+}
+
+} // namespace pgn
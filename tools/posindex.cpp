@@ -0,0 +1,114 @@
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "pgn.hpp"
+#include "position_index.hpp"
+
+/* *
+ * posindex
+ *  answers "which games reached this position?" without replaying every game.
+ *
+ *  --build replays games from PGN files or packed move lists (see pgn.hpp) through the contract's rules and writes an
+ *  index from the hash of every position reached, the start included, to the game and ply (see position_index.hpp).
+ *  Games get consecutive ids starting at --game-id, the same way bundle and parse_pgn.py number them.
+ *
+ *  --index looks a position up, given as the SAN moves that reach it (--moves) or as its hash (--hash), and prints the
+ *  position's hash followed by one 'game_id ply' line per match.
+ * */
+
+static void usage () {
+  std::cerr <<
+    "usage: posindex --build FILE [--game-id N] <game.pgn | game.moves>...\n"
+    "       posindex --index FILE (--moves 'e4 e5 Nf3' | --hash HASH)\n"
+    "  --build FILE       index to write\n"
+    "  --game-id N        id of the first game (default 0)\n"
+    "  --index FILE       index to look positions up in\n"
+    "  --moves SAN        moves from the start that reach the position\n"
+    "  --hash HASH        position hash, in decimal or 0x hex\n";
+  std::exit(1);
+}
+
+int main (int argc, char** argv) {
+  std::string build_file;
+  std::string index_file;
+  std::string moves;
+  bool by_moves = false;
+  std::string hash_text;
+  uint64_t first_game_id = 0;
+  std::vector<std::string> files;
+
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    auto next = [&]() -> std::string {
+      if (i + 1 >= argc) { usage(); }
+      return argv[++i];
+    };
+    if (arg == "--build") { build_file = next(); }
+    else if (arg == "--game-id") { first_game_id = std::stoull(next()); }
+    else if (arg == "--index") { index_file = next(); }
+    else if (arg == "--moves") { moves = next(); by_moves = true; }
+    else if (arg == "--hash") { hash_text = next(); }
+    else if (arg[0] == '-') { usage(); }
+    else { files.push_back(arg); }
+  }
+  if (build_file.empty() == index_file.empty() || (!build_file.empty() && files.empty()) ||
+    (!index_file.empty() && by_moves == !hash_text.empty())) {
+    usage();
+  }
+
+  try {
+    if (!build_file.empty()) {
+      auto start = std::chrono::steady_clock::now();
+      std::vector<position_index::entry> entries;
+      uint64_t game_id = first_game_id;
+      for (auto& file : files) {
+        for (auto& game : pgn::load_games(file)) {
+          rules::game_state state;
+          entries.push_back(position_index::make_entry(rules::position_hash(state), game_id, 0));
+          for (size_t ply = 0; ply < game.size(); ++ply) {
+            uint16_t move = game[ply];
+            uint8_t captured_piece_index = 32;
+            bool checkmate = false;
+            if (!rules::play_move(state, rules::packed_piece_id(move), rules::packed_new_position(move), rules::packed_promotion_type(move), captured_piece_index, checkmate)) {
+              throw std::runtime_error(file + " game " + std::to_string(game_id) + " ply " + std::to_string(ply + 1) + " is illegal");
+            }
+            entries.push_back(position_index::make_entry(rules::position_hash(state), game_id, ply + 1));
+          }
+          ++game_id;
+        }
+      }
+      position_index::write_index(build_file, entries);
+      double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+      std::cerr << game_id - first_game_id << " games, " << entries.size() << " positions indexed in " << seconds << "s\n";
+      return 0;
+    }
+
+    uint64_t hash;
+    if (by_moves) {
+      rules::game_state state;
+      auto games = pgn::split_games(moves);
+      for (uint16_t move : games.empty() ? std::vector<uint16_t>() : pgn::game_moves(games[0])) {
+        uint8_t captured_piece_index = 32;
+        bool checkmate = false;
+        rules::play_move(state, rules::packed_piece_id(move), rules::packed_new_position(move), rules::packed_promotion_type(move), captured_piece_index, checkmate);
+      }
+      hash = rules::position_hash(state);
+    } else {
+      hash = std::stoull(hash_text, nullptr, 0);
+    }
+
+    position_index::index_reader index(index_file);
+    auto matches = index.find(hash);
+    std::printf("0x%016llx\n", (unsigned long long)hash);
+    for (auto e = matches.first; e != matches.second; ++e) {
+      std::printf("%llu %u\n", (unsigned long long)e->game_id(), e->ply());
+    }
+  } catch (const std::exception& e) {
+    std::cerr << "posindex: " << e.what() << "\n";
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,169 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* *
+ * position_index.hpp
+ *  an on-disk index from position hash (rules::position_hash) to every (game_id, ply) that reached the position.
+ *
+ *  Entries are sorted by hash, and a table of where each value of the top 16 hash bits starts sits in front of them, so
+ *  a lookup maps the file, jumps to its bucket and binary searches a few entries - the same handful of page reads
+ *  whether the index holds a thousand games or ten million.
+ *
+ *  File layout (little endian) -
+ *   header   magic "CHESSPOS", version, entry count
+ *   buckets  65537 entry offsets; bucket b holds the entries from buckets[b] up to buckets[b + 1]
+ *   entries  16 bytes each: the hash, then game_id << 16 | ply
+ * */
+
+namespace position_index {
+
+#define POSITION_INDEX_MAGIC   "CHESSPOS"
+#define POSITION_INDEX_VERSION 1
+#define POSITION_INDEX_BUCKETS 65536
+
+struct file_header {
+  char magic[8];
+  uint32_t version;
+  uint32_t reserved;
+  uint64_t entries;
+};
+
+struct entry {
+  uint64_t hash;
+  uint64_t game_ply; //game_id << 16 | ply
+
+  uint64_t game_id () const { return game_ply >> 16; }
+  uint32_t ply () const { return game_ply & 0xFFFF; }
+
+  bool operator< (const entry& other) const {
+    return hash != other.hash ? hash < other.hash : game_ply < other.game_ply;
+  }
+};
+
+inline entry make_entry (
+  uint64_t hash,
+  uint64_t game_id,
+  uint32_t ply
+) {
+  if (ply > 0xFFFF || game_id >> 48 != 0) {
+    throw std::runtime_error("position_index: game " + std::to_string(game_id) + " ply " + std::to_string(ply) + " is out of range");
+  }
+  return { hash, game_id << 16 | ply };
+}
+
+/* *
+ * write_index
+ *  sorts the entries and writes them out as an index file
+ * */
+inline void write_index (
+  const std::string& filename,
+  std::vector<entry>& entries
+) {
+  std::sort(entries.begin(), entries.end());
+  entries.erase(std::unique(entries.begin(), entries.end(), [](const entry& a, const entry& b) {
+    return a.hash == b.hash && a.game_ply == b.game_ply;
+  }), entries.end());
+
+  std::vector<uint64_t> buckets(POSITION_INDEX_BUCKETS + 1, 0);
+  for (auto& e : entries) {
+    ++buckets[(e.hash >> 48) + 1];
+  }
+  for (size_t b = 1; b < buckets.size(); ++b) {
+    buckets[b] += buckets[b - 1];
+  }
+
+  FILE* out = std::fopen(filename.c_str(), "wb");
+  if (out == nullptr) {
+    throw std::runtime_error("position_index: unable to create " + filename);
+  }
+  file_header header {};
+  std::memcpy(header.magic, POSITION_INDEX_MAGIC, 8);
+  header.version = POSITION_INDEX_VERSION;
+  header.entries = entries.size();
+  std::fwrite(&header, sizeof(header), 1, out);
+  std::fwrite(buckets.data(), sizeof(uint64_t), buckets.size(), out);
+  std::fwrite(entries.data(), sizeof(entry), entries.size(), out);
+  bool failed = std::ferror(out) != 0;
+  failed = std::fclose(out) != 0 || failed;
+  if (failed) {
+    throw std::runtime_error("position_index: error writing " + filename);
+  }
+}
+
+/* *
+ * index_reader
+ *  maps an index file read-only and looks positions up in it
+ * */
+class index_reader {
+  public:
+    index_reader (const std::string& filename) {
+      int fd = ::open(filename.c_str(), O_RDONLY);
+      struct stat st;
+      if (fd < 0 || fstat(fd, &st) != 0) {
+        if (fd >= 0) { ::close(fd); }
+        throw std::runtime_error("position_index: unable to open " + filename);
+      }
+      size = st.st_size;
+      if (size >= sizeof(file_header)) {
+        data = (const uint8_t*)mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+      }
+      ::close(fd);
+      if (data == nullptr || data == MAP_FAILED) {
+        data = nullptr;
+        throw std::runtime_error("position_index: unable to map " + filename);
+      }
+
+      header = (const file_header*)data;
+      buckets = (const uint64_t*)(data + sizeof(file_header));
+      entries = (const entry*)(buckets + POSITION_INDEX_BUCKETS + 1);
+      if (std::memcmp(header->magic, POSITION_INDEX_MAGIC, 8) != 0 || header->version != POSITION_INDEX_VERSION ||
+        (const uint8_t*)(entries + header->entries) > data + size) {
+        munmap((void*)data, size);
+        data = nullptr;
+        throw std::runtime_error("position_index: " + filename + " is not a position index");
+      }
+      //lookups jump around the file, so don't read ahead
+      madvise((void*)data, size, MADV_RANDOM);
+    }
+
+    ~index_reader () {
+      if (data != nullptr) {
+        munmap((void*)data, size);
+      }
+    }
+
+    index_reader (const index_reader&) = delete;
+    index_reader& operator= (const index_reader&) = delete;
+
+    uint64_t size_entries () const { return header->entries; }
+
+    //every entry for hash, in game and ply order
+    std::pair<const entry*, const entry*> find (uint64_t hash) const {
+      const entry* first = entries + buckets[hash >> 48];
+      const entry* last = entries + buckets[(hash >> 48) + 1];
+      first = std::lower_bound(first, last, hash, [](const entry& e, uint64_t h) { return e.hash < h; });
+      last = std::upper_bound(first, last, hash, [](uint64_t h, const entry& e) { return h < e.hash; });
+      return { first, last };
+    }
+
+  private:
+    const uint8_t* data = nullptr;
+    size_t size = 0;
+    const file_header* header = nullptr;
+    const uint64_t* buckets = nullptr;
+    const entry* entries = nullptr;
+};
+
+} // namespace position_index
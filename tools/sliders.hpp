@@ -0,0 +1,333 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/* *
+ * sliders.hpp
+ *  rook and bishop attacks by table lookup, for native builds of chess_rules.hpp.  The contract works slider attacks
+ *  out one ray at a time (rules::ray_attacks, from a 4 KB table of empty board rays); native builds include this
+ *  header from chess_rules.hpp, and rules::rook_attacks and rules::bishop_attacks look the attacks up here instead,
+ *  except while they run in a constant expression.  Build with -DCHESS_RAY_SLIDERS to leave it out.
+ *
+ *  Every square has a mask of the squares whose occupancy matters to it - its lines, without the last square of
+ *  each, since nothing lies beyond the edge to block - and its own slice of an attack table with one entry for each
+ *  occupancy of the mask.  The occupancy is turned into an index into the slice in one of two ways -
+ *   magic  multiplying it by the square's magic number and keeping the top bits
+ *   pext   the BMI2 pext instruction, gathering the mask's bits together
+ *  pext is picked at startup when the cpu has BMI2, magic otherwise, and either can be picked with select.  Both
+ *  index the same 845 KB of tables (800 KB for rooks, 41 KB for bishops), filled in the order of the kind in use.
+ *
+ *  Positions are the board positions of chess_rules.hpp, 1 (h1) to 64 (a8), with position p at bit p - 1.
+ * */
+
+namespace sliders {
+
+enum slider_kind {
+  SLIDERS_RAYS,  //no tables: rules::ray_attacks, as the contract does
+  SLIDERS_MAGIC, //magic multiply and shift
+  SLIDERS_PEXT   //BMI2 pext
+};
+
+inline const char* kind_name (slider_kind kind) {
+  switch (kind) {
+    case SLIDERS_RAYS : return "rays";
+    case SLIDERS_MAGIC : return "magic";
+    case SLIDERS_PEXT : return "pext";
+  }
+  return "unknown";
+}
+
+/* *
+ * Magic numbers
+ *  for every square, a multiplier that maps each occupancy of the square's mask to its own slot of 2^(mask bits)
+ *  (or to a slot holding the same attacks).  Found by find_magic with seed 1; slider_bench --find-magics searches
+ *  for them again.
+ * */
+inline constexpr uint64_t rook_magics[64] = {
+  0x01800088E0114000ULL, 0x0440004820001000ULL, 0x0C80081000802000ULL, 0x8880080010000480ULL,
+  0x1200085060048200ULL, 0x018004000E000180ULL, 0x2400024100841008ULL, 0x808000450001A280ULL,
+  0x0212800022C00080ULL, 0x0002004100220082ULL, 0x8082801000822002ULL, 0x1002002040081200ULL,
+  0x0820800400080081ULL, 0x0801000204010008ULL, 0x0094801100020080ULL, 0x2012800080004500ULL,
+  0x0090908000400029ULL, 0x0480220042008100ULL, 0x0008420010842204ULL, 0x0020808010000800ULL,
+  0x0604008008000680ULL, 0x0082008080040002ULL, 0x0A01808001000200ULL, 0x1C00060000830264ULL,
+  0x1085400480008020ULL, 0x1020100040004020ULL, 0x8450200500110440ULL, 0x00C8100100200902ULL,
+  0x0000080080800400ULL, 0x0002000200041009ULL, 0x80A0028400100841ULL, 0x0004088200006C01ULL,
+  0x0480082010400040ULL, 0x0040080020201000ULL, 0x0408104101002000ULL, 0x4018001000800880ULL,
+  0x1484040080800800ULL, 0x0100800200800400ULL, 0x8002002182004408ULL, 0x1120004102000084ULL,
+  0xC840044080248008ULL, 0x0010002000414000ULL, 0x0410008020008010ULL, 0x4008020100101000ULL,
+  0x8001014800110024ULL, 0xA002000400028080ULL, 0x0432080201040010ULL, 0x8800010080420004ULL,
+  0x4100800510204300ULL, 0x8080812542090200ULL, 0x010A820012244200ULL, 0x0000800800100080ULL,
+  0x9312011020040A00ULL, 0x2044000480020080ULL, 0x0100820108100400ULL, 0x2088210400508200ULL,
+  0x0005412180083101ULL, 0x0020290084104001ULL, 0x0000811088C02202ULL, 0x0443002110000489ULL,
+  0x2042001120040802ULL, 0x0021000802040001ULL, 0x0008100082410804ULL, 0x010000610284004EULL
+};
+
+inline constexpr uint64_t bishop_magics[64] = {
+  0x0208010404040224ULL, 0x00314102008A0000ULL, 0xC1B001020A340A00ULL, 0x0004410021A40020ULL,
+  0x8012021080400804ULL, 0x2103100884020002ULL, 0x2186081404450041ULL, 0x0109804800A42000ULL,
+  0x041028421C040412ULL, 0x000418261ACA0200ULL, 0x15801088A0810000ULL, 0x0109AC4101A204C2ULL,
+  0xA8300404200A0000ULL, 0x0080511042100000ULL, 0x10008C008C112800ULL, 0x8001410400C3850AULL,
+  0x8010000690020804ULL, 0x0408009022008405ULL, 0x0008024043850011ULL, 0x8404200804210148ULL,
+  0x0002000412020000ULL, 0x0802000101008222ULL, 0x20010A4200902400ULL, 0x0422000044540404ULL,
+  0x1108048488101040ULL, 0x0050240808886091ULL, 0x1408020011120208ULL, 0x0058080010820002ULL,
+  0x02A1001103004004ULL, 0x8090020841008E00ULL, 0x200400A0004A1000ULL, 0x0000420144808400ULL,
+  0x004823080810A010ULL, 0x0044042200210200ULL, 0x000B040100021806ULL, 0x00A2004041040101ULL,
+  0xA190010410020200ULL, 0x08020401C1080808ULL, 0x0A040102020C0090ULL, 0x8401041100088843ULL,
+  0x130804100A004421ULL, 0x00D2180208000240ULL, 0x8162001402020400ULL, 0x00200C2214000806ULL,
+  0x0120080100440404ULL, 0x000925010A002502ULL, 0x008A0C03040C0600ULL, 0x0401024096008101ULL,
+  0x9902090402420488ULL, 0x9004210402202000ULL, 0x0834020082210000ULL, 0x0100090642022500ULL,
+  0x50C0001002020804ULL, 0x03424A9049020000ULL, 0x2005083004008402ULL, 0x008802008401080CULL,
+  0x0000820041444000ULL, 0x4470024108280201ULL, 0x004084804C040400ULL, 0x0040800100460801ULL,
+  0x0040240008830400ULL, 0x2020000888100420ULL, 0x4A402820A5860200ULL, 0x0084011004010041ULL
+};
+
+/* *
+ * line_attacks
+ *  the squares a rook (or, with diagonal, a bishop) on square attacks, up to and including the first occupied square
+ *  in each direction.  Slow, for building the tables.  square is position - 1.
+ * */
+inline uint64_t line_attacks (
+  int square,
+  uint64_t occupied,
+  bool diagonal
+) {
+  static const int steps[2][4][2] = {
+    { {1, 1}, {8, 0}, {-1, -1}, {-8, 0} },
+    { {7, -1}, {9, 1}, {-7, 1}, {-9, -1} }
+  };
+  uint64_t attacks = 0;
+  for (auto& step : steps[diagonal]) {
+    for (int next = square + step[0], col = square % 8 + step[1];
+      next >= 0 && next < 64 && col >= 0 && col < 8;
+      next += step[0], col += step[1]) {
+      attacks |= (uint64_t)1 << next;
+      if (occupied & ((uint64_t)1 << next)) {
+        break;
+      }
+    }
+  }
+  return attacks;
+}
+
+/* *
+ * relevant_mask
+ *  the squares whose occupancy can change the attacks from square: its lines without the square at the end of each
+ * */
+inline uint64_t relevant_mask (
+  int square,
+  bool diagonal
+) {
+  uint64_t mask = 0;
+  uint64_t lines = line_attacks(square, 0, diagonal);
+  for (uint64_t rest = lines; rest != 0; rest &= rest - 1) {
+    int next = __builtin_ctzll(rest);
+    //keep the square if the line carries on past it
+    uint64_t beyond = line_attacks(square, (uint64_t)1 << next, diagonal) ^ lines;
+    if (beyond != 0) {
+      mask |= (uint64_t)1 << next;
+    }
+  }
+  return mask;
+}
+
+//the index-th occupancy of mask, taking the bits of index in mask's bit order
+inline uint64_t occupancy (
+  uint64_t mask,
+  uint64_t index
+) {
+  uint64_t occupied = 0;
+  for (uint64_t rest = mask; rest != 0; rest &= rest - 1, index >>= 1) {
+    if (index & 1) {
+      occupied |= rest & -rest;
+    }
+  }
+  return occupied;
+}
+
+inline uint64_t pext (
+  uint64_t value,
+  uint64_t mask
+) {
+#if defined(__BMI2__)
+  return __builtin_ia32_pext_di(value, mask);
+#elif defined(__x86_64__)
+  //only reached once select has checked the cpu for BMI2, so it doesn't need the whole build compiled for it
+  uint64_t result;
+  __asm__ ("pext %2, %1, %0" : "=r" (result) : "r" (value), "rm" (mask));
+  return result;
+#else
+  return value & mask; //never reached: select doesn't pick pext off x86-64
+#endif
+}
+
+/* *
+ * find_magic
+ *  searches for a magic number for square, trying sparse random numbers from seed until one maps every occupancy of
+ *  the mask to a slot that holds the same attacks.  Returns 0 if none turns up within tries.
+ * */
+inline uint64_t find_magic (
+  int square,
+  bool diagonal,
+  uint64_t& seed,
+  uint64_t tries = 100000000
+) {
+  uint64_t mask = relevant_mask(square, diagonal);
+  int bits = __builtin_popcountll(mask);
+  size_t size = (size_t)1 << bits;
+  std::vector<uint64_t> occupied(size), attacks(size), slots(size);
+  std::vector<uint32_t> used(size, 0);
+  for (size_t index = 0; index < size; ++index) {
+    occupied[index] = occupancy(mask, index);
+    attacks[index] = line_attacks(square, occupied[index], diagonal);
+  }
+
+  auto random = [&seed]() {
+    uint64_t z = (seed += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+  };
+  for (uint32_t attempt = 1; attempt <= tries; ++attempt) {
+    uint64_t magic = random() & random() & random();
+    if (__builtin_popcountll((mask * magic) >> 56) < 6) {
+      continue;
+    }
+    bool fits = true;
+    for (size_t index = 0; index < size && fits; ++index) {
+      size_t slot = (occupied[index] * magic) >> (64 - bits);
+      if (used[slot] != attempt) {
+        used[slot] = attempt;
+        slots[slot] = attacks[index];
+      } else if (slots[slot] != attacks[index]) {
+        fits = false;
+      }
+    }
+    if (fits) {
+      return magic;
+    }
+  }
+  return 0;
+}
+
+/* *
+ * square_table
+ *  one square's mask, magic number and slice of the attack table
+ * */
+struct square_table {
+  uint64_t mask = 0;
+  uint64_t magic = 0;
+  const uint64_t* attacks = nullptr;
+  uint32_t shift = 0;
+};
+
+struct slider_tables {
+  slider_kind kind = SLIDERS_RAYS;
+  square_table rook[64];
+  square_table bishop[64];
+  std::vector<uint64_t> attacks;
+};
+
+//the tables in use, filled in for best_kind before main runs, or by select
+inline slider_tables tables;
+
+inline bool cpu_has_pext () {
+#if defined(__x86_64__)
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("bmi2");
+#else
+  return false;
+#endif
+}
+
+inline slider_kind best_kind () {
+  return cpu_has_pext() ? SLIDERS_PEXT : SLIDERS_MAGIC;
+}
+
+/* *
+ * select
+ *  fills the tables in for kind (pext falls back to magic if the cpu lacks BMI2), and returns the kind now in use.
+ *  Not thread safe: pick a kind before starting threads that run the rules.
+ * */
+inline slider_kind select (
+  slider_kind kind
+) {
+  if (kind == SLIDERS_PEXT && !cpu_has_pext()) {
+    kind = SLIDERS_MAGIC;
+  }
+  tables.kind = SLIDERS_RAYS;
+  if (kind == SLIDERS_RAYS) {
+    tables.attacks = std::vector<uint64_t>();
+    return kind;
+  }
+
+  //both kinds give a square 2^(mask bits) slots, so the slices are laid out the same way
+  size_t total = 0;
+  for (int diagonal = 0; diagonal < 2; ++diagonal) {
+    for (int square = 0; square < 64; ++square) {
+      total += (size_t)1 << __builtin_popcountll(relevant_mask(square, diagonal));
+    }
+  }
+  tables.attacks.assign(total, 0);
+
+  size_t offset = 0;
+  for (int diagonal = 0; diagonal < 2; ++diagonal) {
+    for (int square = 0; square < 64; ++square) {
+      square_table& entry = diagonal ? tables.bishop[square] : tables.rook[square];
+      entry.mask = relevant_mask(square, diagonal);
+      entry.magic = diagonal ? bishop_magics[square] : rook_magics[square];
+      entry.shift = 64 - __builtin_popcountll(entry.mask);
+      entry.attacks = tables.attacks.data() + offset;
+      size_t size = (size_t)1 << __builtin_popcountll(entry.mask);
+      for (size_t index = 0; index < size; ++index) {
+        uint64_t occupied = occupancy(entry.mask, index);
+        size_t slot = kind == SLIDERS_PEXT ? index : (size_t)((occupied * entry.magic) >> entry.shift);
+        tables.attacks[offset + slot] = line_attacks(square, occupied, diagonal);
+      }
+      offset += size;
+    }
+  }
+  tables.kind = kind;
+  return kind;
+}
+
+//the bytes of table select fills in for kind
+inline size_t table_bytes (
+  slider_kind kind
+) {
+  if (kind == SLIDERS_RAYS) {
+    return 0;
+  }
+  size_t bytes = sizeof(slider_tables::rook) + sizeof(slider_tables::bishop);
+  for (int diagonal = 0; diagonal < 2; ++diagonal) {
+    for (int square = 0; square < 64; ++square) {
+      bytes += sizeof(uint64_t) << __builtin_popcountll(relevant_mask(square, diagonal));
+    }
+  }
+  return bytes;
+}
+
+inline uint64_t lookup (
+  const square_table& entry,
+  slider_kind kind,
+  uint64_t occupied
+) {
+  if (kind == SLIDERS_PEXT) {
+    return entry.attacks[pext(occupied, entry.mask)];
+  }
+  return entry.attacks[((occupied & entry.mask) * entry.magic) >> entry.shift];
+}
+
+//the attacks of a rook or bishop on position (1 to 64); only for kinds other than SLIDERS_RAYS
+inline uint64_t rook_attacks (uint8_t position, uint64_t occupied) {
+  return lookup(tables.rook[position - 1], tables.kind, occupied);
+}
+
+inline uint64_t bishop_attacks (uint8_t position, uint64_t occupied) {
+  return lookup(tables.bishop[position - 1], tables.kind, occupied);
+}
+
+inline const slider_kind startup_kind = select(best_kind());
+
+} // namespace sliders
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <sqlite3.h>
+
+/* *
+ * sqlite.hpp
+ *  the little of SQLite's C api the tools use, for the index database written by the indexer.
+ *  Link with -lsqlite3.
+ * */
+
+/* *
+ * statement
+ *  a prepared SQLite statement, reset after every step
+ * */
+class statement {
+  public:
+    statement (sqlite3* db, const char* sql) : db(db) {
+      if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) != SQLITE_OK) {
+        throw std::runtime_error(std::string("sqlite: ") + sqlite3_errmsg(db));
+      }
+    }
+
+    ~statement () { sqlite3_finalize(stmt); }
+
+    statement (const statement&) = delete;
+    statement& operator= (const statement&) = delete;
+
+    statement& bind (int index, int64_t value) { sqlite3_bind_int64(stmt, index, value); return *this; }
+    statement& bind (int index, const std::string& value) { sqlite3_bind_text(stmt, index, value.c_str(), value.size(), SQLITE_TRANSIENT); return *this; }
+    statement& bind (int index, const std::vector<uint8_t>& value) { sqlite3_bind_blob(stmt, index, value.data(), value.size(), SQLITE_TRANSIENT); return *this; }
+
+    //runs the statement to the next row; returns false when there are no more rows
+    bool step () {
+      int rc = sqlite3_step(stmt);
+      if (rc == SQLITE_ROW) {
+        return true;
+      }
+      sqlite3_reset(stmt);
+      sqlite3_clear_bindings(stmt);
+      if (rc != SQLITE_DONE) {
+        throw std::runtime_error(std::string("sqlite: ") + sqlite3_errmsg(db));
+      }
+      return false;
+    }
+
+    //ends a query early, once the rows needed have been read
+    void done () {
+      sqlite3_reset(stmt);
+      sqlite3_clear_bindings(stmt);
+    }
+
+    int64_t integer (int column) { return sqlite3_column_int64(stmt, column); }
+    std::string text (int column) {
+      const unsigned char* s = sqlite3_column_text(stmt, column);
+      return s ? (const char*)s : "";
+    }
+    std::vector<uint8_t> blob (int column) {
+      const uint8_t* b = (const uint8_t*)sqlite3_column_blob(stmt, column);
+      return std::vector<uint8_t>(b, b + sqlite3_column_bytes(stmt, column));
+    }
+
+  private:
+    sqlite3* db;
+    sqlite3_stmt* stmt = nullptr;
+};
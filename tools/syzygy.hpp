@@ -0,0 +1,1223 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "../chess_rules.hpp"
+
+/* *
+ * syzygy.hpp
+ *  probes Syzygy endgame tablebases - win/draw/loss (.rtbw) and distance to zeroing (.rtbz) files of up to 7 pieces -
+ *  straight from local files, for adjudicating games that are down to a handful of pieces.
+ *
+ *  tablebase scans its directories for table files once, and maps a file read-only the first time a position needs it;
+ *  nothing is read over the network and nothing is copied out of the page cache.  The decoding follows the published
+ *  format, the one Stockfish and Fathom read: a table is split by side to move and, with pawns, by the file of the
+ *  leading pawn; each part is a Huffman coded list of values in blocks, indexed by an encoding of the piece squares that
+ *  folds away the board's symmetries.
+ *
+ *  The tables are of standard chess, so positions are probed as standard chess positions (see board): kings attack the
+ *  squares around them, pawns capture only diagonally and double step only from their starting rank, and there is no
+ *  en passant or castling.  The contract's rules differ in places (kings can stand side by side, pawns step diagonally
+ *  and double step from any rank), so a verdict is what the position is worth in standard chess.  The fewer the
+ *  pawns, the closer the two are.
+ *
+ *  A tablebase is not thread safe, since it maps tables as they are first used.
+ * */
+
+namespace syzygy {
+
+#define SYZYGY_MAX_PIECES 7
+
+/* *
+ * wdl_score
+ *  the value of a position for the side to move.  A cursed win is a win that takes more than 50 moves without a capture
+ *  or pawn move, and so is a draw under the fifty move rule; a blessed loss is the other side of one.
+ * */
+enum wdl_score {
+  WDL_LOSS = -2,
+  WDL_BLESSED_LOSS = -1,
+  WDL_DRAW = 0,
+  WDL_CURSED_WIN = 1,
+  WDL_WIN = 2
+};
+
+enum probe_state {
+  PROBE_FAIL = 0,          //a table is missing
+  PROBE_OK = 1,
+  PROBE_CHANGE_STM = -1,   //a dtz table has only the other side to move
+  PROBE_ZEROING = 2        //the best move is a capture or pawn move
+};
+
+inline const char* wdl_name (wdl_score wdl) {
+  switch (wdl) {
+    case WDL_LOSS : return "loss";
+    case WDL_BLESSED_LOSS : return "blessed loss";
+    case WDL_DRAW : return "draw";
+    case WDL_CURSED_WIN : return "cursed win";
+    case WDL_WIN : return "win";
+  }
+  return "?";
+}
+
+/* *
+ * board
+ *  a standard chess position.  Squares are numbered like the contract's positions, less one - h1 is 0, a1 is 7 and a8
+ *  is 63 - so the slider attacks of the rules can be used; the tables number them a1 = 0, h1 = 7, which is the square
+ *  with its file bits flipped (square ^ 7).
+ *
+ *  Pieces are coded as the tables code them: white pawn, knight, bishop, rook, queen and king are 1 to 6, and black
+ *  ones are the same plus 8.  pieces[color][0] has every piece of a color.
+ * */
+#define SYZYGY_PAWN   1
+#define SYZYGY_KNIGHT 2
+#define SYZYGY_BISHOP 3
+#define SYZYGY_ROOK   4
+#define SYZYGY_QUEEN  5
+#define SYZYGY_KING   6
+
+struct board {
+  uint64_t pieces[2][7] = {};
+  uint8_t black_to_move = 0;
+
+  uint64_t occupied () const { return pieces[0][0] | pieces[1][0]; }
+
+  int piece_count () const { return __builtin_popcountll(occupied()); }
+
+  uint8_t piece_on (int square) const {
+    uint64_t bit = (uint64_t)1 << square;
+    for (int color = 0; color < 2; ++color) {
+      if (pieces[color][0] & bit) {
+        for (int type = SYZYGY_PAWN; type <= SYZYGY_KING; ++type) {
+          if (pieces[color][type] & bit) {
+            return color * 8 + type;
+          }
+        }
+      }
+    }
+    return 0;
+  }
+
+  void put (int square, uint8_t piece) {
+    uint64_t bit = (uint64_t)1 << square;
+    pieces[piece >> 3][0] |= bit;
+    pieces[piece >> 3][piece & 7] |= bit;
+  }
+
+  void remove (int square, uint8_t piece) {
+    uint64_t bit = (uint64_t)1 << square;
+    pieces[piece >> 3][0] &= ~bit;
+    pieces[piece >> 3][piece & 7] &= ~bit;
+  }
+
+  //the material of color as in table names, "KRP"
+  std::string material (int color) const {
+    static const char letters[] = "KQRBNP";
+    static const int types[] = { SYZYGY_KING, SYZYGY_QUEEN, SYZYGY_ROOK, SYZYGY_BISHOP, SYZYGY_KNIGHT, SYZYGY_PAWN };
+    std::string out;
+    for (int i = 0; i < 6; ++i) {
+      out.append(__builtin_popcountll(pieces[color][types[i]]), letters[i]);
+    }
+    return out;
+  }
+};
+
+struct step_attacks {
+  uint64_t knight[64] = {};
+  uint64_t king[64] = {};
+  uint64_t pawn[2][64] = {};
+};
+
+inline step_attacks build_step_attacks () {
+  static const int knight[8][2] = { {1, 2}, {2, 1}, {2, -1}, {1, -2}, {-1, -2}, {-2, -1}, {-2, 1}, {-1, 2} };
+  static const int king[8][2] = { {0, 1}, {1, 1}, {1, 0}, {1, -1}, {0, -1}, {-1, -1}, {-1, 0}, {-1, 1} };
+  step_attacks out;
+  for (int square = 0; square < 64; ++square) {
+    int col = square % 8;
+    int row = square / 8;
+    auto add = [&](uint64_t& set, int dcol, int drow) {
+      if (col + dcol >= 0 && col + dcol < 8 && row + drow >= 0 && row + drow < 8) {
+        set |= (uint64_t)1 << ((row + drow) * 8 + col + dcol);
+      }
+    };
+    for (int i = 0; i < 8; ++i) {
+      add(out.knight[square], knight[i][0], knight[i][1]);
+      add(out.king[square], king[i][0], king[i][1]);
+    }
+    for (int dcol : { -1, 1 }) {
+      add(out.pawn[0][square], dcol, 1);
+      add(out.pawn[1][square], dcol, -1);
+    }
+  }
+  return out;
+}
+
+inline const step_attacks steps = build_step_attacks();
+
+//whether color attacks square
+inline bool attacked (
+  const board& b,
+  int square,
+  int color,
+  uint64_t occupied
+) {
+  const uint64_t* p = b.pieces[color];
+  uint8_t position = square + 1;
+  return (steps.knight[square] & p[SYZYGY_KNIGHT]) || (steps.king[square] & p[SYZYGY_KING]) ||
+    (steps.pawn[!color][square] & p[SYZYGY_PAWN]) ||
+    (rules::rook_attacks(position, occupied) & (p[SYZYGY_ROOK] | p[SYZYGY_QUEEN])) ||
+    (rules::bishop_attacks(position, occupied) & (p[SYZYGY_BISHOP] | p[SYZYGY_QUEEN]));
+}
+
+inline bool in_check (
+  const board& b
+) {
+  int color = b.black_to_move;
+  return b.pieces[color][SYZYGY_KING] != 0 &&
+    attacked(b, __builtin_ctzll(b.pieces[color][SYZYGY_KING]), !color, b.occupied());
+}
+
+struct move {
+  uint8_t from;
+  uint8_t to;
+  uint8_t promotion;   //piece type, or 0
+};
+
+#define SYZYGY_MAX_MOVES 256
+
+inline board make_move (
+  const board& b,
+  const move& m
+) {
+  board out = b;
+  uint8_t piece = b.piece_on(m.from);
+  uint8_t captured = b.piece_on(m.to);
+  if (captured != 0) {
+    out.remove(m.to, captured);
+  }
+  out.remove(m.from, piece);
+  out.put(m.to, m.promotion ? (piece & 8) | m.promotion : piece);
+  out.black_to_move ^= 1;
+  return out;
+}
+
+inline bool is_capture (const board& b, const move& m) {
+  return b.pieces[!b.black_to_move][0] & ((uint64_t)1 << m.to);
+}
+
+//captures and pawn moves reset the fifty move count
+inline bool is_zeroing (const board& b, const move& m) {
+  return is_capture(b, m) || (b.pieces[b.black_to_move][SYZYGY_PAWN] & ((uint64_t)1 << m.from));
+}
+
+/* *
+ * legal_moves
+ *  fills list with the legal moves of the side to move, and returns how many there are
+ * */
+inline int legal_moves (
+  const board& b,
+  move* list
+) {
+  int color = b.black_to_move;
+  uint64_t own = b.pieces[color][0];
+  uint64_t enemy = b.pieces[!color][0];
+  uint64_t occupied = own | enemy;
+  int count = 0;
+  auto add = [&](int from, int to, uint8_t promotion) {
+    move m { (uint8_t)from, (uint8_t)to, promotion };
+    board after = make_move(b, m);
+    after.black_to_move = color;
+    if (!in_check(after)) {
+      list[count++] = m;
+    }
+  };
+
+  for (uint64_t set = own; set; set &= set - 1) {
+    int from = __builtin_ctzll(set);
+    uint64_t bit = (uint64_t)1 << from;
+    uint8_t position = from + 1;
+    uint64_t targets = 0;
+    if (b.pieces[color][SYZYGY_PAWN] & bit) {
+      int forward = color ? -8 : 8;
+      targets = steps.pawn[color][from] & enemy;
+      if (!(occupied & ((uint64_t)1 << (from + forward)))) {
+        targets |= (uint64_t)1 << (from + forward);
+        int start_row = color ? 6 : 1;
+        if (from / 8 == start_row && !(occupied & ((uint64_t)1 << (from + 2 * forward)))) {
+          targets |= (uint64_t)1 << (from + 2 * forward);
+        }
+      }
+      for (; targets; targets &= targets - 1) {
+        int to = __builtin_ctzll(targets);
+        if (to / 8 == (color ? 0 : 7)) {
+          for (uint8_t promotion : { SYZYGY_QUEEN, SYZYGY_ROOK, SYZYGY_BISHOP, SYZYGY_KNIGHT }) {
+            add(from, to, promotion);
+          }
+        } else {
+          add(from, to, 0);
+        }
+      }
+      continue;
+    }
+    if (b.pieces[color][SYZYGY_KNIGHT] & bit) { targets = steps.knight[from]; }
+    else if (b.pieces[color][SYZYGY_KING] & bit) { targets = steps.king[from]; }
+    else {
+      if (b.pieces[color][SYZYGY_ROOK] & bit) { targets = rules::rook_attacks(position, occupied); }
+      if (b.pieces[color][SYZYGY_BISHOP] & bit) { targets = rules::bishop_attacks(position, occupied); }
+      if (b.pieces[color][SYZYGY_QUEEN] & bit) {
+        targets = rules::rook_attacks(position, occupied) | rules::bishop_attacks(position, occupied);
+      }
+    }
+    for (targets &= ~own; targets; targets &= targets - 1) {
+      add(from, __builtin_ctzll(targets), 0);
+    }
+  }
+  return count;
+}
+
+/* *
+ * from_state
+ *  the standard chess position of a contract game, or false with the reason in why if it has none the tables could
+ *  answer: a king is gone, two pieces share a square, a pawn stands on the first or last rank, the side not to move is in
+ *  check (standard chess forbids kings side by side), a side can still castle, or there are more than SYZYGY_MAX_PIECES
+ *  pieces.  Promoted pawns count as
+ *  the piece they became; the contract's en passant never captures, so it is ignored.
+ * */
+inline bool from_state (
+  const rules::game_state& state,
+  board& out,
+  std::string& why
+) {
+  out = board();
+  out.black_to_move = state.move_count % 2;
+  static const uint8_t types[] = { SYZYGY_KING, SYZYGY_QUEEN, SYZYGY_BISHOP, SYZYGY_KNIGHT, SYZYGY_ROOK, SYZYGY_PAWN };
+  for (uint8_t piece_id = 0; piece_id < 32; ++piece_id) {
+    uint8_t position = state.piece_positions[piece_id];
+    if (position == 0 || position > 64) {
+      continue;
+    }
+    if (out.occupied() & ((uint64_t)1 << (position - 1))) {
+      why = "two pieces on one square";
+      return false;
+    }
+    uint8_t type = types[rules::piece_type(piece_id, state.promoted_pawns, state.promoted_pawn_types)];
+    out.put(position - 1, (piece_id >= 16) * 8 + type);
+  }
+
+  if (__builtin_popcountll(out.pieces[0][SYZYGY_KING]) != 1 || __builtin_popcountll(out.pieces[1][SYZYGY_KING]) != 1) {
+    why = "a king is missing";
+    return false;
+  }
+  if ((out.pieces[0][SYZYGY_PAWN] | out.pieces[1][SYZYGY_PAWN]) & 0xFF000000000000FFULL) {
+    why = "a pawn on the first or last rank";
+    return false;
+  }
+  if (out.piece_count() > SYZYGY_MAX_PIECES) {
+    why = std::to_string(out.piece_count()) + " pieces";
+    return false;
+  }
+  //the king and a rook on their starting squares, with the right to castle
+  static const struct { uint8_t flag; uint8_t king; uint8_t rook; uint8_t king_at; uint8_t rook_at; } castles[] = {
+    { W_CAS_K, 0, 6, 4, 1 }, { W_CAS_Q, 0, 7, 4, 8 }, { B_CAS_K, 16, 22, 60, 57 }, { B_CAS_Q, 16, 23, 60, 64 },
+  };
+  for (auto& c : castles) {
+    if (!(state.castle & c.flag) && state.piece_positions[c.king] == c.king_at && state.piece_positions[c.rook] == c.rook_at) {
+      why = "castling is still possible";
+      return false;
+    }
+  }
+  board other = out;
+  other.black_to_move ^= 1;
+  if (in_check(other)) {
+    why = "the side not to move is in check";
+    return false;
+  }
+  return true;
+}
+
+/* *
+ * encoding
+ *  the tables the position encoding is built from, as the generator defines them.  Squares here are numbered as the
+ *  table files number them (a1 = 0, h1 = 7).
+ * */
+struct encoding {
+  int map_pawns[64] = {};          //a2-h7 to 0..47, higher toward the edges and lower ranks
+  int map_b1h1h7[64] = {};         //squares below the a1-h8 diagonal to 0..27
+  int map_a1d1d4[64] = {};         //the a1-d1-d4 triangle to 0..9, diagonal squares last
+  int map_kk[10][64] = {};         //the 462 placements of two kings with the first in the triangle
+  uint64_t binomial[6][64] = {};   //binomial[k][n] ways to choose k of n
+  uint64_t lead_pawn_idx[6][64] = {};
+  uint64_t lead_pawns_size[6][4] = {};
+};
+
+inline int off_diagonal (int square) { return (square >> 3) - (square & 7); }
+
+inline encoding build_encoding () {
+  encoding e;
+  int code = 0;
+  for (int s = 0; s < 64; ++s) {
+    if (off_diagonal(s) < 0) {
+      e.map_b1h1h7[s] = code++;
+    }
+  }
+
+  std::vector<int> diagonal;
+  code = 0;
+  for (int s = 0; s <= 27; ++s) {
+    if (off_diagonal(s) < 0 && (s & 7) <= 3) {
+      e.map_a1d1d4[s] = code++;
+    } else if (off_diagonal(s) == 0 && (s & 7) <= 3) {
+      diagonal.push_back(s);
+    }
+  }
+  for (int s : diagonal) {
+    e.map_a1d1d4[s] = code++;
+  }
+
+  //kings that touch are illegal; with the first king on the diagonal, the second is kept on or below it
+  std::vector<std::pair<int, int>> both_on_diagonal;
+  code = 0;
+  for (int idx = 0; idx < 10; ++idx) {
+    for (int s1 = 0; s1 <= 27; ++s1) {
+      if (e.map_a1d1d4[s1] != idx || (idx == 0 && s1 != 1)) {
+        continue;
+      }
+      for (int s2 = 0; s2 < 64; ++s2) {
+        int dr = (s1 >> 3) - (s2 >> 3);
+        int df = (s1 & 7) - (s2 & 7);
+        if (dr >= -1 && dr <= 1 && df >= -1 && df <= 1) {
+          continue;
+        } else if (off_diagonal(s1) == 0 && off_diagonal(s2) > 0) {
+          continue;
+        } else if (off_diagonal(s1) == 0 && off_diagonal(s2) == 0) {
+          both_on_diagonal.emplace_back(idx, s2);
+        } else {
+          e.map_kk[idx][s2] = code++;
+        }
+      }
+    }
+  }
+  for (auto& p : both_on_diagonal) {
+    e.map_kk[p.first][p.second] = code++;
+  }
+
+  e.binomial[0][0] = 1;
+  for (int n = 1; n < 64; ++n) {
+    for (int k = 0; k < 6 && k <= n; ++k) {
+      e.binomial[k][n] = (k > 0 ? e.binomial[k - 1][n - 1] : 0) + (k < n ? e.binomial[k][n - 1] : 0);
+    }
+  }
+
+  int available = 47;
+  for (int lead = 1; lead <= 5; ++lead) {
+    for (int file = 0; file <= 3; ++file) {
+      uint64_t idx = 0;
+      for (int rank = 1; rank <= 6; ++rank) {
+        int s = rank * 8 + file;
+        if (lead == 1) {
+          e.map_pawns[s] = available--;
+          e.map_pawns[s ^ 7] = available--;
+        }
+        e.lead_pawn_idx[lead][s] = idx;
+        idx += e.binomial[lead - 1][e.map_pawns[s]];
+      }
+      e.lead_pawns_size[lead][file] = idx;
+    }
+  }
+  return e;
+}
+
+inline const encoding& encoding_tables () {
+  static const encoding e = build_encoding();
+  return e;
+}
+
+/* *
+ * pairs_data
+ *  one part of a table: the values of one side to move (and one leading pawn file), Huffman coded in blocks
+ * */
+struct pairs_data {
+  uint8_t flags = 0;
+  uint64_t block_size = 0;
+  uint64_t span = 0;              //one sparse index entry every span values
+  uint32_t block_count = 0;
+  int max_sym_len = 0;
+  int min_sym_len = 0;            //the value itself, for single value parts
+  const uint8_t* lowest_sym = nullptr;
+  const uint8_t* btree = nullptr;
+  const uint8_t* block_length = nullptr;
+  uint64_t block_length_count = 0;
+  const uint8_t* sparse_index = nullptr;
+  uint64_t sparse_index_count = 0;
+  const uint8_t* data = nullptr;
+  std::vector<uint64_t> base64;
+  std::vector<uint8_t> symlen;
+  uint8_t pieces[SYZYGY_MAX_PIECES] = {};
+  uint64_t group_idx[SYZYGY_MAX_PIECES + 1] = {};
+  int group_len[SYZYGY_MAX_PIECES + 1] = {};
+  uint16_t map_idx[4] = {};       //dtz value maps of win, loss, cursed win and blessed loss
+};
+
+#define SYZYGY_STM          1
+#define SYZYGY_MAPPED       2
+#define SYZYGY_WIN_PLIES    4
+#define SYZYGY_LOSS_PLIES   8
+#define SYZYGY_WIDE         16
+#define SYZYGY_SINGLE_VALUE 128
+
+inline uint16_t read16 (const uint8_t* p) { uint16_t v; std::memcpy(&v, p, 2); return v; }
+inline uint32_t read32 (const uint8_t* p) { uint32_t v; std::memcpy(&v, p, 4); return v; }
+inline uint32_t read32_be (const uint8_t* p) { return __builtin_bswap32(read32(p)); }
+inline uint64_t read64_be (const uint8_t* p) { uint64_t v; std::memcpy(&v, p, 8); return __builtin_bswap64(v); }
+
+//the left and right symbols a pair symbol expands to, 12 bits each in 3 bytes
+inline int sym_left (const pairs_data& d, int sym) {
+  const uint8_t* lr = d.btree + 3 * sym;
+  return ((lr[1] & 0xF) << 8) | lr[0];
+}
+
+inline int sym_right (const pairs_data& d, int sym) {
+  const uint8_t* lr = d.btree + 3 * sym;
+  return (lr[2] << 4) | (lr[1] >> 4);
+}
+
+/* *
+ * table
+ *  one mapped table file.  The name ("KRPvKR") tells the material of the side the table calls white, then the other.
+ * */
+struct table {
+  std::string path;
+  std::string name;
+  bool dtz = false;
+  int piece_count = 0;
+  bool has_pawns = false;
+  bool unique_pieces = false;   //a side has exactly one of some piece other than the king
+  bool symmetric = false;       //both sides have the same material
+  int pawn_count[2] = {};       //the leading color's pawns, then the other's
+  bool mapped = false;
+  const uint8_t* file = nullptr;
+  size_t size = 0;
+  const uint8_t* dtz_map = nullptr;
+  pairs_data items[2][4];
+
+  table (const std::string& path, const std::string& name, bool dtz) : path(path), name(name), dtz(dtz) {
+    std::string white = name.substr(0, name.find('v'));
+    std::string black = name.substr(name.find('v') + 1);
+    piece_count = white.size() + black.size();
+    has_pawns = name.find('P') != std::string::npos;
+    symmetric = white == black;
+    for (const std::string& side : { white, black }) {
+      for (char piece : std::string("QRBNP")) {
+        unique_pieces |= std::count(side.begin(), side.end(), piece) == 1;
+      }
+    }
+    int white_pawns = std::count(white.begin(), white.end(), 'P');
+    int black_pawns = std::count(black.begin(), black.end(), 'P');
+    //the side with fewer pawns leads, which compresses better
+    bool white_leads = black_pawns == 0 || (white_pawns != 0 && black_pawns >= white_pawns);
+    pawn_count[0] = white_leads ? white_pawns : black_pawns;
+    pawn_count[1] = white_leads ? black_pawns : white_pawns;
+  }
+
+  ~table () {
+    if (file != nullptr) {
+      munmap((void*)file, size);
+    }
+  }
+
+  table (const table&) = delete;
+  table& operator= (const table&) = delete;
+
+  pairs_data& get (int stm, int file_index) {
+    return items[dtz ? 0 : stm][has_pawns ? file_index : 0];
+  }
+
+  /* *
+   * map
+   *  maps the file and reads its layout.  Throws std::runtime_error if the file isn't a table of its name.
+   * */
+  void map () {
+    mapped = true;
+    int fd = ::open(path.c_str(), O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0) {
+      if (fd >= 0) { ::close(fd); }
+      throw std::runtime_error("syzygy: unable to open " + path);
+    }
+    size = st.st_size;
+    if (size % 64 == 16) {
+      file = (const uint8_t*)mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    }
+    ::close(fd);
+    if (file == nullptr || file == MAP_FAILED) {
+      file = nullptr;
+      throw std::runtime_error("syzygy: " + path + " is not a table file");
+    }
+    static const uint8_t magics[2][4] = { { 0x71, 0xE8, 0x23, 0x5D }, { 0xD7, 0x66, 0x0C, 0xA5 } };
+    if (std::memcmp(file, magics[dtz], 4) != 0 || (bool)(file[4] & 2) != has_pawns || (bool)(file[4] & 1) == symmetric) {
+      throw std::runtime_error("syzygy: " + path + " is not a table of " + name);
+    }
+    madvise((void*)file, size, MADV_RANDOM);
+    read_layout(file + 5);
+  }
+
+  private:
+    void read_layout (const uint8_t* data) {
+      int sides = !dtz && !symmetric ? 2 : 1;
+      int max_file = has_pawns ? 3 : 0;
+      bool both_pawns = has_pawns && pawn_count[1] != 0;
+
+      for (int f = 0; f <= max_file; ++f) {
+        int order[2][2] = {
+          { data[0] & 0xF, both_pawns ? data[1] & 0xF : 0xF },
+          { data[0] >> 4, both_pawns ? data[1] >> 4 : 0xF },
+        };
+        data += 1 + both_pawns;
+        for (int k = 0; k < piece_count; ++k, ++data) {
+          for (int i = 0; i < sides; ++i) {
+            get(i, f).pieces[k] = i ? *data >> 4 : *data & 0xF;
+          }
+        }
+        for (int i = 0; i < sides; ++i) {
+          set_groups(get(i, f), order[i], f);
+        }
+      }
+      data += (data - file) & 1;
+
+      for (int f = 0; f <= max_file; ++f) {
+        for (int i = 0; i < sides; ++i) {
+          data = set_sizes(get(i, f), data);
+        }
+      }
+      if (dtz) {
+        data = set_dtz_map(data, max_file);
+      }
+      for (int f = 0; f <= max_file; ++f) {
+        for (int i = 0; i < sides; ++i) {
+          get(i, f).sparse_index = data;
+          data += get(i, f).sparse_index_count * 6;
+        }
+      }
+      for (int f = 0; f <= max_file; ++f) {
+        for (int i = 0; i < sides; ++i) {
+          get(i, f).block_length = data;
+          data += get(i, f).block_length_count * 2;
+        }
+      }
+      for (int f = 0; f <= max_file; ++f) {
+        for (int i = 0; i < sides; ++i) {
+          pairs_data& d = get(i, f);
+          data = file + (((data - file) + 0x3F) & ~(size_t)0x3F);
+          d.data = data;
+          data += d.block_count * d.block_size;
+          if (d.block_count != 0 && data > file + size) {
+            throw std::runtime_error("syzygy: " + path + " is truncated");
+          }
+        }
+      }
+    }
+
+    /* *
+     * set_groups
+     *  splits the pieces into the groups that are encoded together - the leading pieces or pawns, the other side's pawns,
+     *  then each run of like pieces - and works out each group's multiplier in the index, in the table's order
+     * */
+    void set_groups (
+      pairs_data& d,
+      const int order[2],
+      int f
+    ) {
+      const encoding& e = encoding_tables();
+      int n = 0;
+      int first_len = has_pawns ? 0 : unique_pieces ? 3 : 2;
+      d.group_len[n] = 1;
+      for (int i = 1; i < piece_count; ++i) {
+        if (--first_len > 0 || d.pieces[i] == d.pieces[i - 1]) {
+          d.group_len[n]++;
+        } else {
+          d.group_len[++n] = 1;
+        }
+      }
+      d.group_len[++n] = 0;
+
+      bool both_pawns = has_pawns && pawn_count[1] != 0;
+      int next = both_pawns ? 2 : 1;
+      int free_squares = 64 - d.group_len[0] - (both_pawns ? d.group_len[1] : 0);
+      uint64_t idx = 1;
+      for (int k = 0; next < n || k == order[0] || k == order[1]; ++k) {
+        if (k == order[0]) {
+          d.group_idx[0] = idx;
+          idx *= has_pawns ? e.lead_pawns_size[d.group_len[0]][f] : unique_pieces ? 31332 : 462;
+        } else if (k == order[1]) {
+          d.group_idx[1] = idx;
+          idx *= e.binomial[d.group_len[1]][48 - d.group_len[0]];
+        } else {
+          d.group_idx[next] = idx;
+          idx *= e.binomial[d.group_len[next]][free_squares];
+          free_squares -= d.group_len[next++];
+        }
+      }
+      d.group_idx[n] = idx;
+    }
+
+    //the number of values (less one) each symbol stands for, following pairs down the tree
+    static uint8_t set_symlen (
+      pairs_data& d,
+      int sym,
+      std::vector<bool>& visited
+    ) {
+      visited[sym] = true;
+      int right = sym_right(d, sym);
+      if (right == 0xFFF) {
+        return 0;
+      }
+      int left = sym_left(d, sym);
+      if (!visited[left]) {
+        d.symlen[left] = set_symlen(d, left, visited);
+      }
+      if (!visited[right]) {
+        d.symlen[right] = set_symlen(d, right, visited);
+      }
+      return d.symlen[left] + d.symlen[right] + 1;
+    }
+
+    const uint8_t* set_sizes (
+      pairs_data& d,
+      const uint8_t* data
+    ) {
+      d.flags = *data++;
+      if (d.flags & SYZYGY_SINGLE_VALUE) {
+        d.min_sym_len = *data++;
+        return data;
+      }
+
+      int groups = 0;
+      while (d.group_len[groups] != 0) {
+        ++groups;
+      }
+      uint64_t table_size = d.group_idx[groups];
+
+      d.block_size = (uint64_t)1 << *data++;
+      d.span = (uint64_t)1 << *data++;
+      d.sparse_index_count = (table_size + d.span - 1) / d.span;
+      uint8_t padding = *data++;
+      d.block_count = read32(data);
+      data += 4;
+      d.block_length_count = (uint64_t)d.block_count + padding;
+      d.max_sym_len = *data++;
+      d.min_sym_len = *data++;
+      d.lowest_sym = data;
+      if (d.max_sym_len < d.min_sym_len || d.max_sym_len > 32) {
+        throw std::runtime_error("syzygy: " + path + " has a bad symbol length");
+      }
+
+      //canonical Huffman codes: the lowest code of each length, left aligned in 64 bits
+      d.base64.assign(d.max_sym_len - d.min_sym_len + 1, 0);
+      for (int i = (int)d.base64.size() - 2; i >= 0; --i) {
+        d.base64[i] = (d.base64[i + 1] + read16(d.lowest_sym + 2 * i) - read16(d.lowest_sym + 2 * (i + 1))) / 2;
+      }
+      for (size_t i = 0; i < d.base64.size(); ++i) {
+        d.base64[i] <<= 64 - i - d.min_sym_len;
+      }
+      data += d.base64.size() * 2;
+
+      d.symlen.assign(read16(data), 0);
+      data += 2;
+      d.btree = data;
+      std::vector<bool> visited(d.symlen.size());
+      for (size_t sym = 0; sym < d.symlen.size(); ++sym) {
+        if (!visited[sym]) {
+          d.symlen[sym] = set_symlen(d, sym, visited);
+        }
+      }
+      return data + d.symlen.size() * 3 + (d.symlen.size() & 1);
+    }
+
+    //dtz values can be stored through a per-result map, of bytes or (wide) 16 bit words
+    const uint8_t* set_dtz_map (
+      const uint8_t* data,
+      int max_file
+    ) {
+      dtz_map = data;
+      for (int f = 0; f <= max_file; ++f) {
+        pairs_data& d = get(0, f);
+        if (!(d.flags & SYZYGY_MAPPED)) {
+          continue;
+        }
+        if (d.flags & SYZYGY_WIDE) {
+          data += (data - file) & 1;
+          for (int i = 0; i < 4; ++i) {
+            d.map_idx[i] = (data - dtz_map) / 2 + 1;
+            data += 2 * read16(data) + 2;
+          }
+        } else {
+          for (int i = 0; i < 4; ++i) {
+            d.map_idx[i] = data - dtz_map + 1;
+            data += *data + 1;
+          }
+        }
+      }
+      return data + ((data - file) & 1);
+    }
+};
+
+/* *
+ * decompress
+ *  the value at idx of a part: find the block through the sparse index, then walk its symbols
+ * */
+inline int decompress (
+  const pairs_data& d,
+  uint64_t idx
+) {
+  if (d.flags & SYZYGY_SINGLE_VALUE) {
+    return d.min_sym_len;
+  }
+
+  const uint8_t* entry = d.sparse_index + 6 * (idx / d.span);
+  uint32_t block = read32(entry);
+  int offset = read16(entry + 4);
+  offset += (int)(idx % d.span) - (int)(d.span / 2);
+  while (offset < 0) {
+    offset += read16(d.block_length + 2 * --block) + 1;
+  }
+  while (offset > read16(d.block_length + 2 * block)) {
+    offset -= read16(d.block_length + 2 * block++) + 1;
+  }
+
+  const uint8_t* ptr = d.data + (uint64_t)block * d.block_size;
+  uint64_t buf64 = read64_be(ptr);
+  ptr += 8;
+  int buf64_size = 64;
+  int sym;
+  while (true) {
+    int len = 0;
+    while (buf64 < d.base64[len]) {
+      ++len;
+    }
+    sym = (int)((buf64 - d.base64[len]) >> (64 - len - d.min_sym_len));
+    sym += read16(d.lowest_sym + 2 * len);
+    if (offset < d.symlen[sym] + 1) {
+      break;
+    }
+    offset -= d.symlen[sym] + 1;
+    len += d.min_sym_len;
+    buf64 <<= len;
+    buf64_size -= len;
+    if (buf64_size <= 32) {
+      buf64_size += 32;
+      buf64 |= (uint64_t)read32_be(ptr) << (64 - buf64_size);
+      ptr += 4;
+    }
+  }
+
+  while (d.symlen[sym] != 0) {
+    int left = sym_left(d, sym);
+    if (offset < d.symlen[left] + 1) {
+      sym = left;
+    } else {
+      offset -= d.symlen[left] + 1;
+      sym = sym_right(d, sym);
+    }
+  }
+  return sym_left(d, sym);
+}
+
+/* *
+ * tablebase
+ *  the tables found in a list of directories (separated by ':'), probed by material.  Files are mapped on first use.
+ * */
+class tablebase {
+  public:
+    tablebase (const std::string& paths) {
+      size_t start = 0;
+      while (start <= paths.size()) {
+        size_t end = paths.find(':', start);
+        if (end == std::string::npos) {
+          end = paths.size();
+        }
+        scan(paths.substr(start, end - start));
+        start = end + 1;
+      }
+    }
+
+    //the most pieces of any table found, or 0
+    int largest () const { return largest_pieces; }
+
+    size_t wdl_count () const { return wdl_tables.size(); }
+    size_t dtz_count () const { return dtz_tables.size(); }
+
+    /* *
+     * probe_wdl
+     *  the value of b for the side to move.  state is PROBE_FAIL if a table it needs is missing.  Captures are searched
+     *  first, since the tables don't store a position's value where a capture is the best move.
+     * */
+    wdl_score probe_wdl (
+      const board& b,
+      probe_state& state
+    ) {
+      state = PROBE_OK;
+      return search(b, state, false);
+    }
+
+    /* *
+     * probe_dtz
+     *  the plies to the next capture or pawn move in the best line, signed like the result: positive when the side to
+     *  move wins, negative when it loses, 0 for a draw.  Wins and losses that need more than 50 moves come out beyond
+     *  +-100.  state is PROBE_FAIL if a table it needs is missing.
+     * */
+    int probe_dtz (
+      const board& b,
+      probe_state& state
+    ) {
+      state = PROBE_OK;
+      wdl_score wdl = search(b, state, true);
+      if (state == PROBE_FAIL || wdl == WDL_DRAW) {
+        return 0;
+      }
+      if (state == PROBE_ZEROING) {
+        return before_zeroing(wdl);
+      }
+
+      int dtz = probe_table(b, state, true, wdl);
+      if (state == PROBE_FAIL) {
+        return 0;
+      }
+      if (state != PROBE_CHANGE_STM) {
+        return (dtz + 100 * (wdl == WDL_BLESSED_LOSS || wdl == WDL_CURSED_WIN)) * sign(wdl);
+      }
+
+      //the table has the other side to move: take the best reply
+      int best = 0xFFFF;
+      move moves[SYZYGY_MAX_MOVES];
+      int count = legal_moves(b, moves);
+      for (int i = 0; i < count; ++i) {
+        bool zeroing = is_zeroing(b, moves[i]);
+        board after = make_move(b, moves[i]);
+        dtz = zeroing ? -before_zeroing(search(after, state, false)) : -probe_dtz(after, state);
+        if (state == PROBE_FAIL) {
+          return 0;
+        }
+        move replies[SYZYGY_MAX_MOVES];
+        if (dtz == 1 && in_check(after) && legal_moves(after, replies) == 0) {
+          best = 1;
+        }
+        if (!zeroing) {
+          dtz += sign(dtz);
+        }
+        if (dtz < best && sign(dtz) == sign(wdl)) {
+          best = dtz;
+        }
+      }
+      return best == 0xFFFF ? -1 : best;
+    }
+
+  private:
+    std::map<std::string, std::unique_ptr<table>> wdl_tables;
+    std::map<std::string, std::unique_ptr<table>> dtz_tables;
+    int largest_pieces = 0;
+
+    static int sign (int value) { return (value > 0) - (value < 0); }
+
+    //the dtz of a position whose best move is a capture or pawn move with value wdl
+    static int before_zeroing (wdl_score wdl) {
+      switch (wdl) {
+        case WDL_WIN : return 1;
+        case WDL_CURSED_WIN : return 101;
+        case WDL_BLESSED_LOSS : return -101;
+        case WDL_LOSS : return -1;
+        default : return 0;
+      }
+    }
+
+    void scan (
+      const std::string& directory
+    ) {
+      if (directory.empty()) {
+        return;
+      }
+      DIR* dir = opendir(directory.c_str());
+      if (dir == nullptr) {
+        throw std::runtime_error("syzygy: unable to open " + directory);
+      }
+      while (dirent* entry = readdir(dir)) {
+        std::string filename = entry->d_name;
+        size_t dot = filename.rfind('.');
+        if (dot == std::string::npos) {
+          continue;
+        }
+        std::string name = filename.substr(0, dot);
+        std::string extension = filename.substr(dot);
+        if ((extension != ".rtbw" && extension != ".rtbz") || !valid_name(name)) {
+          continue;
+        }
+        bool dtz = extension == ".rtbz";
+        auto& tables = dtz ? dtz_tables : wdl_tables;
+        if (tables.count(name) == 0) {
+          tables[name].reset(new table(directory + "/" + filename, name, dtz));
+          largest_pieces = std::max(largest_pieces, (int)name.size() - 1);
+        }
+      }
+      closedir(dir);
+    }
+
+    //"K...vK..." with at most SYZYGY_MAX_PIECES pieces
+    static bool valid_name (
+      const std::string& name
+    ) {
+      size_t v = name.find('v');
+      if (v == std::string::npos || name.size() - 1 > SYZYGY_MAX_PIECES || name[0] != 'K' || name[v + 1] != 'K') {
+        return false;
+      }
+      return name.find_first_not_of("KQRBNPv") == std::string::npos && name.find('v', v + 1) == std::string::npos;
+    }
+
+    /* *
+     * search
+     *  the value of b, trying captures (and, for dtz, pawn moves) before the table: a table's value is wrong where the
+     *  best move zeroes the count.  state becomes PROBE_ZEROING when a zeroing move is best.
+     * */
+    wdl_score search (
+      const board& b,
+      probe_state& state,
+      bool check_zeroing
+    ) {
+      wdl_score best = WDL_LOSS;
+      move moves[SYZYGY_MAX_MOVES];
+      int count = legal_moves(b, moves);
+      int tried = 0;
+      for (int i = 0; i < count; ++i) {
+        if (!is_capture(b, moves[i]) && (!check_zeroing || !is_zeroing(b, moves[i]))) {
+          continue;
+        }
+        ++tried;
+        wdl_score value = (wdl_score)-search(make_move(b, moves[i]), state, false);
+        if (state == PROBE_FAIL) {
+          return WDL_DRAW;
+        }
+        if (value > best) {
+          best = value;
+          if (value >= WDL_WIN) {
+            state = PROBE_ZEROING;
+            return value;
+          }
+        }
+      }
+
+      //with every move tried, the table isn't needed
+      bool all_tried = tried != 0 && tried == count;
+      wdl_score value = best;
+      if (!all_tried) {
+        value = (wdl_score)probe_table(b, state, false, WDL_DRAW);
+        if (state == PROBE_FAIL) {
+          return WDL_DRAW;
+        }
+      }
+      if (best >= value) {
+        state = best > WDL_DRAW || all_tried ? PROBE_ZEROING : PROBE_OK;
+        return best;
+      }
+      state = PROBE_OK;
+      return value;
+    }
+
+    //the table of b's material, mapped; nullptr if there is none.  black_stronger is set if it has black's as white's.
+    table* find_table (
+      const board& b,
+      bool dtz,
+      bool& black_stronger
+    ) {
+      auto& tables = dtz ? dtz_tables : wdl_tables;
+      std::string white = b.material(0);
+      std::string black = b.material(1);
+      black_stronger = false;
+      auto found = tables.find(white + "v" + black);
+      if (found == tables.end()) {
+        black_stronger = true;
+        found = tables.find(black + "v" + white);
+      }
+      if (found == tables.end()) {
+        return nullptr;
+      }
+      if (!found->second->mapped) {
+        found->second->map();
+      }
+      return found->second.get();
+    }
+
+    /* *
+     * probe_table
+     *  the stored value of b: a wdl_score, or for dtz the distance for the result wdl.  For dtz, state becomes
+     *  PROBE_CHANGE_STM if the table only has the other side to move.
+     * */
+    int probe_table (
+      const board& b,
+      probe_state& state,
+      bool dtz,
+      wdl_score wdl
+    ) {
+      if (b.piece_count() == 2) {
+        return WDL_DRAW;
+      }
+      bool black_stronger;
+      table* t = find_table(b, dtz, black_stronger);
+      if (t == nullptr || t->file == nullptr) {
+        state = PROBE_FAIL;
+        return 0;
+      }
+      const encoding& e = encoding_tables();
+
+      //tables are of white to move, or the stronger side as white: flip colors and ranks to match
+      bool symmetric_black_to_move = t->symmetric && b.black_to_move;
+      bool flip = symmetric_black_to_move || (!t->symmetric && black_stronger);
+      int flip_color = flip * 8;
+      int flip_squares = flip * 56;
+      int stm = flip ^ b.black_to_move;
+
+      int squares[SYZYGY_MAX_PIECES];
+      uint8_t pieces[SYZYGY_MAX_PIECES];
+      int size = 0;
+      int lead_pawns_count = 0;
+      uint64_t lead_pawns = 0;
+      int tb_file = 0;
+      auto by_map_pawns = [&](int a, int c) { return e.map_pawns[a] < e.map_pawns[c]; };
+
+      //with pawns, the parts are split by the file of the leading pawn: the one nearest an edge, then the lowest
+      if (t->has_pawns) {
+        uint8_t pawn = t->get(0, 0).pieces[0] ^ flip_color;
+        lead_pawns = b.pieces[pawn >> 3][SYZYGY_PAWN];
+        for (uint64_t set = lead_pawns; set; set &= set - 1) {
+          squares[size++] = (__builtin_ctzll(set) ^ 7) ^ flip_squares;
+        }
+        lead_pawns_count = size;
+        std::swap(squares[0], *std::max_element(squares, squares + size, by_map_pawns));
+        int file = squares[0] & 7;
+        tb_file = file > 3 ? 7 - file : file;
+      }
+
+      if (dtz) {
+        int flags = t->get(stm, tb_file).flags;
+        if ((flags & SYZYGY_STM) != stm && !(t->symmetric && !t->has_pawns)) {
+          state = PROBE_CHANGE_STM;
+          return 0;
+        }
+      }
+
+      for (uint64_t set = b.occupied() & ~lead_pawns; set; set &= set - 1) {
+        int square = __builtin_ctzll(set);
+        squares[size] = (square ^ 7) ^ flip_squares;
+        pieces[size++] = b.piece_on(square) ^ flip_color;
+      }
+
+      //order the pieces as the table does
+      const pairs_data& d = t->get(stm, tb_file);
+      for (int i = lead_pawns_count; i < size - 1; ++i) {
+        for (int j = i + 1; j < size; ++j) {
+          if (d.pieces[i] == pieces[j]) {
+            std::swap(pieces[i], pieces[j]);
+            std::swap(squares[i], squares[j]);
+            break;
+          }
+        }
+      }
+
+      //the leading piece goes on the a-d files
+      if ((squares[0] & 7) > 3) {
+        for (int i = 0; i < size; ++i) {
+          squares[i] ^= 7;
+        }
+      }
+
+      uint64_t idx;
+      if (t->has_pawns) {
+        idx = e.lead_pawn_idx[lead_pawns_count][squares[0]];
+        std::stable_sort(squares + 1, squares + lead_pawns_count, by_map_pawns);
+        for (int i = 1; i < lead_pawns_count; ++i) {
+          idx += e.binomial[i][e.map_pawns[squares[i]]];
+        }
+      } else {
+        //without pawns the board can also be turned about its middle rank and the a1-h8 diagonal
+        if ((squares[0] >> 3) > 3) {
+          for (int i = 0; i < size; ++i) {
+            squares[i] ^= 56;
+          }
+        }
+        for (int i = 0; i < d.group_len[0]; ++i) {
+          if (off_diagonal(squares[i]) == 0) {
+            continue;
+          }
+          if (off_diagonal(squares[i]) > 0) {
+            for (int j = i; j < size; ++j) {
+              squares[j] = ((squares[j] >> 3) | (squares[j] << 3)) & 63;
+            }
+          }
+          break;
+        }
+
+        if (t->unique_pieces) {
+          int adjust1 = squares[1] > squares[0];
+          int adjust2 = (squares[2] > squares[0]) + (squares[2] > squares[1]);
+          if (off_diagonal(squares[0])) {
+            idx = ((uint64_t)e.map_a1d1d4[squares[0]] * 63 + (squares[1] - adjust1)) * 62 + squares[2] - adjust2;
+          } else if (off_diagonal(squares[1])) {
+            idx = (6 * 63 + (squares[0] >> 3) * 28 + e.map_b1h1h7[squares[1]]) * 62 + squares[2] - adjust2;
+          } else if (off_diagonal(squares[2])) {
+            idx = 6 * 63 * 62 + 4 * 28 * 62 + (squares[0] >> 3) * 7 * 28 + ((squares[1] >> 3) - adjust1) * 28 +
+              e.map_b1h1h7[squares[2]];
+          } else {
+            idx = 6 * 63 * 62 + 4 * 28 * 62 + 4 * 7 * 28 + (squares[0] >> 3) * 7 * 6 + ((squares[1] >> 3) - adjust1) * 6 +
+              (squares[2] >> 3) - adjust2;
+          }
+        } else {
+          idx = e.map_kk[e.map_a1d1d4[squares[0]]][squares[1]];
+        }
+      }
+
+      //then the other groups, each as a combination of the squares the earlier groups left
+      idx *= d.group_idx[0];
+      int* group = squares + d.group_len[0];
+      bool remaining_pawns = t->has_pawns && t->pawn_count[1] != 0;
+      for (int next = 1; d.group_len[next] != 0; ++next) {
+        std::stable_sort(group, group + d.group_len[next]);
+        uint64_t n = 0;
+        for (int i = 0; i < d.group_len[next]; ++i) {
+          int adjust = std::count_if(squares, group, [&](int s) { return group[i] > s; });
+          n += e.binomial[i + 1][group[i] - adjust - 8 * remaining_pawns];
+        }
+        remaining_pawns = false;
+        idx += n * d.group_idx[next];
+        group += d.group_len[next];
+      }
+
+      int value = decompress(d, idx);
+      if (!dtz) {
+        return value - 2;
+      }
+
+      //dtz: undo the value map, and count in plies
+      static const int map_index[] = { 1, 3, 0, 2, 0 };
+      const pairs_data& first = t->get(0, tb_file);
+      if (first.flags & SYZYGY_MAPPED) {
+        uint16_t at = first.map_idx[map_index[wdl + 2]] + value;
+        value = first.flags & SYZYGY_WIDE ? read16(t->dtz_map + 2 * at) : t->dtz_map[at];
+      }
+      if ((wdl == WDL_WIN && !(first.flags & SYZYGY_WIN_PLIES)) || (wdl == WDL_LOSS && !(first.flags & SYZYGY_LOSS_PLIES)) ||
+        wdl == WDL_CURSED_WIN || wdl == WDL_BLESSED_LOSS) {
+        value *= 2;
+      }
+      return value + 1;
+    }
+};
+
+} // namespace syzygy
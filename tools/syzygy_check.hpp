@@ -0,0 +1,253 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "syzygy.hpp"
+
+/* *
+ * syzygy_check.hpp
+ *  checks syzygy.hpp against results worked out from scratch.  The tables of a king and one piece against a lone king
+ *  (KQvK, KRvK, KBvK and KNvK) are small enough to solve here by retrograde analysis, in standard chess like the
+ *  tables, so every position's value and distance to mate comes from the rules alone.  Probing every legal position
+ *  of a table - with the piece on white's side and, mirrored, on black's - and comparing goes through the whole
+ *  decoder on the real files: the square encoding and its symmetries, the Huffman blocks, the dtz maps and the one ply
+ *  search of a dtz table stored for the other side to move.  A bug in the decoder or a damaged file shows up as wrong
+ *  positions before any verdict from the tables is acted on.
+ * */
+
+namespace syzygy {
+
+struct check_result {
+  std::string material;       //"KRvK"
+  bool found = false;         //the tables have it
+  uint64_t positions = 0;     //legal positions probed, both ways round
+  uint64_t wdl_wrong = 0;
+  uint64_t dtz_checked = 0;   //positions probed against a dtz table; mates and stalemates have no distance to check
+  uint64_t dtz_wrong = 0;
+  std::string first_wrong;    //the first position that came out wrong, and how
+
+  bool passed () const { return found && positions != 0 && wdl_wrong == 0 && dtz_wrong == 0; }
+};
+
+/* *
+ * solved_table
+ *  every position of white king, white piece and black king with the value for the side to move: plies to mate, with
+ *  the sign of the result (positive when the side to move mates, negative when it gets mated, 0 when mated already),
+ *  or draw.  Indexed by black_to_move << 18 | white_king << 12 | black_king << 6 | piece, in board squares.
+ * */
+#define SOLVED_ILLEGAL 0x7F
+#define SOLVED_DRAW    0x7E
+#define SOLVED_UNKNOWN 0x7D
+
+struct solved_table {
+  std::vector<int8_t> plies = std::vector<int8_t>(2 << 18, SOLVED_ILLEGAL);
+
+  static board position (uint32_t index, uint8_t piece) {
+    board b;
+    b.black_to_move = index >> 18;
+    b.put((index >> 12) & 63, SYZYGY_KING);
+    b.put((index >> 6) & 63, 8 | SYZYGY_KING);
+    b.put(index & 63, piece);
+    return b;
+  }
+};
+
+/* *
+ * solve
+ *  works out every position with a white king and piece against the black king, one ply further from mate on each
+ *  pass: a position is won in n plies if some move reaches a position lost in n - 1, and lost in n if every move
+ *  reaches a position won in at most n - 1 and one in exactly that.  What is left when two passes find nothing is a
+ *  draw - a lone king, which is all a capture of the piece leaves, can't mate.
+ * */
+inline solved_table solve (
+  uint8_t piece
+) {
+  solved_table out;
+  const uint32_t draw = 0xFFFFFFFF;
+  std::vector<uint32_t> first_child(out.plies.size() + 1, 0);
+  std::vector<uint32_t> children;
+
+  for (uint32_t index = 0; index < out.plies.size(); ++index) {
+    first_child[index] = children.size();
+    uint8_t white_king = (index >> 12) & 63;
+    uint8_t black_king = (index >> 6) & 63;
+    uint8_t square = index & 63;
+    if (white_king == black_king || white_king == square || black_king == square) {
+      continue;
+    }
+    board b = solved_table::position(index, piece);
+    board other = b;
+    other.black_to_move ^= 1;
+    if (in_check(other)) {
+      continue;
+    }
+
+    move moves[SYZYGY_MAX_MOVES];
+    int count = legal_moves(b, moves);
+    if (count == 0) {
+      out.plies[index] = in_check(b) ? 0 : SOLVED_DRAW;
+      continue;
+    }
+    out.plies[index] = SOLVED_UNKNOWN;
+    for (int i = 0; i < count; ++i) {
+      board after = make_move(b, moves[i]);
+      if (after.piece_count() == 2) {
+        children.push_back(draw);
+        continue;
+      }
+      uint32_t child = after.black_to_move << 18 | __builtin_ctzll(after.pieces[0][SYZYGY_KING]) << 12 |
+        __builtin_ctzll(after.pieces[1][SYZYGY_KING]) << 6 | __builtin_ctzll(after.pieces[0][0] & ~after.pieces[0][SYZYGY_KING]);
+      children.push_back(child);
+    }
+  }
+  first_child[out.plies.size()] = children.size();
+
+  bool changed_last = true;
+  for (int n = 1; ; ++n) {
+    bool changed = false;
+    for (uint32_t index = 0; index < out.plies.size(); ++index) {
+      if (out.plies[index] != SOLVED_UNKNOWN) {
+        continue;
+      }
+      bool wins = false;
+      bool all_won = true;
+      int longest = 0;
+      for (uint32_t c = first_child[index]; c < first_child[index + 1]; ++c) {
+        int value = children[c] == draw ? SOLVED_DRAW : out.plies[children[c]];
+        if (value <= 0 && value == -(n - 1)) {
+          wins = true;
+          break;
+        }
+        if (value <= 0 || value >= SOLVED_UNKNOWN - 2) {
+          all_won = false;
+        } else {
+          longest = std::max(longest, value);
+        }
+      }
+      //results of this pass are only read by the next one
+      if (wins) {
+        out.plies[index] = SOLVED_UNKNOWN - 1;
+        changed = true;
+      } else if (all_won && longest == n - 1) {
+        out.plies[index] = SOLVED_UNKNOWN - 2;
+        changed = true;
+      }
+    }
+    for (auto& value : out.plies) {
+      if (value == SOLVED_UNKNOWN - 1) {
+        value = n;
+      } else if (value == SOLVED_UNKNOWN - 2) {
+        value = -n;
+      }
+    }
+    if (!changed && !changed_last) {
+      break;
+    }
+    changed_last = changed;
+  }
+  for (auto& value : out.plies) {
+    if (value == SOLVED_UNKNOWN) {
+      value = SOLVED_DRAW;
+    }
+  }
+  return out;
+}
+
+//a board square as a name, "e4"
+inline std::string square_name (int square) {
+  return std::string(1, 'h' - (square & 7)) + std::string(1, '1' + (square >> 3));
+}
+
+/* *
+ * check_table
+ *  probes every position of a king and piece against a lone king and compares it with solve.  The piece is on white's
+ *  side, then on black's with the board mirrored, which the tables answer from the same file.  A dtz table may hold
+ *  distances in moves rather than plies, which rounds them up by one, so a distance one ply longer than the solved
+ *  one still counts as right.
+ * */
+inline check_result check_table (
+  tablebase& tb,
+  uint8_t piece
+) {
+  static const char letters[] = " PNBRQK";
+  check_result out;
+  out.material = std::string("K") + letters[piece] + "vK";
+
+  //a table that isn't there fails the first probe
+  board probe = solved_table::position(0 << 12 | 63 << 6 | 16, piece);
+  probe_state state;
+  tb.probe_wdl(probe, state);
+  if (state == PROBE_FAIL) {
+    return out;
+  }
+  out.found = true;
+
+  solved_table solved = solve(piece);
+  for (uint32_t index = 0; index < solved.plies.size(); ++index) {
+    int plies = solved.plies[index];
+    if (plies == SOLVED_ILLEGAL) {
+      continue;
+    }
+    wdl_score expected = plies == SOLVED_DRAW ? WDL_DRAW : plies > 0 ? WDL_WIN : WDL_LOSS;
+    board white_side = solved_table::position(index, piece);
+    board black_side;
+    black_side.black_to_move = !white_side.black_to_move;
+    for (int color = 0; color < 2; ++color) {
+      for (int type = SYZYGY_PAWN; type <= SYZYGY_KING; ++type) {
+        for (uint64_t set = white_side.pieces[color][type]; set; set &= set - 1) {
+          black_side.put(__builtin_ctzll(set) ^ 56, (!color) << 3 | type);
+        }
+      }
+    }
+
+    for (const board* b : { &white_side, &black_side }) {
+      ++out.positions;
+      std::string wrong;
+      wdl_score wdl = tb.probe_wdl(*b, state);
+      if (state == PROBE_FAIL || wdl != expected) {
+        ++out.wdl_wrong;
+        wrong = std::string(state == PROBE_FAIL ? "no result" : wdl_name(wdl)) + " instead of " + wdl_name(expected);
+      } else if (tb.dtz_count() != 0 && plies != 0 && plies != SOLVED_DRAW) {
+        int dtz = tb.probe_dtz(*b, state);
+        if (state != PROBE_FAIL) {
+          ++out.dtz_checked;
+          if (dtz != plies && dtz != plies + (plies > 0 ? 1 : -1)) {
+            ++out.dtz_wrong;
+            wrong = "dtz " + std::to_string(dtz) + " instead of " + std::to_string(plies);
+          }
+        }
+      }
+      if (!wrong.empty() && out.first_wrong.empty()) {
+        std::string squares;
+        for (int color = 0; color < 2; ++color) {
+          for (int type = SYZYGY_KING; type >= SYZYGY_PAWN; --type) {
+            for (uint64_t set = b->pieces[color][type]; set; set &= set - 1) {
+              squares += std::string(color ? " black " : " white ") + letters[type] + square_name(__builtin_ctzll(set));
+            }
+          }
+        }
+        out.first_wrong = squares.substr(1) + (b->black_to_move ? ", black" : ", white") + " to move: " + wrong;
+      }
+    }
+  }
+  return out;
+}
+
+/* *
+ * check_tables
+ *  check_table for every king and piece against a lone king
+ * */
+inline std::vector<check_result> check_tables (
+  tablebase& tb
+) {
+  std::vector<check_result> out;
+  for (uint8_t piece : { SYZYGY_QUEEN, SYZYGY_ROOK, SYZYGY_BISHOP, SYZYGY_KNIGHT }) {
+    out.push_back(check_table(tb, piece));
+  }
+  return out;
+}
+
+}
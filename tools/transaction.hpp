@@ -0,0 +1,479 @@
+#pragma once
+
+#include <cstdint>
+#include <ctime>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "http_client.hpp"
+#include "json.hpp"
+
+/* *
+ * transaction.hpp
+ *  builds, signs and pushes eosio transactions without going through cleos.
+ *  Action data is packed here directly, signing is delegated to keosd, and everything goes over kept-alive connections
+ *  so a long run of transactions costs one connection to nodeos and one to keosd.
+ * */
+
+namespace eos {
+
+/* *
+ * string_to_name
+ *  encodes an account or action name into its 64 bit form, the same way eosio's name type does
+ * */
+inline uint64_t string_to_name (
+  const std::string& str
+) {
+  auto char_to_symbol = [](char c) -> uint64_t {
+    if (c >= 'a' && c <= 'z') { return (c - 'a') + 6; }
+    if (c >= '1' && c <= '5') { return (c - '1') + 1; }
+    return 0;
+  };
+
+  uint64_t value = 0;
+  for (size_t i = 0; i < str.size() && i < 13; ++i) {
+    uint64_t symbol = char_to_symbol(str[i]);
+    if (i < 12) {
+      value |= (symbol & 0x1F) << (64 - 5 * (i + 1));
+    } else {
+      value |= symbol & 0x0F;
+    }
+  }
+  return value;
+}
+
+/* *
+ * name_to_string
+ *  decodes a 64 bit name back into its string form
+ * */
+inline std::string name_to_string (
+  uint64_t value
+) {
+  static const char* charmap = ".12345abcdefghijklmnopqrstuvwxyz";
+  std::string str(13, '.');
+  uint64_t tmp = value;
+  for (int i = 0; i < 13; ++i) {
+    char c = charmap[tmp & (i == 0 ? 0x0F : 0x1F)];
+    str[12 - i] = c;
+    tmp >>= (i == 0 ? 4 : 5);
+  }
+  while (!str.empty() && str.back() == '.') {
+    str.pop_back();
+  }
+  return str;
+}
+
+inline std::string to_hex (
+  const std::vector<char>& bytes
+) {
+  static const char* hex = "0123456789abcdef";
+  std::string out;
+  out.reserve(bytes.size() * 2);
+  for (unsigned char c : bytes) {
+    out += hex[c >> 4];
+    out += hex[c & 0x0F];
+  }
+  return out;
+}
+
+inline std::vector<char> from_hex (
+  const std::string& hex
+) {
+  auto nibble = [](char c) -> int {
+    if (c >= '0' && c <= '9') { return c - '0'; }
+    if (c >= 'a' && c <= 'f') { return c - 'a' + 10; }
+    if (c >= 'A' && c <= 'F') { return c - 'A' + 10; }
+    throw std::runtime_error("invalid hex string");
+  };
+  std::vector<char> out;
+  for (size_t i = 0; i + 1 < hex.size(); i += 2) {
+    out.push_back((char)((nibble(hex[i]) << 4) | nibble(hex[i + 1])));
+  }
+  return out;
+}
+
+/* *
+ * packer
+ *  appends values in eosio's binary serialization format (little endian, varuint32 lengths)
+ * */
+struct packer {
+  std::vector<char> bytes;
+
+  packer& u8 (uint8_t v) { bytes.push_back((char)v); return *this; }
+  packer& u16 (uint16_t v) { return raw(&v, 2); }
+  packer& u32 (uint32_t v) { return raw(&v, 4); }
+  packer& u64 (uint64_t v) { return raw(&v, 8); }
+  packer& name (const std::string& n) { return u64(string_to_name(n)); }
+
+  packer& varuint32 (uint32_t v) {
+    do {
+      uint8_t b = v & 0x7F;
+      v >>= 7;
+      bytes.push_back((char)(b | (v > 0 ? 0x80 : 0)));
+    } while (v > 0);
+    return *this;
+  }
+
+  packer& blob (const std::vector<char>& data) {
+    varuint32(data.size());
+    bytes.insert(bytes.end(), data.begin(), data.end());
+    return *this;
+  }
+
+  packer& raw (const void* data, size_t size) {
+    //the tools only build for little endian hosts, which matches the wire format
+    const char* p = (const char*)data;
+    bytes.insert(bytes.end(), p, p + size);
+    return *this;
+  }
+};
+
+struct permission {
+  std::string actor;
+  std::string permission = "active";
+};
+
+struct action {
+  std::string account;
+  std::string name;
+  std::vector<permission> authorization;
+  std::vector<char> data;
+};
+
+struct transaction {
+  uint32_t expiration = 0;
+  uint16_t ref_block_num = 0;
+  uint32_t ref_block_prefix = 0;
+  std::vector<action> context_free_actions;
+  std::vector<action> actions;
+
+  std::vector<char> pack () const {
+    packer p;
+    p.u32(expiration).u16(ref_block_num).u32(ref_block_prefix);
+    p.varuint32(0); //max_net_usage_words
+    p.u8(0);        //max_cpu_usage_ms
+    p.varuint32(0); //delay_sec
+    pack_actions(p, context_free_actions);
+    pack_actions(p, actions);
+    p.varuint32(0); //transaction_extensions
+    return p.bytes;
+  }
+
+  static void pack_actions (
+    packer& p,
+    const std::vector<action>& list
+  ) {
+    p.varuint32(list.size());
+    for (auto& a : list) {
+      p.name(a.account).name(a.name);
+      p.varuint32(a.authorization.size());
+      for (auto& auth : a.authorization) {
+        p.name(auth.actor).name(auth.permission);
+      }
+      p.blob(a.data);
+    }
+  }
+
+  json::value to_json () const {
+    char expiration_str[32];
+    time_t t = expiration;
+    strftime(expiration_str, sizeof(expiration_str), "%Y-%m-%dT%H:%M:%S", gmtime(&t));
+
+    json::value trx = json::value::object();
+    trx.set("expiration", expiration_str);
+    trx.set("ref_block_num", (uint32_t)ref_block_num);
+    trx.set("ref_block_prefix", ref_block_prefix);
+    trx.set("max_net_usage_words", 0);
+    trx.set("max_cpu_usage_ms", 0);
+    trx.set("delay_sec", 0);
+    trx.set("context_free_actions", actions_json(context_free_actions));
+    trx.set("actions", actions_json(actions));
+    trx.set("transaction_extensions", json::value::array());
+    trx.set("signatures", json::value::array());
+    trx.set("context_free_data", json::value::array());
+    return trx;
+  }
+
+  static json::value actions_json (
+    const std::vector<action>& list
+  ) {
+    json::value acts = json::value::array();
+    for (auto& a : list) {
+      json::value act = json::value::object();
+      act.set("account", a.account);
+      act.set("name", a.name);
+      json::value& auths = act.set("authorization", json::value::array());
+      for (auto& auth : a.authorization) {
+        json::value perm = json::value::object();
+        perm.set("actor", auth.actor);
+        perm.set("permission", auth.permission);
+        auths.push(perm);
+      }
+      act.set("data", to_hex(a.data));
+      acts.push(act);
+    }
+    return acts;
+  }
+
+  /* *
+   * set_tapos
+   *  fills in expiration and TaPoS fields from a get_info response
+   * */
+  void set_tapos (
+    const json::value& info,
+    uint32_t expire_seconds = 60
+  ) {
+    struct tm tm {};
+    strptime(info["head_block_time"].as_string().c_str(), "%Y-%m-%dT%H:%M:%S", &tm);
+    expiration = (uint32_t)timegm(&tm) + expire_seconds;
+
+    //ref_block_prefix is the second 32 bit word of the block id, read as little endian
+    std::vector<char> block_id = from_hex(info["head_block_id"].as_string());
+    ref_block_num = (uint16_t)(info["head_block_num"].as_uint64() & 0xFFFF);
+    ref_block_prefix = 0;
+    for (int i = 0; i < 4; ++i) {
+      ref_block_prefix |= (uint32_t)(uint8_t)block_id[8 + i] << (8 * i);
+    }
+  }
+
+  /* *
+   * sign_request / push_request
+   *  request bodies for keosd's sign_transaction and nodeos' push_transaction
+   * */
+  std::string sign_request (
+    const json::value& keys,
+    const std::string& chain_id
+  ) const {
+    json::value request = json::value::array();
+    request.push(to_json());
+    request.push(keys);
+    request.push(chain_id);
+    return request.dump();
+  }
+
+  std::string push_request (
+    const json::value& signatures
+  ) const {
+    json::value request = json::value::object();
+    request.set("signatures", signatures);
+    request.set("compression", "none");
+    request.set("packed_context_free_data", "");
+    request.set("packed_trx", to_hex(pack()));
+    return request.dump();
+  }
+};
+
+/* *
+ * error_message
+ *  pulls the readable part out of an error response.
+ *  nodeos and keosd both report errors as {"error": {"name": ..., "what": ..., "details": [{"message": ...}]}}
+ * */
+inline std::string error_message (
+  const std::string& body
+) {
+  try {
+    json::value err = json::parse(body)["error"];
+    std::string what = err["what"].as_string();
+    if (err["details"].size() > 0) {
+      what += ": " + err["details"].at(0)["message"].as_string();
+    }
+    return what;
+  } catch (const std::exception&) {
+    return body;
+  }
+}
+
+/* *
+ * chain_session
+ *  a kept-alive connection to nodeos and to keosd, with the few api calls needed to sign and push transactions
+ * */
+class chain_session {
+  public:
+    chain_session (
+      const std::string& node_url,
+      const std::string& wallet_url
+    ) : node(node_url), wallet(wallet_url) {}
+
+    /* *
+     * call_node / call_wallet
+     *  posts a JSON body to an api endpoint and parses the reply.  Throws with the server's error text on failure.
+     * */
+    json::value call_node (const std::string& path, const std::string& body) { return call(node, path, body); }
+    json::value call_wallet (const std::string& path, const std::string& body) { return call(wallet, path, body); }
+
+    /* *
+     * prepare
+     *  fills in expiration and TaPoS fields from the current head block
+     * */
+    void prepare (
+      transaction& trx,
+      uint32_t expire_seconds = 60
+    ) {
+      json::value info = call_node("/v1/chain/get_info", "{}");
+      chain_id = info["chain_id"].as_string();
+      trx.set_tapos(info, expire_seconds);
+    }
+
+    /* *
+     * required_keys
+     *  asks nodeos which of the wallet's keys are needed to sign trx
+     * */
+    json::value required_keys (
+      const transaction& trx
+    ) {
+      if (wallet_keys.is_null()) {
+        wallet_keys = call_wallet("/v1/wallet/get_public_keys", "");
+      }
+
+      json::value request = json::value::object();
+      request.set("transaction", trx.to_json());
+      request.set("available_keys", wallet_keys);
+      return call_node("/v1/chain/get_required_keys", request.dump())["required_keys"];
+    }
+
+    /* *
+     * sign
+     *  has keosd sign trx with the keys it requires, and returns the signed transaction as keosd reports it.
+     *  prepare must have been called first, for the chain id.
+     * */
+    json::value sign (
+      const transaction& trx
+    ) {
+      return call_wallet("/v1/wallet/sign_transaction", trx.sign_request(required_keys(trx), chain_id));
+    }
+
+    /* *
+     * push
+     *  pushes a signed transaction in packed form, and returns nodeos' response (which includes the action traces)
+     * */
+    json::value push (
+      const transaction& trx,
+      const json::value& signed_trx
+    ) {
+      return call_node("/v1/chain/push_transaction", trx.push_request(signed_trx["signatures"]));
+    }
+
+    const std::string& get_chain_id () const { return chain_id; }
+
+    int connections () const { return node.connections() + wallet.connections(); }
+
+  private:
+    http_client node;
+    http_client wallet;
+    std::string chain_id;
+    json::value wallet_keys;
+
+    static json::value call (
+      http_client& client,
+      const std::string& path,
+      const std::string& body
+    ) {
+      http_response response = client.post(path, body);
+      if (response.status < 200 || response.status > 299) {
+        throw std::runtime_error(path + " returned " + std::to_string(response.status) + " - " + error_message(response.body));
+      }
+      return json::parse(response.body);
+    }
+};
+
+/* *
+ * nonce_action
+ *  a context free action that does nothing, used to keep otherwise identical transactions (like a knight going back and
+ *  forth) from being rejected as duplicates - the same thing cleos does for --force-unique
+ * */
+inline action nonce_action (
+  uint64_t nonce
+) {
+  packer p;
+  p.u64(nonce);
+  return action { "eosio.null", "nonce", {}, p.bytes };
+}
+
+/* *
+ * chess contract actions
+ *  builders for the chess contract's actions, with the same argument order as the ABI
+ * */
+inline action newgame_action (
+  const std::string& contract,
+  const std::string& scope,
+  const std::string& player_w,
+  const std::string& player_b
+) {
+  packer p;
+  p.name(scope).name(player_w).name(player_b);
+  return action { contract, "newgame", { { contract } }, p.bytes };
+}
+
+inline action move_action (
+  const std::string& contract,
+  const std::string& player,
+  const std::string& scope,
+  uint64_t game_id,
+  uint8_t piece_id,
+  uint8_t new_position,
+  uint8_t promotion_type
+) {
+  packer p;
+  p.name(player).name(scope).u64(game_id).u8(piece_id).u8(new_position).u8(promotion_type);
+  return action { contract, "move", { { player } }, p.bytes };
+}
+
+inline action concede_action (
+  const std::string& contract,
+  const std::string& player,
+  const std::string& scope,
+  uint64_t game_id
+) {
+  packer p;
+  p.name(player).name(scope).u64(game_id);
+  return action { contract, "concede", { { player } }, p.bytes };
+}
+
+inline action draw_action (
+  const std::string& contract,
+  const std::string& player,
+  const std::string& scope,
+  uint64_t game_id
+) {
+  packer p;
+  p.name(player).name(scope).u64(game_id);
+  return action { contract, "draw", { { player } }, p.bytes };
+}
+
+inline action claimmate_action (
+  const std::string& contract,
+  const std::string& player,
+  const std::string& scope,
+  uint64_t game_id
+) {
+  packer p;
+  p.name(player).name(scope).u64(game_id);
+  return action { contract, "claimmate", { { player } }, p.bytes };
+}
+
+inline action claimdraw_action (
+  const std::string& contract,
+  const std::string& player,
+  const std::string& scope,
+  uint64_t game_id
+) {
+  packer p;
+  p.name(player).name(scope).u64(game_id);
+  return action { contract, "claimdraw", { { player } }, p.bytes };
+}
+
+inline action premove_action (
+  const std::string& contract,
+  const std::string& player,
+  const std::string& scope,
+  uint64_t game_id,
+  uint16_t if_move,
+  uint16_t reply
+) {
+  packer p;
+  p.name(player).name(scope).u64(game_id).u16(if_move).u16(reply);
+  return action { contract, "premove", { { player } }, p.bytes };
+}
+
+} // namespace eos
@@ -0,0 +1,716 @@
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <iostream>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <poll.h>
+
+#include "games_table.hpp"
+#include "pgn.hpp"
+#include "sqlite.hpp"
+
+/* *
+ * validator
+ *  answers "is this move legal?" and "which moves are legal?" for live games locally, without a trip to the chain.
+ *
+ *  Serves HTTP on localhost or a unix socket.  Positions are read from the contract's games table (--url) or from the
+ *  indexer's database (--db), and kept in an LRU cache keyed by game id and move count.  Answers come from the same
+ *  rules the contract runs (chess_rules.hpp), behind the same checks the 'move' action makes first, so a move it accepts
+ *  is a move the contract accepts against the same position.  Build it with the contract's flags (CHESS_LAZY_MATE).
+ *
+ *  Endpoints, all POST with a JSON body -
+ *   /v1/legal_moves  {game_id, move_count?, piece_id?}
+ *                    the legal moves of the side to move, or of one piece, with their from and to squares
+ *   /v1/check_move   {game_id, move_count?, player?, piece_id, new_position, promotion_type?}
+ *                    whether 'move' would accept the move, and what it captures
+ *
+ *  A request naming the move_count the client is showing is served from the cache; without one, the game is read again.
+ *  Cached positions older than --ttl milliseconds are read again before use, since a game can end by concede or draw
+ *  without its move count changing.  When the position has moved on, the answer is a 409 with the current move_count.
+ *
+ *  Every worker thread runs a poll loop over the listening socket and the connections it has accepted, with its own
+ *  connection to the source, so idle keep-alive clients hold up nobody and any number of clients can stay connected.
+ *  The cache is split into shards with a lock each, so requests on different games never wait for each other.
+ * */
+
+#define VALIDATOR_IDLE_SECONDS 60 //keep-alive connections idle for longer are closed
+
+static volatile std::sig_atomic_t stopping = 0;
+
+static void on_signal (int) {
+  stopping = 1;
+}
+
+/* *
+ * cached_position
+ *  a game as read from the source.  Never changed once cached; the legal move list is worked out on first use.
+ * */
+struct cached_position {
+  uint64_t game_id = 0;
+  std::string player_w;
+  std::string player_b;
+  std::string winner;
+  rules::game_state state;
+  std::chrono::steady_clock::time_point loaded;
+
+  const std::vector<uint16_t>& moves () const {
+    std::call_once(moves_once, [this]() {
+      if (winner.empty()) {
+        legal = rules::legal_moves(state);
+      }
+    });
+    return legal;
+  }
+
+  private:
+    mutable std::once_flag moves_once;
+    mutable std::vector<uint16_t> legal;
+};
+
+typedef std::shared_ptr<const cached_position> position_ptr;
+
+/* *
+ * position_cache
+ *  an LRU cache of positions, split into shards by game id.  Each shard has its own lock, held only to find or insert
+ *  an entry; positions are shared, so they are used after the lock is released.
+ * */
+class position_cache {
+  public:
+    position_cache (size_t capacity) : shard_capacity(capacity / SHARDS + 1) {}
+
+    //the position of game_id at move_count, if cached
+    position_ptr get (uint64_t game_id, uint32_t move_count) {
+      shard& s = shard_of(game_id);
+      std::lock_guard<std::mutex> guard(s.lock);
+      auto itr = s.entries.find(key(game_id, move_count));
+      if (itr == s.entries.end()) {
+        return nullptr;
+      }
+      s.lru.splice(s.lru.begin(), s.lru, itr->second);
+      return *itr->second;
+    }
+
+    void put (position_ptr position) {
+      shard& s = shard_of(position->game_id);
+      std::lock_guard<std::mutex> guard(s.lock);
+      uint64_t k = key(position->game_id, position->state.move_count);
+      auto itr = s.entries.find(k);
+      if (itr != s.entries.end()) {
+        *itr->second = position;
+        s.lru.splice(s.lru.begin(), s.lru, itr->second);
+      } else {
+        s.lru.push_front(position);
+        s.entries[k] = s.lru.begin();
+      }
+
+      while (s.lru.size() > shard_capacity) {
+        const position_ptr& oldest = s.lru.back();
+        s.entries.erase(key(oldest->game_id, oldest->state.move_count));
+        s.lru.pop_back();
+      }
+    }
+
+  private:
+    static const size_t SHARDS = 64;
+
+    struct shard {
+      std::mutex lock;
+      std::list<position_ptr> lru; //most recently used first
+      std::unordered_map<uint64_t, std::list<position_ptr>::iterator> entries;
+    };
+
+    size_t shard_capacity;
+    shard shards[SHARDS];
+
+    //game ids are table keys and stay far below 2^40, move counts below 2^24
+    static uint64_t key (uint64_t game_id, uint32_t move_count) { return game_id << 24 | (move_count & 0xFFFFFF); }
+
+    shard& shard_of (uint64_t game_id) { return shards[(game_id * 0x9E3779B97F4A7C15ULL) >> 58]; }
+};
+
+/* *
+ * position_source
+ *  reads the current position of a game.  Each worker has its own, so sources don't need to be thread safe.
+ * */
+class position_source {
+  public:
+    virtual ~position_source () {}
+    //the current position of game_id, or nullptr if there is no such game
+    virtual std::shared_ptr<cached_position> load (uint64_t game_id) = 0;
+};
+
+/* *
+ * table_source
+ *  reads the games table through get_table_rows, so positions include the stored attack maps as they are on chain
+ * */
+class table_source : public position_source {
+  public:
+    table_source (const std::string& url, const std::string& contract, const std::string& scope)
+      : node(url), contract(contract), scope(scope) {}
+
+    std::shared_ptr<cached_position> load (uint64_t game_id) override {
+      json::value row;
+      if (!games_table::read_game(node, contract, scope, game_id, row)) {
+        return nullptr;
+      }
+      auto position = std::make_shared<cached_position>();
+      position->game_id = game_id;
+      position->player_w = row["player_w"].as_string();
+      position->player_b = row["player_b"].as_string();
+      position->winner = row["winner"].as_string();
+      position->state = games_table::to_state(row);
+      return position;
+    }
+
+  private:
+    http_client node;
+    std::string contract;
+    std::string scope;
+};
+
+/* *
+ * index_source
+ *  reads the last indexed position of a game from the indexer's database.  Games the indexer couldn't replay are
+ *  reported as missing rather than answered from a wrong board.
+ * */
+class index_source : public position_source {
+  public:
+    index_source (const std::string& filename) {
+      if (sqlite3_open_v2(filename.c_str(), &db, SQLITE_OPEN_READONLY, nullptr) != SQLITE_OK) {
+        std::string error = "sqlite: unable to open " + filename + ": " + sqlite3_errmsg(db);
+        sqlite3_close(db);
+        throw std::runtime_error(error);
+      }
+      sqlite3_busy_timeout(db, 1000);
+      query.reset(new statement(db,
+        "select g.player_w, g.player_b, g.winner, p.ply, p.castle, p.en_passant_idx, p.promoted_pawns, p.promoted_pawn_types, p.piece_positions "
+        "from games g join positions p on p.game_id = g.game_id and p.ply = g.plies where g.game_id = ? and g.diverged = 0"));
+    }
+
+    ~index_source () {
+      query.reset();
+      sqlite3_close(db);
+    }
+
+    std::shared_ptr<cached_position> load (uint64_t game_id) override {
+      query->bind(1, game_id);
+      if (!query->step()) {
+        return nullptr;
+      }
+      auto position = std::make_shared<cached_position>();
+      position->game_id = game_id;
+      position->player_w = query->text(0);
+      position->player_b = query->text(1);
+      position->winner = query->text(2);
+      rules::game_state& state = position->state;
+      state.move_count = query->integer(3);
+      state.castle = query->integer(4);
+      state.en_passant_idx = query->integer(5);
+      state.promoted_pawns = query->integer(6);
+      state.promoted_pawn_types = query->integer(7);
+      state.piece_positions = query->blob(8);
+      query->done();
+      rules::update_attacks(state);
+      return position;
+    }
+
+  private:
+    sqlite3* db = nullptr;
+    std::unique_ptr<statement> query;
+};
+
+struct reply {
+  int status = 200;
+  json::value body = json::value::object();
+};
+
+static reply error_reply (
+  int status,
+  const std::string& message
+) {
+  reply r;
+  r.status = status;
+  r.body.set("error", message);
+  return r;
+}
+
+/* *
+ * service
+ *  the cache and the request handlers, shared by every worker
+ * */
+class service {
+  public:
+    service (size_t capacity, int ttl_ms) : cache(capacity), ttl(std::chrono::milliseconds(ttl_ms)) {}
+
+    reply handle (
+      const std::string& path,
+      const std::string& body,
+      position_source& source
+    ) {
+      json::value request;
+      try {
+        request = json::parse(body);
+      } catch (const std::runtime_error& e) {
+        return error_reply(400, e.what());
+      }
+      if (!request.is_object() || request["game_id"].is_null()) {
+        return error_reply(400, "game_id is required");
+      }
+
+      position_ptr position = lookup(request, source);
+      if (position == nullptr) {
+        return error_reply(404, "Unable to find a game with ID " + request["game_id"].as_string());
+      }
+      if (!request["move_count"].is_null() && request["move_count"].as_uint64() != position->state.move_count) {
+        reply r = error_reply(409, "The game has moved on");
+        r.body.set("move_count", position->state.move_count);
+        return r;
+      }
+
+      if (path == "/v1/legal_moves") {
+        return legal_moves(request, *position);
+      } else if (path == "/v1/check_move") {
+        return check_move(request, *position);
+      }
+      return error_reply(404, "Unknown endpoint " + path);
+    }
+
+  private:
+    position_cache cache;
+    std::chrono::steady_clock::duration ttl;
+
+    //the position a request is about: from the cache if the client named it and it's fresh, otherwise from the source
+    position_ptr lookup (
+      const json::value& request,
+      position_source& source
+    ) {
+      uint64_t game_id = request["game_id"].as_uint64();
+      position_ptr position = request["move_count"].is_null() ? nullptr : cache.get(game_id, request["move_count"].as_uint64());
+      if (position != nullptr && std::chrono::steady_clock::now() - position->loaded < ttl) {
+        return position;
+      }
+
+      std::shared_ptr<cached_position> loaded = source.load(game_id);
+      if (loaded == nullptr) {
+        return nullptr;
+      }
+      loaded->loaded = std::chrono::steady_clock::now();
+      cache.put(loaded);
+      return loaded;
+    }
+
+    static json::value describe (
+      uint16_t move,
+      const rules::game_state& state
+    ) {
+      uint8_t piece_id = rules::packed_piece_id(move);
+      uint8_t to = rules::packed_new_position(move);
+      json::value m = json::value::object();
+      m.set("move", (uint32_t)move);
+      m.set("piece_id", (uint32_t)piece_id);
+      m.set("from", (uint32_t)state.piece_positions[piece_id]);
+      m.set("to", (uint32_t)to);
+      m.set("promotion_type", (uint32_t)rules::packed_promotion_type(move));
+      m.set("from_square", pgn::position_to_square(state.piece_positions[piece_id]));
+      m.set("to_square", pgn::position_to_square(to));
+      return m;
+    }
+
+    static reply legal_moves (
+      const json::value& request,
+      const cached_position& position
+    ) {
+      bool one_piece = !request["piece_id"].is_null();
+      uint8_t piece_id = request["piece_id"].as_uint64();
+
+      reply r;
+      json::value moves = json::value::array();
+      for (uint16_t move : position.moves()) {
+        if (!one_piece || rules::packed_piece_id(move) == piece_id) {
+          moves.push(describe(move, position.state));
+        }
+      }
+      r.body.set("game_id", position.game_id);
+      r.body.set("move_count", position.state.move_count);
+      r.body.set("to_move", position.state.move_count % 2 == 0 ? position.player_w : position.player_b);
+      r.body.set("winner", position.winner);
+      r.body.set("moves", moves);
+      return r;
+    }
+
+    /* *
+     * check_move
+     *  makes the checks of the 'move' action, in the same order and with the same messages, then plays the move on a
+     *  copy of the position.  Without a player, the move is checked for whichever player owns the piece.
+     * */
+    static reply check_move (
+      const json::value& request,
+      const cached_position& position
+    ) {
+      uint64_t piece_id = request["piece_id"].as_uint64();
+      uint64_t new_position = request["new_position"].as_uint64();
+      uint8_t promotion_type = request["promotion_type"].as_uint64();
+      std::string player = request["player"].is_null() ? (piece_id < 16 ? position.player_w : position.player_b) : request["player"].as_string();
+
+      reply r;
+      auto rejected = [&](const std::string& message) {
+        r.body.set("valid", false);
+        r.body.set("error", message);
+        return r;
+      };
+
+      if (new_position > 64 || new_position == 0) {
+        return rejected("Invalid position ID; must be a value between 1 - 64");
+      }
+      if (piece_id > 31) {
+        return rejected("Invalid piece ID; must be a value between 0 - 31");
+      }
+      if (!position.winner.empty()) {
+        return rejected(position.winner == position.player_w || position.winner == position.player_b ?
+          position.winner + " has already won this game" : "This game has ended in a draw");
+      }
+      if (player == position.player_w) {
+        if (position.state.move_count % 2 != 0) {
+          return rejected("It is not your turn");
+        }
+        if (piece_id > 15) {
+          return rejected("Piece " + std::to_string(piece_id) + " is not your piece");
+        }
+      } else if (player == position.player_b) {
+        if (position.state.move_count % 2 == 0) {
+          return rejected("It is not your turn");
+        }
+        if (piece_id < 16) {
+          return rejected("Piece " + std::to_string(piece_id) + " is not your piece");
+        }
+      } else {
+        return rejected("You are not a player in this game");
+      }
+
+      rules::game_state state = position.state;
+      uint8_t captured_piece_index = 32;
+      bool checkmate = false;
+      if (!rules::play_move(state, piece_id, new_position, promotion_type, captured_piece_index, checkmate)) {
+        return rejected("Move invalid");
+      }
+      r.body.set("valid", true);
+      r.body.set("captured_piece", (uint32_t)captured_piece_index);
+      r.body.set("check", state.attacks.checkers != 0);
+      r.body.set("checkmate", checkmate);
+      return r;
+    }
+};
+
+/* *
+ * take_request
+ *  takes the first request off a connection's input.  Returns 1 with it in method, path, body and close_after, 0 if
+ *  the input doesn't hold a whole request yet, or -1 for one too large to serve.
+ * */
+static int take_request (
+  std::string& buffer,
+  std::string& method,
+  std::string& path,
+  std::string& body,
+  bool& close_after
+) {
+  size_t header_end = buffer.find("\r\n\r\n");
+  if (header_end == std::string::npos) {
+    return buffer.size() > 65536 ? -1 : 0;
+  }
+
+  std::string head = buffer.substr(0, header_end);
+  size_t content_length = 0;
+  close_after = false;
+  size_t line_start = head.find("\r\n");
+  while (line_start != std::string::npos && line_start < head.size()) {
+    line_start += 2;
+    size_t line_end = head.find("\r\n", line_start);
+    std::string line = head.substr(line_start, line_end == std::string::npos ? std::string::npos : line_end - line_start);
+    for (size_t i = 0; i < line.size() && line[i] != ':'; ++i) {
+      line[i] = std::tolower(line[i]);
+    }
+    if (line.compare(0, 15, "content-length:") == 0) {
+      content_length = std::strtoul(line.c_str() + 15, nullptr, 10);
+    } else if (line.compare(0, 11, "connection:") == 0 && line.find("close") != std::string::npos) {
+      close_after = true;
+    }
+    line_start = line_end;
+  }
+  if (content_length > 65536) {
+    return -1;
+  }
+  if (buffer.size() < header_end + 4 + content_length) {
+    return 0;
+  }
+
+  size_t method_end = head.find(' ');
+  size_t path_end = head.find(' ', method_end + 1);
+  method = head.substr(0, method_end);
+  path = method_end == std::string::npos ? "" : head.substr(method_end + 1, path_end - method_end - 1);
+  body = buffer.substr(header_end + 4, content_length);
+  buffer.erase(0, header_end + 4 + content_length);
+  return 1;
+}
+
+/* *
+ * respond
+ *  answers one request, as the HTTP response to send back
+ * */
+static std::string respond (
+  const std::string& method,
+  const std::string& path,
+  const std::string& body,
+  bool close_after,
+  service& svc,
+  position_source& source
+) {
+  reply r;
+  if (method != "POST") {
+    r = error_reply(405, "Only POST is supported");
+  } else {
+    try {
+      r = svc.handle(path, body, source);
+    } catch (const std::exception& e) {
+      r = error_reply(502, e.what());
+    }
+  }
+
+  std::string out = r.body.dump();
+  return "HTTP/1.1 " + std::to_string(r.status) + (r.status == 200 ? " OK" : " Error") + "\r\n"
+    "Content-Type: application/json\r\n"
+    "Content-Length: " + std::to_string(out.size()) + "\r\n"
+    "Connection: " + (close_after ? "close" : "keep-alive") + "\r\n\r\n" + out;
+}
+
+/* *
+ * connection
+ *  a client connection of one worker: what has been read of its next request, and the responses still to be sent
+ * */
+struct connection {
+  std::string in;
+  std::string out;
+  bool closing = false; //close once out has been sent
+  std::chrono::steady_clock::time_point active;
+};
+
+/* *
+ * run_worker
+ *  one worker's poll loop over the shared listening socket and the connections it has accepted.  Waiting on a client
+ *  costs nothing, so idle keep-alive connections never hold up the others; a worker is only busy while it answers a
+ *  request.  Connections idle for VALIDATOR_IDLE_SECONDS are closed.
+ * */
+static void run_worker (
+  int listen_fd,
+  service& svc,
+  position_source& source
+) {
+  std::unordered_map<int, connection> connections;
+  std::vector<pollfd> fds;
+  char chunk[16384];
+  std::string method, path, body;
+
+  while (!stopping) {
+    fds.clear();
+    fds.push_back(pollfd { listen_fd, POLLIN, 0 });
+    for (auto& entry : connections) {
+      fds.push_back(pollfd { entry.first, (short)(entry.second.out.empty() ? POLLIN : POLLIN | POLLOUT), 0 });
+    }
+    if (poll(fds.data(), fds.size(), 200) < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      throw std::runtime_error("poll failed");
+    }
+    auto now = std::chrono::steady_clock::now();
+
+    //every worker polls the listening socket, and the ones that lose the race for a connection get EAGAIN
+    if (fds[0].revents & POLLIN) {
+      int fd = accept(listen_fd, nullptr, nullptr);
+      if (fd >= 0) {
+        int one = 1;
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        connections[fd].active = now;
+      }
+    }
+
+    for (size_t i = 1; i < fds.size(); ++i) {
+      int fd = fds[i].fd;
+      connection& conn = connections[fd];
+      bool drop = false;
+
+      if ((fds[i].revents & (POLLIN | POLLHUP | POLLERR)) && !conn.closing) {
+        ssize_t n = recv(fd, chunk, sizeof(chunk), 0);
+        if (n > 0) {
+          conn.in.append(chunk, n);
+          conn.active = now;
+          bool close_after = false;
+          int taken;
+          while (!conn.closing && (taken = take_request(conn.in, method, path, body, close_after)) != 0) {
+            if (taken < 0) {
+              conn.closing = true;
+              break;
+            }
+            conn.out += respond(method, path, body, close_after, svc, source);
+            conn.closing = close_after;
+          }
+        } else if (n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+          drop = true;
+        }
+      }
+
+      while (!drop && !conn.out.empty()) {
+        ssize_t n = send(fd, conn.out.data(), conn.out.size(), MSG_NOSIGNAL);
+        if (n > 0) {
+          conn.out.erase(0, n);
+          conn.active = now;
+        } else {
+          drop = n < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR;
+          break;
+        }
+      }
+
+      if (drop || (conn.closing && conn.out.empty()) || now - conn.active > std::chrono::seconds(VALIDATOR_IDLE_SECONDS)) {
+        close(fd);
+        connections.erase(fd);
+      }
+    }
+  }
+
+  for (auto& entry : connections) {
+    close(entry.first);
+  }
+}
+
+/* *
+ * listen_on
+ *  opens the listening socket for 'host:port' or 'unix:///path'
+ * */
+static int listen_on (
+  const std::string& address
+) {
+  int fd = -1;
+  if (address.compare(0, 7, "unix://") == 0) {
+    std::string path = address.substr(7);
+    sockaddr_un addr {};
+    addr.sun_family = AF_UNIX;
+    path.copy(addr.sun_path, sizeof(addr.sun_path) - 1);
+    unlink(path.c_str());
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || bind(fd, (sockaddr*)&addr, sizeof(addr)) != 0) {
+      throw std::runtime_error("unable to listen on " + path);
+    }
+  } else {
+    size_t colon = address.rfind(':');
+    sockaddr_in addr {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(std::stoi(address.substr(colon + 1)));
+    std::string host = address.substr(0, colon);
+    if (inet_pton(AF_INET, host == "localhost" ? "127.0.0.1" : host.c_str(), &addr.sin_addr) != 1) {
+      throw std::runtime_error("bad listen address " + address);
+    }
+    fd = socket(AF_INET, SOCK_STREAM, 0);
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    if (fd < 0 || bind(fd, (sockaddr*)&addr, sizeof(addr)) != 0) {
+      throw std::runtime_error("unable to listen on " + address);
+    }
+  }
+  if (listen(fd, 128) != 0) {
+    throw std::runtime_error("unable to listen on " + address);
+  }
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+  return fd;
+}
+
+static void usage () {
+  std::cerr <<
+    "usage: validator [options] (--url URL | --db FILE)\n"
+    "  --url URL          nodeos endpoint to read the games table from\n"
+    "  --db FILE          indexer database to read positions from instead\n"
+    "  --contract NAME    chess contract account (default chess)\n"
+    "  --scope NAME       games table scope (default the contract account)\n"
+    "  --listen ADDRESS   host:port or unix:///path (default 127.0.0.1:8890)\n"
+    "  --threads N        worker threads (default 8)\n"
+    "  --cache N          positions to keep cached (default 100000)\n"
+    "  --ttl MS           read cached positions again after this long (default 2000)\n";
+  std::exit(1);
+}
+
+int main (int argc, char** argv) {
+  std::string node_url;
+  std::string db_file;
+  std::string contract = "chess";
+  std::string scope;
+  std::string address = "127.0.0.1:8890";
+  size_t threads = 8;
+  size_t capacity = 100000;
+  int ttl_ms = 2000;
+
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    auto next = [&]() -> std::string {
+      if (i + 1 >= argc) { usage(); }
+      return argv[++i];
+    };
+    if (arg == "--url") { node_url = next(); }
+    else if (arg == "--db") { db_file = next(); }
+    else if (arg == "--contract") { contract = next(); }
+    else if (arg == "--scope") { scope = next(); }
+    else if (arg == "--listen") { address = next(); }
+    else if (arg == "--threads") { threads = std::stoul(next()); }
+    else if (arg == "--cache") { capacity = std::stoul(next()); }
+    else if (arg == "--ttl") { ttl_ms = std::stoi(next()); }
+    else { usage(); }
+  }
+  if (scope.empty()) {
+    scope = contract;
+  }
+  if (node_url.empty() == db_file.empty() || threads == 0) {
+    usage();
+  }
+
+  std::signal(SIGINT, on_signal);
+  std::signal(SIGTERM, on_signal);
+
+  try {
+    int listen_fd = listen_on(address);
+    service svc(capacity, ttl_ms);
+    std::vector<std::thread> workers;
+    for (size_t i = 0; i < threads; ++i) {
+      std::unique_ptr<position_source> source;
+      if (db_file.empty()) {
+        source.reset(new table_source(node_url, contract, scope));
+      } else {
+        source.reset(new index_source(db_file));
+      }
+      workers.emplace_back([listen_fd, &svc](std::unique_ptr<position_source> source) {
+        try {
+          run_worker(listen_fd, svc, *source);
+        } catch (const std::exception& e) {
+          std::cerr << "validator: " << e.what() << "\n";
+          stopping = 1;
+        }
+      }, std::move(source));
+    }
+    std::cerr << "validator: listening on " << address << " with " << threads << " threads\n";
+
+    //the workers poll with a timeout, and notice a shutdown by themselves
+    for (auto& worker : workers) {
+      worker.join();
+    }
+    close(listen_fd);
+  } catch (const std::exception& e) {
+    std::cerr << "validator: " << e.what() << "\n";
+    return 1;
+  }
+  return 0;
+}
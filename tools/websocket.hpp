@@ -0,0 +1,530 @@
+#pragma once
+
+#include <cctype>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+/* *
+ * websocket.hpp
+ *  a small WebSocket (RFC 6455) server for pushing messages to many clients from one thread, driven by poll() the same
+ *  way as async_http: the caller owns the loop, so the server can share it with other file descriptors.
+ *
+ *  Messages are encoded once into a shared frame (make_text) and queued by reference on every connection they go to,
+ *  then written straight from the shared buffers with writev, so fanning a message out to many clients doesn't copy
+ *  it.  Each connection's queue is bounded by max_queue bytes: a client that falls that far behind is marked lagging,
+ *  its queued messages are dropped and later sends to it are refused, and once its socket drains on_drain is called so
+ *  the caller can send it a fresh state instead of the messages it missed.  A client still lagging after lag_timeout
+ *  is disconnected.
+ *
+ *  Clients can send text messages (to on_text), pings and close frames; fragmented messages and frames over 64KB
+ *  close the connection.
+ * */
+
+namespace websocket {
+
+/* *
+ * sha1
+ *  the 20 byte SHA-1 digest of data; only needed for the handshake
+ * */
+inline std::string sha1 (
+  const std::string& data
+) {
+  uint32_t h[5] = { 0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0 };
+  std::string message = data;
+  uint64_t bits = (uint64_t)data.size() * 8;
+  message += (char)0x80;
+  while (message.size() % 64 != 56) {
+    message += (char)0;
+  }
+  for (int i = 7; i >= 0; --i) {
+    message += (char)(bits >> (i * 8));
+  }
+
+  auto rotl = [](uint32_t x, int n) { return (x << n) | (x >> (32 - n)); };
+  for (size_t chunk = 0; chunk < message.size(); chunk += 64) {
+    uint32_t w[80];
+    for (int i = 0; i < 16; ++i) {
+      const uint8_t* p = (const uint8_t*)message.data() + chunk + i * 4;
+      w[i] = (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+    }
+    for (int i = 16; i < 80; ++i) {
+      w[i] = rotl(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+    }
+    uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+    for (int i = 0; i < 80; ++i) {
+      uint32_t f, k;
+      if (i < 20) { f = (b & c) | (~b & d); k = 0x5A827999; }
+      else if (i < 40) { f = b ^ c ^ d; k = 0x6ED9EBA1; }
+      else if (i < 60) { f = (b & c) | (b & d) | (c & d); k = 0x8F1BBCDC; }
+      else { f = b ^ c ^ d; k = 0xCA62C1D6; }
+      uint32_t t = rotl(a, 5) + f + e + k + w[i];
+      e = d; d = c; c = rotl(b, 30); b = a; a = t;
+    }
+    h[0] += a; h[1] += b; h[2] += c; h[3] += d; h[4] += e;
+  }
+
+  std::string digest;
+  for (uint32_t word : h) {
+    for (int i = 3; i >= 0; --i) {
+      digest += (char)(word >> (i * 8));
+    }
+  }
+  return digest;
+}
+
+inline std::string base64 (
+  const std::string& data
+) {
+  static const char* chars = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+  std::string out;
+  for (size_t i = 0; i < data.size(); i += 3) {
+    uint32_t n = (uint8_t)data[i] << 16;
+    if (i + 1 < data.size()) { n |= (uint8_t)data[i + 1] << 8; }
+    if (i + 2 < data.size()) { n |= (uint8_t)data[i + 2]; }
+    out += chars[(n >> 18) & 63];
+    out += chars[(n >> 12) & 63];
+    out += i + 1 < data.size() ? chars[(n >> 6) & 63] : '=';
+    out += i + 2 < data.size() ? chars[n & 63] : '=';
+  }
+  return out;
+}
+
+//the Sec-WebSocket-Accept value for a client's Sec-WebSocket-Key
+inline std::string accept_key (
+  const std::string& key
+) {
+  return base64(sha1(key + "258EAFA5-E914-47DA-95CA-C5AB0DC85B11"));
+}
+
+#define WS_TEXT  0x1
+#define WS_CLOSE 0x8
+#define WS_PING  0x9
+#define WS_PONG  0xA
+
+#define WS_MAX_FRAME 65536
+
+//one encoded frame, shared by every connection it is queued on
+using message = std::shared_ptr<const std::string>;
+
+/* *
+ * frame
+ *  a server frame (unmasked, unfragmented) with payload
+ * */
+inline std::string frame (
+  uint8_t opcode,
+  const std::string& payload
+) {
+  std::string out;
+  out += (char)(0x80 | opcode);
+  if (payload.size() < 126) {
+    out += (char)payload.size();
+  } else if (payload.size() < 65536) {
+    out += (char)126;
+    out += (char)(payload.size() >> 8);
+    out += (char)payload.size();
+  } else {
+    out += (char)127;
+    for (int i = 7; i >= 0; --i) {
+      out += (char)((uint64_t)payload.size() >> (i * 8));
+    }
+  }
+  return out + payload;
+}
+
+inline message make_text (const std::string& payload) {
+  return std::make_shared<const std::string>(frame(WS_TEXT, payload));
+}
+
+struct server_stats {
+  uint64_t accepted = 0;
+  uint64_t messages = 0;       //messages queued on connections
+  uint64_t bytes = 0;          //bytes written
+  uint64_t dropped = 0;        //messages dropped from or refused to lagging connections
+  uint64_t lagged = 0;         //times a connection started lagging
+  uint64_t timed_out = 0;      //connections closed for lagging too long
+};
+
+class server {
+  public:
+    //path is the request path of the handshake
+    std::function<void(int client, const std::string& path)> on_open;
+    std::function<void(int client, const std::string& text)> on_text;
+    std::function<void(int client)> on_drain;
+    std::function<void(int client)> on_close;
+
+    server (
+      int listen_fd,
+      size_t max_clients,
+      size_t max_queue,
+      int lag_timeout_ms
+    ) : listen_fd(listen_fd), max_clients(max_clients), max_queue(max_queue), lag_timeout(lag_timeout_ms) {
+      fcntl(listen_fd, F_SETFL, fcntl(listen_fd, F_GETFL) | O_NONBLOCK);
+    }
+
+    ~server () {
+      for (auto& entry : clients) {
+        ::close(entry.second.fd);
+      }
+    }
+
+    server (const server&) = delete;
+    server& operator= (const server&) = delete;
+
+    size_t client_count () const { return clients.size(); }
+    const server_stats& stats () const { return counters; }
+
+    /* *
+     * send
+     *  queues msg on a client.  Returns false if the client is gone, still handshaking, or lagging, in which case the
+     *  message is dropped.
+     * */
+    bool send (
+      int client,
+      const message& msg
+    ) {
+      auto found = clients.find(client);
+      if (found == clients.end() || !found->second.open || found->second.closing) {
+        return false;
+      }
+      connection& c = found->second;
+      if (c.lagging) {
+        ++counters.dropped;
+        return false;
+      }
+      if (c.queued + msg->size() > max_queue) {
+        //the queue may only be full of messages the socket has room for
+        write_to(client, c);
+      }
+      if (c.queued + msg->size() > max_queue) {
+        start_lagging(c);
+        ++counters.dropped;
+        return false;
+      }
+      c.out.push_back(msg);
+      c.queued += msg->size();
+      ++counters.messages;
+      return true;
+    }
+
+    //sends a close frame and closes the connection once it is written
+    void close (
+      int client
+    ) {
+      auto found = clients.find(client);
+      if (found != clients.end() && !found->second.closing) {
+        found->second.out.push_back(std::make_shared<const std::string>(frame(WS_CLOSE, std::string("\x03\xe8", 2))));
+        found->second.closing = true;
+      }
+    }
+
+    void add_poll_fds (
+      std::vector<pollfd>& fds
+    ) {
+      fds.push_back(pollfd { listen_fd, (short)(clients.size() < max_clients ? POLLIN : 0), 0 });
+      for (auto& entry : clients) {
+        //a lagging connection has caught up when its socket is writable again
+        bool writing = !entry.second.out.empty() || entry.second.lagging;
+        fds.push_back(pollfd { entry.second.fd, (short)(POLLIN | (writing ? POLLOUT : 0)), 0 });
+      }
+    }
+
+    void handle_poll (
+      const std::vector<pollfd>& fds
+    ) {
+      for (const pollfd& p : fds) {
+        if (p.fd == listen_fd) {
+          if (p.revents & POLLIN) {
+            accept_clients();
+          }
+          continue;
+        }
+        auto found = clients.find(p.fd);
+        if (found == clients.end() || p.revents == 0) {
+          continue;
+        }
+        connection& c = found->second;
+        if (p.revents & (POLLIN | POLLHUP | POLLERR)) {
+          read_from(p.fd, c);
+        }
+        if (!c.dead && (p.revents & POLLOUT)) {
+          write_to(p.fd, c);
+        }
+      }
+
+      auto now = std::chrono::steady_clock::now();
+      for (auto it = clients.begin(); it != clients.end(); ) {
+        connection& c = it->second;
+        if (!c.dead && c.lagging && now - c.lagging_since > lag_timeout) {
+          ++counters.timed_out;
+          c.dead = true;
+        }
+        if (c.dead || (c.closing && c.out.empty())) {
+          int client = it->first;
+          bool was_open = c.open;
+          ::close(c.fd);
+          it = clients.erase(it);
+          if (was_open && on_close) {
+            on_close(client);
+          }
+        } else {
+          ++it;
+        }
+      }
+    }
+
+  private:
+    struct connection {
+      int fd = -1;
+      bool open = false;         //handshake done
+      bool closing = false;
+      bool dead = false;
+      bool lagging = false;
+      std::chrono::steady_clock::time_point lagging_since;
+      std::string in;
+      std::deque<message> out;
+      size_t offset = 0;         //bytes of out.front() already written
+      size_t queued = 0;         //bytes in out not yet written
+    };
+
+    int listen_fd;
+    size_t max_clients;
+    size_t max_queue;
+    std::chrono::milliseconds lag_timeout;
+    std::map<int, connection> clients; //by socket, which is also the client's id
+    server_stats counters;
+
+    void start_lagging (
+      connection& c
+    ) {
+      c.lagging = true;
+      c.lagging_since = std::chrono::steady_clock::now();
+      ++counters.lagged;
+      //a frame that is partly written has to be finished, or the stream breaks
+      while (c.out.size() > (c.offset > 0 ? 1 : 0)) {
+        c.queued -= c.out.back()->size();
+        c.out.pop_back();
+        ++counters.dropped;
+      }
+    }
+
+    void accept_clients () {
+      while (clients.size() < max_clients) {
+        int fd = accept(listen_fd, nullptr, nullptr);
+        if (fd < 0) {
+          return;
+        }
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        connection c;
+        c.fd = fd;
+        clients[fd] = std::move(c);
+        ++counters.accepted;
+      }
+    }
+
+    void read_from (
+      int client,
+      connection& c
+    ) {
+      char chunk[16384];
+      while (true) {
+        ssize_t n = recv(c.fd, chunk, sizeof(chunk), 0);
+        if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+          c.dead = true;
+          return;
+        }
+        if (n < 0) {
+          break;
+        }
+        c.in.append(chunk, n);
+        if (c.in.size() > 2 * WS_MAX_FRAME) {
+          c.dead = true;
+          return;
+        }
+      }
+      if (!c.open) {
+        handshake(client, c);
+      }
+      while (c.open && !c.dead && read_frame(client, c)) {
+      }
+    }
+
+    void handshake (
+      int client,
+      connection& c
+    ) {
+      size_t end = c.in.find("\r\n\r\n");
+      if (end == std::string::npos) {
+        if (c.in.size() > 8192) {
+          c.dead = true;
+        }
+        return;
+      }
+      std::string head = c.in.substr(0, end);
+      c.in.erase(0, end + 4);
+
+      std::string key;
+      bool upgrade = false;
+      size_t line_start = head.find("\r\n");
+      while (line_start != std::string::npos && line_start < head.size()) {
+        line_start += 2;
+        size_t line_end = head.find("\r\n", line_start);
+        std::string line = head.substr(line_start, line_end == std::string::npos ? std::string::npos : line_end - line_start);
+        size_t colon = line.find(':');
+        for (size_t i = 0; i < line.size() && i < colon; ++i) {
+          line[i] = std::tolower(line[i]);
+        }
+        std::string value = colon == std::string::npos ? "" : line.substr(line.find_first_not_of(' ', colon + 1));
+        if (line.compare(0, 18, "sec-websocket-key:") == 0) {
+          key = value;
+        } else if (line.compare(0, 8, "upgrade:") == 0) {
+          for (char& ch : value) {
+            ch = std::tolower(ch);
+          }
+          upgrade = value == "websocket";
+        }
+        line_start = line_end;
+      }
+
+      size_t method_end = head.find(' ');
+      size_t path_end = head.find(' ', method_end + 1);
+      std::string path = method_end == std::string::npos ? "" : head.substr(method_end + 1, path_end - method_end - 1);
+      if (head.compare(0, 4, "GET ") != 0 || !upgrade || key.empty()) {
+        c.out.push_back(std::make_shared<const std::string>(
+          "HTTP/1.1 400 Bad Request\r\nContent-Length: 0\r\nConnection: close\r\n\r\n"));
+        c.closing = true;
+        return;
+      }
+
+      std::string response = "HTTP/1.1 101 Switching Protocols\r\n"
+        "Upgrade: websocket\r\n"
+        "Connection: Upgrade\r\n"
+        "Sec-WebSocket-Accept: " + accept_key(key) + "\r\n\r\n";
+      c.out.push_back(std::make_shared<const std::string>(response));
+      c.queued += response.size();
+      c.open = true;
+      if (on_open) {
+        on_open(client, path);
+      }
+    }
+
+    //handles one complete client frame from c.in; false if there isn't one yet
+    bool read_frame (
+      int client,
+      connection& c
+    ) {
+      if (c.in.size() < 2) {
+        return false;
+      }
+      const uint8_t* p = (const uint8_t*)c.in.data();
+      bool fin = p[0] & 0x80;
+      uint8_t opcode = p[0] & 0x0F;
+      bool masked = p[1] & 0x80;
+      uint64_t length = p[1] & 0x7F;
+      size_t header = 2;
+      if (length == 126) {
+        if (c.in.size() < 4) { return false; }
+        length = (uint64_t)p[2] << 8 | p[3];
+        header = 4;
+      } else if (length == 127) {
+        if (c.in.size() < 10) { return false; }
+        length = 0;
+        for (int i = 0; i < 8; ++i) {
+          length = length << 8 | p[2 + i];
+        }
+        header = 10;
+      }
+      //clients must mask their frames
+      if (!fin || !masked || length > WS_MAX_FRAME) {
+        c.dead = true;
+        return false;
+      }
+      if (c.in.size() < header + 4 + length) {
+        return false;
+      }
+      const uint8_t* mask = p + header;
+      std::string payload = c.in.substr(header + 4, length);
+      for (size_t i = 0; i < payload.size(); ++i) {
+        payload[i] ^= mask[i % 4];
+      }
+      c.in.erase(0, header + 4 + length);
+
+      if (opcode == WS_TEXT) {
+        if (on_text && !c.closing) {
+          on_text(client, payload);
+        }
+      } else if (opcode == WS_PING) {
+        //control frames skip the lag limit; they are tiny and a client that pings is reading
+        std::string pong = frame(WS_PONG, payload);
+        c.out.push_back(std::make_shared<const std::string>(pong));
+        c.queued += pong.size();
+      } else if (opcode == WS_CLOSE) {
+        close(client);
+      } else if (opcode != WS_PONG) {
+        c.dead = true;
+        return false;
+      }
+      return true;
+    }
+
+    void write_to (
+      int client,
+      connection& c
+    ) {
+      while (!c.out.empty()) {
+        iovec parts[64];
+        int count = 0;
+        for (auto it = c.out.begin(); it != c.out.end() && count < 64; ++it, ++count) {
+          size_t skip = count == 0 ? c.offset : 0;
+          parts[count].iov_base = (void*)((*it)->data() + skip);
+          parts[count].iov_len = (*it)->size() - skip;
+        }
+        ssize_t n = writev(c.fd, parts, count);
+        if (n < 0) {
+          if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+            c.dead = true;
+          }
+          return;
+        }
+        counters.bytes += n;
+        size_t written = n;
+        while (written > 0) {
+          size_t left = c.out.front()->size() - c.offset;
+          if (written < left) {
+            c.offset += written;
+            c.queued -= written;
+            break;
+          }
+          written -= left;
+          c.queued -= left;
+          c.offset = 0;
+          c.out.pop_front();
+        }
+      }
+      if (c.lagging && c.out.empty()) {
+        c.lagging = false;
+        if (on_drain && !c.closing) {
+          on_drain(client);
+        }
+      }
+    }
+};
+
+} // namespace websocket